@@ -0,0 +1,98 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*
+ * All returned memory is aligned to this value (enough for any type used by decoders)
+ */
+#define ARENA_ALIGNMENT		16
+
+#define ARENA_ALIGN(size)	(((size) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+void
+arena_init(struct arena *arena, size_t block_size)
+{
+
+	memset(arena, 0, sizeof(*arena));
+	arena->block_size = block_size;
+}
+
+void
+arena_destroy(struct arena *arena)
+{
+	struct arena_block *block;
+	struct arena_block *block_next;
+
+	block = arena->first;
+	while (block != NULL) {
+		block_next = block->next;
+		free(block);
+		block = block_next;
+	}
+
+	arena_init(arena, arena->block_size);
+}
+
+/*
+ * Return memory for size bytes or NULL on alloc failure
+ */
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block;
+	size_t block_size;
+	void *res;
+
+	size = ARENA_ALIGN(size);
+
+	while (arena->current != NULL) {
+		if (arena->current_pos + size <= arena->current->size) {
+			res = arena->current->data + arena->current_pos;
+			arena->current_pos += size;
+
+			return (res);
+		}
+
+		if (arena->current->next == NULL) {
+			break;
+		}
+
+		arena->current = arena->current->next;
+		arena->current_pos = 0;
+	}
+
+	block_size = (size > arena->block_size ? size : arena->block_size);
+
+	block = malloc(sizeof(*block) + block_size);
+	if (block == NULL) {
+		return (NULL);
+	}
+
+	block->next = NULL;
+	block->size = block_size;
+
+	if (arena->current == NULL) {
+		arena->first = block;
+	} else {
+		arena->current->next = block;
+	}
+
+	arena->current = block;
+	arena->current_pos = size;
+
+	return (block->data);
+}
+
+/*
+ * Release all allocated memory in O(1). Blocks are reused by following allocations.
+ */
+void
+arena_reset(struct arena *arena)
+{
+
+	arena->current = arena->first;
+	arena->current_pos = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bump allocator for short living data. Memory is never freed one by one, whole arena is
+ * released at once by arena_reset. Blocks are kept for reuse until arena_destroy.
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	char data[];
+};
+
+struct arena {
+	struct arena_block *first;
+	struct arena_block *current;
+	size_t current_pos;	// Used bytes of current block
+	size_t block_size;	// Minimal size of newly allocated block
+};
+
+extern void	 arena_init(struct arena *arena, size_t block_size);
+
+extern void	 arena_destroy(struct arena *arena);
+
+extern void	*arena_alloc(struct arena *arena, size_t size);
+
+extern void	 arena_reset(struct arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARENA_H_ */
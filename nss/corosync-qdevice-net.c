@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <nss.h>
 #include <secerr.h>
 #include <sslerr.h>
@@ -12,6 +16,7 @@
 #include <getopt.h>
 #include <err.h>
 #include <keyhi.h>
+#include <signal.h>
 
 #include "dynar.h"
 #include "nss-sock.h"
@@ -19,12 +24,38 @@
 #include "msg.h"
 #include "msgio.h"
 #include "qnetd-log.h"
+#include "resolver-cache.h"
 #include "timer-list.h"
+#include "node-list.h"
+#include "send-queue.h"
 
 #define NSS_DB_DIR	"node/nssdb"
 
 #define QNETD_HOST	"localhost"
 #define QNETD_PORT	4433
+#define QNETD_TLS_PORT	4434
+
+/*
+ * Maximum number of qnetd servers (active + standby) qdevice-net is connected to
+ */
+#define QDEVICE_NET_MAX_SERVERS		2
+
+/*
+ * Timeout (in ms) of connection attempt to one address of qnetd server
+ */
+#define QDEVICE_NET_CONNECT_TIMEOUT	2000
+
+/*
+ * Time (in ms) after which resolved qnetd addresses are refreshed
+ */
+#define QDEVICE_NET_RESOLVER_CACHE_TTL	60000
+
+/*
+ * Reconnect backoff (in ms). Pause is doubled after every failed attempt up to maximum and
+ * randomized (equal jitter) so nodes don't reconnect to qnetd in lockstep.
+ */
+#define QDEVICE_NET_PAUSE_BEFORE_RECONNECT	250
+#define QDEVICE_NET_MAX_PAUSE_BEFORE_RECONNECT	30000
 
 #define QNETD_NSS_SERVER_CN		"Qnetd Server"
 #define QDEVICE_NET_NSS_CLIENT_CERT_NICKNAME	"Cluster Cert"
@@ -46,6 +77,25 @@
 
 #define QDEVICE_NET_HEARTBEAT_INTERVAL		10000
 
+#define QDEVICE_NET_MAX_NODE_LIST		256
+
+/*
+ * Number of vote info messages server may send before waiting for credit. Credit is given
+ * back when half of the window is consumed.
+ */
+#define QDEVICE_NET_CREDIT_WINDOW		8
+
+/*
+ * Maximum number of requests waiting for send
+ */
+#define QDEVICE_NET_MAX_SEND_QUEUE_SIZE		32
+
+/*
+ * TLV encoding offered to server in init. Standard encoding is used if server doesn't
+ * accept it.
+ */
+#define QDEVICE_NET_TLV_ENCODING		TLV_ENCODING_COMPACT
+
 #define qdevice_net_log			qnetd_log
 #define qdevice_net_log_nss		qnetd_log_nss
 #define qdevice_net_log_init		qnetd_log_init
@@ -60,37 +110,85 @@ enum qdevice_net_state {
 	QDEVICE_NET_STATE_WAITING_STARTTLS_BEING_SENT,
 	QDEVICE_NET_STATE_WAITING_INIT_REPLY,
 	QDEVICE_NET_STATE_WAITING_SET_OPTION_REPLY,
+	QDEVICE_NET_STATE_CONNECTED,
+};
+
+struct qdevice_net_reconnect_stats {
+	uint32_t no_reconnects;
+	uint32_t no_failed_attempts;
+	uint32_t last_latency;		// All latencies are in ms
+	uint32_t min_latency;
+	uint32_t max_latency;
+	uint64_t total_latency;
 };
 
 struct qdevice_net_instance {
+	const char *host_addr;
+	uint16_t host_port;
+	struct resolver_cache *resolver_cache;
 	PRFileDesc *socket;
+	struct nss_sock_connector connector;	// Valid only if connecting
+	int connecting;				// Connect is in progress, socket is NULL
 	size_t initial_send_size;
 	size_t initial_receive_size;
 	size_t max_receive_size;
 	size_t min_send_size;
-	struct dynar receive_buffer;
-	struct dynar send_buffer;
+	struct msg_decoder msg_decoder;		// Received message is decoded option by option
+	struct msg_decoded received_msg;	// Filled by msg_decoder as options arrive
+	struct dynar send_buffer;		// Requests are built there and then copied to send_queue
+	struct send_queue send_queue;
 	struct dynar echo_request_send_buffer;
-	int sending_msg;
-	int skipping_msg;
+	struct dynar credit_send_buffer;
 	int sending_echo_request_msg;
-	size_t msg_already_received_bytes;
-	size_t msg_already_sent_bytes;
+	int sending_credit_msg;
 	size_t echo_request_msg_already_sent_bytes;
+	size_t credit_msg_already_sent_bytes;
+	int server_supports_credit;
+	int server_supports_heartbeat;		// Compact heartbeat is used instead of echo request
+	uint32_t heartbeat_rtt;			// Round trip time (ms) of last compact heartbeat
+	PRIntervalTime heartbeat_epoch;		// Heartbeat timestamps are relative to it
+	uint32_t server_request_window;		// Requests which can be sent without waiting for reply
+	uint32_t consumed_credit;		// Vote infos received since last credit was sent
+	enum tlv_encoding tlv_encoding;		// Encoding of messages sent after init reply
 	enum qdevice_net_state state;
-	uint32_t expected_msg_seq_num;
+	uint32_t msg_seq_num;			// Seq number of last queued request
+	uint32_t expected_msg_seq_num;		// Seq number of oldest request waiting for reply
+	uint32_t requests_in_flight;		// Sent requests waiting for reply
 	uint32_t echo_request_expected_msg_seq_num;
 	uint32_t echo_reply_received_msg_seq_num;
 	enum tlv_tls_supported tls_supported;
+	int implicit_tls;			// TLS starts right after connect, preinit is skipped
 	int using_tls;
 	uint32_t node_id;
 	uint32_t heartbeat_interval;
 	enum tlv_decision_algorithm_type decision_algorithm;
+	struct node_list node_list;		// Membership reported to server
+	struct node_list sent_node_list;	// Node list in flight (waiting for reply)
+	struct node_list acked_node_list;	// Node list server has under acked_node_list_epoch
+	struct node_list node_list_added;	// Scratch lists for delta computation
+	struct node_list node_list_removed;
+	uint32_t node_list_epoch;		// Epoch of last sent node list
+	uint32_t acked_node_list_epoch;
+	int acked_node_list_epoch_set;
+	int sending_node_list;			// Node list was sent and reply not yet received
+	int server_supports_node_list;
+	int server_supports_node_list_delta;
+	enum tlv_vote vote;			// Last vote received from server
 	struct timer_list main_timer_list;
 	struct timer_list_entry *echo_request_timer;
+	struct timer_list_entry *reconnect_timer;
 	int schedule_disconnect;
+	unsigned int reconnect_attempt;		// Reconnect attempts since last fully initialized connection
+	int reconnecting;			// Set when instance lost connection and reconnects
+	PRIntervalTime disconnect_time;		// Valid only if reconnecting
+	struct qdevice_net_reconnect_stats reconnect_stats;
 };
 
+/*
+ * Pollable event used for communication between signal handler and main loop
+ */
+PRFileDesc *global_quit_event;
+
 static void
 err_nss(void) {
 	errx(1, "nss error %d: %s", PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
@@ -122,20 +220,57 @@ qdevice_net_nss_get_client_auth_data(void *arg, PRFileDesc *socket, struct CERTD
 	return (NSS_GetClientAuthData(arg, socket, caNames, pRetCert, pRetKey));
 }
 
+/*
+ * Queue request prepared in send_buffer. Request is sent when fewer than
+ * server_request_window requests are waiting for reply.
+ */
 int
 qdevice_net_schedule_send(struct qdevice_net_instance *instance)
 {
-	if (instance->sending_msg) {
-		/*
-		 * Msg is already scheduled for send
-		 */
+	struct send_queue_msg *msg;
+	int res;
+
+	msg = send_queue_msg_create(dynar_max_size(&instance->send_buffer));
+	if (msg == NULL) {
 		return (-1);
 	}
 
-	instance->msg_already_sent_bytes = 0;
-	instance->sending_msg = 1;
+	if (dynar_cat(&msg->buffer, dynar_data(&instance->send_buffer),
+	    dynar_size(&instance->send_buffer)) != 0) {
+		send_queue_msg_unref(msg);
 
-	return (0);
+		return (-1);
+	}
+
+	res = send_queue_add(&instance->send_queue, msg);
+	send_queue_msg_unref(msg);
+
+	return (res == 0 ? 0 : -1);
+}
+
+/*
+ * Returns 1 if next request from send queue can be written to socket
+ */
+static int
+qdevice_net_can_send_msg(const struct qdevice_net_instance *instance)
+{
+
+	if (send_queue_is_empty(&instance->send_queue)) {
+		return (0);
+	}
+
+	return (instance->send_queue.msg_already_sent_bytes > 0 ||
+	    instance->requests_in_flight < instance->server_request_window);
+}
+
+/*
+ * Milliseconds since heartbeat support was negotiated. Small values keep varint short.
+ */
+static uint32_t
+qdevice_net_heartbeat_timestamp(const struct qdevice_net_instance *instance)
+{
+
+	return (PR_IntervalToMilliseconds(PR_IntervalNow() - instance->heartbeat_epoch));
 }
 
 int
@@ -155,7 +290,16 @@ qdevice_net_schedule_echo_request_send(struct qdevice_net_instance *instance)
 
 	instance->echo_request_expected_msg_seq_num++;
 
-	if (msg_create_echo_request(&instance->echo_request_send_buffer, 1, instance->echo_request_expected_msg_seq_num) == -1) {
+	if (instance->server_supports_heartbeat) {
+		if (msg_create_heartbeat(&instance->echo_request_send_buffer,
+		    instance->echo_request_expected_msg_seq_num,
+		    qdevice_net_heartbeat_timestamp(instance)) == 0) {
+			qdevice_net_log(LOG_ERR, "Can't allocate send buffer for heartbeat msg");
+
+			return (-1);
+		}
+	} else if (msg_create_echo_request(&instance->echo_request_send_buffer, instance->tlv_encoding, 1,
+	    instance->echo_request_expected_msg_seq_num) == -1) {
 		qdevice_net_log(LOG_ERR, "Can't allocate send buffer for echo request msg");
 
 		return (-1);
@@ -167,6 +311,32 @@ qdevice_net_schedule_echo_request_send(struct qdevice_net_instance *instance)
 	return (0);
 }
 
+/*
+ * Give credit back to server if enough of window was consumed
+ */
+int
+qdevice_net_send_credit(struct qdevice_net_instance *instance)
+{
+
+	if (!instance->server_supports_credit || instance->sending_credit_msg ||
+	    instance->consumed_credit < (QDEVICE_NET_CREDIT_WINDOW + 1) / 2) {
+		return (0);
+	}
+
+	if (msg_create_credit(&instance->credit_send_buffer, instance->tlv_encoding,
+	    instance->consumed_credit) == 0) {
+		qdevice_net_log(LOG_ERR, "Can't allocate send buffer for credit msg");
+
+		return (-1);
+	}
+
+	instance->consumed_credit = 0;
+	instance->credit_msg_already_sent_bytes = 0;
+	instance->sending_credit_msg = 1;
+
+	return (0);
+}
+
 void
 qdevice_net_log_msg_decode_error(int ret)
 {
@@ -242,12 +412,19 @@ int
 qdevice_net_msg_check_seq_number(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
 {
 
-	if (!msg->seq_number_set || msg->seq_number != instance->expected_msg_seq_num) {
+	/*
+	 * Server processes requests one by one, so replies come in order of requests
+	 */
+	if (instance->requests_in_flight == 0 ||
+	    !msg->seq_number_set || msg->seq_number != instance->expected_msg_seq_num) {
 		qdevice_net_log(LOG_ERR, "Received message doesn't contain seq_number or it's not expected one.");
 
 		return (-1);
 	}
 
+	instance->expected_msg_seq_num++;
+	instance->requests_in_flight--;
+
 	return (0);
 }
 
@@ -270,6 +447,83 @@ qdevice_net_msg_check_echo_reply_seq_number(struct qdevice_net_instance *instanc
 	return (0);
 }
 
+/*
+ * Create delta node list msg if server has acknowledged previous node list and delta is
+ * smaller than full list. Returns 1 if msg was created, 0 if full list should be sent and
+ * -1 on error.
+ */
+static int
+qdevice_net_create_node_list_delta(struct qdevice_net_instance *instance)
+{
+
+	if (!instance->server_supports_node_list_delta || !instance->acked_node_list_epoch_set) {
+		return (0);
+	}
+
+	if (node_list_diff(&instance->acked_node_list, &instance->node_list,
+	    &instance->node_list_added, &instance->node_list_removed) != 0) {
+		return (-1);
+	}
+
+	if (instance->node_list_added.size + instance->node_list_removed.size >=
+	    instance->node_list.size) {
+		return (0);
+	}
+
+	if (msg_create_node_list_delta(&instance->send_buffer, instance->tlv_encoding, 1, instance->msg_seq_num,
+	    instance->node_list_epoch, instance->acked_node_list_epoch,
+	    instance->node_list_added.node_ids, instance->node_list_added.size,
+	    instance->node_list_removed.node_ids, instance->node_list_removed.size) == 0) {
+		return (-1);
+	}
+
+	return (1);
+}
+
+/*
+ * Report membership to server. If server supports it, only changes against node list
+ * acknowledged by server are sent.
+ */
+int
+qdevice_net_send_node_list(struct qdevice_net_instance *instance)
+{
+	int res;
+
+	instance->msg_seq_num++;
+	instance->node_list_epoch++;
+
+	res = qdevice_net_create_node_list_delta(instance);
+	if (res == 0) {
+		if (msg_create_node_list(&instance->send_buffer, instance->tlv_encoding, 1, instance->msg_seq_num,
+		    instance->server_supports_node_list_delta, instance->node_list_epoch,
+		    instance->node_list.node_ids, instance->node_list.size) == 0) {
+			res = -1;
+		}
+	}
+
+	if (res == -1) {
+		qdevice_net_log(LOG_ERR, "Can't allocate send buffer for node list msg");
+
+		return (-1);
+	}
+
+	if (node_list_copy(&instance->sent_node_list, &instance->node_list) != 0) {
+		qdevice_net_log(LOG_ERR, "Can't allocate sent node list");
+
+		return (-1);
+	}
+
+	if (qdevice_net_schedule_send(instance) != 0) {
+		qdevice_net_log(LOG_ERR, "Can't schedule send of node list msg");
+
+		return (-1);
+	}
+
+	instance->sending_node_list = 1;
+
+	return (0);
+}
+
 int
 qdevice_net_send_init(struct qdevice_net_instance *instance)
 {
@@ -280,11 +534,13 @@ qdevice_net_send_init(struct qdevice_net_instance *instance)
 
 	tlv_get_supported_options(&supported_opts, &no_supported_opts);
 	msg_get_supported_messages(&supported_msgs, &no_supported_msgs);
-	instance->expected_msg_seq_num++;
+	instance->msg_seq_num++;
 
-	if (msg_create_init(&instance->send_buffer, 1, instance->expected_msg_seq_num,
+	if (msg_create_init(&instance->send_buffer, 1, instance->msg_seq_num,
 	    supported_msgs, no_supported_msgs, supported_opts, no_supported_opts,
-	    instance->node_id) == 0) {
+	    instance->node_id, QDEVICE_NET_CREDIT_WINDOW,
+	    1, instance->decision_algorithm, 1, instance->heartbeat_interval,
+	    (instance->implicit_tls ? QDEVICE_NET_CLUSTER_NAME : NULL), QDEVICE_NET_TLV_ENCODING) == 0) {
 		qdevice_net_log(LOG_ERR, "Can't allocate send buffer for init msg");
 
 		return (-1);
@@ -336,8 +592,8 @@ qdevice_net_msg_received_preinit_reply(struct qdevice_net_instance *instance, co
 		/*
 		 * Start TLS
 		 */
-		instance->expected_msg_seq_num++;
-		if (msg_create_starttls(&instance->send_buffer, 1, instance->expected_msg_seq_num) == 0) {
+		instance->msg_seq_num++;
+		if (msg_create_starttls(&instance->send_buffer, 1, instance->msg_seq_num) == 0) {
 			qdevice_net_log(LOG_ERR, "Can't allocate send buffer for starttls msg");
 
 			return (-1);
@@ -359,6 +615,100 @@ qdevice_net_msg_received_preinit_reply(struct qdevice_net_instance *instance, co
 	return (0);
 }
 
+int qdevice_net_timer_send_heartbeat(void *data1, void *data2)
+{
+	struct qdevice_net_instance *instance;
+
+	instance = (struct qdevice_net_instance *)data1;
+
+	if (qdevice_net_schedule_echo_request_send(instance) == -1) {
+		instance->schedule_disconnect = 1;
+		return (0);
+	}
+
+	/*
+	 * Schedule this function callback again
+	 */
+	return (-1);
+}
+
+void
+qdevice_net_reconnect_stats_update(struct qdevice_net_instance *instance)
+{
+	struct qdevice_net_reconnect_stats *stats;
+	uint32_t latency;
+
+	stats = &instance->reconnect_stats;
+	latency = PR_IntervalToMilliseconds(PR_IntervalNow() - instance->disconnect_time);
+
+	if (stats->no_reconnects == 0 || latency < stats->min_latency) {
+		stats->min_latency = latency;
+	}
+
+	if (latency > stats->max_latency) {
+		stats->max_latency = latency;
+	}
+
+	stats->no_reconnects++;
+	stats->last_latency = latency;
+	stats->total_latency += latency;
+
+	instance->reconnecting = 0;
+	instance->reconnect_attempt = 0;
+
+	qdevice_net_log(LOG_INFO, "Reconnected to qnetd server %s:%u in %"PRIu32" ms "
+	    "(reconnects %"PRIu32", failed attempts %"PRIu32", latency min/avg/max "
+	    "%"PRIu32"/%"PRIu64"/%"PRIu32" ms)",
+	    instance->host_addr, instance->host_port, latency,
+	    stats->no_reconnects, stats->no_failed_attempts,
+	    stats->min_latency, stats->total_latency / stats->no_reconnects, stats->max_latency);
+}
+
+/*
+ * Server accepted decision algorithm and heartbeat interval (in set option reply or init
+ * reply) so connection is fully initialized
+ */
+static int
+qdevice_net_options_accepted(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	if (msg->decision_algorithm != instance->decision_algorithm ||
+	    msg->heartbeat_interval != instance->heartbeat_interval) {
+		qdevice_net_log(LOG_ERR, "Server doesn't accept sent decision algorithm or heartbeat interval.");
+
+		return (-1);
+	}
+
+	/*
+	 * Server accepted heartbeat interval -> schedule regular sending of echo request
+	 */
+	if (instance->heartbeat_interval > 0) {
+		instance->echo_request_timer = timer_list_add(&instance->main_timer_list, instance->heartbeat_interval,
+		    qdevice_net_timer_send_heartbeat, (void *)instance, NULL);
+
+		if (instance->echo_request_timer == NULL) {
+			qdevice_net_log(LOG_ERR, "Can't schedule regular sending of heartbeat.");
+
+			return (-1);
+		}
+	}
+
+	instance->state = QDEVICE_NET_STATE_CONNECTED;
+	qdevice_net_log(LOG_INFO, "Connection to qnetd server %s:%u fully initialized",
+	    instance->host_addr, instance->host_port);
+
+	if (instance->reconnecting) {
+		qdevice_net_reconnect_stats_update(instance);
+	}
+
+	if (!instance->server_supports_node_list) {
+		qdevice_net_log(LOG_WARNING, "Server doesn't support node list message. "
+		    "Membership is not reported.");
+	}
+
+	return (0);
+}
+
 int
 qdevice_net_msg_received_init_reply(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
 {
@@ -412,7 +762,7 @@ qdevice_net_msg_received_init_reply(struct qdevice_net_instance *instance, const
 	/*
 	 * Change buffer sizes
 	 */
-	dynar_set_max_size(&instance->receive_buffer, msg->server_maximum_reply_size);
+	msg_decoder_set_max_msg_size(&instance->msg_decoder, msg->server_maximum_reply_size);
 	dynar_set_max_size(&instance->send_buffer, msg->server_maximum_request_size);
 	dynar_set_max_size(&instance->echo_request_send_buffer, msg->server_maximum_request_size);
 
@@ -434,25 +784,87 @@ qdevice_net_msg_received_init_reply(struct qdevice_net_instance *instance, const
 		return (-1);
 	}
 
+	instance->server_supports_node_list = 0;
+
+	for (zi = 0; zi < msg->no_supported_messages; zi++) {
+		if (msg->supported_messages[zi] == MSG_TYPE_NODE_LIST) {
+			instance->server_supports_node_list = 1;
+		}
+	}
+
+	instance->server_supports_credit = 0;
+	instance->server_supports_heartbeat = 0;
+
+	for (zi = 0; zi < msg->no_supported_messages; zi++) {
+		if (msg->supported_messages[zi] == MSG_TYPE_CREDIT) {
+			instance->server_supports_credit = 1;
+		}
+
+		if (msg->supported_messages[zi] == MSG_TYPE_HEARTBEAT) {
+			instance->server_supports_heartbeat = 1;
+			instance->heartbeat_epoch = PR_IntervalNow();
+		}
+	}
+
 	/*
-	 * Send set options message
+	 * Old server doesn't send window. Wait for reply of every request.
 	 */
-	instance->expected_msg_seq_num++;
+	instance->server_request_window = (msg->request_window_set && msg->request_window > 0 ?
+	    msg->request_window : 1);
+
+	/*
+	 * Old server doesn't know encoding option and ignores it
+	 */
+	if (msg->tlv_encoding_set && msg->tlv_encoding == QDEVICE_NET_TLV_ENCODING) {
+		instance->tlv_encoding = QDEVICE_NET_TLV_ENCODING;
+	} else {
+		instance->tlv_encoding = TLV_ENCODING_STANDARD;
+	}
 
-	if (msg_create_set_option(&instance->send_buffer, 1, instance->expected_msg_seq_num,
-	    1, instance->decision_algorithm, 1, instance->heartbeat_interval) == 0) {
-		qdevice_net_log(LOG_ERR, "Can't allocate send buffer for set option msg");
+	instance->server_supports_node_list_delta = 0;
 
-		return (-1);
+	for (zi = 0; zi < msg->no_supported_options; zi++) {
+		if (msg->supported_options[zi] == TLV_OPT_NODE_LIST_BASE_EPOCH) {
+			instance->server_supports_node_list_delta = 1;
+		}
 	}
 
-	if (qdevice_net_schedule_send(instance) != 0) {
-		qdevice_net_log(LOG_ERR, "Can't schedule send of set option msg");
+	if (msg->decision_algorithm_set && msg->heartbeat_interval_set) {
+		/*
+		 * Server accepted options sent in init message
+		 */
+		if (qdevice_net_options_accepted(instance, msg) != 0) {
+			return (-1);
+		}
+	} else {
+		/*
+		 * Old server ignores options in init message. Send set options message.
+		 */
+		instance->msg_seq_num++;
 
-		return (-1);
+		if (msg_create_set_option(&instance->send_buffer, instance->tlv_encoding, 1,
+		    instance->msg_seq_num, 1, instance->decision_algorithm, 1, instance->heartbeat_interval) == 0) {
+			qdevice_net_log(LOG_ERR, "Can't allocate send buffer for set option msg");
+
+			return (-1);
+		}
+
+		if (qdevice_net_schedule_send(instance) != 0) {
+			qdevice_net_log(LOG_ERR, "Can't schedule send of set option msg");
+
+			return (-1);
+		}
+
+		instance->state = QDEVICE_NET_STATE_WAITING_SET_OPTION_REPLY;
 	}
 
-	instance->state = QDEVICE_NET_STATE_WAITING_SET_OPTION_REPLY;
+	/*
+	 * Membership doesn't depend on set option reply. Server processes requests in order, so
+	 * node list can share round trip with set option (if window allows it).
+	 */
+	if (instance->server_supports_node_list) {
+		return (qdevice_net_send_node_list(instance));
+	}
 
 	return (0);
 }
@@ -489,58 +901,80 @@ qdevice_net_msg_received_set_option(struct qdevice_net_instance *instance, const
 	return (-1);
 }
 
-int qdevice_net_timer_send_heartbeat(void *data1, void *data2)
+/*
+ * Change membership. New membership is reported to server as soon as init reply is received
+ * and previous node list is acknowledged.
+ */
+int
+qdevice_net_set_node_list(struct qdevice_net_instance *instance, const uint32_t *node_list,
+    size_t no_node_list)
 {
-	struct qdevice_net_instance *instance;
 
-	instance = (struct qdevice_net_instance *)data1;
+	if (node_list_set(&instance->node_list, node_list, no_node_list) != 0) {
+		qdevice_net_log(LOG_ERR, "Can't store node list");
 
-	if (qdevice_net_schedule_echo_request_send(instance) == -1) {
-		instance->schedule_disconnect = 1;
+		return (-1);
+	}
+
+	if ((instance->state != QDEVICE_NET_STATE_WAITING_SET_OPTION_REPLY &&
+	    instance->state != QDEVICE_NET_STATE_CONNECTED) || !instance->server_supports_node_list ||
+	    instance->sending_node_list) {
 		return (0);
 	}
 
-	/*
-	 * Schedule this function callback again
-	 */
-	return (-1);
+	return (qdevice_net_send_node_list(instance));
 }
 
-int
-qdevice_net_msg_received_set_option_reply(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+/*
+ * Return vote of active instance (server quorum decision is taken from). Vote is undefined
+ * until active instance is fully initialized.
+ */
+static enum tlv_vote
+qdevice_net_get_active_vote(const struct qdevice_net_instance *instances, size_t active_instance)
 {
 
-	if (qdevice_net_msg_check_seq_number(instance, msg) != 0) {
-		return (-1);
+	if (instances[active_instance].state != QDEVICE_NET_STATE_CONNECTED) {
+		return (TLV_VOTE_UNDEFINED);
 	}
 
-	if (!msg->decision_algorithm_set || !msg->heartbeat_interval_set) {
-		qdevice_net_log(LOG_ERR, "Received set option reply message without required options. "
-		    "Disconnecting from server");
-	}
+	return (instances[active_instance].vote);
+}
 
-	if (msg->decision_algorithm != instance->decision_algorithm ||
-	    msg->heartbeat_interval != instance->heartbeat_interval) {
-		qdevice_net_log(LOG_ERR, "Server doesn't accept sent decision algorithm or heartbeat interval.");
+static void
+qdevice_net_set_vote(struct qdevice_net_instance *instance, enum tlv_vote vote)
+{
+
+	if (instance->vote != vote) {
+		qdevice_net_log(LOG_INFO, "Vote of qnetd server %s:%u changed from %u to %u",
+		    instance->host_addr, instance->host_port, instance->vote, vote);
+	}
+
+	instance->vote = vote;
+}
+
+int
+qdevice_net_msg_received_set_option_reply(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	if (instance->state != QDEVICE_NET_STATE_WAITING_SET_OPTION_REPLY) {
+		qdevice_net_log(LOG_ERR, "Received unexpected set option reply message. "
+		    "Disconnecting from server");
 
 		return (-1);
 	}
 
-	/*
-	 * Server accepted heartbeat interval -> schedule regular sending of echo request
-	 */
-	if (instance->heartbeat_interval > 0) {
-		instance->echo_request_timer = timer_list_add(&instance->main_timer_list, instance->heartbeat_interval,
-		    qdevice_net_timer_send_heartbeat, (void *)instance, NULL);
+	if (qdevice_net_msg_check_seq_number(instance, msg) != 0) {
+		return (-1);
+	}
 
-		if (instance->echo_request_timer == NULL) {
-			qdevice_net_log(LOG_ERR, "Can't schedule regular sending of heartbeat.");
+	if (!msg->decision_algorithm_set || !msg->heartbeat_interval_set) {
+		qdevice_net_log(LOG_ERR, "Received set option reply message without required options. "
+		    "Disconnecting from server");
 
-			return (-1);
-		}
+		return (-1);
 	}
 
-	return (0);
+	return (qdevice_net_options_accepted(instance, msg));
 }
 
 int
@@ -565,17 +999,150 @@ qdevice_net_msg_received_echo_reply(struct qdevice_net_instance *instance, const
 	return (0);
 }
 
+int
+qdevice_net_msg_received_heartbeat_reply(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	if (qdevice_net_msg_check_echo_reply_seq_number(instance, msg) != 0) {
+		return (-1);
+	}
+
+	instance->echo_reply_received_msg_seq_num = msg->seq_number;
+
+	/*
+	 * Timestamp is returned unchanged, so round trip time is known without extra state
+	 */
+	instance->heartbeat_rtt = qdevice_net_heartbeat_timestamp(instance) - msg->heartbeat_timestamp;
+
+	qdevice_net_log(LOG_DEBUG, "Heartbeat round trip time to qnetd server %s:%u is %"PRIu32" ms",
+	    instance->host_addr, instance->host_port, instance->heartbeat_rtt);
+
+	return (0);
+}
+
+
+int
+qdevice_net_msg_received_node_list(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	qdevice_net_log(LOG_ERR, "Received unexpected node list message. Disconnecting from server");
+
+	return (-1);
+}
+
+int
+qdevice_net_msg_received_credit(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	qdevice_net_log(LOG_ERR, "Received unexpected credit message. Disconnecting from server");
+
+	return (-1);
+}
+
+int
+qdevice_net_msg_received_node_list_reply(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	if (qdevice_net_msg_check_seq_number(instance, msg) != 0) {
+		return (-1);
+	}
+
+	if (!msg->vote_set) {
+		qdevice_net_log(LOG_ERR, "Received node list reply message without vote. Disconnecting from server");
+
+		return (-1);
+	}
+
+	qdevice_net_set_vote(instance, msg->vote);
+
+	instance->sending_node_list = 0;
+
+	if (instance->server_supports_node_list_delta) {
+		if (msg->node_list_epoch_set && msg->node_list_epoch == instance->node_list_epoch) {
+			if (node_list_copy(&instance->acked_node_list, &instance->sent_node_list) != 0) {
+				qdevice_net_log(LOG_ERR, "Can't allocate acked node list");
+
+				return (-1);
+			}
+
+			instance->acked_node_list_epoch = instance->node_list_epoch;
+			instance->acked_node_list_epoch_set = 1;
+		} else {
+			/*
+			 * Server doesn't know base of delta. Send full node list.
+			 */
+			qdevice_net_log(LOG_DEBUG, "Server didn't accept node list delta. Sending full node list");
+
+			instance->acked_node_list_epoch_set = 0;
+
+			return (qdevice_net_send_node_list(instance));
+		}
+	}
+
+	if (instance->node_list.size != instance->sent_node_list.size ||
+	    memcmp(instance->node_list.node_ids, instance->sent_node_list.node_ids,
+	    sizeof(uint32_t) * instance->node_list.size) != 0) {
+		/*
+		 * Membership changed while waiting for reply
+		 */
+		return (qdevice_net_send_node_list(instance));
+	}
+
+	return (0);
+}
+
+int
+qdevice_net_msg_received_vote_info(struct qdevice_net_instance *instance, const struct msg_decoded *msg)
+{
+
+	if (instance->state != QDEVICE_NET_STATE_CONNECTED) {
+		qdevice_net_log(LOG_ERR, "Received unexpected vote info message. Disconnecting from server");
+
+		return (-1);
+	}
+
+	if (!msg->vote_set) {
+		qdevice_net_log(LOG_ERR, "Received vote info message without vote. Disconnecting from server");
+
+		return (-1);
+	}
+
+	qdevice_net_set_vote(instance, msg->vote);
+
+	/*
+	 * Vote info is sent by server without request so it consumes credit
+	 */
+	instance->consumed_credit++;
+
+	return (qdevice_net_send_credit(instance));
+}
+
+/*
+ * Options are decoded as they arrive, so whole message is never stored
+ */
+static int
+qdevice_net_msg_option_received(struct tlv_iterator *tlv_iter, void *user_data)
+{
+	struct qdevice_net_instance *instance;
+
+	instance = (struct qdevice_net_instance *)user_data;
+
+	return (msg_decode_option(tlv_iter, &instance->received_msg));
+}
 
 int
 qdevice_net_msg_received(struct qdevice_net_instance *instance)
 {
-	struct msg_decoded msg;
+	struct msg_decoded *msg;
 	int res;
 	int ret_val;
 
-	msg_decoded_init(&msg);
+	msg = &instance->received_msg;
 
-	res = msg_decode(&instance->receive_buffer, &msg);
+	/*
+	 * Options were already decoded by qdevice_net_msg_option_received
+	 */
+	res = msg_decoder_finish(&instance->msg_decoder, msg);
 	if (res != 0) {
 		/*
 		 * Error occurred. Disconnect.
@@ -588,41 +1155,57 @@ qdevice_net_msg_received(struct qdevice_net_instance *instance)
 
 	ret_val = 0;
 
-	switch (msg.type) {
+	switch (msg->type) {
 	case MSG_TYPE_PREINIT:
-		ret_val = qdevice_net_msg_received_preinit(instance, &msg);
+		ret_val = qdevice_net_msg_received_preinit(instance, msg);
 		break;
 	case MSG_TYPE_PREINIT_REPLY:
-		ret_val = qdevice_net_msg_received_preinit_reply(instance, &msg);
+		ret_val = qdevice_net_msg_received_preinit_reply(instance, msg);
 		break;
 	case MSG_TYPE_STARTTLS:
-		ret_val = qdevice_net_msg_received_stattls(instance, &msg);
+		ret_val = qdevice_net_msg_received_stattls(instance, msg);
 		break;
 	case MSG_TYPE_SERVER_ERROR:
-		ret_val = qdevice_net_msg_received_server_error(instance, &msg);
+		ret_val = qdevice_net_msg_received_server_error(instance, msg);
 		break;
 	case MSG_TYPE_INIT_REPLY:
-		ret_val = qdevice_net_msg_received_init_reply(instance, &msg);
+		ret_val = qdevice_net_msg_received_init_reply(instance, msg);
 		break;
 	case MSG_TYPE_SET_OPTION:
-		ret_val = qdevice_net_msg_received_set_option(instance, &msg);
+		ret_val = qdevice_net_msg_received_set_option(instance, msg);
 		break;
 	case MSG_TYPE_SET_OPTION_REPLY:
-		ret_val = qdevice_net_msg_received_set_option_reply(instance, &msg);
+		ret_val = qdevice_net_msg_received_set_option_reply(instance, msg);
 		break;
 	case MSG_TYPE_ECHO_REQUEST:
-		ret_val = qdevice_net_msg_received_echo_request(instance, &msg);
+	case MSG_TYPE_HEARTBEAT:
+		ret_val = qdevice_net_msg_received_echo_request(instance, msg);
 		break;
 	case MSG_TYPE_ECHO_REPLY:
-		ret_val = qdevice_net_msg_received_echo_reply(instance, &msg);
+		ret_val = qdevice_net_msg_received_echo_reply(instance, msg);
+		break;
+	case MSG_TYPE_HEARTBEAT_REPLY:
+		ret_val = qdevice_net_msg_received_heartbeat_reply(instance, msg);
+		break;
+	case MSG_TYPE_NODE_LIST:
+		ret_val = qdevice_net_msg_received_node_list(instance, msg);
+		break;
+	case MSG_TYPE_NODE_LIST_REPLY:
+		ret_val = qdevice_net_msg_received_node_list_reply(instance, msg);
+		break;
+	case MSG_TYPE_VOTE_INFO:
+		ret_val = qdevice_net_msg_received_vote_info(instance, msg);
+		break;
+	case MSG_TYPE_CREDIT:
+		ret_val = qdevice_net_msg_received_credit(instance, msg);
 		break;
 	default:
-		qdevice_net_log(LOG_ERR, "Received unsupported message %u. Disconnecting from server", msg.type);
+		qdevice_net_log(LOG_ERR, "Received unsupported message %u. Disconnecting from server", msg->type);
 		ret_val = -1;
 		break;
 	}
 
-	msg_decoded_destroy(&msg);
+	msg_decoded_destroy(msg);
 
 	return (ret_val);
 }
@@ -635,16 +1218,10 @@ qdevice_net_socket_read(struct qdevice_net_instance *instance)
 {
 	int res;
 	int ret_val;
-	int orig_skipping_msg;
+	int decode_res;
 
-	orig_skipping_msg = instance->skipping_msg;
-
-	res = msgio_read(instance->socket, &instance->receive_buffer, &instance->msg_already_received_bytes,
-	    &instance->skipping_msg);
-
-	if (!orig_skipping_msg && instance->skipping_msg) {
-		qdevice_net_log(LOG_DEBUG, "msgio_read set skipping_msg");
-	}
+	res = msgio_read_decoder(instance->socket, &instance->msg_decoder, qdevice_net_msg_option_received,
+	    instance, &decode_res);
 
 	ret_val = 0;
 
@@ -663,39 +1240,28 @@ qdevice_net_socket_read(struct qdevice_net_instance *instance)
 		ret_val = -1;
 		break;
 	case -3:
-		qdevice_net_log(LOG_ERR, "Can't store message header from server. Disconnecting from server");
-		ret_val = -1;
-		break;
-	case -4:
-		qdevice_net_log(LOG_ERR, "Can't store message from server. Disconnecting from server");
-		ret_val = -1;
-		break;
-	case -5:
-		qdevice_net_log(LOG_WARNING, "Server sent unsupported msg type %u. Disconnecting from server",
-			    msg_get_type(&instance->receive_buffer));
-		ret_val = -1;
-		break;
-	case -6:
-		qdevice_net_log(LOG_WARNING,
-		    "Server wants to send too long message %u bytes. Disconnecting from server",
-		    msg_get_len(&instance->receive_buffer));
+		if (decode_res == -5) {
+			qdevice_net_log(LOG_WARNING, "Server sent unsupported msg type %u. Disconnecting from server",
+			    msg_get_type(&instance->msg_decoder.msg));
+		} else if (decode_res == -6) {
+			qdevice_net_log(LOG_WARNING,
+			    "Server wants to send too long message %u bytes. Disconnecting from server",
+			    msg_get_len(&instance->msg_decoder.msg));
+		} else {
+			qdevice_net_log_msg_decode_error(decode_res);
+			qdevice_net_log(LOG_ERR, "Disconnecting from server");
+		}
 		ret_val = -1;
 		break;
 	case 1:
 		/*
-		 * Full message received / skipped
+		 * Full message received
 		 */
-		if (!instance->skipping_msg) {
-			if (qdevice_net_msg_received(instance) == -1) {
-				ret_val = -1;
-			}
-		} else {
-			errx(1, "net_socket_read in skipping msg state");
+		if (qdevice_net_msg_received(instance) == -1) {
+			ret_val = -1;
 		}
 
-		instance->skipping_msg = 0;
-		instance->msg_already_received_bytes = 0;
-		dynar_clean(&instance->receive_buffer);
+		msg_decoder_reset(&instance->msg_decoder);
 		break;
 	default:
 		errx(1, "qdevice_net_socket_read unhandled error %d", res);
@@ -712,8 +1278,10 @@ qdevice_net_socket_write_finished(struct qdevice_net_instance *instance)
 
 	if (instance->state == QDEVICE_NET_STATE_WAITING_STARTTLS_BEING_SENT) {
 		/*
-		 * StartTLS sent to server. Begin with TLS handshake
+		 * StartTLS sent to server. Server doesn't reply to it. Begin with TLS handshake
 		 */
+		instance->expected_msg_seq_num++;
+
 		if ((new_pr_fd = nss_sock_start_ssl_as_client(instance->socket, QNETD_NSS_SERVER_CN,
 		    qdevice_net_nss_bad_cert_hook,
 		    qdevice_net_nss_get_client_auth_data, QDEVICE_NET_NSS_CLIENT_CERT_NICKNAME,
@@ -731,6 +1299,9 @@ qdevice_net_socket_write_finished(struct qdevice_net_instance *instance)
 		}
 
 		instance->socket = new_pr_fd;
+		instance->using_tls = 1;
+	} else {
+		instance->requests_in_flight++;
 	}
 
 	return (0);
@@ -739,26 +1310,58 @@ qdevice_net_socket_write_finished(struct qdevice_net_instance *instance)
 int
 qdevice_net_socket_write(struct qdevice_net_instance *instance)
 {
+	struct send_queue_msg *msg;
 	int res;
 	int send_echo_request;
+	int send_credit;
+
+	if (!qdevice_net_can_send_msg(instance) && !instance->sending_echo_request_msg &&
+	    !instance->sending_credit_msg) {
+		/*
+		 * Nothing to send (window is full)
+		 */
+		return (0);
+	}
 
 	/*
-	 * Echo request has extra buffer and special processing. Messages other then echo request
-	 * has higher priority, but if echo request send was not completed
-	 * it's necesary to complete it.
+	 * Echo request and credit have extra buffers and special processing. Message which was
+	 * partly sent has to be completed first. Otherwise credit (it unblocks server) has highest
+	 * priority, then other messages and echo request is last.
 	 */
-	send_echo_request = !(instance->sending_msg && instance->echo_request_msg_already_sent_bytes == 0);
+	if (instance->send_queue.msg_already_sent_bytes > 0) {
+		send_credit = send_echo_request = 0;
+	} else if (instance->sending_echo_request_msg && instance->echo_request_msg_already_sent_bytes > 0) {
+		send_credit = 0;
+		send_echo_request = 1;
+	} else {
+		send_credit = instance->sending_credit_msg;
+		send_echo_request = (!send_credit && !qdevice_net_can_send_msg(instance));
+	}
 
-	if (!send_echo_request) {
-		res = msgio_write(instance->socket, &instance->send_buffer, &instance->msg_already_sent_bytes);
+	if (send_credit) {
+		res = msgio_write(instance->socket, &instance->credit_send_buffer,
+		    &instance->credit_msg_already_sent_bytes);
+	} else if (!send_echo_request) {
+		msg = send_queue_first(&instance->send_queue);
+		res = msgio_write(instance->socket, &msg->buffer,
+		    &instance->send_queue.msg_already_sent_bytes);
 	} else {
 		res = msgio_write(instance->socket, &instance->echo_request_send_buffer,
 		    &instance->echo_request_msg_already_sent_bytes);
 	}
 
 	if (res == 1) {
-		if (!send_echo_request) {
-			instance->sending_msg = 0;
+		if (send_credit) {
+			instance->sending_credit_msg = 0;
+
+			/*
+			 * More vote infos may have arrived while credit was being sent
+			 */
+			if (qdevice_net_send_credit(instance) == -1) {
+				return (-1);
+			}
+		} else if (!send_echo_request) {
+			send_queue_del_first(&instance->send_queue);
 
 			if (qdevice_net_socket_write_finished(instance) == -1) {
 				return (-1);
@@ -784,94 +1387,428 @@ qdevice_net_socket_write(struct qdevice_net_instance *instance)
 }
 
 
-#define QDEVICE_NET_POLL_NO_FDS		1
-#define QDEVICE_NET_POLL_SOCKET		0
+static int	qdevice_net_instance_connect_process(struct qdevice_net_instance *instance,
+    const PRPollDesc *pfds, size_t no_pfds);
 
+/*
+ * Poll all instances (connections to qnetd servers) with opened socket or connect in
+ * progress and quit_event. Returns -1 if some of the instances has to be disconnected
+ * (schedule_disconnect is set), -2 if quit_event was set or poll failed, otherwise 0.
+ */
 int
-qdevice_net_poll(struct qdevice_net_instance *instance)
+qdevice_net_poll(struct qdevice_net_instance *instances, size_t no_instances, PRFileDesc *quit_event)
 {
-	PRPollDesc pfds[QDEVICE_NET_POLL_NO_FDS];
+	PRPollDesc pfds[QDEVICE_NET_MAX_SERVERS * NSS_SOCK_CONNECT_MAX_ADDRS + 1];
+	struct qdevice_net_instance *pfds_instance[QDEVICE_NET_MAX_SERVERS * NSS_SOCK_CONNECT_MAX_ADDRS + 1];
+	size_t connector_pfds_pos[QDEVICE_NET_MAX_SERVERS];
+	size_t connector_no_pfds[QDEVICE_NET_MAX_SERVERS];
+	struct qdevice_net_instance *instance;
+	PRIntervalTime timeout, instance_timeout;
 	PRInt32 poll_res;
-	int i;
+	size_t no_pfds;
+	size_t zi, zj;
+	int res;
+
+	/*
+	 * Quit event is always first
+	 */
+	pfds[0].fd = quit_event;
+	pfds[0].in_flags = PR_POLL_READ;
+	pfds[0].out_flags = 0;
+	pfds_instance[0] = NULL;
+	no_pfds = 1;
+
+	timeout = PR_INTERVAL_NO_TIMEOUT;
 
-	pfds[QDEVICE_NET_POLL_SOCKET].fd = instance->socket;
-	pfds[QDEVICE_NET_POLL_SOCKET].in_flags = PR_POLL_READ;
-	if (instance->sending_msg || instance->sending_echo_request_msg) {
-		pfds[QDEVICE_NET_POLL_SOCKET].in_flags |= PR_POLL_WRITE;
+	for (zi = 0; zi < no_instances; zi++) {
+		instance = &instances[zi];
+
+		instance->schedule_disconnect = 0;
+
+		instance_timeout = timer_list_time_to_expire(&instance->main_timer_list);
+		if (timeout == PR_INTERVAL_NO_TIMEOUT ||
+		    (instance_timeout != PR_INTERVAL_NO_TIMEOUT && instance_timeout < timeout)) {
+			timeout = instance_timeout;
+		}
+
+		if (instance->connecting) {
+			/*
+			 * Connection attempts are polled together with other instances, so
+			 * connecting never blocks established connection
+			 */
+			connector_pfds_pos[zi] = no_pfds;
+			connector_no_pfds[zi] = nss_sock_connector_get_pfds(&instance->connector,
+			    &pfds[no_pfds]);
+			for (zj = 0; zj < connector_no_pfds[zi]; zj++) {
+				pfds_instance[no_pfds++] = NULL;
+			}
+
+			instance_timeout = nss_sock_connector_time_to_next_event(&instance->connector);
+			if (instance_timeout < timeout) {
+				timeout = instance_timeout;
+			}
+		}
+
+		if (instance->socket == NULL) {
+			continue ;
+		}
+
+		pfds[no_pfds].fd = instance->socket;
+		pfds[no_pfds].in_flags = PR_POLL_READ;
+		if (qdevice_net_can_send_msg(instance) || instance->sending_echo_request_msg ||
+		    instance->sending_credit_msg) {
+			pfds[no_pfds].in_flags |= PR_POLL_WRITE;
+		}
+		pfds[no_pfds].out_flags = 0;
+		pfds_instance[no_pfds] = instance;
+		no_pfds++;
+	}
+
+	if ((poll_res = PR_Poll(pfds, no_pfds, timeout)) < 0) {
+		qdevice_net_log_nss(LOG_CRIT, "Poll failed");
+
+		return (-2);
 	}
 
-	instance->schedule_disconnect = 0;
+	if (poll_res > 0 && pfds[0].out_flags != 0) {
+		qdevice_net_log(LOG_DEBUG, "Quit event received");
 
-	if ((poll_res = PR_Poll(pfds, QDEVICE_NET_POLL_NO_FDS,
-	    timer_list_time_to_expire(&instance->main_timer_list))) > 0) {
-		for (i = 0; i < QDEVICE_NET_POLL_NO_FDS; i++) {
-			if (pfds[i].out_flags & PR_POLL_READ) {
-				switch (i) {
-				case QDEVICE_NET_POLL_SOCKET:
-					if (qdevice_net_socket_read(instance) == -1) {
-						instance->schedule_disconnect = 1;
-					}
+		return (-2);
+	}
 
-					break;
-				default:
-					errx(1, "Unhandled read poll descriptor %u", i);
-					break;
-				}
+	if (poll_res > 0) {
+		for (zi = 1; zi < no_pfds; zi++) {
+			instance = pfds_instance[zi];
+
+			if (instance == NULL) {
+				/*
+				 * Connection attempt, processed later
+				 */
+				continue ;
 			}
 
-			if (!instance->schedule_disconnect && pfds[i].out_flags & PR_POLL_WRITE) {
-				switch (i) {
-				case QDEVICE_NET_POLL_SOCKET:
-					if (qdevice_net_socket_write(instance) == -1) {
-						instance->schedule_disconnect = 1;
-					}
+			if (pfds[zi].out_flags & PR_POLL_READ) {
+				if (qdevice_net_socket_read(instance) == -1) {
+					instance->schedule_disconnect = 1;
+				}
+			}
 
-					break;
-				default:
-					errx(1, "Unhandled write poll descriptor %u", i);
-					break;
+			if (!instance->schedule_disconnect && pfds[zi].out_flags & PR_POLL_WRITE) {
+				if (qdevice_net_socket_write(instance) == -1) {
+					instance->schedule_disconnect = 1;
 				}
 			}
 
 			if (!instance->schedule_disconnect &&
-			    pfds[i].out_flags & (PR_POLL_ERR|PR_POLL_NVAL|PR_POLL_HUP|PR_POLL_EXCEPT)) {
-				switch (i) {
-				case QDEVICE_NET_POLL_SOCKET:
-					qdevice_net_log(LOG_CRIT, "POLL_ERR (%u) on main socket", pfds[i].out_flags);
+			    pfds[zi].out_flags & (PR_POLL_ERR|PR_POLL_NVAL|PR_POLL_HUP|PR_POLL_EXCEPT)) {
+				qdevice_net_log(LOG_CRIT, "POLL_ERR (%u) on socket to %s:%u", pfds[zi].out_flags,
+				    instance->host_addr, instance->host_port);
 
-					return (-1);
+				instance->schedule_disconnect = 1;
+			}
+		}
+	}
 
-					break;
-				default:
-					errx(1, "Unhandled poll err on descriptor %u", i);
-					break;
-				}
+	res = 0;
+
+	for (zi = 0; zi < no_instances; zi++) {
+		instance = &instances[zi];
+
+		if (instance->connecting) {
+			if (qdevice_net_instance_connect_process(instance,
+			    (poll_res > 0 ? &pfds[connector_pfds_pos[zi]] : NULL),
+			    (poll_res > 0 ? connector_no_pfds[zi] : 0)) != 0) {
+				instance->reconnect_stats.no_failed_attempts++;
+				instance->schedule_disconnect = 1;
 			}
 		}
+
+		if (!instance->schedule_disconnect) {
+			timer_list_expire(&instance->main_timer_list);
+		}
+
+		if (instance->schedule_disconnect) {
+			/*
+			 * Schedule disconnect can be set by this function or by some timer_list callback
+			 */
+			res = -1;
+		}
+	}
+
+	return (res);
+}
+
+/*
+ * Connection to qnetd server is established (instance->socket is set). Schedule send of
+ * preinit (or init) message.
+ */
+static int
+qdevice_net_instance_connected(struct qdevice_net_instance *instance)
+{
+	PRFileDesc *new_pr_fd;
+
+	instance->expected_msg_seq_num = 1;
+	instance->requests_in_flight = 0;
+
+	/*
+	 * Request window of server is unknown until init reply is received
+	 */
+	instance->server_request_window = 1;
+
+	if (instance->implicit_tls) {
+		/*
+		 * Server listens with TLS already started, so preinit and starttls are skipped
+		 * and cluster name is sent in init
+		 */
+		if ((new_pr_fd = nss_sock_start_ssl_as_client(instance->socket, QNETD_NSS_SERVER_CN,
+		    qdevice_net_nss_bad_cert_hook,
+		    qdevice_net_nss_get_client_auth_data, QDEVICE_NET_NSS_CLIENT_CERT_NICKNAME,
+		    0, NULL)) == NULL) {
+			qdevice_net_log_nss(LOG_ERR, "Can't start TLS");
+
+			PR_Close(instance->socket);
+			instance->socket = NULL;
+
+			return (-1);
+		}
+
+		instance->socket = new_pr_fd;
+		instance->using_tls = 1;
+		instance->msg_seq_num = 0;
+
+		return (qdevice_net_send_init(instance));
+	}
+
+	/*
+	 * Create and schedule send of preinit message to qnetd
+	 */
+	instance->msg_seq_num = 1;
+	if (msg_create_preinit(&instance->send_buffer, QDEVICE_NET_CLUSTER_NAME, 1,
+	    instance->msg_seq_num) == 0) {
+		qdevice_net_log(LOG_ERR, "Can't allocate buffer");
+
+		return (-1);
+	}
+
+	if (qdevice_net_schedule_send(instance) != 0) {
+		qdevice_net_log(LOG_ERR, "Can't schedule send of preinit msg");
+
+		return (-1);
 	}
 
-	if (!instance->schedule_disconnect) {
-		timer_list_expire(&instance->main_timer_list);
+	instance->state = QDEVICE_NET_STATE_WAITING_PREINIT_REPLY;
+
+	return (0);
+}
+
+/*
+ * Continue connect started by qdevice_net_instance_connect with result of polling connector
+ * pfds. Returns 0 when connect is still in progress or connection was established, -1 on
+ * failure.
+ */
+static int
+qdevice_net_instance_connect_process(struct qdevice_net_instance *instance, const PRPollDesc *pfds,
+    size_t no_pfds)
+{
+	PRFileDesc *socket;
+	int res;
+
+	res = nss_sock_connector_process(&instance->connector, pfds, no_pfds, &socket);
+	if (res == 0) {
+		return (0);
+	}
+
+	instance->connecting = 0;
+
+	if (res == -1) {
+		qdevice_net_log_nss(LOG_ERR, "Can't connect to qnetd server");
+
+		return (-1);
 	}
 
-	if (instance->schedule_disconnect) {
+	instance->socket = socket;
+
+	return (qdevice_net_instance_connected(instance));
+}
+
+/*
+ * Start connect to qnetd server. Connection attempts are then driven by qdevice_net_poll.
+ */
+int
+qdevice_net_instance_connect(struct qdevice_net_instance *instance)
+{
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+
+	/*
+	 * Cached addresses are used so resolver never blocks reconnect
+	 */
+	if (resolver_cache_get(instance->resolver_cache, instance->host_addr, instance->host_port,
+	    PR_AF_UNSPEC, 0, addrs, &no_addrs) != 0) {
+		qdevice_net_log_nss(LOG_ERR, "Can't resolve qnetd server address");
+
+		return (-1);
+	}
+
+	nss_sock_connector_init(&instance->connector, addrs, no_addrs,
+	    PR_MillisecondsToInterval(QDEVICE_NET_CONNECT_TIMEOUT));
+	instance->connecting = 1;
+
+	return (qdevice_net_instance_connect_process(instance, NULL, 0));
+}
+
+int
+qdevice_net_timer_reconnect(void *data1, void *data2)
+{
+	struct qdevice_net_instance *instance;
+
+	instance = (struct qdevice_net_instance *)data1;
+	instance->reconnect_timer = NULL;
+
+	qdevice_net_log(LOG_DEBUG, "Trying to reconnect to qnetd server %s:%u (attempt %u)",
+	    instance->host_addr, instance->host_port, instance->reconnect_attempt);
+
+	if (qdevice_net_instance_connect(instance) != 0) {
 		/*
-		 * Schedule disconnect can be set by this function or by some timer_list callback
+		 * Handled same way as any other disconnect -> next reconnect is scheduled
 		 */
+		instance->reconnect_stats.no_failed_attempts++;
+		instance->schedule_disconnect = 1;
+	}
+
+	return (0);
+}
+
+/*
+ * Schedule reconnect to qnetd server. Pause before reconnect grows exponentially with number of
+ * attempts since last fully initialized connection and half of it is random.
+ */
+int
+qdevice_net_instance_schedule_reconnect(struct qdevice_net_instance *instance)
+{
+	uint32_t pause;
+
+	pause = QDEVICE_NET_PAUSE_BEFORE_RECONNECT;
+
+	if (instance->reconnect_attempt >= 16 ||
+	    (pause << instance->reconnect_attempt) > QDEVICE_NET_MAX_PAUSE_BEFORE_RECONNECT) {
+		pause = QDEVICE_NET_MAX_PAUSE_BEFORE_RECONNECT;
+	} else {
+		pause <<= instance->reconnect_attempt;
+	}
+
+	instance->reconnect_attempt++;
+
+	pause = pause / 2 + random() % (pause / 2 + 1);
+
+	if (!instance->reconnecting) {
+		instance->reconnecting = 1;
+		instance->disconnect_time = PR_IntervalNow();
+	}
+
+	qdevice_net_log(LOG_DEBUG, "Scheduling reconnect to qnetd server %s:%u in %"PRIu32" ms",
+	    instance->host_addr, instance->host_port, pause);
+
+	instance->reconnect_timer = timer_list_add(&instance->main_timer_list, pause,
+	    qdevice_net_timer_reconnect, (void *)instance, NULL);
+
+	if (instance->reconnect_timer == NULL) {
+		qdevice_net_log(LOG_ERR, "Can't schedule reconnect");
+
 		return (-1);
 	}
 
 	return (0);
 }
 
+/*
+ * Reset connection related state so instance can be used for new connection. Buffers
+ * (including already allocated memory), timer list and statistics are kept.
+ */
+void
+qdevice_net_instance_clean(struct qdevice_net_instance *instance)
+{
+
+	msg_decoder_reset(&instance->msg_decoder);
+	msg_decoded_destroy(&instance->received_msg);
+	dynar_clean(&instance->send_buffer);
+	send_queue_destroy(&instance->send_queue);
+	dynar_clean(&instance->echo_request_send_buffer);
+	dynar_clean(&instance->credit_send_buffer);
+
+	msg_decoder_set_max_msg_size(&instance->msg_decoder, instance->initial_receive_size);
+	dynar_set_max_size(&instance->send_buffer, instance->initial_send_size);
+	dynar_set_max_size(&instance->echo_request_send_buffer, instance->initial_send_size);
+
+	instance->sending_echo_request_msg = 0;
+	instance->sending_credit_msg = 0;
+	instance->echo_request_msg_already_sent_bytes = 0;
+	instance->credit_msg_already_sent_bytes = 0;
+	instance->server_supports_credit = 0;
+	instance->server_supports_heartbeat = 0;
+	instance->server_request_window = 1;
+	instance->consumed_credit = 0;
+	instance->tlv_encoding = TLV_ENCODING_STANDARD;
+	instance->state = QDEVICE_NET_STATE_WAITING_PREINIT_REPLY;
+	instance->msg_seq_num = 0;
+	instance->expected_msg_seq_num = 0;
+	instance->requests_in_flight = 0;
+	instance->echo_request_expected_msg_seq_num = 0;
+	instance->echo_reply_received_msg_seq_num = 0;
+	instance->using_tls = 0;
+	instance->server_supports_node_list = 0;
+	instance->server_supports_node_list_delta = 0;
+	instance->acked_node_list_epoch_set = 0;
+	instance->sending_node_list = 0;
+	instance->vote = TLV_VOTE_UNDEFINED;
+}
+
+/*
+ * Close connection to qnetd server. Buffers and timer list are kept.
+ */
+void
+qdevice_net_instance_disconnect(struct qdevice_net_instance *instance)
+{
+
+	if (instance->reconnect_timer != NULL) {
+		timer_list_delete(&instance->main_timer_list, instance->reconnect_timer);
+		instance->reconnect_timer = NULL;
+	}
+
+	if (instance->echo_request_timer != NULL) {
+		timer_list_delete(&instance->main_timer_list, instance->echo_request_timer);
+		instance->echo_request_timer = NULL;
+	}
+
+	if (instance->connecting) {
+		nss_sock_connector_destroy(&instance->connector);
+		instance->connecting = 0;
+	}
+
+	if (instance->socket != NULL) {
+		if (PR_Close(instance->socket) != PR_SUCCESS) {
+			qdevice_net_log_nss(LOG_WARNING, "Unable to close connection");
+		}
+
+		instance->socket = NULL;
+	}
+
+	qdevice_net_instance_clean(instance);
+}
+
 int
-qdevice_net_instance_init(struct qdevice_net_instance *instance, size_t initial_receive_size,
-    size_t initial_send_size, size_t min_send_size, size_t max_receive_size, enum tlv_tls_supported tls_supported,
-    uint32_t node_id, enum tlv_decision_algorithm_type decision_algorithm, uint32_t heartbeat_interval)
+qdevice_net_instance_init(struct qdevice_net_instance *instance, const char *host_addr, uint16_t host_port,
+    struct resolver_cache *resolver_cache, size_t initial_receive_size, size_t initial_send_size, size_t min_send_size, size_t max_receive_size,
+    enum tlv_tls_supported tls_supported, int implicit_tls, uint32_t node_id,
+    enum tlv_decision_algorithm_type decision_algorithm,
+    uint32_t heartbeat_interval, const uint32_t *node_list, size_t no_node_list)
 {
 
 	memset(instance, 0, sizeof(*instance));
 
+	instance->host_addr = host_addr;
+	instance->host_port = host_port;
+	instance->resolver_cache = resolver_cache;
 	instance->initial_receive_size = initial_receive_size;
 	instance->initial_send_size = initial_send_size;
 	instance->min_send_size = min_send_size;
@@ -879,12 +1816,24 @@ qdevice_net_instance_init(struct qdevice_net_instance *instance, size_t initial_
 	instance->node_id = node_id;
 	instance->decision_algorithm = decision_algorithm;
 	instance->heartbeat_interval = heartbeat_interval;
-	dynar_init(&instance->receive_buffer, initial_receive_size);
+	node_list_init(&instance->node_list, QDEVICE_NET_MAX_NODE_LIST);
+	node_list_init(&instance->sent_node_list, QDEVICE_NET_MAX_NODE_LIST);
+	node_list_init(&instance->acked_node_list, QDEVICE_NET_MAX_NODE_LIST);
+	node_list_init(&instance->node_list_added, QDEVICE_NET_MAX_NODE_LIST);
+	node_list_init(&instance->node_list_removed, QDEVICE_NET_MAX_NODE_LIST);
+	if (node_list_set(&instance->node_list, node_list, no_node_list) != 0) {
+		return (-1);
+	}
+	msg_decoder_init(&instance->msg_decoder, initial_receive_size);
+	msg_decoded_init(&instance->received_msg);
 	dynar_init(&instance->send_buffer, initial_send_size);
+	send_queue_init(&instance->send_queue, QDEVICE_NET_MAX_SEND_QUEUE_SIZE);
 	dynar_init(&instance->echo_request_send_buffer, initial_send_size);
+	dynar_init(&instance->credit_send_buffer, initial_send_size);
 	timer_list_init(&instance->main_timer_list);
 
 	instance->tls_supported = tls_supported;
+	instance->implicit_tls = implicit_tls;
 
 	return (0);
 }
@@ -893,18 +1842,170 @@ int
 qdevice_net_instance_destroy(struct qdevice_net_instance *instance)
 {
 
+	qdevice_net_instance_disconnect(instance);
+
 	timer_list_free(&instance->main_timer_list);
-	dynar_destroy(&instance->receive_buffer);
+	msg_decoder_destroy(&instance->msg_decoder);
+	msg_decoded_destroy(&instance->received_msg);
 	dynar_destroy(&instance->send_buffer);
+	send_queue_destroy(&instance->send_queue);
 	dynar_destroy(&instance->echo_request_send_buffer);
+	dynar_destroy(&instance->credit_send_buffer);
+	node_list_destroy(&instance->node_list);
+	node_list_destroy(&instance->sent_node_list);
+	node_list_destroy(&instance->acked_node_list);
+	node_list_destroy(&instance->node_list_added);
+	node_list_destroy(&instance->node_list_removed);
 
 	return (0);
 }
 
+static void
+signal_int_handler(int sig)
+{
+
+	PR_SetPollableEvent(global_quit_event);
+}
+
+static void
+signal_handlers_register(void)
+{
+	struct sigaction act;
+
+	act.sa_handler = signal_int_handler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+}
+
+static void
+usage(void)
+{
+
+	printf("usage: corosync-qdevice-net [-t] [-a test|ffsplit|lms] [-i node_id] [-m node_id,...] "
+	    "[-s standby_qnetd_host]\n");
+	printf("  -t  connect to implicit TLS port %u (no preinit and STARTTLS exchange)\n",
+	    QNETD_TLS_PORT);
+}
+
+static void
+cli_parse_node_list(const char *str, uint32_t *node_list, size_t *no_node_list)
+{
+	const char *cp;
+	char *ep;
+
+	*no_node_list = 0;
+
+	for (cp = str; *cp != '\0'; cp = (*ep == ',' ? ep + 1 : ep)) {
+		if (*no_node_list >= QDEVICE_NET_MAX_NODE_LIST) {
+			errx(1, "Too many nodes in node list (maximum is %u)", QDEVICE_NET_MAX_NODE_LIST);
+		}
+
+		node_list[(*no_node_list)++] = strtoul(cp, &ep, 10);
+
+		if (ep == cp || (*ep != ',' && *ep != '\0')) {
+			errx(1, "Invalid node list %s", str);
+		}
+	}
+}
+
+static void
+cli_parse(int argc, char * const argv[], const char **standby_host,
+    enum tlv_decision_algorithm_type *decision_algorithm, uint32_t *node_id,
+    uint32_t *node_list, size_t *no_node_list, int *implicit_tls)
+{
+	int ch;
+	char *ep;
+
+	*standby_host = NULL;
+	*implicit_tls = 0;
+	*decision_algorithm = QDEVICE_NET_DECISION_ALGORITHM;
+	*node_id = QDEVICE_NET_NODE_ID;
+	*no_node_list = 0;
+
+	while ((ch = getopt(argc, argv, "a:hi:m:s:t")) != -1) {
+		switch (ch) {
+		case 'a':
+			if (strcmp(optarg, "test") == 0) {
+				*decision_algorithm = TLV_DECISION_ALGORITHM_TYPE_TEST;
+			} else if (strcmp(optarg, "ffsplit") == 0) {
+				*decision_algorithm = TLV_DECISION_ALGORITHM_TYPE_FFSPLIT;
+			} else if (strcmp(optarg, "lms") == 0) {
+				*decision_algorithm = TLV_DECISION_ALGORITHM_TYPE_LMS;
+			} else {
+				errx(1, "Unknown decision algorithm %s", optarg);
+			}
+			break;
+		case 'i':
+			*node_id = strtoul(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0') {
+				errx(1, "Invalid node id %s", optarg);
+			}
+			break;
+		case 'm':
+			cli_parse_node_list(optarg, node_list, no_node_list);
+			break;
+		case 's':
+			*standby_host = optarg;
+			break;
+		case 't':
+			*implicit_tls = 1;
+			break;
+		case 'h':
+		case '?':
+			usage();
+			exit(1);
+			break;
+		}
+	}
+}
+
 int
-main(void)
+main(int argc, char *argv[])
 {
-	struct qdevice_net_instance instance;
+	struct qdevice_net_instance instances[QDEVICE_NET_MAX_SERVERS];
+	struct qdevice_net_instance *instance;
+	struct resolver_cache resolver_cache;
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+	const char *hosts[QDEVICE_NET_MAX_SERVERS];
+	const char *standby_host;
+	enum tlv_decision_algorithm_type decision_algorithm;
+	uint32_t node_id;
+	uint32_t node_list[QDEVICE_NET_MAX_NODE_LIST];
+	size_t no_node_list;
+	size_t no_instances;
+	size_t active_instance;
+	size_t zi;
+	enum tlv_vote active_vote, vote;
+	int implicit_tls;
+	int poll_res;
+
+	cli_parse(argc, argv, &standby_host, &decision_algorithm, &node_id, node_list, &no_node_list,
+	    &implicit_tls);
+
+	if (implicit_tls && QDEVICE_NET_TLS_SUPPORTED == TLV_TLS_UNSUPPORTED) {
+		errx(1, "Implicit TLS can't be used when TLS is unsupported");
+	}
+
+	if (no_node_list == 0) {
+		/*
+		 * Static membership. By default node sees only itself.
+		 */
+		node_list[no_node_list++] = node_id;
+	}
+
+	hosts[0] = QNETD_HOST;
+	no_instances = 1;
+
+	if (standby_host != NULL) {
+		/*
+		 * Hot standby mode. Second fully initialized connection is kept to standby server
+		 */
+		hosts[no_instances++] = standby_host;
+	}
 
 	/*
 	 * Init
@@ -916,53 +2017,115 @@ main(void)
 		err_nss();
 	}
 
-	if (qdevice_net_instance_init(&instance,
-	    QDEVICE_NET_INITIAL_MSG_RECEIVE_SIZE, QDEVICE_NET_INITIAL_MSG_SEND_SIZE,
-	    QDEVICE_NET_MIN_MSG_SEND_SIZE, QDEVICE_NET_MAX_MSG_RECEIVE_SIZE,
-	    QDEVICE_NET_TLS_SUPPORTED, QDEVICE_NET_NODE_ID, QDEVICE_NET_DECISION_ALGORITHM,
-	    QDEVICE_NET_HEARTBEAT_INTERVAL) == -1) {
-		errx(1, "Can't initialize qdevice-net");
+	if (resolver_cache_init(&resolver_cache, QDEVICE_NET_RESOLVER_CACHE_TTL) != 0) {
+		errx(1, "Can't initialize resolver cache");
 	}
 
-	/*
-	 * Try to connect to qnetd host
-	 */
-	instance.socket = nss_sock_create_client_socket(QNETD_HOST, QNETD_PORT, PR_AF_UNSPEC, 100);
-	if (instance.socket == NULL) {
-		err_nss();
+	for (zi = 0; zi < no_instances; zi++) {
+		if (qdevice_net_instance_init(&instances[zi], hosts[zi],
+		    (implicit_tls ? QNETD_TLS_PORT : QNETD_PORT), &resolver_cache,
+		    QDEVICE_NET_INITIAL_MSG_RECEIVE_SIZE, QDEVICE_NET_INITIAL_MSG_SEND_SIZE,
+		    QDEVICE_NET_MIN_MSG_SEND_SIZE, QDEVICE_NET_MAX_MSG_RECEIVE_SIZE,
+		    QDEVICE_NET_TLS_SUPPORTED, implicit_tls, node_id, decision_algorithm,
+		    QDEVICE_NET_HEARTBEAT_INTERVAL, node_list, no_node_list) == -1) {
+			errx(1, "Can't initialize qdevice-net");
+		}
 	}
 
-	if (nss_sock_set_nonblocking(instance.socket) != 0) {
+	srandom(time(NULL) ^ getpid());
+
+	if ((global_quit_event = PR_NewPollableEvent()) == NULL) {
 		err_nss();
 	}
 
+	signal_handlers_register();
+
 	/*
-	 * Create and schedule send of preinit message to qnetd
+	 * Try to connect to qnetd host(s)
 	 */
-	instance.expected_msg_seq_num = 1;
-	if (msg_create_preinit(&instance.send_buffer, QDEVICE_NET_CLUSTER_NAME, 1, instance.expected_msg_seq_num) == 0) {
-		errx(1, "Can't allocate buffer");
-	}
-	if (qdevice_net_schedule_send(&instance) != 0) {
-		errx(1, "Can't schedule send of preinit msg");
+	active_instance = 0;
+
+	for (zi = 0; zi < no_instances; zi++) {
+		/*
+		 * Fill resolver cache. This is only place where resolver can block.
+		 */
+		if (resolver_cache_get(&resolver_cache, instances[zi].host_addr, instances[zi].host_port,
+		    PR_AF_UNSPEC, 1, addrs, &no_addrs) != 0) {
+			qdevice_net_log_nss(LOG_WARNING, "Can't resolve qnetd server address");
+		}
+
+		if (qdevice_net_instance_connect(&instances[zi]) != 0) {
+			qdevice_net_log(LOG_WARNING, "Can't connect to qnetd server %s. Scheduling reconnect",
+			    instances[zi].host_addr);
+
+			if (qdevice_net_instance_schedule_reconnect(&instances[zi]) != 0) {
+				errx(1, "Can't schedule reconnect");
+			}
+		}
 	}
 
-	instance.state = QDEVICE_NET_STATE_WAITING_PREINIT_REPLY;
+	active_vote = TLV_VOTE_UNDEFINED;
 
 	/*
-	 * Main loop
+	 * Main loop. Runs until signal is received or poll fails.
 	 */
-	while (qdevice_net_poll(&instance) == 0) {
+	while ((poll_res = qdevice_net_poll(instances, no_instances, global_quit_event)) != -2) {
+		if (poll_res == -1) {
+			for (zi = 0; zi < no_instances; zi++) {
+				instance = &instances[zi];
+
+				if (!instance->schedule_disconnect) {
+					continue ;
+				}
+
+				if (instance->socket != NULL) {
+					qdevice_net_log(LOG_INFO, "Disconnecting from qnetd server %s:%u",
+					    instance->host_addr, instance->host_port);
+				}
+
+				qdevice_net_instance_disconnect(instance);
+
+				if (qdevice_net_instance_schedule_reconnect(instance) != 0) {
+					errx(1, "Can't schedule reconnect");
+				}
+			}
+		}
+
+		if (instances[active_instance].state != QDEVICE_NET_STATE_CONNECTED) {
+			/*
+			 * Active server is not (yet) usable. Switch to fully initialized standby (if any).
+			 */
+			for (zi = 0; zi < no_instances; zi++) {
+				if (zi != active_instance && instances[zi].state == QDEVICE_NET_STATE_CONNECTED) {
+					qdevice_net_log(LOG_NOTICE, "Switching to qnetd server %s:%u",
+					    instances[zi].host_addr, instances[zi].host_port);
+
+					active_instance = zi;
+					break;
+				}
+			}
+		}
+
+		vote = qdevice_net_get_active_vote(instances, active_instance);
+		if (vote != active_vote) {
+			qdevice_net_log(LOG_NOTICE, "Vote changed from %u to %u (qnetd server %s:%u)",
+			    active_vote, vote, instances[active_instance].host_addr,
+			    instances[active_instance].host_port);
+
+			active_vote = vote;
+		}
 	}
 
 	/*
 	 * Cleanup
 	 */
-	if (PR_Close(instance.socket) != PR_SUCCESS) {
-		err_nss();
+	for (zi = 0; zi < no_instances; zi++) {
+		qdevice_net_instance_destroy(&instances[zi]);
 	}
 
-	qdevice_net_instance_destroy(&instance);
+	resolver_cache_destroy(&resolver_cache);
+
+	PR_DestroyPollableEvent(global_quit_event);
 
 	SSL_ClearSessionCache();
 
@@ -12,6 +12,9 @@
 #include <keyhi.h>
 #include <syslog.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
 
 #include "msg.h"
 #include "msgio.h"
@@ -19,16 +22,56 @@
 #include "nss-sock.h"
 #include "qnetd-client.h"
 #include "qnetd-clients-list.h"
+#include "qnetd-cluster-list.h"
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-test.h"
+#include "qnetd-algo-ffsplit.h"
+#include "qnetd-algo-lms.h"
 #include "qnetd-poll-array.h"
 #include "qnetd-log.h"
+#include "qnetd-defines.h"
 #include "dynar.h"
 #include "timer-list.h"
 
 #define QNETD_HOST      NULL
 #define QNETD_PORT      4433
-#define QNETD_LISTEN_BACKLOG	10
+#define QNETD_TLS_PORT	4434
+#define QNETD_LISTEN_BACKLOG	128
+#define QNETD_MAX_ACCEPTS_PER_POLL	64
+#define QNETD_DEFER_ACCEPT_TIMEOUT	5
 #define QNETD_MAX_CLIENT_SEND_SIZE	(1 << 15)
 #define QNETD_MAX_CLIENT_RECEIVE_SIZE	(1 << 15)
+#define QNETD_MAX_CLIENT_SEND_QUEUE_SIZE	32
+
+/*
+ * Received messages are stored in chunks shared by all clients. Free chunks are cached up
+ * to the given count.
+ */
+#define QNETD_RECEIVE_CHUNK_SIZE		(1 << 12)
+#define QNETD_MAX_FREE_RECEIVE_CHUNKS		256
+
+/*
+ * Decoded strings and arrays of received message live in arena until dispatch finishes
+ */
+#define QNETD_MSG_ARENA_BLOCK_SIZE		(1 << 14)
+
+/*
+ * Number of requests client may send without waiting for reply. Requests are processed
+ * one by one, so unprocessed requests wait in socket buffers.
+ */
+#define QNETD_CLIENT_REQUEST_WINDOW		8
+
+/*
+ * Listening sockets are not polled for this time (ms) after accept failed (for example
+ * with EMFILE), so pending connection doesn't wake up poll loop again and again
+ */
+#define QNETD_ACCEPT_ERROR_BACKOFF		500
+
+/*
+ * Cache of encoded vote info messages is indexed by client TLV encoding and vote
+ */
+#define QNETD_VOTE_MSGS_SIZE			((TLV_ENCODING_COMPACT + 1) * (TLV_VOTE_ASK_LATER + 1))
+#define QNETD_VOTE_MSGS_INDEX(encoding, vote)	((encoding) * (TLV_VOTE_ASK_LATER + 1) + (vote))
 
 #define NSS_DB_DIR	"nssdb"
 #define QNETD_CERT_NICKNAME	"QNetd Cert"
@@ -39,16 +82,40 @@
 #define QNETD_HEARTBEAT_INTERVAL_MIN		1000
 #define QNETD_HEARTBEAT_INTERVAL_MAX		200000
 
+/*
+ * Client which doesn't send echo request within this time is considered dead by decision
+ * algorithm
+ */
+#define QNETD_HEARTBEAT_TIMEOUT(interval)	((interval) * 3 / 2)
+
+/*
+ * Vote info caused by membership changes is sent immediately if cluster was quiet, otherwise
+ * it is postponed until no change arrives for QNETD_VOTE_INFO_DEBOUNCE_WINDOW ms, but at
+ * most for QNETD_VOTE_INFO_MAX_DELAY ms.
+ */
+#define QNETD_VOTE_INFO_DEBOUNCE_WINDOW		50
+#define QNETD_VOTE_INFO_MAX_DELAY		250
+
 struct qnetd_instance {
 	struct {
 		PRFileDesc *socket;
+		PRFileDesc *tls_socket;		// Implicit TLS listener. NULL if disabled
 		CERTCertificate *cert;
 		SECKEYPrivateKey *private_key;
 	} server;
 	size_t max_client_receive_size;
 	size_t max_client_send_size;
+	size_t max_client_send_queue_size;
+	unsigned int max_accepts_per_poll;
 	struct qnetd_clients_list clients;
+	struct qnetd_client_slots client_slots;	// Hot parts of clients, scanned by poll loop
+	struct rope_chunk_pool receive_chunk_pool;
+	struct arena msg_arena;		// Reset after every received message is processed
+	struct qnetd_cluster_list clusters;
 	struct qnetd_poll_array poll_array;
+	struct timer_list main_timer_list;
+	struct timer_list_entry *accept_backoff_timer;	// Set while accept is paused after error
+	int clients_scheduled_for_disconnect;
 	enum tlv_tls_supported tls_supported;
 	int tls_client_cert_required;
 };
@@ -58,16 +125,6 @@ struct qnetd_instance {
  */
 PRFileDesc *global_server_socket;
 
-/*
- * Decision algorithms supported in this server
- */
-#define QNETD_STATIC_SUPPORTED_DECISION_ALGORITHMS_SIZE		1
-
-enum tlv_decision_algorithm_type
-    qnetd_static_supported_decision_algorithms[QNETD_STATIC_SUPPORTED_DECISION_ALGORITHMS_SIZE] = {
-	TLV_DECISION_ALGORITHM_TYPE_TEST,
-};
-
 static void
 qnetd_err_nss(void) {
 
@@ -108,15 +165,24 @@ qnetd_client_log_msg_decode_error(int ret)
 int
 qnetd_client_net_schedule_send(struct qnetd_client *client)
 {
-	if (client->sending_msg) {
+	struct qnetd_client_hot *hot;
+
+	hot = qnetd_client_hot(client);
+
+	if (hot->sending_msg) {
 		/*
 		 * Client is already sending msg
 		 */
 		return (-1);
 	}
 
-	client->msg_already_sent_bytes = 0;
-	client->sending_msg = 1;
+	hot->msg_already_sent_bytes = 0;
+	hot->sending_msg = 1;
+
+	/*
+	 * Keep order with already queued shared messages
+	 */
+	client->send_queue_before_msg = client->send_queue.no_entries;
 
 	return (0);
 }
@@ -126,7 +192,8 @@ qnetd_client_send_err(struct qnetd_client *client, int add_msg_seq_number, uint3
     enum tlv_reply_error_code reply)
 {
 
-	if (msg_create_server_error(&client->send_buffer, add_msg_seq_number, msg_seq_number, reply) == 0) {
+	if (msg_create_server_error(&client->send_buffer, client->tlv_encoding, add_msg_seq_number,
+	    msg_seq_number, reply) == 0) {
 		qnetd_log(LOG_ERR, "Can't alloc server error msg. Disconnecting client connection.");
 
 		return (-1);
@@ -141,38 +208,487 @@ qnetd_client_send_err(struct qnetd_client *client, int add_msg_seq_number, uint3
 	return (0);
 }
 
-int
-qnetd_client_msg_received_preinit(struct qnetd_instance *instance, struct qnetd_client *client,
+/*
+ * Queue vote info message to client if vote changed and client has credit. vote_msgs is
+ * cache of already encoded messages indexed by QNETD_VOTE_MSGS_INDEX, new message is added
+ * if needed. Client which can't be informed is scheduled for disconnect.
+ */
+static void
+qnetd_client_queue_vote_info(struct qnetd_instance *instance, struct qnetd_client *client,
+    struct send_queue_msg **vote_msgs)
+{
+	struct send_queue_msg **vote_msg;
+	int res;
+
+	if (!client->algorithm_attached || !client->vote_info_pending ||
+	    qnetd_client_hot(client)->schedule_disconnect) {
+		return ;
+	}
+
+	if (client->credit_window > 0 && client->send_credit == 0) {
+		/*
+		 * Vote stays pending and newest vote is sent after client gives credit
+		 */
+		return ;
+	}
+
+	vote_msg = &vote_msgs[QNETD_VOTE_MSGS_INDEX(client->tlv_encoding, client->vote)];
+
+	if (*vote_msg == NULL) {
+		*vote_msg = send_queue_msg_create(instance->max_client_send_size);
+
+		if (*vote_msg == NULL ||
+		    msg_create_vote_info(&(*vote_msg)->buffer, client->tlv_encoding, 0, 0, client->vote) == 0) {
+			qnetd_log(LOG_ERR, "Can't alloc vote info msg. Disconnecting client connection.");
+
+			if (*vote_msg != NULL) {
+				send_queue_msg_unref(*vote_msg);
+				*vote_msg = NULL;
+			}
+
+			qnetd_client_hot(client)->schedule_disconnect = 1;
+			instance->clients_scheduled_for_disconnect = 1;
+
+			return ;
+		}
+	}
+
+	res = send_queue_add(&client->send_queue, *vote_msg);
+	if (res != 0) {
+		if (res == -1) {
+			qnetd_log(LOG_ERR, "Send queue of client is full. Disconnecting client connection.");
+		} else {
+			qnetd_log(LOG_ERR, "Can't alloc send queue entry. Disconnecting client connection.");
+		}
+
+		qnetd_client_hot(client)->schedule_disconnect = 1;
+		instance->clients_scheduled_for_disconnect = 1;
+
+		return ;
+	}
+
+	qnetd_client_hot(client)->send_queue_pending = 1;
+
+	if (client->credit_window > 0) {
+		client->send_credit--;
+	}
+
+	client->vote_info_pending = 0;
+	client->reported_vote = client->vote;
+}
+
+static void
+qnetd_vote_msgs_unref(struct send_queue_msg **vote_msgs)
+{
+	size_t zi;
+
+	/*
+	 * Drop creator references. Messages live as long as they are queued.
+	 */
+	for (zi = 0; zi < QNETD_VOTE_MSGS_SIZE; zi++) {
+		if (vote_msgs[zi] != NULL) {
+			send_queue_msg_unref(vote_msgs[zi]);
+		}
+	}
+}
+
+/*
+ * Inform all clients of cluster whose vote was changed by decision algorithm. Vote info
+ * message is encoded only once per vote value and shared by send queues of all clients.
+ */
+void
+qnetd_cluster_send_vote_info(struct qnetd_instance *instance, struct qnetd_cluster *cluster)
+{
+	struct send_queue_msg *vote_msgs[QNETD_VOTE_MSGS_SIZE];
+	struct qnetd_client *client;
+
+	memset(vote_msgs, 0, sizeof(vote_msgs));
+
+	TAILQ_FOREACH(client, &cluster->clients, cluster_entries) {
+		qnetd_client_queue_vote_info(instance, client, vote_msgs);
+	}
+
+	qnetd_vote_msgs_unref(vote_msgs);
+}
+
+static int
+qnetd_cluster_has_pending_vote_info(const struct qnetd_cluster *cluster)
+{
+	const struct qnetd_client *client;
+
+	TAILQ_FOREACH(client, &cluster->clients, cluster_entries) {
+		if (client->vote_info_pending) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * End of debounce window. Send postponed vote info and keep window open for another full
+ * period, or close window if there was no change.
+ */
+static int
+qnetd_cluster_vote_info_timer_callback(void *data1, void *data2)
+{
+	struct qnetd_instance *instance;
+	struct qnetd_cluster *cluster;
+
+	instance = (struct qnetd_instance *)data1;
+	cluster = (struct qnetd_cluster *)data2;
+
+	if (cluster->vote_info_deferred) {
+		cluster->vote_info_deferred = 0;
+		qnetd_cluster_send_vote_info(instance, cluster);
+
+		/*
+		 * Interval may have been shortened by max delay. Timer is rescheduled with this one.
+		 */
+		cluster->vote_info_timer->interval = QNETD_VOTE_INFO_DEBOUNCE_WINDOW;
+
+		return (-1);
+	}
+
+	cluster->vote_info_timer = NULL;
+
+	return (0);
+}
+
+/*
+ * Send vote info after membership change, coalescing bursts of changes. Must not be called
+ * from timer callback.
+ */
+static void
+qnetd_cluster_schedule_vote_info(struct qnetd_instance *instance, struct qnetd_cluster *cluster)
+{
+	PRUint32 deferred_for;
+	PRUint32 interval;
+
+	if (!qnetd_cluster_has_pending_vote_info(cluster)) {
+		/*
+		 * No vote changed. Neither open nor extend window.
+		 */
+		return ;
+	}
+
+	if (cluster->vote_info_timer == NULL) {
+		/*
+		 * Leading edge. Send now and open window.
+		 */
+		qnetd_cluster_send_vote_info(instance, cluster);
+
+		interval = QNETD_VOTE_INFO_DEBOUNCE_WINDOW;
+	} else {
+		if (!cluster->vote_info_deferred) {
+			cluster->vote_info_deferred = 1;
+			cluster->vote_info_deferred_since = PR_IntervalNow();
+		}
+
+		deferred_for = PR_IntervalToMilliseconds(PR_IntervalNow() -
+		    cluster->vote_info_deferred_since);
+
+		if (deferred_for >= QNETD_VOTE_INFO_MAX_DELAY) {
+			interval = 0;
+		} else if (QNETD_VOTE_INFO_MAX_DELAY - deferred_for < QNETD_VOTE_INFO_DEBOUNCE_WINDOW) {
+			interval = QNETD_VOTE_INFO_MAX_DELAY - deferred_for;
+		} else {
+			interval = QNETD_VOTE_INFO_DEBOUNCE_WINDOW;
+		}
+
+		timer_list_delete(&instance->main_timer_list, cluster->vote_info_timer);
+	}
+
+	cluster->vote_info_timer = timer_list_add(&instance->main_timer_list, interval,
+	    qnetd_cluster_vote_info_timer_callback, (void *)instance, (void *)cluster);
+
+	if (cluster->vote_info_timer == NULL) {
+		/*
+		 * Can't debounce. Fall back to immediate send.
+		 */
+		qnetd_log(LOG_WARNING, "Can't add vote info timer for cluster %s", cluster->cluster_name);
+
+		cluster->vote_info_deferred = 0;
+		qnetd_cluster_send_vote_info(instance, cluster);
+	}
+}
+
+/*
+ * Variant of qnetd_cluster_schedule_vote_info for timer callbacks, where timers can be neither
+ * added nor deleted. Change is postponed to end of already open window, otherwise sent now.
+ */
+static void
+qnetd_cluster_schedule_vote_info_from_timer(struct qnetd_instance *instance,
+    struct qnetd_cluster *cluster)
+{
+
+	if (!qnetd_cluster_has_pending_vote_info(cluster)) {
+		return ;
+	}
+
+	if (cluster->vote_info_timer != NULL) {
+		if (!cluster->vote_info_deferred) {
+			cluster->vote_info_deferred = 1;
+			cluster->vote_info_deferred_since = PR_IntervalNow();
+		}
+	} else {
+		qnetd_cluster_send_vote_info(instance, cluster);
+	}
+}
+
+/*
+ * Detach client from decision algorithm and remove it from its cluster. Other clients of
+ * cluster are informed about changed votes unless server is going down.
+ */
+static void
+qnetd_client_leave_cluster(struct qnetd_instance *instance, struct qnetd_client *client,
+    int server_going_down)
+{
+	struct qnetd_cluster *cluster;
+
+	cluster = client->cluster;
+
+	qnetd_algorithm_client_disconnect(client, server_going_down);
+
+	node_list_clean(&client->node_list);
+	client->node_list_epoch_set = 0;
+
+	if (!server_going_down) {
+		qnetd_cluster_schedule_vote_info(instance, cluster);
+	}
+
+	if (cluster->no_clients == 1 && cluster->vote_info_timer != NULL) {
+		/*
+		 * Cluster is going to be freed together with last client
+		 */
+		timer_list_delete(&instance->main_timer_list, cluster->vote_info_timer);
+		cluster->vote_info_timer = NULL;
+	}
+
+	qnetd_cluster_list_del_client(&instance->clusters, client);
+}
+
+static int
+qnetd_client_heartbeat_timeout(void *data1, void *data2)
+{
+	struct qnetd_instance *instance;
+	struct qnetd_client *client;
+
+	instance = (struct qnetd_instance *)data1;
+	client = (struct qnetd_client *)data2;
+
+	client->heartbeat_timeout_timer = NULL;
+
+	qnetd_log(LOG_WARNING, "Client with node id %"PRIu32" of cluster %s didn't send heartbeat "
+	    "in %"PRIu32" ms", client->node_id, client->cluster_name,
+	    QNETD_HEARTBEAT_TIMEOUT(client->heartbeat_interval));
+
+	if (qnetd_algorithm_heartbeat_timeout(client) != 0) {
+		qnetd_log(LOG_ERR, "Decision algorithm failed to process heartbeat timeout. "
+		    "Disconnecting client connection.");
+
+		qnetd_client_hot(client)->schedule_disconnect = 1;
+		instance->clients_scheduled_for_disconnect = 1;
+	}
+
+	qnetd_cluster_schedule_vote_info_from_timer(instance, client->cluster);
+
+	/*
+	 * Timer is added again when client sends heartbeat
+	 */
+	return (0);
+}
+
+/*
+ * (Re)start heartbeat timeout timer of client. Timer is stopped if heartbeat interval is 0.
+ */
+static int
+qnetd_client_heartbeat_timer_restart(struct qnetd_instance *instance, struct qnetd_client *client)
+{
+
+	if (client->heartbeat_timeout_timer != NULL) {
+		timer_list_delete(&instance->main_timer_list, client->heartbeat_timeout_timer);
+		client->heartbeat_timeout_timer = NULL;
+	}
+
+	if (client->heartbeat_interval == 0) {
+		return (0);
+	}
+
+	client->heartbeat_timeout_timer = timer_list_add(&instance->main_timer_list,
+	    QNETD_HEARTBEAT_TIMEOUT(client->heartbeat_interval), qnetd_client_heartbeat_timeout,
+	    (void *)instance, (void *)client);
+
+	if (client->heartbeat_timeout_timer == NULL) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Send error reply for failed qnetd_algorithm_client_init. Returns -1 if client should be
+ * disconnected, otherwise 0.
+ */
+static int
+qnetd_client_send_algorithm_init_err(struct qnetd_client *client, const struct msg_decoded *msg,
+    int algorithm_init_res)
+{
+	enum tlv_reply_error_code reply_error_code;
+
+	switch (algorithm_init_res) {
+	case -1:
+		reply_error_code = TLV_REPLY_ERROR_CODE_UNSUPPORTED_DECISION_ALGORITHM;
+		qnetd_log(LOG_ERR, "Client requested unsupported decision algorithm. Sending error reply.");
+		break;
+	case -2:
+		reply_error_code = TLV_REPLY_ERROR_CODE_DECISION_ALGORITHM_DIFFERS;
+		qnetd_log(LOG_ERR, "Client requested decision algorithm %u but other clients of cluster %s "
+		    "use different one. Sending error reply.", client->decision_algorithm,
+		    client->cluster_name);
+		break;
+	default:
+		reply_error_code = TLV_REPLY_ERROR_CODE_INTERNAL_ERROR;
+		qnetd_log(LOG_ERR, "Decision algorithm failed to initialize client. Sending error reply.");
+		break;
+	}
+
+	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number, reply_error_code) != 0) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Apply decision algorithm and heartbeat interval from set option or init message. Returns 0
+ * on success, 1 if options were not accepted and error reply was sent, -1 on fatal error.
+ */
+static int
+qnetd_client_apply_options(struct qnetd_instance *instance, struct qnetd_client *client,
 	const struct msg_decoded *msg)
 {
+	int res;
+	enum tlv_decision_algorithm_type old_decision_algorithm;
 
-	if (msg->cluster_name == NULL) {
-		qnetd_log(LOG_ERR, "Received preinit message without cluster name. Sending error reply.");
+	if (msg->decision_algorithm_set && qnetd_algorithm_find(msg->decision_algorithm) == NULL) {
+		qnetd_log(LOG_ERR, "Client requested unsupported decision algorithm %u. Sending error reply.",
+		    msg->decision_algorithm);
 
 		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-		    TLV_REPLY_ERROR_CODE_DOESNT_CONTAIN_REQUIRED_OPTION) != 0) {
+		    TLV_REPLY_ERROR_CODE_UNSUPPORTED_DECISION_ALGORITHM) != 0) {
 			return (-1);
 		}
 
-		return (0);
+		return (1);
 	}
 
-	client->cluster_name = malloc(msg->cluster_name_len + 1);
-	if (client->cluster_name == NULL) {
-		qnetd_log(LOG_ERR, "Can't allocate cluster name. Sending error reply.");
+	if (msg->heartbeat_interval_set) {
+		/*
+		 * Check if heartbeat interval is valid
+		 */
+		if (msg->heartbeat_interval != 0 && (msg->heartbeat_interval < QNETD_HEARTBEAT_INTERVAL_MIN ||
+		    msg->heartbeat_interval > QNETD_HEARTBEAT_INTERVAL_MAX)) {
+			qnetd_log(LOG_ERR, "Client requested invalid heartbeat interval %u. Sending error reply.",
+			    msg->heartbeat_interval);
+
+			if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+			    TLV_REPLY_ERROR_CODE_INVALID_HEARTBEAT_INTERVAL) != 0) {
+				return (-1);
+			}
+
+			return (1);
+		}
+
+		client->heartbeat_interval = msg->heartbeat_interval;
+	}
+
+	/*
+	 * Attach client to (possibly changed) decision algorithm of its cluster
+	 */
+	old_decision_algorithm = client->decision_algorithm;
+	if (msg->decision_algorithm_set) {
+		client->decision_algorithm = msg->decision_algorithm;
+	}
+
+	res = qnetd_algorithm_client_init(client);
+	if (res == -4) {
+		qnetd_log(LOG_ERR, "Decision algorithm failed to initialize client and client can't be "
+		    "attached back to previous algorithm. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	if (res != 0) {
+		res = qnetd_client_send_algorithm_init_err(client, msg, res);
+		client->decision_algorithm = old_decision_algorithm;
+
+		return (res == 0 ? 1 : -1);
+	}
+
+	if (qnetd_client_heartbeat_timer_restart(instance, client) != 0) {
+		qnetd_log(LOG_ERR, "Can't add heartbeat timeout timer. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Add client to cluster named in preinit (or init on implicit TLS connection) message. Returns
+ * 0 on success, 1 if error reply was sent, -1 on fatal error.
+ */
+static int
+qnetd_client_join_cluster(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+
+	if (client->cluster != NULL) {
+		/*
+		 * Client sent preinit again. Remove it from previous cluster.
+		 */
+		qnetd_client_leave_cluster(instance, client, 0);
+	}
+
+	if (qnetd_cluster_list_add_client(&instance->clusters, client, msg->cluster_name,
+	    msg->cluster_name_len) == NULL) {
+		qnetd_log(LOG_ERR, "Can't add client to cluster list. Sending error reply.");
 
 		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
 		    TLV_REPLY_ERROR_CODE_INTERNAL_ERROR) != 0) {
 			return (-1);
 		}
 
-		return (0);
+		return (1);
 	}
 
-	memcpy(client->cluster_name, msg->cluster_name, msg->cluster_name_len + 1);
-	client->cluster_name_len = msg->cluster_name_len;
 	client->preinit_received = 1;
 
+	return (0);
+}
+
+int
+qnetd_client_msg_received_preinit(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+	int res;
+
+	if (msg->cluster_name == NULL) {
+		qnetd_log(LOG_ERR, "Received preinit message without cluster name. Sending error reply.");
+
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_DOESNT_CONTAIN_REQUIRED_OPTION) != 0) {
+			return (-1);
+		}
+
+		return (0);
+	}
+
+	if ((res = qnetd_client_join_cluster(instance, client, msg)) != 0) {
+		return (res == -1 ? -1 : 0);
+	}
+
 	if (msg_create_preinit_reply(&client->send_buffer, msg->seq_number_set, msg->seq_number,
 	    instance->tls_supported, instance->tls_client_cert_required) == 0) {
 		qnetd_log(LOG_ERR, "Can't alloc preinit reply msg. Disconnecting client connection.");
@@ -221,7 +737,18 @@ qnetd_client_msg_received_starttls(struct qnetd_instance *instance, struct qnetd
 		return (0);
 	}
 
-	if ((new_pr_fd = nss_sock_start_ssl_as_server(client->socket, instance->server.cert,
+	if (client->tls_started) {
+		qnetd_log(LOG_ERR, "Received starttls on TLS connection. Sending error reply.");
+
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
+			return (-1);
+		}
+
+		return (0);
+	}
+
+	if ((new_pr_fd = nss_sock_start_ssl_as_server(qnetd_client_hot(client)->socket, instance->server.cert,
 	    instance->server.private_key, instance->tls_client_cert_required, 0, NULL)) == NULL) {
 		qnetd_log_nss(LOG_ERR, "Can't start TLS. Disconnecting client.");
 
@@ -230,7 +757,7 @@ qnetd_client_msg_received_starttls(struct qnetd_instance *instance, struct qnetd
 
 	client->tls_started = 1;
 	client->tls_peer_certificate_verified = 0;
-	client->socket = new_pr_fd;
+	qnetd_client_hot(client)->socket = new_pr_fd;
 
 	return (0);
 }
@@ -299,7 +826,7 @@ qnetd_client_check_tls(struct qnetd_instance *instance, struct qnetd_client *cli
 	}
 
 	if (check_certificate) {
-		peer_cert = SSL_PeerCertificate(client->socket);
+		peer_cert = SSL_PeerCertificate(qnetd_client_hot(client)->socket);
 
 		if (peer_cert == NULL) {
 			qnetd_log(LOG_ERR, "Client doesn't sent valid certificate. Disconnecting client");
@@ -332,12 +859,26 @@ qnetd_client_msg_received_init(struct qnetd_instance *instance, struct qnetd_cli
 	size_t no_supported_msgs;
 	enum tlv_opt_type *supported_opts;
 	size_t no_supported_opts;
+	struct qnetd_client *stale_client;
+	enum tlv_decision_algorithm_type supported_algorithms[QNETD_ALGORITHM_MAX_ALGORITHMS];
+	size_t no_supported_algorithms;
+	int options_set;
 
 	supported_msgs = NULL;
 	supported_opts = NULL;
 	no_supported_msgs = 0;
 	no_supported_opts = 0;
 
+	if (!client->preinit_received && client->tls_started && msg->cluster_name != NULL) {
+		/*
+		 * Implicit TLS connection. Preinit is skipped and cluster name is in init (it
+		 * must be known before client certificate is checked).
+		 */
+		if ((res = qnetd_client_join_cluster(instance, client, msg)) != 0) {
+			return (res == -1 ? -1 : 0);
+		}
+	}
+
 	if ((res = qnetd_client_check_tls(instance, client, msg)) != 0) {
 		return (res == -1 ? -1 : 0);
 	}
@@ -398,14 +939,69 @@ qnetd_client_msg_received_init(struct qnetd_instance *instance, struct qnetd_cli
 		tlv_get_supported_options(&supported_opts, &no_supported_opts);
 	}
 
-	client->node_id_set = 1;
-	client->node_id = msg->node_id;
+	if (qnetd_cluster_set_node_id(client->cluster, client, msg->node_id, &stale_client) != 0) {
+		qnetd_log(LOG_ERR, "Can't alloc node id map. Sending error reply.");
+
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_INTERNAL_ERROR) != 0) {
+			return (-1);
+		}
+
+		return (0);
+	}
+
+	if (stale_client != NULL) {
+		/*
+		 * Node reconnected before old connection timed out. Old connection is stale.
+		 */
+		qnetd_log(LOG_WARNING, "Client with node id %"PRIu32" already connected to cluster %s. "
+		    "Disconnecting stale connection.", msg->node_id, client->cluster_name);
+
+		qnetd_client_hot(stale_client)->schedule_disconnect = 1;
+		instance->clients_scheduled_for_disconnect = 1;
+	}
+
+	qnetd_cluster_client_init_received(client->cluster, client);
+
 	client->init_received = 1;
 
+	if (msg->credit_window_set && msg->credit_window > 0) {
+		/*
+		 * Client uses flow control for messages sent without request (vote info). Window
+		 * larger than send queue would only let queue overflow and disconnect client.
+		 */
+		client->credit_window = msg->credit_window;
+		if (client->credit_window > instance->max_client_send_queue_size) {
+			client->credit_window = instance->max_client_send_queue_size;
+		}
+		client->send_credit = client->credit_window;
+	}
+
+	if (msg->tlv_encoding_set) {
+		/*
+		 * Init reply is still in standard encoding, following messages use encoding
+		 * requested by client
+		 */
+		client->tlv_encoding = msg->tlv_encoding;
+	}
+
+	/*
+	 * Client may send options of set option message in init, so connection setup takes
+	 * one round trip less. Accepted options are echoed in init reply.
+	 */
+	options_set = (msg->decision_algorithm_set || msg->heartbeat_interval_set);
+	if (options_set && (res = qnetd_client_apply_options(instance, client, msg)) != 0) {
+		return (res == -1 ? -1 : 0);
+	}
+
+	qnetd_algorithm_get_supported(supported_algorithms, &no_supported_algorithms);
+
 	if (msg_create_init_reply(&client->send_buffer, msg->seq_number_set, msg->seq_number,
 	    supported_msgs, no_supported_msgs, supported_opts, no_supported_opts,
 	    instance->max_client_receive_size, instance->max_client_send_size,
-	    qnetd_static_supported_decision_algorithms, QNETD_STATIC_SUPPORTED_DECISION_ALGORITHMS_SIZE) == -1) {
+	    supported_algorithms, no_supported_algorithms, QNETD_CLIENT_REQUEST_WINDOW,
+	    options_set, client->decision_algorithm, options_set, client->heartbeat_interval,
+	    client->tlv_encoding) == -1) {
 		qnetd_log(LOG_ERR, "Can't alloc init reply msg. Disconnecting client connection.");
 
 		return (-1);
@@ -414,53 +1010,221 @@ qnetd_client_msg_received_init(struct qnetd_instance *instance, struct qnetd_cli
 	if (qnetd_client_net_schedule_send(client) != 0) {
 		qnetd_log(LOG_ERR, "Can't schedule send of init reply message. Disconnecting client connection.");
 
-		return (-1);
+		return (-1);
+	}
+
+	if (options_set) {
+		qnetd_cluster_send_vote_info(instance, client->cluster);
+	}
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_init_reply(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+	qnetd_log(LOG_ERR, "Received init reply. Sending back error message");
+
+	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_set_option_reply(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+	qnetd_log(LOG_ERR, "Received set option reply. Sending back error message");
+
+	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_set_option(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+	int res;
+
+	if ((res = qnetd_client_check_tls(instance, client, msg)) != 0) {
+		return (res == -1 ? -1 : 0);
+	}
+
+	if (!client->init_received) {
+		qnetd_log(LOG_ERR, "Received set option message before init message. Sending error reply.");
+
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_INIT_REQUIRED) != 0) {
+			return (-1);
+		}
+
+		return (0);
+	}
+
+	if ((res = qnetd_client_apply_options(instance, client, msg)) != 0) {
+		return (res == -1 ? -1 : 0);
+	}
+
+	if (msg_create_set_option_reply(&client->send_buffer, client->tlv_encoding,
+	    msg->seq_number_set, msg->seq_number, client->decision_algorithm,
+	    client->heartbeat_interval) == -1) {
+		qnetd_log(LOG_ERR, "Can't alloc set option reply msg. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	if (qnetd_client_net_schedule_send(client) != 0) {
+		qnetd_log(LOG_ERR, "Can't schedule send of set option reply message. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	qnetd_cluster_send_vote_info(instance, client->cluster);
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_echo_reply(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+	qnetd_log(LOG_ERR, "Received echo reply. Sending back error message");
+
+	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Process heartbeat (echo request or compact heartbeat) of initialized client and send reply
+ */
+static int
+qnetd_client_heartbeat_reply(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct rope *msg_orig)
+{
+	size_t res;
+
+	if (qnetd_client_heartbeat_timer_restart(instance, client) != 0) {
+		qnetd_log(LOG_ERR, "Can't add heartbeat timeout timer. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	if (qnetd_algorithm_heartbeat(client) != 0) {
+		qnetd_log(LOG_ERR, "Decision algorithm failed to process heartbeat. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	if (msg_rope_get_type(msg_orig) == MSG_TYPE_HEARTBEAT) {
+		res = msg_create_heartbeat_reply(&client->send_buffer, msg_orig);
+	} else {
+		res = msg_create_echo_reply(&client->send_buffer, msg_orig);
+	}
+
+	if (res == 0) {
+		qnetd_log(LOG_ERR, "Can't alloc echo reply msg. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	if (qnetd_client_net_schedule_send(client) != 0) {
+		qnetd_log(LOG_ERR, "Can't schedule send of echo reply message. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	qnetd_cluster_schedule_vote_info(instance, client->cluster);
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_echo_request(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg, const struct rope *msg_orig)
+{
+	int res;
+
+	if ((res = qnetd_client_check_tls(instance, client, msg)) != 0) {
+		return (res == -1 ? -1 : 0);
+	}
+
+	if (!client->init_received) {
+		qnetd_log(LOG_ERR, "Received echo request before init message. Sending error reply.");
+
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_INIT_REQUIRED) != 0) {
+			return (-1);
+		}
+
+		return (0);
 	}
 
-	return (0);
+	return (qnetd_client_heartbeat_reply(instance, client, msg_orig));
 }
 
-int
-qnetd_client_msg_received_init_reply(struct qnetd_instance *instance, struct qnetd_client *client,
-	const struct msg_decoded *msg)
+/*
+ * Update stored node list of client by full list or by delta. Returns 0 on success, 1 if
+ * delta doesn't apply to stored node list (client must send full list) and -1 on error.
+ */
+static int
+qnetd_client_update_node_list(struct qnetd_client *client, const struct msg_decoded *msg)
 {
-	qnetd_log(LOG_ERR, "Received init reply. Sending back error message");
 
-	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
-		return (-1);
+	if (!msg->node_list_base_epoch_set) {
+		if (node_list_set(&client->node_list, msg->node_list, msg->no_node_list) != 0) {
+			return (-1);
+		}
+
+		client->node_list_epoch_set = msg->node_list_epoch_set;
+		client->node_list_epoch = msg->node_list_epoch;
+
+		return (0);
 	}
 
-	return (0);
-}
+	if (!client->node_list_epoch_set || client->node_list_epoch != msg->node_list_base_epoch) {
+		return (1);
+	}
 
-int
-qnetd_client_msg_received_set_option_reply(struct qnetd_instance *instance, struct qnetd_client *client,
-	const struct msg_decoded *msg)
-{
-	qnetd_log(LOG_ERR, "Received set option reply. Sending back error message");
+	if (node_list_apply_delta(&client->node_list, msg->node_list_added, msg->no_node_list_added,
+	    msg->node_list_removed, msg->no_node_list_removed) != 0) {
+		/*
+		 * Stored list is no longer valid
+		 */
+		node_list_clean(&client->node_list);
+		client->node_list_epoch_set = 0;
 
-	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
 		return (-1);
 	}
 
+	client->node_list_epoch = msg->node_list_epoch;
+
 	return (0);
 }
 
 int
-qnetd_client_msg_received_set_option(struct qnetd_instance *instance, struct qnetd_client *client,
+qnetd_client_msg_received_node_list(struct qnetd_instance *instance, struct qnetd_client *client,
 	const struct msg_decoded *msg)
 {
 	int res;
-	size_t zi;
 
 	if ((res = qnetd_client_check_tls(instance, client, msg)) != 0) {
 		return (res == -1 ? -1 : 0);
 	}
 
 	if (!client->init_received) {
-		qnetd_log(LOG_ERR, "Received set option message before init message. Sending error reply.");
+		qnetd_log(LOG_ERR, "Received node list before init message. Sending error reply.");
 
 		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
 		    TLV_REPLY_ERROR_CODE_INIT_REQUIRED) != 0) {
@@ -470,87 +1234,81 @@ qnetd_client_msg_received_set_option(struct qnetd_instance *instance, struct qne
 		return (0);
 	}
 
-	if (msg->decision_algorithm_set) {
-		/*
-		 * Check if decision algorithm requested by client is supported
-		 */
-		res = 0;
-
-		for (zi = 0; zi < QNETD_STATIC_SUPPORTED_DECISION_ALGORITHMS_SIZE && !res; zi++) {
-			if (qnetd_static_supported_decision_algorithms[zi] == msg->decision_algorithm) {
-				res = 1;
-			}
-		}
-
-		if (!res) {
-			qnetd_log(LOG_ERR, "Client requested unsupported decision algorithm %u. Sending error reply.",
-			    msg->decision_algorithm);
-
-			if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-			    TLV_REPLY_ERROR_CODE_UNSUPPORTED_DECISION_ALGORITHM) != 0) {
-				return (-1);
-			}
+	if ((!msg->node_list_base_epoch_set && msg->node_list == NULL) ||
+	    (msg->node_list_base_epoch_set && !msg->node_list_epoch_set)) {
+		qnetd_log(LOG_ERR, "Received node list message without node list. Sending error reply.");
 
-			return (0);
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_DOESNT_CONTAIN_REQUIRED_OPTION) != 0) {
+			return (-1);
 		}
 
-		client->decision_algorithm = msg->decision_algorithm;
+		return (0);
 	}
 
-	if (msg->heartbeat_interval_set) {
+	if (!client->algorithm_attached) {
 		/*
-		 * Check if heartbeat interval is valid
+		 * Client didn't send set option. Use default decision algorithm.
 		 */
-		if (msg->heartbeat_interval != 0 && (msg->heartbeat_interval < QNETD_HEARTBEAT_INTERVAL_MIN ||
-		    msg->heartbeat_interval > QNETD_HEARTBEAT_INTERVAL_MAX)) {
-			qnetd_log(LOG_ERR, "Client requested invalid heartbeat interval %u. Sending error reply.",
-			    msg->heartbeat_interval);
-
-			if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-			    TLV_REPLY_ERROR_CODE_INVALID_HEARTBEAT_INTERVAL) != 0) {
-				return (-1);
-			}
-
-			return (0);
+		res = qnetd_algorithm_client_init(client);
+		if (res != 0) {
+			return (qnetd_client_send_algorithm_init_err(client, msg, res));
 		}
-
-		client->heartbeat_interval = msg->heartbeat_interval;
 	}
 
-	if (msg_create_set_option_reply(&client->send_buffer, msg->seq_number_set, msg->seq_number,
-	    client->decision_algorithm, client->heartbeat_interval) == -1) {
-		qnetd_log(LOG_ERR, "Can't alloc set option reply msg. Disconnecting client connection.");
+	res = qnetd_client_update_node_list(client, msg);
+	if (res == -1) {
+		qnetd_log(LOG_ERR, "Can't store node list. Disconnecting client connection.");
 
 		return (-1);
 	}
 
-	if (qnetd_client_net_schedule_send(client) != 0) {
-		qnetd_log(LOG_ERR, "Can't schedule send of set option reply message. Disconnecting client connection.");
+	if (res == 1) {
+		/*
+		 * Reply contains epoch server knows, so client sends full node list
+		 */
+		qnetd_log(LOG_DEBUG, "Node list delta with base epoch %"PRIu32" doesn't match. "
+		    "Requesting full node list.", msg->node_list_base_epoch);
+	} else if (qnetd_algorithm_membership_changed(client, client->node_list.node_ids,
+	    client->node_list.size) != 0) {
+		qnetd_log(LOG_ERR, "Decision algorithm failed to process node list. Disconnecting client connection.");
 
 		return (-1);
 	}
 
-	return (0);
-}
+	/*
+	 * Vote is part of reply
+	 */
+	client->vote_info_pending = 0;
+	client->reported_vote = client->vote;
 
-int
-qnetd_client_msg_received_echo_reply(struct qnetd_instance *instance, struct qnetd_client *client,
-	const struct msg_decoded *msg)
-{
-	qnetd_log(LOG_ERR, "Received echo reply. Sending back error message");
+	if (msg_create_node_list_reply(&client->send_buffer, client->tlv_encoding,
+	    msg->seq_number_set, msg->seq_number, client->node_list_epoch_set,
+	    client->node_list_epoch, client->vote) == 0) {
+		qnetd_log(LOG_ERR, "Can't alloc node list reply msg. Disconnecting client connection.");
 
-	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
-	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
 		return (-1);
 	}
 
+	if (qnetd_client_net_schedule_send(client) != 0) {
+		qnetd_log(LOG_ERR, "Can't schedule send of node list reply message. Disconnecting client connection.");
+
+		return (-1);
+	}
+
+	qnetd_cluster_schedule_vote_info(instance, client->cluster);
+
 	return (0);
 }
 
+/*
+ * Client gives credit for more vote info messages. Credit has no reply.
+ */
 int
-qnetd_client_msg_received_echo_request(struct qnetd_instance *instance, struct qnetd_client *client,
-	const struct msg_decoded *msg, const struct dynar *msg_orig)
+qnetd_client_msg_received_credit(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
 {
+	struct send_queue_msg *vote_msgs[QNETD_VOTE_MSGS_SIZE];
 	int res;
 
 	if ((res = qnetd_client_check_tls(instance, client, msg)) != 0) {
@@ -558,7 +1316,7 @@ qnetd_client_msg_received_echo_request(struct qnetd_instance *instance, struct q
 	}
 
 	if (!client->init_received) {
-		qnetd_log(LOG_ERR, "Received echo request before init message. Sending error reply.");
+		qnetd_log(LOG_ERR, "Received credit before init message. Sending error reply.");
 
 		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
 		    TLV_REPLY_ERROR_CODE_INIT_REQUIRED) != 0) {
@@ -568,15 +1326,49 @@ qnetd_client_msg_received_echo_request(struct qnetd_instance *instance, struct q
 		return (0);
 	}
 
-	if (msg_create_echo_reply(&client->send_buffer, msg_orig) == -1) {
-		qnetd_log(LOG_ERR, "Can't alloc echo reply msg. Disconnecting client connection.");
+	if (!msg->credit_set) {
+		qnetd_log(LOG_ERR, "Received credit message without credit. Sending error reply.");
 
-		return (-1);
+		if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+		    TLV_REPLY_ERROR_CODE_DOESNT_CONTAIN_REQUIRED_OPTION) != 0) {
+			return (-1);
+		}
+
+		return (0);
 	}
 
-	if (qnetd_client_net_schedule_send(client) != 0) {
-		qnetd_log(LOG_ERR, "Can't schedule send of echo reply message. Disconnecting client connection.");
+	if (client->credit_window == 0) {
+		/*
+		 * Client didn't ask for flow control
+		 */
+		return (0);
+	}
+
+	if (msg->credit > client->credit_window - client->send_credit) {
+		client->send_credit = client->credit_window;
+	} else {
+		client->send_credit += msg->credit;
+	}
+
+	/*
+	 * Send vote held back because of missing credit
+	 */
+	memset(vote_msgs, 0, sizeof(vote_msgs));
+	qnetd_client_queue_vote_info(instance, client, vote_msgs);
+	qnetd_vote_msgs_unref(vote_msgs);
+
+	return (0);
+}
+
+int
+qnetd_client_msg_received_unexpected(struct qnetd_instance *instance, struct qnetd_client *client,
+	const struct msg_decoded *msg)
+{
+
+	qnetd_log(LOG_ERR, "Received unexpected message %u. Sending back error message", msg->type);
 
+	if (qnetd_client_send_err(client, msg->seq_number_set, msg->seq_number,
+	    TLV_REPLY_ERROR_CODE_UNEXPECTED_MESSAGE) != 0) {
 		return (-1);
 	}
 
@@ -591,8 +1383,9 @@ qnetd_client_msg_received(struct qnetd_instance *instance, struct qnetd_client *
 	int ret_val;
 
 	msg_decoded_init(&msg);
+	msg_decoded_set_arena(&msg, &instance->msg_arena);
 
-	res = msg_decode(&client->receive_buffer, &msg);
+	res = msg_decode_rope(&client->receive_buffer, &client->msg_decoder, &msg);
 	if (res != 0) {
 		/*
 		 * Error occurred. Send server error.
@@ -608,6 +1401,14 @@ qnetd_client_msg_received(struct qnetd_instance *instance, struct qnetd_client *
 		return (0);
 	}
 
+	/*
+	 * Fast path for compact heartbeat of initialized client (TLS was already checked when
+	 * init was received). Fixed layout message owns no decoded memory.
+	 */
+	if (client->init_received && msg.type == MSG_TYPE_HEARTBEAT) {
+		return (qnetd_client_heartbeat_reply(instance, client, &client->receive_buffer));
+	}
+
 	ret_val = 0;
 
 	switch (msg.type) {
@@ -636,11 +1437,23 @@ qnetd_client_msg_received(struct qnetd_instance *instance, struct qnetd_client *
 		ret_val = qnetd_client_msg_received_set_option_reply(instance, client, &msg);
 		break;
 	case MSG_TYPE_ECHO_REQUEST:
+	case MSG_TYPE_HEARTBEAT:
 		ret_val = qnetd_client_msg_received_echo_request(instance, client, &msg, &client->receive_buffer);
 		break;
 	case MSG_TYPE_ECHO_REPLY:
 		ret_val = qnetd_client_msg_received_echo_reply(instance, client, &msg);
 		break;
+	case MSG_TYPE_NODE_LIST:
+		ret_val = qnetd_client_msg_received_node_list(instance, client, &msg);
+		break;
+	case MSG_TYPE_CREDIT:
+		ret_val = qnetd_client_msg_received_credit(instance, client, &msg);
+		break;
+	case MSG_TYPE_NODE_LIST_REPLY:
+	case MSG_TYPE_VOTE_INFO:
+	case MSG_TYPE_HEARTBEAT_REPLY:
+		ret_val = qnetd_client_msg_received_unexpected(instance, client, &msg);
+		break;
 	default:
 		qnetd_log(LOG_ERR, "Unsupported message %u received from client. Sending back error message",
 		    msg.type);
@@ -672,15 +1485,42 @@ qnetd_client_net_write_finished(struct qnetd_instance *instance, struct qnetd_cl
 int
 qnetd_client_net_write(struct qnetd_instance *instance, struct qnetd_client *client)
 {
+	struct qnetd_client_hot *hot;
+	struct send_queue_msg *shared_msg;
 	int res;
 
-	res = msgio_write(client->socket, &client->send_buffer, &client->msg_already_sent_bytes);
+	hot = qnetd_client_hot(client);
 
-	if (res == 1) {
-		client->sending_msg = 0;
+	/*
+	 * Messages are sent in order they were scheduled. Shared messages queued before
+	 * send_buffer was filled go first.
+	 */
+	if (hot->sending_msg && client->send_queue_before_msg == 0) {
+		res = msgio_write(hot->socket, &client->send_buffer, &hot->msg_already_sent_bytes);
 
-		if (qnetd_client_net_write_finished(instance, client) == -1) {
-			return (-1);
+		if (res == 1) {
+			hot->sending_msg = 0;
+
+			if (qnetd_client_net_write_finished(instance, client) == -1) {
+				return (-1);
+			}
+		}
+	} else {
+		shared_msg = send_queue_first(&client->send_queue);
+		if (shared_msg == NULL) {
+			return (0);
+		}
+
+		res = msgio_write(hot->socket, &shared_msg->buffer,
+		    &client->send_queue.msg_already_sent_bytes);
+
+		if (res == 1) {
+			send_queue_del_first(&client->send_queue);
+			hot->send_queue_pending = !send_queue_is_empty(&client->send_queue);
+
+			if (hot->sending_msg) {
+				client->send_queue_before_msg--;
+			}
 		}
 	}
 
@@ -706,17 +1546,19 @@ qnetd_client_net_write(struct qnetd_instance *instance, struct qnetd_client *cli
 int
 qnetd_client_net_read(struct qnetd_instance *instance, struct qnetd_client *client)
 {
+	struct qnetd_client_hot *hot;
 	int res;
 	int ret_val;
 	int orig_skipping_msg;
 
-	orig_skipping_msg = client->skipping_msg;
+	hot = qnetd_client_hot(client);
+	orig_skipping_msg = hot->skipping_msg;
 
-	res = msgio_read(client->socket, &client->receive_buffer, &client->msg_already_received_bytes,
-	    &client->skipping_msg);
+	res = msgio_read_rope(hot->socket, &client->receive_buffer, &hot->msg_already_received_bytes,
+	    &hot->skipping_msg);
 
-	if (!orig_skipping_msg && client->skipping_msg) {
-		qnetd_log(LOG_DEBUG, "msgio_read set skipping_msg");
+	if (!orig_skipping_msg && hot->skipping_msg) {
+		qnetd_log(LOG_DEBUG, "msgio_read_rope set skipping_msg");
 	}
 
 	ret_val = 0;
@@ -745,82 +1587,182 @@ qnetd_client_net_read(struct qnetd_instance *instance, struct qnetd_client *clie
 		break;
 	case -5:
 		qnetd_log(LOG_WARNING, "Client sent unsupported msg type %u. Skipping message",
-			    msg_get_type(&client->receive_buffer));
+			    msg_rope_get_type(&client->receive_buffer));
 		client->skipping_msg_reason = TLV_REPLY_ERROR_CODE_UNSUPPORTED_MESSAGE;
 		break;
 	case -6:
 		qnetd_log(LOG_WARNING,
 		    "Client wants to send too long message %u bytes. Skipping message",
-		    msg_get_len(&client->receive_buffer));
+		    msg_rope_get_len(&client->receive_buffer));
 		client->skipping_msg_reason = TLV_REPLY_ERROR_CODE_MESSAGE_TOO_LONG;
 		break;
 	case 1:
 		/*
 		 * Full message received / skipped
 		 */
-		if (!client->skipping_msg) {
+		if (!hot->skipping_msg) {
 			if (qnetd_client_msg_received(instance, client) == -1) {
 				ret_val = -1;
 			}
+
+			arena_reset(&instance->msg_arena);
 		} else {
 			if (qnetd_client_send_err(client, 0, 0, client->skipping_msg_reason) != 0) {
 				ret_val = -1;
 			}
 		}
 
-		client->skipping_msg = 0;
+		hot->skipping_msg = 0;
 		client->skipping_msg_reason = TLV_REPLY_ERROR_CODE_NO_ERROR;
-		client->msg_already_received_bytes = 0;
-		dynar_clean(&client->receive_buffer);
+		hot->msg_already_received_bytes = 0;
+		rope_clean(&client->receive_buffer);
 		break;
 	default:
-		errx(1, "Unhandled msgio_read error %d\n", res);
+		errx(1, "Unhandled msgio_read_rope error %d\n", res);
 		break;
 	}
 
 	return (ret_val);
 }
 
+/*
+ * Accept pending connections until listening socket would block or max_accepts_per_poll
+ * connections are accepted (so flood of new connections cannot starve existing clients).
+ *
+ *  0 - Success
+ * -1 - Error during accept
+ * -2 - Can't add client to list
+ */
 int
-qnetd_client_accept(struct qnetd_instance *instance)
+qnetd_client_accept(struct qnetd_instance *instance, PRFileDesc *listen_socket, int implicit_tls)
 {
 	PRNetAddr client_addr;
 	PRFileDesc *client_socket;
+	PRFileDesc *new_pr_fd;
 	struct qnetd_client *client;
+	unsigned int accepted;
+
+	for (accepted = 0; accepted < instance->max_accepts_per_poll; accepted++) {
+		if ((client_socket = PR_Accept(listen_socket, &client_addr,
+		    PR_INTERVAL_NO_TIMEOUT)) == NULL) {
+			if (PR_GetError() == PR_WOULD_BLOCK_ERROR) {
+				/*
+				 * All pending connections accepted
+				 */
+				break;
+			}
 
-        if ((client_socket = PR_Accept(instance->server.socket, &client_addr, PR_INTERVAL_NO_TIMEOUT)) == NULL) {
-		qnetd_log_nss(LOG_ERR, "Can't accept connection");
-		return (-1);
-	}
+			qnetd_log_nss(LOG_ERR, "Can't accept connection");
+			return (-1);
+		}
 
-	if (nss_sock_set_nonblocking(client_socket) != 0) {
-		qnetd_log_nss(LOG_ERR, "Can't set client socket to non blocking mode");
-		return (-1);
-	}
+		if (nss_sock_set_nonblocking(client_socket) != 0) {
+			qnetd_log_nss(LOG_ERR, "Can't set client socket to non blocking mode");
+			PR_Close(client_socket);
 
-	client = qnetd_clients_list_add(&instance->clients, client_socket, &client_addr,
-	    instance->max_client_receive_size, instance->max_client_send_size);
-	if (client == NULL) {
-		qnetd_log(LOG_ERR, "Can't add client to list");
-		return (-2);
+			continue ;
+		}
+
+		if (implicit_tls) {
+			/*
+			 * TLS starts right away. Handshake is completed during first read.
+			 */
+			if ((new_pr_fd = nss_sock_start_ssl_as_server(client_socket, instance->server.cert,
+			    instance->server.private_key, instance->tls_client_cert_required, 0,
+			    NULL)) == NULL) {
+				qnetd_log_nss(LOG_ERR, "Can't start TLS on implicit TLS connection");
+				PR_Close(client_socket);
+
+				continue ;
+			}
+
+			client_socket = new_pr_fd;
+		}
+
+		client = qnetd_clients_list_add(&instance->clients, &instance->client_slots,
+		    client_socket, &client_addr, &instance->receive_chunk_pool,
+		    instance->max_client_receive_size, instance->max_client_send_size,
+		    instance->max_client_send_queue_size);
+		if (client == NULL) {
+			qnetd_log(LOG_ERR, "Can't add client to list");
+			PR_Close(client_socket);
+
+			return (-2);
+		}
+
+		client->tls_started = implicit_tls;
 	}
 
 	return (0);
 }
 
 void
-qnetd_client_disconnect(struct qnetd_instance *instance, struct qnetd_client *client)
+qnetd_client_disconnect(struct qnetd_instance *instance, struct qnetd_client *client,
+    int server_going_down)
 {
 
-	PR_Close(client->socket);
+	PR_Close(qnetd_client_hot(client)->socket);
+
+	qnetd_client_hot(client)->schedule_disconnect = 0;
+
+	if (client->heartbeat_timeout_timer != NULL) {
+		timer_list_delete(&instance->main_timer_list, client->heartbeat_timeout_timer);
+		client->heartbeat_timeout_timer = NULL;
+	}
+
+	if (client->cluster != NULL) {
+		qnetd_client_leave_cluster(instance, client, server_going_down);
+	}
+
 	qnetd_clients_list_del(&instance->clients, client);
 }
 
+static int
+qnetd_accept_backoff_timer_callback(void *data1, void *data2)
+{
+	struct qnetd_instance *instance;
+
+	instance = (struct qnetd_instance *)data1;
+
+	instance->accept_backoff_timer = NULL;
+
+	qnetd_log(LOG_INFO, "Resuming accepting of new connections");
+
+	return (0);
+}
+
+/*
+ * Stop polling listening sockets for QNETD_ACCEPT_ERROR_BACKOFF ms
+ */
+static void
+qnetd_accept_backoff(struct qnetd_instance *instance)
+{
+
+	if (instance->accept_backoff_timer != NULL) {
+		return ;
+	}
+
+	instance->accept_backoff_timer = timer_list_add(&instance->main_timer_list,
+	    QNETD_ACCEPT_ERROR_BACKOFF, qnetd_accept_backoff_timer_callback, (void *)instance, NULL);
+
+	if (instance->accept_backoff_timer == NULL) {
+		qnetd_log(LOG_ERR, "Can't add accept backoff timer");
+
+		return ;
+	}
+
+	qnetd_log(LOG_WARNING, "Can't accept new connection. Pausing accepting of new "
+	    "connections for %u ms", QNETD_ACCEPT_ERROR_BACKOFF);
+}
+
 int
 qnetd_poll(struct qnetd_instance *instance)
 {
 	struct qnetd_client *client;
-	struct qnetd_client *client_next;
+	struct qnetd_client_hot *hot;
+	PRFileDesc *listen_sockets[2];
+	unsigned int no_listen_sockets;
+	unsigned int slot;
 	PRPollDesc *pfds;
 	PRInt32 poll_res;
 	int i;
@@ -829,37 +1771,58 @@ qnetd_poll(struct qnetd_instance *instance)
 	client = NULL;
 	client_disconnect = 0;
 
-	pfds = qnetd_poll_array_create_from_clients_list(&instance->poll_array,
-	    &instance->clients, instance->server.socket, PR_POLL_READ);
+	no_listen_sockets = 0;
+	listen_sockets[no_listen_sockets++] = instance->server.socket;
+	if (instance->server.tls_socket != NULL) {
+		listen_sockets[no_listen_sockets++] = instance->server.tls_socket;
+	}
+
+	/*
+	 * Slots released in previous iteration are removed, so poll array item
+	 * i + no_listen_sockets belongs to slot i
+	 */
+	qnetd_client_slots_compact(&instance->client_slots);
+
+	/*
+	 * Listening sockets stay in poll array (so indexes don't change), but without events
+	 * while accept is paused
+	 */
+	pfds = qnetd_poll_array_create_from_client_slots(&instance->poll_array,
+	    &instance->client_slots, listen_sockets, no_listen_sockets,
+	    (instance->accept_backoff_timer == NULL ? PR_POLL_READ : 0));
 
 	if (pfds == NULL) {
 		return (-1);
 	}
 
 	if ((poll_res = PR_Poll(pfds, qnetd_poll_array_size(&instance->poll_array),
-	    PR_INTERVAL_NO_TIMEOUT)) > 0) {
+	    timer_list_time_to_expire(&instance->main_timer_list))) > 0) {
 		/*
 		 * Walk thru pfds array and process events
 		 */
 		for (i = 0; i < qnetd_poll_array_size(&instance->poll_array); i++) {
-			/*
-			 * Also traverse clients list
-			 */
-			if (i > 0) {
-				if (i == 1) {
-					client = TAILQ_FIRST(&instance->clients);
-					client_next = TAILQ_NEXT(client, entries);
-				} else {
-					client = client_next;
-					client_next = TAILQ_NEXT(client, entries);
+			client = NULL;
+			client_disconnect = 0;
+
+			if (i >= no_listen_sockets) {
+				/*
+				 * Slot is released when client was disconnected during this iteration
+				 */
+				hot = qnetd_client_slots_get(&instance->client_slots, i - no_listen_sockets);
+				if (hot->client == NULL) {
+					continue ;
 				}
-			}
 
-			client_disconnect = 0;
+				client = hot->client;
+				client_disconnect = hot->schedule_disconnect;
+			}
 
 			if (!client_disconnect && pfds[i].out_flags & PR_POLL_READ) {
-				if (i == 0) {
-					qnetd_client_accept(instance);
+				if (i < no_listen_sockets) {
+					if (qnetd_client_accept(instance, listen_sockets[i],
+					    listen_sockets[i] == instance->server.tls_socket) != 0) {
+						qnetd_accept_backoff(instance);
+					}
 				} else {
 					if (qnetd_client_net_read(instance, client) == -1) {
 						client_disconnect = 1;
@@ -868,7 +1831,7 @@ qnetd_poll(struct qnetd_instance *instance)
 			}
 
 			if (!client_disconnect && pfds[i].out_flags & PR_POLL_WRITE) {
-				if (i == 0) {
+				if (i < no_listen_sockets) {
 					/*
 					 * Poll write on listen socket -> fatal error
 					 */
@@ -884,7 +1847,7 @@ qnetd_poll(struct qnetd_instance *instance)
 
 			if (!client_disconnect &&
 			    pfds[i].out_flags & (PR_POLL_ERR|PR_POLL_NVAL|PR_POLL_HUP|PR_POLL_EXCEPT)) {
-				if (i == 0) {
+				if (i < no_listen_sockets) {
 					if (pfds[i].out_flags != PR_POLL_NVAL) {
 						/*
 						 * Poll ERR on listening socket is fatal error. POLL_NVAL is
@@ -909,7 +1872,25 @@ qnetd_poll(struct qnetd_instance *instance)
 			 * If client is scheduled for disconnect, disconnect it
 			 */
 			if (client_disconnect) {
-				qnetd_client_disconnect(instance, client);
+				qnetd_client_disconnect(instance, client, 0);
+			}
+		}
+	}
+
+	timer_list_expire(&instance->main_timer_list);
+
+	/*
+	 * Disconnect rest of clients scheduled for disconnect (stale connections replaced
+	 * by other client or clients whose timer failed)
+	 */
+	if (instance->clients_scheduled_for_disconnect) {
+		instance->clients_scheduled_for_disconnect = 0;
+
+		for (slot = 0; slot < qnetd_client_slots_size(&instance->client_slots); slot++) {
+			hot = qnetd_client_slots_get(&instance->client_slots, slot);
+
+			if (hot->client != NULL && hot->schedule_disconnect) {
+				qnetd_client_disconnect(instance, hot->client, 0);
 			}
 		}
 	}
@@ -936,16 +1917,29 @@ qnetd_instance_init_certs(struct qnetd_instance *instance)
 
 int
 qnetd_instance_init(struct qnetd_instance *instance, size_t max_client_receive_size,
-    size_t max_client_send_size, enum tlv_tls_supported tls_supported, int tls_client_cert_required)
+    size_t max_client_send_size, size_t max_client_send_queue_size,
+    enum tlv_tls_supported tls_supported, int tls_client_cert_required,
+    unsigned int max_accepts_per_poll)
 {
 
 	memset(instance, 0, sizeof(*instance));
 
 	qnetd_poll_array_init(&instance->poll_array);
 	qnetd_clients_list_init(&instance->clients);
+	qnetd_client_slots_init(&instance->client_slots);
+	rope_chunk_pool_init(&instance->receive_chunk_pool, QNETD_RECEIVE_CHUNK_SIZE,
+	    QNETD_MAX_FREE_RECEIVE_CHUNKS);
+	arena_init(&instance->msg_arena, QNETD_MSG_ARENA_BLOCK_SIZE);
+	timer_list_init(&instance->main_timer_list);
+
+	if (qnetd_cluster_list_init(&instance->clusters) != 0) {
+		return (-1);
+	}
 
 	instance->max_client_receive_size = max_client_receive_size;
 	instance->max_client_send_size = max_client_send_size;
+	instance->max_client_send_queue_size = max_client_send_queue_size;
+	instance->max_accepts_per_poll = max_accepts_per_poll;
 
 	instance->tls_supported = tls_supported;
 	instance->tls_client_cert_required = tls_client_cert_required;
@@ -963,13 +1957,18 @@ qnetd_instance_destroy(struct qnetd_instance *instance)
 	while (client != NULL) {
 		client_next = TAILQ_NEXT(client, entries);
 
-		qnetd_client_disconnect(instance, client);
+		qnetd_client_disconnect(instance, client, 1);
 
 		client = client_next;
 	}
 
 	qnetd_poll_array_destroy(&instance->poll_array);
 	qnetd_clients_list_free(&instance->clients);
+	qnetd_client_slots_destroy(&instance->client_slots);
+	rope_chunk_pool_destroy(&instance->receive_chunk_pool);
+	arena_destroy(&instance->msg_arena);
+	qnetd_cluster_list_free(&instance->clusters);
+	timer_list_free(&instance->main_timer_list);
 
 	return (0);
 }
@@ -995,10 +1994,59 @@ signal_handlers_register(void)
 	sigaction(SIGINT, &act, NULL);
 }
 
+static void
+usage(void)
+{
+
+	printf("usage: %s [-t] [-b listen_backlog]\n", QNETD_PROGRAM_NAME);
+	printf("  -t  also listen on port %u where TLS starts without STARTTLS exchange\n",
+	    QNETD_TLS_PORT);
+}
+
+static void
+cli_parse(int argc, char * const argv[], int *listen_backlog, int *implicit_tls)
+{
+	long int tmpli;
+	int ch;
+	char *ep;
+
+	*listen_backlog = QNETD_LISTEN_BACKLOG;
+	*implicit_tls = 0;
+
+	while ((ch = getopt(argc, argv, "b:ht")) != -1) {
+		switch (ch) {
+		case 'b':
+			errno = 0;
+			tmpli = strtol(optarg, &ep, 10);
+			if (errno != 0 || tmpli <= 0 || tmpli > INT_MAX || *ep != '\0') {
+				errx(1, "listen backlog must be positive number");
+			}
+			*listen_backlog = (int)tmpli;
+			break;
+		case 't':
+			*implicit_tls = 1;
+			break;
+		case 'h':
+		case '?':
+			usage();
+			exit(1);
+			break;
+		}
+	}
+}
+
 int
-main(void)
+main(int argc, char *argv[])
 {
 	struct qnetd_instance instance;
+	int listen_backlog;
+	int implicit_tls;
+
+	cli_parse(argc, argv, &listen_backlog, &implicit_tls);
+
+	if (implicit_tls && QNETD_TLS_SUPPORTED == TLV_TLS_UNSUPPORTED) {
+		errx(1, "Implicit TLS listener can't be used when TLS is unsupported");
+	}
 
 	/*
 	 * INIT
@@ -1006,6 +2054,11 @@ main(void)
 	qnetd_log_init(QNETD_LOG_TARGET_STDERR);
 	qnetd_log_set_debug(1);
 
+	if (qnetd_algo_test_register() != 0 || qnetd_algo_ffsplit_register() != 0 ||
+	    qnetd_algo_lms_register() != 0) {
+		errx(1, "Can't register decision algorithms");
+	}
+
 	if (nss_sock_init_nss(NSS_DB_DIR) != 0) {
 		qnetd_err_nss();
 	}
@@ -1015,7 +2068,7 @@ main(void)
 	}
 
 	if (qnetd_instance_init(&instance, QNETD_MAX_CLIENT_RECEIVE_SIZE, QNETD_MAX_CLIENT_SEND_SIZE,
-	    QNETD_TLS_SUPPORTED, QNETD_TLS_CLIENT_CERT_REQUIRED) == -1) {
+	    QNETD_MAX_CLIENT_SEND_QUEUE_SIZE, QNETD_TLS_SUPPORTED, QNETD_TLS_CLIENT_CERT_REQUIRED, QNETD_MAX_ACCEPTS_PER_POLL) == -1) {
 		errx(1, "Can't initialize qnetd");
 	}
 
@@ -1023,7 +2076,8 @@ main(void)
 		qnetd_err_nss();
 	}
 
-	instance.server.socket = nss_sock_create_listen_socket(QNETD_HOST, QNETD_PORT, PR_AF_INET6);
+	instance.server.socket = nss_sock_create_listen_socket(QNETD_HOST, QNETD_PORT, PR_AF_INET6,
+	    QNETD_DEFER_ACCEPT_TIMEOUT);
 	if (instance.server.socket == NULL) {
 		qnetd_err_nss();
 	}
@@ -1032,10 +2086,26 @@ main(void)
 		qnetd_err_nss();
 	}
 
-	if (PR_Listen(instance.server.socket, QNETD_LISTEN_BACKLOG) != PR_SUCCESS) {
+	if (PR_Listen(instance.server.socket, listen_backlog) != PR_SUCCESS) {
 		qnetd_err_nss();
 	}
 
+	if (implicit_tls) {
+		instance.server.tls_socket = nss_sock_create_listen_socket(QNETD_HOST, QNETD_TLS_PORT,
+		    PR_AF_INET6, QNETD_DEFER_ACCEPT_TIMEOUT);
+		if (instance.server.tls_socket == NULL) {
+			qnetd_err_nss();
+		}
+
+		if (nss_sock_set_nonblocking(instance.server.tls_socket) != 0) {
+			qnetd_err_nss();
+		}
+
+		if (PR_Listen(instance.server.tls_socket, listen_backlog) != PR_SUCCESS) {
+			qnetd_err_nss();
+		}
+	}
+
 	global_server_socket = instance.server.socket;
 	signal_handlers_register();
 
@@ -1048,6 +2118,10 @@ main(void)
 	/*
 	 * Cleanup
 	 */
+	if (instance.server.tls_socket != NULL) {
+		PR_Close(instance.server.tls_socket);
+	}
+
 	CERT_DestroyCertificate(instance.server.cert);
 	SECKEY_DestroyPrivateKey(instance.server.private_key);
 
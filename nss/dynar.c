@@ -9,7 +9,12 @@ void
 dynar_init(struct dynar *array, size_t maximum_size)
 {
 
-	memset(array, 0, sizeof(*array));
+	/*
+	 * inline_data is not cleared, there is no need to touch it
+	 */
+	array->data = NULL;
+	array->size = 0;
+	array->allocated = DYNAR_INLINE_SIZE;
 	array->maximum_size = maximum_size;
 }
 
@@ -53,6 +58,10 @@ char *
 dynar_data(const struct dynar *array)
 {
 
+	if (array->data == NULL) {
+		return ((char *)array->inline_data);
+	}
+
 	return (array->data);
 }
 
@@ -71,14 +80,26 @@ dynar_realloc(struct dynar *array, size_t new_array_size)
 		return (-1);
 	}
 
+	if (array->data == NULL) {
+		/*
+		 * Move data out of inline storage
+		 */
+		memcpy(new_data, array->inline_data, array->size);
+	}
+
 	array->allocated = new_array_size;
 	array->data = new_data;
 
 	return (0);
 }
 
+/*
+ * Append size bytes to array and store pointer to them in grown_data, so caller can fill
+ * them without intermediate buffer. Returns 0 on success or -1 if array would exceed
+ * maximum size or on alloc failure.
+ */
 int
-dynar_cat(struct dynar *array, const void *src, size_t size)
+dynar_grow(struct dynar *array, size_t size, char **grown_data)
 {
 	size_t new_size;
 
@@ -97,8 +118,22 @@ dynar_cat(struct dynar *array, const void *src, size_t size)
 		}
 	}
 
-	memmove(array->data + array->size, src, size);
+	*grown_data = dynar_data(array) + array->size;
 	array->size += size;
 
 	return (0);
 }
+
+int
+dynar_cat(struct dynar *array, const void *src, size_t size)
+{
+	char *dst;
+
+	if (dynar_grow(array, size, &dst) == -1) {
+		return (-1);
+	}
+
+	memmove(dst, src, size);
+
+	return (0);
+}
@@ -9,13 +9,22 @@ extern "C" {
 #endif
 
 /*
- * Dynamic array structure
+ * Size of storage inside of structure. It's used until data outgrow it, so most small
+ * messages never touch heap.
+ */
+#define DYNAR_INLINE_SIZE	128
+
+/*
+ * Dynamic array structure. Inline storage is selected by data == NULL (not by pointer to
+ * inline_data), so moved structure stays valid. Copy is not independent once data is on
+ * heap (both copies own same buffer), so structure must not be copied while in use.
  */
 struct dynar {
-	char *data;
+	char *data;		// Heap storage. NULL while inline_data is used
 	size_t size;
 	size_t allocated;
 	size_t maximum_size;
+	char inline_data[DYNAR_INLINE_SIZE];
 };
 
 extern void	 dynar_init(struct dynar *array, size_t maximum_size);
@@ -34,6 +43,8 @@ extern char	*dynar_data(const struct dynar *array);
 
 extern int	 dynar_cat(struct dynar *array, const void *src, size_t size);
 
+extern int	 dynar_grow(struct dynar *array, size_t size, char **grown_data);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "msg.h"
+
+#define TEST_NO_NODES		1000
+#define TEST_MAX_CHUNK		40
+
+static int
+option_cb(struct tlv_iterator *tlv_iter, void *user_data)
+{
+
+	return (msg_decode_option(tlv_iter, (struct msg_decoded *)user_data));
+}
+
+/*
+ * Feed msg to decoder in parts. First part is first_len bytes long, rest is fed in chunks of
+ * chunk_len bytes. Returns result of last msg_decoder_feed call.
+ */
+static int
+feed_msg(const struct dynar *msg, size_t first_len, size_t chunk_len, struct msg_decoded *decoded_msg)
+{
+	struct msg_decoder decoder;
+	size_t pos;
+	size_t to_feed;
+	int res;
+
+	msg_decoder_init(&decoder, 1 << 20);
+
+	res = 0;
+	pos = 0;
+
+	while (pos < dynar_size(msg) && res == 0) {
+		to_feed = (pos == 0 ? first_len : chunk_len);
+		if (to_feed > msg_decoder_get_remaining(&decoder)) {
+			to_feed = msg_decoder_get_remaining(&decoder);
+		}
+
+		if (to_feed > dynar_size(msg) - pos) {
+			to_feed = dynar_size(msg) - pos;
+		}
+
+		res = msg_decoder_feed(&decoder, dynar_data(msg) + pos, to_feed, option_cb, decoded_msg);
+		pos += to_feed;
+	}
+
+	if (res == 1) {
+		assert(pos == dynar_size(msg));
+		assert(msg_decoder_finish(&decoder, decoded_msg) == 0);
+	}
+
+	msg_decoder_destroy(&decoder);
+
+	return (res);
+}
+
+/*
+ * Incrementally decoded msg must be same as msg decoded at once
+ */
+static void
+check_msg(const struct dynar *msg, size_t first_len, size_t chunk_len)
+{
+	struct msg_decoded decoded_msg;
+	struct msg_decoded expected_msg;
+
+	msg_decoded_init(&decoded_msg);
+	msg_decoded_init(&expected_msg);
+
+	assert(feed_msg(msg, first_len, chunk_len, &decoded_msg) == 1);
+	assert(msg_decode(msg, &expected_msg) == 0);
+
+	assert(decoded_msg.type == expected_msg.type);
+	assert(decoded_msg.seq_number == expected_msg.seq_number);
+	assert(decoded_msg.vote == expected_msg.vote);
+	assert(decoded_msg.node_list_epoch == expected_msg.node_list_epoch);
+	assert(decoded_msg.heartbeat_timestamp == expected_msg.heartbeat_timestamp);
+	assert(decoded_msg.no_node_list == expected_msg.no_node_list);
+	assert(decoded_msg.no_node_list == 0 || memcmp(decoded_msg.node_list, expected_msg.node_list,
+	    sizeof(*decoded_msg.node_list) * decoded_msg.no_node_list) == 0);
+
+	msg_decoded_destroy(&decoded_msg);
+	msg_decoded_destroy(&expected_msg);
+}
+
+static void
+check_msg_all_splits(const struct dynar *msg)
+{
+	size_t zi;
+
+	/*
+	 * Split at every position. Rest of message is fed at once, so option header split in first
+	 * part is completed byte by byte from bigger buffer.
+	 */
+	for (zi = 1; zi <= dynar_size(msg); zi++) {
+		check_msg(msg, zi, dynar_size(msg));
+	}
+
+	for (zi = 1; zi <= TEST_MAX_CHUNK; zi++) {
+		check_msg(msg, zi, zi);
+	}
+}
+
+static int
+decode_raw(const unsigned char *data, size_t data_len)
+{
+	struct msg_decoded decoded_msg;
+	struct dynar msg;
+	int res;
+
+	dynar_init(&msg, data_len);
+	assert(dynar_cat(&msg, (const char *)data, data_len) == 0);
+
+	msg_decoded_init(&decoded_msg);
+	res = msg_decode(&msg, &decoded_msg);
+	msg_decoded_destroy(&decoded_msg);
+
+	dynar_destroy(&msg);
+
+	return (res);
+}
+
+static int
+feed_raw(const unsigned char *data, size_t data_len, size_t chunk_len)
+{
+	struct msg_decoded decoded_msg;
+	struct dynar msg;
+	int res;
+
+	dynar_init(&msg, data_len);
+	assert(dynar_cat(&msg, (const char *)data, data_len) == 0);
+
+	msg_decoded_init(&decoded_msg);
+	res = feed_msg(&msg, chunk_len, chunk_len, &decoded_msg);
+	msg_decoded_destroy(&decoded_msg);
+
+	dynar_destroy(&msg);
+
+	return (res);
+}
+
+int
+main(void)
+{
+	/*
+	 * Node list messages (type 10) with option longer than message. Second message starts
+	 * with valid unknown option.
+	 */
+	const unsigned char opt_past_end[] = {0x00, 0x0a, 0, 0, 0, 6, 0, 0, 0, 4, 1, 2};
+	const unsigned char opt_header_past_end[] = {0x00, 0x0a, 0, 0, 0, 3, 0, 0, 0};
+	const unsigned char opt_past_end2[] = {0x00, 0x0a, 0, 0, 0, 11, 0, 0x63, 0, 1, 0,
+	    0, 0, 0, 4, 1, 2};
+	/*
+	 * Heartbeats (type 14) with trailing byte, truncated varint and too long body
+	 */
+	const unsigned char hb_trailing[] = {0x00, 0x0e, 0, 0, 0, 3, 0x05, 0x63, 0x00};
+	const unsigned char hb_truncated[] = {0x00, 0x0e, 0, 0, 0, 2, 0x05, 0x80};
+	const unsigned char hb_too_long[] = {0x00, 0x0e, 0, 0, 0, 11, 0x80, 0x80, 0x80, 0x80, 0x01,
+	    0x80, 0x80, 0x80, 0x80, 0x01, 0x00};
+	struct msg_decoded decoded_msg;
+	uint32_t nodes[TEST_NO_NODES];
+	struct dynar msg;
+	size_t zi;
+	int encoding;
+
+	for (zi = 0; zi < TEST_NO_NODES; zi++) {
+		nodes[zi] = zi * 7919;
+	}
+
+	dynar_init(&msg, 1 << 20);
+
+	for (encoding = TLV_ENCODING_STANDARD; encoding <= TLV_ENCODING_COMPACT; encoding++) {
+		/*
+		 * Node list option is longer than 127 bytes, so compact length is multi-byte varint
+		 */
+		assert(msg_create_node_list(&msg, encoding, 1, 77, 1, 3, nodes, TEST_NO_NODES) != 0);
+		check_msg_all_splits(&msg);
+
+		assert(msg_create_vote_info(&msg, encoding, 1, 300, TLV_VOTE_ACK) != 0);
+		check_msg_all_splits(&msg);
+	}
+
+	/*
+	 * Heartbeat fields are varints, so heartbeat is smaller than echo request
+	 */
+	assert(msg_create_heartbeat(&msg, 5, 99) == msg_get_header_length() + 2);
+	check_msg_all_splits(&msg);
+
+	assert(msg_create_heartbeat(&msg, UINT32_MAX, UINT32_MAX) ==
+	    msg_get_header_length() + 2 * TLV_VARINT_MAX_LENGTH);
+	check_msg_all_splits(&msg);
+
+	msg_decoded_init(&decoded_msg);
+	assert(msg_decode(&msg, &decoded_msg) == 0);
+	assert(decoded_msg.seq_number == UINT32_MAX && decoded_msg.heartbeat_timestamp == UINT32_MAX);
+	msg_decoded_destroy(&decoded_msg);
+
+	assert(decode_raw(hb_trailing, sizeof(hb_trailing)) == -1);
+	assert(decode_raw(hb_truncated, sizeof(hb_truncated)) == -1);
+	assert(decode_raw(hb_too_long, sizeof(hb_too_long)) == -1);
+
+	/*
+	 * Option (or its header) running past end of message
+	 */
+	for (zi = 1; zi <= sizeof(opt_past_end2); zi++) {
+		assert(feed_raw(opt_past_end, sizeof(opt_past_end), zi) == -3);
+		assert(feed_raw(opt_header_past_end, sizeof(opt_header_past_end), zi) == -3);
+		assert(feed_raw(opt_past_end2, sizeof(opt_past_end2), zi) == -3);
+	}
+
+	dynar_destroy(&msg);
+
+	printf("msg-ut: all tests passed\n");
+
+	return (0);
+}
@@ -10,7 +10,14 @@
 #define MSG_TYPE_LENGTH		2
 #define MSG_LENGTH_LENGTH	4
 
-#define MSG_STATIC_SUPPORTED_MESSAGES_SIZE	10
+#define MSG_TYPE_COMPACT_FLAG	0x8000
+
+/*
+ * Heartbeat body has no TLVs: seq number and timestamp, both as varint without TLV header
+ */
+#define MSG_HEARTBEAT_MAX_LENGTH	(TLV_VARINT_MAX_LENGTH * 2)
+
+#define MSG_STATIC_SUPPORTED_MESSAGES_SIZE	16
 
 enum msg_type msg_static_supported_messages[MSG_STATIC_SUPPORTED_MESSAGES_SIZE] = {
     MSG_TYPE_PREINIT,
@@ -23,6 +30,12 @@ enum msg_type msg_static_supported_messages[MSG_STATIC_SUPPORTED_MESSAGES_SIZE]
     MSG_TYPE_SET_OPTION_REPLY,
     MSG_TYPE_ECHO_REQUEST,
     MSG_TYPE_ECHO_REPLY,
+    MSG_TYPE_NODE_LIST,
+    MSG_TYPE_NODE_LIST_REPLY,
+    MSG_TYPE_VOTE_INFO,
+    MSG_TYPE_CREDIT,
+    MSG_TYPE_HEARTBEAT,
+    MSG_TYPE_HEARTBEAT_REPLY,
 };
 
 size_t
@@ -31,25 +44,51 @@ msg_get_header_length(void)
 	return (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH);
 }
 
+/*
+ * TLVs of message are encoded by compact encoding if MSG_TYPE_COMPACT_FLAG is set in type
+ */
 static void
-msg_add_type(struct dynar *msg, enum msg_type type)
+msg_add_type(struct dynar *msg, enum msg_type type, enum tlv_encoding encoding)
 {
 	uint16_t ntype;
+	uint16_t utype;
+
+	utype = (uint16_t)type;
+	if (encoding == TLV_ENCODING_COMPACT) {
+		utype |= MSG_TYPE_COMPACT_FLAG;
+	}
 
-	ntype = htons((uint16_t)type);
+	ntype = htons(utype);
 	dynar_cat(msg, &ntype, sizeof(ntype));
 }
 
+static enum msg_type
+msg_header_get_type(const char *header)
+{
+	uint16_t ntype;
+	uint16_t type;
+
+	memcpy(&ntype, header, sizeof(ntype));
+	type = ntohs(ntype) & ~MSG_TYPE_COMPACT_FLAG;
+
+	return (type);
+}
+
 enum msg_type
 msg_get_type(const struct dynar *msg)
+{
+
+	return (msg_header_get_type(dynar_data(msg)));
+}
+
+enum tlv_encoding
+msg_get_tlv_encoding(const struct dynar *msg)
 {
 	uint16_t ntype;
-	uint16_t type;
 
 	memcpy(&ntype, dynar_data(msg), sizeof(ntype));
-	type = ntohs(ntype);
 
-	return (type);
+	return ((ntohs(ntype) & MSG_TYPE_COMPACT_FLAG) ? TLV_ENCODING_COMPACT : TLV_ENCODING_STANDARD);
 }
 
 /*
@@ -75,29 +114,61 @@ msg_set_len(struct dynar *msg, uint32_t len)
 }
 
 /*
- * Used only for echo reply msg. All other messages should use msg_add_type.
+ * Used only for echo reply msg. All other messages should use msg_add_type. Encoding of
+ * original message is kept.
  */
 static void
 msg_set_type(struct dynar *msg, enum msg_type type)
 {
 	uint16_t ntype;
 
-	ntype = htons((uint16_t)type);
+	memcpy(&ntype, dynar_data(msg), sizeof(ntype));
+	ntype = htons((uint16_t)type | (ntohs(ntype) & MSG_TYPE_COMPACT_FLAG));
 	memcpy(dynar_data(msg), &ntype, sizeof(ntype));
 }
 
-uint32_t
-msg_get_len(const struct dynar *msg)
+static uint32_t
+msg_header_get_len(const char *header)
 {
 	uint32_t nlen;
 	uint32_t len;
 
-	memcpy(&nlen, dynar_data(msg) + MSG_TYPE_LENGTH, sizeof(nlen));
+	memcpy(&nlen, header + MSG_TYPE_LENGTH, sizeof(nlen));
 	len = ntohl(nlen);
 
 	return (len);
 }
 
+uint32_t
+msg_get_len(const struct dynar *msg)
+{
+
+	return (msg_header_get_len(dynar_data(msg)));
+}
+
+/*
+ * Header accessors for message stored in rope. Rope must contain at least whole header.
+ */
+enum msg_type
+msg_rope_get_type(const struct rope *msg)
+{
+	char header[MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH];
+
+	rope_copy_out(msg, 0, header, sizeof(header));
+
+	return (msg_header_get_type(header));
+}
+
+uint32_t
+msg_rope_get_len(const struct rope *msg)
+{
+	char header[MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH];
+
+	rope_copy_out(msg, 0, header, sizeof(header));
+
+	return (msg_header_get_len(header));
+}
+
 
 size_t
 msg_create_preinit(struct dynar *msg, const char *cluster_name, int add_msg_seq_number, uint32_t msg_seq_number)
@@ -105,16 +176,16 @@ msg_create_preinit(struct dynar *msg, const char *cluster_name, int add_msg_seq_
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_PREINIT);
+	msg_add_type(msg, MSG_TYPE_PREINIT, TLV_ENCODING_STANDARD);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, TLV_ENCODING_STANDARD, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-	if (tlv_add_cluster_name(msg, cluster_name) == -1) {
+	if (tlv_add_cluster_name(msg, TLV_ENCODING_STANDARD, cluster_name) == -1) {
 		goto small_buf_err;
 	}
 
@@ -133,20 +204,20 @@ msg_create_preinit_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_PREINIT_REPLY);
+	msg_add_type(msg, MSG_TYPE_PREINIT_REPLY, TLV_ENCODING_STANDARD);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, TLV_ENCODING_STANDARD, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-	if (tlv_add_tls_supported(msg, tls_supported) == -1) {
+	if (tlv_add_tls_supported(msg, TLV_ENCODING_STANDARD, tls_supported) == -1) {
 		goto small_buf_err;
 	}
 
-	if (tlv_add_tls_client_cert_required(msg, tls_client_cert_required) == -1) {
+	if (tlv_add_tls_client_cert_required(msg, TLV_ENCODING_STANDARD, tls_client_cert_required) == -1) {
 		goto small_buf_err;
 	}
 
@@ -164,11 +235,11 @@ msg_create_starttls(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_STARTTLS);
+	msg_add_type(msg, MSG_TYPE_STARTTLS, TLV_ENCODING_STANDARD);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, TLV_ENCODING_STANDARD, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
@@ -182,22 +253,22 @@ small_buf_err:
 }
 
 size_t
-msg_create_server_error(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
-    enum tlv_reply_error_code reply_error_code)
+msg_create_server_error(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, enum tlv_reply_error_code reply_error_code)
 {
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_SERVER_ERROR);
+	msg_add_type(msg, MSG_TYPE_SERVER_ERROR, encoding);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-	if (tlv_add_reply_error_code(msg, reply_error_code) == -1) {
+	if (tlv_add_reply_error_code(msg, encoding, reply_error_code) == -1) {
 		goto small_buf_err;
 	}
 
@@ -230,7 +301,11 @@ msg_convert_msg_type_array_to_u16_array(const enum msg_type *msg_type_array, siz
 size_t
 msg_create_init(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
     const enum msg_type *supported_msgs, size_t no_supported_msgs,
-    const enum tlv_opt_type *supported_opts, size_t no_supported_opts, uint32_t node_id)
+    const enum tlv_opt_type *supported_opts, size_t no_supported_opts, uint32_t node_id,
+    uint32_t credit_window,
+    int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
+    int add_heartbeat_interval, uint32_t heartbeat_interval, const char *cluster_name,
+    enum tlv_encoding tlv_encoding)
 {
 	uint16_t *u16a;
 	int res;
@@ -239,11 +314,11 @@ msg_create_init(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_numb
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_INIT);
+	msg_add_type(msg, MSG_TYPE_INIT, TLV_ENCODING_STANDARD);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, TLV_ENCODING_STANDARD, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
@@ -255,7 +330,7 @@ msg_create_init(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_numb
 			goto small_buf_err;
 		}
 
-		res = tlv_add_u16_array(msg, TLV_OPT_SUPPORTED_MESSAGES, u16a, no_supported_msgs);
+		res = tlv_add_u16_array(msg, TLV_ENCODING_STANDARD, TLV_OPT_SUPPORTED_MESSAGES, u16a, no_supported_msgs);
 
 		free(u16a);
 
@@ -265,15 +340,56 @@ msg_create_init(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_numb
 	}
 
 	if (supported_opts != NULL && no_supported_opts > 0) {
-		if (tlv_add_supported_options(msg, supported_opts, no_supported_opts) == -1) {
+		if (tlv_add_supported_options(msg, TLV_ENCODING_STANDARD, supported_opts, no_supported_opts) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-        if (tlv_add_node_id(msg, node_id) == -1) {
+        if (tlv_add_node_id(msg, TLV_ENCODING_STANDARD, node_id) == -1) {
 		goto small_buf_err;
         }
 
+	/*
+	 * Number of messages server may send to client without request before waiting for credit
+	 */
+	if (tlv_add_credit_window(msg, TLV_ENCODING_STANDARD, credit_window) == -1) {
+		goto small_buf_err;
+	}
+
+	/*
+	 * Options which would be otherwise sent by set option message
+	 */
+	if (add_decision_algorithm) {
+		if (tlv_add_decision_algorithm(msg, TLV_ENCODING_STANDARD, decision_algorithm) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (add_heartbeat_interval) {
+		if (tlv_add_heartbeat_interval(msg, TLV_ENCODING_STANDARD, heartbeat_interval) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	/*
+	 * Cluster name is sent only when preinit was skipped (implicit TLS)
+	 */
+	if (cluster_name != NULL) {
+		if (tlv_add_cluster_name(msg, TLV_ENCODING_STANDARD, cluster_name) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	/*
+	 * Init itself is always in standard encoding. Option is added only when client wants
+	 * compact encoding, so old servers get same message as before.
+	 */
+	if (tlv_encoding != TLV_ENCODING_STANDARD) {
+		if (tlv_add_tlv_encoding(msg, TLV_ENCODING_STANDARD, tlv_encoding) == -1) {
+			goto small_buf_err;
+		}
+	}
+
 	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
 
 	return (dynar_size(msg));
@@ -287,7 +403,10 @@ msg_create_init_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_se
     const enum msg_type *supported_msgs, size_t no_supported_msgs,
     const enum tlv_opt_type *supported_opts, size_t no_supported_opts,
     size_t server_maximum_request_size, size_t server_maximum_reply_size,
-    const enum tlv_decision_algorithm_type *supported_decision_algorithms, size_t no_supported_decision_algorithms)
+    const enum tlv_decision_algorithm_type *supported_decision_algorithms, size_t no_supported_decision_algorithms,
+    uint32_t request_window,
+    int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
+    int add_heartbeat_interval, uint32_t heartbeat_interval, enum tlv_encoding tlv_encoding)
 {
 	uint16_t *u16a;
 	int res;
@@ -296,7 +415,7 @@ msg_create_init_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_se
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_INIT_REPLY);
+	msg_add_type(msg, MSG_TYPE_INIT_REPLY, TLV_ENCODING_STANDARD);
 	msg_add_len(msg);
 
 	if (supported_msgs != NULL && no_supported_msgs > 0) {
@@ -306,7 +425,7 @@ msg_create_init_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_se
 			goto small_buf_err;
 		}
 
-		res = tlv_add_u16_array(msg, TLV_OPT_SUPPORTED_MESSAGES, u16a, no_supported_msgs);
+		res = tlv_add_u16_array(msg, TLV_ENCODING_STANDARD, TLV_OPT_SUPPORTED_MESSAGES, u16a, no_supported_msgs);
 
 		free(u16a);
 
@@ -316,32 +435,63 @@ msg_create_init_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_se
 	}
 
 	if (supported_opts != NULL && no_supported_opts > 0) {
-		if (tlv_add_supported_options(msg, supported_opts, no_supported_opts) == -1) {
+		if (tlv_add_supported_options(msg, TLV_ENCODING_STANDARD, supported_opts, no_supported_opts) == -1) {
 			goto small_buf_err;
 		}
 	}
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, TLV_ENCODING_STANDARD, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-	if (tlv_add_server_maximum_request_size(msg, server_maximum_request_size) == -1) {
+	if (tlv_add_server_maximum_request_size(msg, TLV_ENCODING_STANDARD, server_maximum_request_size) == -1) {
 		goto small_buf_err;
 	}
 
-	if (tlv_add_server_maximum_reply_size(msg, server_maximum_reply_size) == -1) {
+	if (tlv_add_server_maximum_reply_size(msg, TLV_ENCODING_STANDARD, server_maximum_reply_size) == -1) {
 		goto small_buf_err;
 	}
 
 	if (supported_decision_algorithms != NULL && no_supported_decision_algorithms > 0) {
-		if (tlv_add_supported_decision_algorithms(msg, supported_decision_algorithms,
+		if (tlv_add_supported_decision_algorithms(msg, TLV_ENCODING_STANDARD, supported_decision_algorithms,
 		    no_supported_decision_algorithms) == -1) {
 			goto small_buf_err;
 		}
 	}
 
+	/*
+	 * Number of requests client may send without waiting for reply
+	 */
+	if (tlv_add_request_window(msg, TLV_ENCODING_STANDARD, request_window) == -1) {
+		goto small_buf_err;
+	}
+
+	/*
+	 * Options accepted from init message
+	 */
+	if (add_decision_algorithm) {
+		if (tlv_add_decision_algorithm(msg, TLV_ENCODING_STANDARD, decision_algorithm) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (add_heartbeat_interval) {
+		if (tlv_add_heartbeat_interval(msg, TLV_ENCODING_STANDARD, heartbeat_interval) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	/*
+	 * Encoding used by both sides for messages following init reply
+	 */
+	if (tlv_encoding != TLV_ENCODING_STANDARD) {
+		if (tlv_add_tlv_encoding(msg, TLV_ENCODING_STANDARD, tlv_encoding) == -1) {
+			goto small_buf_err;
+		}
+	}
+
 	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
 
 	return (dynar_size(msg));
@@ -351,30 +501,31 @@ small_buf_err:
 }
 
 size_t
-msg_create_set_option(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
-    int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
-    int add_heartbeat_interval, uint32_t heartbeat_interval)
+msg_create_set_option(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, int add_decision_algorithm,
+    enum tlv_decision_algorithm_type decision_algorithm, int add_heartbeat_interval,
+    uint32_t heartbeat_interval)
 {
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_SET_OPTION);
+	msg_add_type(msg, MSG_TYPE_SET_OPTION, encoding);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
 	if (add_decision_algorithm) {
-		if (tlv_add_decision_algorithm(msg, decision_algorithm) == -1) {
+		if (tlv_add_decision_algorithm(msg, encoding, decision_algorithm) == -1) {
 			goto small_buf_err;
 		}
 	}
 
 	if (add_heartbeat_interval) {
-		if (tlv_add_heartbeat_interval(msg, heartbeat_interval) == -1) {
+		if (tlv_add_heartbeat_interval(msg, encoding, heartbeat_interval) == -1) {
 			goto small_buf_err;
 		}
 	}
@@ -388,26 +539,27 @@ small_buf_err:
 }
 
 size_t
-msg_create_set_option_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
-    enum tlv_decision_algorithm_type decision_algorithm, uint32_t heartbeat_interval)
+msg_create_set_option_reply(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, enum tlv_decision_algorithm_type decision_algorithm,
+    uint32_t heartbeat_interval)
 {
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_SET_OPTION_REPLY);
+	msg_add_type(msg, MSG_TYPE_SET_OPTION_REPLY, encoding);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
 
-	if (tlv_add_decision_algorithm(msg, decision_algorithm) == -1) {
+	if (tlv_add_decision_algorithm(msg, encoding, decision_algorithm) == -1) {
 		goto small_buf_err;
 	}
 
-	if (tlv_add_heartbeat_interval(msg, heartbeat_interval) == -1) {
+	if (tlv_add_heartbeat_interval(msg, encoding, heartbeat_interval) == -1) {
 		goto small_buf_err;
 	}
 
@@ -420,16 +572,17 @@ small_buf_err:
 }
 
 size_t
-msg_create_echo_request(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number)
+msg_create_echo_request(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number)
 {
 
 	dynar_clean(msg);
 
-	msg_add_type(msg, MSG_TYPE_ECHO_REQUEST);
+	msg_add_type(msg, MSG_TYPE_ECHO_REQUEST, encoding);
 	msg_add_len(msg);
 
 	if (add_msg_seq_number) {
-		if (tlv_add_msg_seq_number(msg, msg_seq_number) == -1) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
 			goto small_buf_err;
 		}
 	}
@@ -442,13 +595,28 @@ small_buf_err:
 	return (0);
 }
 
-size_t
-msg_create_echo_reply(struct dynar *msg, const struct dynar *echo_request_msg)
+/*
+ * Copy whole message stored in rope to msg
+ */
+static int
+msg_copy_from_rope(struct dynar *msg, const struct rope *src_msg)
 {
+	char *data;
 
 	dynar_clean(msg);
 
-	if (dynar_cat(msg, dynar_data(echo_request_msg), dynar_size(echo_request_msg)) == -1) {
+	if (dynar_grow(msg, rope_size(src_msg), &data) == -1) {
+		return (-1);
+	}
+
+	return (rope_copy_out(src_msg, 0, data, rope_size(src_msg)));
+}
+
+size_t
+msg_create_echo_reply(struct dynar *msg, const struct rope *echo_request_msg)
+{
+
+	if (msg_copy_from_rope(msg, echo_request_msg) == -1) {
 		goto small_buf_err;
 	}
 
@@ -460,185 +628,624 @@ small_buf_err:
 	return (0);
 }
 
-int
-msg_is_valid_msg_type(const struct dynar *msg)
+/*
+ * Full node list. If add_epoch is set, list is stored by server under given epoch and
+ * following changes can be sent by msg_create_node_list_delta.
+ */
+size_t
+msg_create_node_list(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, int add_epoch, uint32_t epoch, const uint32_t *node_list, size_t no_nodes)
 {
-	enum msg_type type;
-	size_t i;
 
-	type = msg_get_type(msg);
+	dynar_clean(msg);
 
-	for (i = 0; i < MSG_STATIC_SUPPORTED_MESSAGES_SIZE; i++) {
-		if (msg_static_supported_messages[i] == type) {
-			return (1);
+	msg_add_type(msg, MSG_TYPE_NODE_LIST, encoding);
+	msg_add_len(msg);
+
+	if (add_msg_seq_number) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (add_epoch) {
+		if (tlv_add_node_list_epoch(msg, encoding, epoch) == -1) {
+			goto small_buf_err;
 		}
 	}
 
+	if (tlv_add_node_list(msg, encoding, node_list, no_nodes) == -1) {
+		goto small_buf_err;
+	}
+
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
+
+	return (dynar_size(msg));
+
+small_buf_err:
 	return (0);
 }
 
-void
-msg_decoded_init(struct msg_decoded *decoded_msg)
+/*
+ * Node list changes relative to list acknowledged by server under base_epoch
+ */
+size_t
+msg_create_node_list_delta(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, uint32_t epoch, uint32_t base_epoch, const uint32_t *added_nodes,
+    size_t no_added_nodes, const uint32_t *removed_nodes, size_t no_removed_nodes)
 {
 
-	memset(decoded_msg, 0, sizeof(*decoded_msg));
+	dynar_clean(msg);
+
+	msg_add_type(msg, MSG_TYPE_NODE_LIST, encoding);
+	msg_add_len(msg);
+
+	if (add_msg_seq_number) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (tlv_add_node_list_epoch(msg, encoding, epoch) == -1) {
+		goto small_buf_err;
+	}
+
+	if (tlv_add_node_list_base_epoch(msg, encoding, base_epoch) == -1) {
+		goto small_buf_err;
+	}
+
+	/*
+	 * Missing added or removed option means empty list
+	 */
+	if (no_added_nodes > 0 && tlv_add_node_list_added(msg, encoding, added_nodes, no_added_nodes) == -1) {
+		goto small_buf_err;
+	}
+
+	if (no_removed_nodes > 0 &&
+	    tlv_add_node_list_removed(msg, encoding, removed_nodes, no_removed_nodes) == -1) {
+		goto small_buf_err;
+	}
+
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
+
+	return (dynar_size(msg));
+
+small_buf_err:
+	return (0);
 }
 
-void
-msg_decoded_destroy(struct msg_decoded *decoded_msg)
+/*
+ * epoch is epoch of node list server has for client after processing node list msg
+ */
+size_t
+msg_create_node_list_reply(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, int add_epoch, uint32_t epoch, enum tlv_vote vote)
 {
 
-	free(decoded_msg->cluster_name);
-	free(decoded_msg->supported_messages);
-	free(decoded_msg->supported_options);
+	dynar_clean(msg);
 
-	msg_decoded_init(decoded_msg);
+	msg_add_type(msg, MSG_TYPE_NODE_LIST_REPLY, encoding);
+	msg_add_len(msg);
+
+	if (add_msg_seq_number) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (add_epoch) {
+		if (tlv_add_node_list_epoch(msg, encoding, epoch) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (tlv_add_vote(msg, encoding, vote) == -1) {
+		goto small_buf_err;
+	}
+
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
+
+	return (dynar_size(msg));
+
+small_buf_err:
+	return (0);
 }
 
 /*
- *  0 - No error
- * -1 - option with invalid length
- * -2 - Unable to allocate memory
- * -3 - Inconsistent msg (tlv len > msg size)
- * -4 - invalid option content
+ * Give peer credit for credit more messages. Credit message itself is not accounted and
+ * has no reply.
  */
-int
-msg_decode(const struct dynar *msg, struct msg_decoded *decoded_msg)
+size_t
+msg_create_credit(struct dynar *msg, enum tlv_encoding encoding, uint32_t credit)
 {
-	struct tlv_iterator tlv_iter;
-	uint16_t *u16a;
-	uint32_t u32;
-	size_t zi;
-	enum tlv_opt_type opt_type;
-	int iter_res;
-	int res;
 
-	msg_decoded_destroy(decoded_msg);
+	dynar_clean(msg);
 
-	decoded_msg->type = msg_get_type(msg);
+	msg_add_type(msg, MSG_TYPE_CREDIT, encoding);
+	msg_add_len(msg);
 
-	tlv_iter_init(msg, msg_get_header_length(), &tlv_iter);
+	if (tlv_add_credit(msg, encoding, credit) == -1) {
+		goto small_buf_err;
+	}
 
-	while ((iter_res = tlv_iter_next(&tlv_iter)) > 0) {
-		opt_type = tlv_iter_get_type(&tlv_iter);
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
 
-		switch (opt_type) {
-		case TLV_OPT_MSG_SEQ_NUMBER:
-			if (tlv_iter_decode_u32(&tlv_iter, &decoded_msg->seq_number) != 0) {
-				return (-1);
-			}
+	return (dynar_size(msg));
 
-			decoded_msg->seq_number_set = 1;
-			break;
-		case TLV_OPT_CLUSTER_NAME:
-			if (tlv_iter_decode_str(&tlv_iter, &decoded_msg->cluster_name,
-			    &decoded_msg->cluster_name_len) != 0) {
-				return (-2);
-			}
-			break;
-		case TLV_OPT_TLS_SUPPORTED:
-			if ((res = tlv_iter_decode_tls_supported(&tlv_iter, &decoded_msg->tls_supported)) != 0) {
-				return (res);
-			}
+small_buf_err:
+	return (0);
+}
 
-			decoded_msg->tls_supported_set = 1;
-			break;
-		case TLV_OPT_TLS_CLIENT_CERT_REQUIRED:
-			if (tlv_iter_decode_client_cert_required(&tlv_iter, &decoded_msg->tls_client_cert_required) != 0) {
-				return (-1);
-			}
+/*
+ * Compact replacement of echo request. Body is seq number and timestamp, both as varint
+ * without TLV header. Timestamp is opaque for server and it's returned back in reply, so
+ * client can compute round trip time.
+ */
+size_t
+msg_create_heartbeat(struct dynar *msg, uint32_t msg_seq_number, uint32_t timestamp)
+{
+	unsigned char body[MSG_HEARTBEAT_MAX_LENGTH];
+	size_t body_len;
 
-			decoded_msg->tls_client_cert_required_set = 1;
-			break;
-		case TLV_OPT_SUPPORTED_MESSAGES:
-			free(decoded_msg->supported_messages);
+	dynar_clean(msg);
 
-			if ((res = tlv_iter_decode_u16_array(&tlv_iter, &u16a,
-			    &decoded_msg->no_supported_messages)) != 0) {
-				return (res);
-			}
+	msg_add_type(msg, MSG_TYPE_HEARTBEAT, TLV_ENCODING_STANDARD);
+	msg_add_len(msg);
 
-			decoded_msg->supported_messages = malloc(sizeof(enum msg_type) * decoded_msg->no_supported_messages);
-			if (decoded_msg->supported_messages == NULL) {
-				free(u16a);
-				return (-2);
-			}
+	body_len = tlv_varint_encode(msg_seq_number, body);
+	body_len += tlv_varint_encode(timestamp, body + body_len);
 
-			for (zi = 0; zi < decoded_msg->no_supported_messages; zi++) {
-				decoded_msg->supported_messages[zi] = (enum msg_type)u16a[zi];
-			}
+	if (dynar_cat(msg, body, body_len) == -1) {
+		goto small_buf_err;
+	}
 
-			free(u16a);
-			break;
-		case TLV_OPT_SUPPORTED_OPTIONS:
-			free(decoded_msg->supported_options);
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
 
-			if ((res = tlv_iter_decode_supported_options(&tlv_iter, &decoded_msg->supported_options,
-			    &decoded_msg->no_supported_options)) != 0) {
-				return (res);
-			}
-			break;
-		case TLV_OPT_REPLY_ERROR_CODE:
-			if (tlv_iter_decode_reply_error_code(&tlv_iter, &decoded_msg->reply_error_code) != 0) {
-				return (-1);
-			}
+	return (dynar_size(msg));
 
-			decoded_msg->reply_error_code_set = 1;
-			break;
-		case TLV_OPT_SERVER_MAXIMUM_REQUEST_SIZE:
-			if (tlv_iter_decode_u32(&tlv_iter, &u32) != 0) {
-				return (-1);
-			}
+small_buf_err:
+	return (0);
+}
 
-			decoded_msg->server_maximum_request_size_set = 1;
-			decoded_msg->server_maximum_request_size = u32;
-			break;
-		case TLV_OPT_SERVER_MAXIMUM_REPLY_SIZE:
-			if (tlv_iter_decode_u32(&tlv_iter, &u32) != 0) {
-				return (-1);
-			}
+size_t
+msg_create_heartbeat_reply(struct dynar *msg, const struct rope *heartbeat_msg)
+{
 
-			decoded_msg->server_maximum_reply_size_set = 1;
-			decoded_msg->server_maximum_reply_size = u32;
-			break;
-		case TLV_OPT_NODE_ID:
-			if (tlv_iter_decode_u32(&tlv_iter, &u32) != 0) {
-				return (-1);
-			}
+	if (msg_copy_from_rope(msg, heartbeat_msg) == -1) {
+		goto small_buf_err;
+	}
 
-			decoded_msg->node_id_set = 1;
-			decoded_msg->node_id = u32;
-			break;
-		case TLV_OPT_SUPPORTED_DECISION_ALGORITHMS:
-			free(decoded_msg->supported_decision_algorithms);
+	msg_set_type(msg, MSG_TYPE_HEARTBEAT_REPLY);
 
-			if ((res = tlv_iter_decode_supported_decision_algorithms(&tlv_iter,
-			    &decoded_msg->supported_decision_algorithms,
-			    &decoded_msg->no_supported_decision_algorithms)) != 0) {
-				return (res);
-			}
-			break;
-		case TLV_OPT_DECISION_ALGORITHM:
-			if (tlv_iter_decode_decision_algorithm(&tlv_iter, &decoded_msg->decision_algorithm) != 0) {
-				return (-1);
-			}
+	return (dynar_size(msg));
 
-			decoded_msg->decision_algorithm_set = 1;
-			break;
-		case TLV_OPT_HEARTBEAT_INTERVAL:
-			if (tlv_iter_decode_u32(&tlv_iter, &u32) != 0) {
-				return (-1);
-			}
+small_buf_err:
+	return (0);
+}
 
-			decoded_msg->heartbeat_interval_set = 1;
-			decoded_msg->heartbeat_interval = u32;
-			break;
-		default:
-			/*
-			 * Unknown option
-			 */
-			break;
-		}
+/*
+ * Decode heartbeat or heartbeat reply without TLV iterator. Returns 0 on success or -1 if
+ * message has invalid length or varints don't fill whole body.
+ */
+int
+msg_decode_heartbeat(const struct dynar *msg, uint32_t *msg_seq_number, uint32_t *timestamp)
+{
+	const unsigned char *body;
+	size_t body_len;
+	size_t used;
+
+	if (dynar_size(msg) < MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH ||
+	    dynar_size(msg) != MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH + msg_get_len(msg) ||
+	    msg_get_len(msg) > MSG_HEARTBEAT_MAX_LENGTH) {
+		return (-1);
+	}
+
+	body = (const unsigned char *)dynar_data(msg) + MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH;
+	body_len = msg_get_len(msg);
+
+	if (tlv_varint_decode(body, body_len, msg_seq_number, &used) != 0) {
+		return (-1);
+	}
+	body += used;
+	body_len -= used;
+
+	if (tlv_varint_decode(body, body_len, timestamp, &used) != 0 || used != body_len) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+size_t
+msg_create_vote_info(struct dynar *msg, enum tlv_encoding encoding, int add_msg_seq_number,
+    uint32_t msg_seq_number, enum tlv_vote vote)
+{
+
+	dynar_clean(msg);
+
+	msg_add_type(msg, MSG_TYPE_VOTE_INFO, encoding);
+	msg_add_len(msg);
+
+	if (add_msg_seq_number) {
+		if (tlv_add_msg_seq_number(msg, encoding, msg_seq_number) == -1) {
+			goto small_buf_err;
+		}
+	}
+
+	if (tlv_add_vote(msg, encoding, vote) == -1) {
+		goto small_buf_err;
+	}
+
+	msg_set_len(msg, dynar_size(msg) - (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH));
+
+	return (dynar_size(msg));
+
+small_buf_err:
+	return (0);
+}
+
+static int
+msg_is_supported_msg_type(enum msg_type type)
+{
+	size_t i;
+
+	for (i = 0; i < MSG_STATIC_SUPPORTED_MESSAGES_SIZE; i++) {
+		if (msg_static_supported_messages[i] == type) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+int
+msg_is_valid_msg_type(const struct dynar *msg)
+{
+
+	return (msg_is_supported_msg_type(msg_get_type(msg)));
+}
+
+int
+msg_rope_is_valid_msg_type(const struct rope *msg)
+{
+
+	return (msg_is_supported_msg_type(msg_rope_get_type(msg)));
+}
+
+void
+msg_decoded_init(struct msg_decoded *decoded_msg)
+{
+
+	memset(decoded_msg, 0, sizeof(*decoded_msg));
+}
+
+/*
+ * Memory allocated from arena is not freed here, owner of arena releases it at once by
+ * arena_reset. Arena stays set.
+ */
+void
+msg_decoded_destroy(struct msg_decoded *decoded_msg)
+{
+	struct arena *arena;
+
+	arena = decoded_msg->arena;
+
+	if (arena == NULL) {
+		free(decoded_msg->cluster_name);
+		free(decoded_msg->supported_messages);
+		free(decoded_msg->supported_options);
+		free(decoded_msg->supported_decision_algorithms);
+		free(decoded_msg->node_list);
+		free(decoded_msg->node_list_added);
+		free(decoded_msg->node_list_removed);
+	}
+
+	msg_decoded_init(decoded_msg);
+	decoded_msg->arena = arena;
+}
+
+/*
+ * Decode strings and arrays to arena instead of heap. Used for transient messages which are
+ * destroyed right after dispatch.
+ */
+void
+msg_decoded_set_arena(struct msg_decoded *decoded_msg, struct arena *arena)
+{
+
+	decoded_msg->arena = arena;
+}
+
+static void *
+msg_decoded_alloc(const struct msg_decoded *decoded_msg, size_t size)
+{
+
+	if (decoded_msg->arena != NULL) {
+		return (arena_alloc(decoded_msg->arena, size));
+	}
+
+	return (malloc(size));
+}
+
+static void
+msg_decoded_free(const struct msg_decoded *decoded_msg, void *ptr)
+{
+
+	if (decoded_msg->arena == NULL) {
+		free(ptr);
+	}
+}
+
+/*
+ * Messages without TLVs
+ */
+static int
+msg_type_has_fixed_layout(enum msg_type type)
+{
+
+	return (type == MSG_TYPE_HEARTBEAT || type == MSG_TYPE_HEARTBEAT_REPLY);
+}
+
+static int
+msg_decode_fixed_layout(const struct dynar *msg, struct msg_decoded *decoded_msg)
+{
+
+	if (msg_decode_heartbeat(msg, &decoded_msg->seq_number, &decoded_msg->heartbeat_timestamp) != 0) {
+		return (-1);
+	}
+
+	decoded_msg->seq_number_set = 1;
+	decoded_msg->heartbeat_timestamp_set = 1;
+
+	return (0);
+}
+
+/*
+ * Decode one option (current tlv of tlv_iter) into decoded_msg. Unknown options are ignored.
+ * Return values are same as for msg_decode.
+ */
+int
+msg_decode_option(struct tlv_iterator *tlv_iter, struct msg_decoded *decoded_msg)
+{
+	uint16_t *u16a;
+	uint32_t u32;
+	size_t zi;
+	enum tlv_opt_type opt_type;
+	int res;
+
+	opt_type = tlv_iter_get_type(tlv_iter);
+	tlv_iter_set_arena(tlv_iter, decoded_msg->arena);
+
+	switch (opt_type) {
+	case TLV_OPT_MSG_SEQ_NUMBER:
+		if (tlv_iter_decode_u32(tlv_iter, &decoded_msg->seq_number) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->seq_number_set = 1;
+		break;
+	case TLV_OPT_CLUSTER_NAME:
+		if (tlv_iter_decode_str(tlv_iter, &decoded_msg->cluster_name,
+		    &decoded_msg->cluster_name_len) != 0) {
+			return (-2);
+		}
+		break;
+	case TLV_OPT_TLS_SUPPORTED:
+		if ((res = tlv_iter_decode_tls_supported(tlv_iter, &decoded_msg->tls_supported)) != 0) {
+			return (res);
+		}
+
+		decoded_msg->tls_supported_set = 1;
+		break;
+	case TLV_OPT_TLS_CLIENT_CERT_REQUIRED:
+		if (tlv_iter_decode_client_cert_required(tlv_iter, &decoded_msg->tls_client_cert_required) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->tls_client_cert_required_set = 1;
+		break;
+	case TLV_OPT_SUPPORTED_MESSAGES:
+		msg_decoded_free(decoded_msg, decoded_msg->supported_messages);
+
+		if ((res = tlv_iter_decode_u16_array(tlv_iter, &u16a,
+		    &decoded_msg->no_supported_messages)) != 0) {
+			return (res);
+		}
+
+		decoded_msg->supported_messages = msg_decoded_alloc(decoded_msg,
+		    sizeof(enum msg_type) * decoded_msg->no_supported_messages);
+		if (decoded_msg->supported_messages == NULL) {
+			msg_decoded_free(decoded_msg, u16a);
+			return (-2);
+		}
+
+		for (zi = 0; zi < decoded_msg->no_supported_messages; zi++) {
+			decoded_msg->supported_messages[zi] = (enum msg_type)u16a[zi];
+		}
+
+		msg_decoded_free(decoded_msg, u16a);
+		break;
+	case TLV_OPT_SUPPORTED_OPTIONS:
+		msg_decoded_free(decoded_msg, decoded_msg->supported_options);
+
+		if ((res = tlv_iter_decode_supported_options(tlv_iter, &decoded_msg->supported_options,
+		    &decoded_msg->no_supported_options)) != 0) {
+			return (res);
+		}
+		break;
+	case TLV_OPT_REPLY_ERROR_CODE:
+		if (tlv_iter_decode_reply_error_code(tlv_iter, &decoded_msg->reply_error_code) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->reply_error_code_set = 1;
+		break;
+	case TLV_OPT_SERVER_MAXIMUM_REQUEST_SIZE:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->server_maximum_request_size_set = 1;
+		decoded_msg->server_maximum_request_size = u32;
+		break;
+	case TLV_OPT_SERVER_MAXIMUM_REPLY_SIZE:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->server_maximum_reply_size_set = 1;
+		decoded_msg->server_maximum_reply_size = u32;
+		break;
+	case TLV_OPT_NODE_ID:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->node_id_set = 1;
+		decoded_msg->node_id = u32;
+		break;
+	case TLV_OPT_SUPPORTED_DECISION_ALGORITHMS:
+		msg_decoded_free(decoded_msg, decoded_msg->supported_decision_algorithms);
+
+		if ((res = tlv_iter_decode_supported_decision_algorithms(tlv_iter,
+		    &decoded_msg->supported_decision_algorithms,
+		    &decoded_msg->no_supported_decision_algorithms)) != 0) {
+			return (res);
+		}
+		break;
+	case TLV_OPT_DECISION_ALGORITHM:
+		if (tlv_iter_decode_decision_algorithm(tlv_iter, &decoded_msg->decision_algorithm) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->decision_algorithm_set = 1;
+		break;
+	case TLV_OPT_HEARTBEAT_INTERVAL:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->heartbeat_interval_set = 1;
+		decoded_msg->heartbeat_interval = u32;
+		break;
+	case TLV_OPT_NODE_LIST:
+		msg_decoded_free(decoded_msg, decoded_msg->node_list);
+		decoded_msg->node_list = NULL;
+
+		if ((res = tlv_iter_decode_u32_array(tlv_iter, &decoded_msg->node_list,
+		    &decoded_msg->no_node_list)) != 0) {
+			return (res);
+		}
+		break;
+	case TLV_OPT_VOTE:
+		if ((res = tlv_iter_decode_vote(tlv_iter, &decoded_msg->vote)) != 0) {
+			return (res);
+		}
+
+		decoded_msg->vote_set = 1;
+		break;
+	case TLV_OPT_NODE_LIST_EPOCH:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->node_list_epoch_set = 1;
+		decoded_msg->node_list_epoch = u32;
+		break;
+	case TLV_OPT_NODE_LIST_BASE_EPOCH:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->node_list_base_epoch_set = 1;
+		decoded_msg->node_list_base_epoch = u32;
+		break;
+	case TLV_OPT_NODE_LIST_ADDED:
+		msg_decoded_free(decoded_msg, decoded_msg->node_list_added);
+		decoded_msg->node_list_added = NULL;
+
+		if ((res = tlv_iter_decode_u32_array(tlv_iter, &decoded_msg->node_list_added,
+		    &decoded_msg->no_node_list_added)) != 0) {
+			return (res);
+		}
+		break;
+	case TLV_OPT_NODE_LIST_REMOVED:
+		msg_decoded_free(decoded_msg, decoded_msg->node_list_removed);
+		decoded_msg->node_list_removed = NULL;
+
+		if ((res = tlv_iter_decode_u32_array(tlv_iter, &decoded_msg->node_list_removed,
+		    &decoded_msg->no_node_list_removed)) != 0) {
+			return (res);
+		}
+		break;
+	case TLV_OPT_CREDIT_WINDOW:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->credit_window_set = 1;
+		decoded_msg->credit_window = u32;
+		break;
+	case TLV_OPT_CREDIT:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->credit_set = 1;
+		decoded_msg->credit = u32;
+		break;
+	case TLV_OPT_TLV_ENCODING:
+		if ((res = tlv_iter_decode_tlv_encoding(tlv_iter, &decoded_msg->tlv_encoding)) != 0) {
+			return (res);
+		}
+
+		decoded_msg->tlv_encoding_set = 1;
+		break;
+	case TLV_OPT_REQUEST_WINDOW:
+		if (tlv_iter_decode_u32(tlv_iter, &u32) != 0) {
+			return (-1);
+		}
+
+		decoded_msg->request_window_set = 1;
+		decoded_msg->request_window = u32;
+		break;
+	default:
+		/*
+		 * Unknown option
+		 */
+		break;
+	}
+
+	return (0);
+}
+
+/*
+ *  0 - No error
+ * -1 - option with invalid length
+ * -2 - Unable to allocate memory
+ * -3 - Inconsistent msg (tlv len > msg size)
+ * -4 - invalid option content
+ */
+int
+msg_decode(const struct dynar *msg, struct msg_decoded *decoded_msg)
+{
+	struct tlv_iterator tlv_iter;
+	int iter_res;
+	int res;
+
+	msg_decoded_destroy(decoded_msg);
+
+	decoded_msg->type = msg_get_type(msg);
+
+	if (msg_type_has_fixed_layout(decoded_msg->type)) {
+		return (msg_decode_fixed_layout(msg, decoded_msg));
+	}
+
+	tlv_iter_init(msg, msg_get_header_length(), msg_get_tlv_encoding(msg), &tlv_iter);
+
+	while ((iter_res = tlv_iter_next(&tlv_iter)) > 0) {
+		if ((res = msg_decode_option(&tlv_iter, decoded_msg)) != 0) {
+			return (res);
+		}
 	}
 
 	if (iter_res != 0) {
@@ -648,6 +1255,300 @@ msg_decode(const struct dynar *msg, struct msg_decoded *decoded_msg)
 	return (0);
 }
 
+/*
+ * Incremental decoder. Memory used is bounded by size of one option, not by message size.
+ */
+void
+msg_decoder_init(struct msg_decoder *decoder, size_t max_msg_size)
+{
+
+	dynar_init(&decoder->msg, MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH + MSG_HEARTBEAT_MAX_LENGTH);
+	dynar_init(&decoder->option, tlv_get_max_len());
+	decoder->option_len = 0;
+	decoder->received_bytes = 0;
+	decoder->max_msg_size = max_msg_size;
+}
+
+void
+msg_decoder_destroy(struct msg_decoder *decoder)
+{
+
+	dynar_destroy(&decoder->msg);
+	dynar_destroy(&decoder->option);
+}
+
+/*
+ * Prepare decoder for next message
+ */
+void
+msg_decoder_reset(struct msg_decoder *decoder)
+{
+
+	dynar_clean(&decoder->msg);
+	dynar_clean(&decoder->option);
+	decoder->option_len = 0;
+	decoder->received_bytes = 0;
+}
+
+void
+msg_decoder_set_max_msg_size(struct msg_decoder *decoder, size_t max_msg_size)
+{
+
+	decoder->max_msg_size = max_msg_size;
+}
+
+/*
+ * Number of bytes needed to complete header (if it is not complete yet) or message
+ */
+size_t
+msg_decoder_get_remaining(const struct msg_decoder *decoder)
+{
+
+	if (decoder->received_bytes < MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH) {
+		return (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH - decoder->received_bytes);
+	}
+
+	return (MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH + msg_get_len(&decoder->msg) - decoder->received_bytes);
+}
+
+/*
+ * Store part of option and pass option to option_cb when it is complete. data and data_len
+ * are moved past consumed bytes.
+ */
+static int
+msg_decoder_feed_option(struct msg_decoder *decoder, const char **data, size_t *data_len,
+    msg_decoder_option_cb option_cb, void *user_data)
+{
+	struct tlv_iterator tlv_iter;
+	enum tlv_encoding encoding;
+	size_t to_copy;
+	int res;
+
+	encoding = msg_get_tlv_encoding(&decoder->msg);
+
+	if (decoder->option_len == 0 && dynar_size(&decoder->option) == 0) {
+		/*
+		 * Start of option. If option header is incomplete, all data belongs to it.
+		 */
+		res = tlv_get_len_from_header(*data, *data_len, encoding, &decoder->option_len);
+		if (res == -1) {
+			return (-3);
+		}
+
+		if (res == 1 && decoder->option_len <= *data_len) {
+			/*
+			 * Whole option is available. Decode it in place without copy.
+			 */
+			tlv_iter_init_data(*data, decoder->option_len, 0, encoding, &tlv_iter);
+			if (tlv_iter_next(&tlv_iter) != 1) {
+				return (-3);
+			}
+
+			*data += decoder->option_len;
+			*data_len -= decoder->option_len;
+			decoder->received_bytes += decoder->option_len;
+			decoder->option_len = 0;
+
+			return (option_cb(&tlv_iter, user_data));
+		}
+
+		to_copy = *data_len;
+	} else if (decoder->option_len == 0) {
+		/*
+		 * Option header was split between reads. Complete it byte by byte.
+		 */
+		to_copy = 1;
+	} else {
+		to_copy = decoder->option_len - dynar_size(&decoder->option);
+		if (to_copy > *data_len) {
+			to_copy = *data_len;
+		}
+	}
+
+	if (dynar_cat(&decoder->option, *data, to_copy) == -1) {
+		return (-2);
+	}
+
+	*data += to_copy;
+	*data_len -= to_copy;
+	decoder->received_bytes += to_copy;
+
+	if (decoder->option_len == 0) {
+		res = tlv_get_len_from_header(dynar_data(&decoder->option), dynar_size(&decoder->option),
+		    encoding, &decoder->option_len);
+		if (res == -1) {
+			return (-3);
+		}
+	}
+
+	if (decoder->option_len == 0 || dynar_size(&decoder->option) < decoder->option_len) {
+		return (0);
+	}
+
+	tlv_iter_init(&decoder->option, 0, encoding, &tlv_iter);
+	if (tlv_iter_next(&tlv_iter) != 1) {
+		return (-3);
+	}
+
+	res = option_cb(&tlv_iter, user_data);
+
+	dynar_clean(&decoder->option);
+	decoder->option_len = 0;
+
+	return (res);
+}
+
+/*
+ * Feed next part of message to decoder. Data past end of current message are not consumed,
+ * so caller should feed at most msg_decoder_get_remaining bytes. Every complete option is
+ * passed to option_cb, decoder fails with its return value if it is not 0.
+ *  0 - Message is not complete yet
+ *  1 - Message is complete. Call msg_decoder_finish and msg_decoder_reset.
+ * -1 .. -4 - Same as msg_decode
+ * -5 - Invalid msg type
+ * -6 - Msg too long
+ */
+int
+msg_decoder_feed(struct msg_decoder *decoder, const char *data, size_t data_len,
+    msg_decoder_option_cb option_cb, void *user_data)
+{
+	size_t header_len;
+	size_t to_copy;
+	int res;
+
+	header_len = MSG_TYPE_LENGTH + MSG_LENGTH_LENGTH;
+
+	if (decoder->received_bytes < header_len) {
+		to_copy = header_len - decoder->received_bytes;
+		if (to_copy > data_len) {
+			to_copy = data_len;
+		}
+
+		if (dynar_cat(&decoder->msg, data, to_copy) == -1) {
+			return (-2);
+		}
+
+		decoder->received_bytes += to_copy;
+		data += to_copy;
+		data_len -= to_copy;
+
+		if (decoder->received_bytes < header_len) {
+			return (0);
+		}
+
+		if (!msg_is_valid_msg_type(&decoder->msg)) {
+			return (-5);
+		}
+
+		if (header_len + msg_get_len(&decoder->msg) > decoder->max_msg_size) {
+			return (-6);
+		}
+	}
+
+	if (data_len > msg_decoder_get_remaining(decoder)) {
+		data_len = msg_decoder_get_remaining(decoder);
+	}
+
+	if (msg_type_has_fixed_layout(msg_get_type(&decoder->msg))) {
+		/*
+		 * Small fixed layout body is stored together with header
+		 */
+		if (dynar_cat(&decoder->msg, data, data_len) == -1) {
+			return (-1);
+		}
+
+		decoder->received_bytes += data_len;
+	} else {
+		while (data_len > 0) {
+			if ((res = msg_decoder_feed_option(decoder, &data, &data_len, option_cb, user_data)) != 0) {
+				return (res);
+			}
+		}
+	}
+
+	if (msg_decoder_get_remaining(decoder) > 0) {
+		return (0);
+	}
+
+	if (dynar_size(&decoder->option) > 0) {
+		/*
+		 * Last option is longer than message
+		 */
+		return (-3);
+	}
+
+	return (1);
+}
+
+/*
+ * Fill type (and fields of fixed layout message) of decoded_msg after msg_decoder_feed
+ * returned 1. Options were already passed to option_cb. Returns 0 or -1 if fixed layout
+ * message has invalid length.
+ */
+int
+msg_decoder_finish(const struct msg_decoder *decoder, struct msg_decoded *decoded_msg)
+{
+
+	decoded_msg->type = msg_get_type(&decoder->msg);
+
+	if (msg_type_has_fixed_layout(decoded_msg->type)) {
+		return (msg_decode_fixed_layout(&decoder->msg, decoded_msg));
+	}
+
+	return (0);
+}
+
+static int
+msg_decode_rope_option(struct tlv_iterator *tlv_iter, void *user_data)
+{
+
+	return (msg_decode_option(tlv_iter, (struct msg_decoded *)user_data));
+}
+
+/*
+ * Decode message stored in rope. Rope is walked chunk by chunk and options are decoded in
+ * place, only options crossing chunk boundary are copied (to decoder). Decoder state is
+ * reset. Return values are same as for msg_decode.
+ */
+int
+msg_decode_rope(const struct rope *msg, struct msg_decoder *decoder, struct msg_decoded *decoded_msg)
+{
+	struct rope_cursor cursor;
+	const char *data;
+	size_t data_len;
+	int res;
+
+	msg_decoded_destroy(decoded_msg);
+	msg_decoder_reset(decoder);
+	msg_decoder_set_max_msg_size(decoder, rope_size(msg));
+
+	res = 0;
+	rope_cursor_init(msg, 0, &cursor);
+
+	while (res == 0 && (data = rope_cursor_get_data(&cursor, &data_len)) != NULL) {
+		res = msg_decoder_feed(decoder, data, data_len, msg_decode_rope_option, decoded_msg);
+		rope_cursor_skip(&cursor, data_len);
+	}
+
+	if (res == -5 || res == -6 || res == 0) {
+		/*
+		 * Invalid type is checked by reader. Message longer than rope or shorter than
+		 * header is inconsistent.
+		 */
+		return (-3);
+	}
+
+	if (res < 0) {
+		return (res);
+	}
+
+	if (msg_decoder_finish(decoder, decoded_msg) != 0) {
+		return (-1);
+	}
+
+	return (0);
+}
+
 void
 msg_get_supported_messages(enum msg_type **supported_messages, size_t *no_supported_messages)
 {
@@ -5,6 +5,7 @@
 #include <inttypes.h>
 
 #include "dynar.h"
+#include "rope.h"
 #include "tlv.h"
 
 #ifdef __cplusplus
@@ -22,6 +23,12 @@ enum msg_type {
 	MSG_TYPE_SET_OPTION_REPLY = 7,
 	MSG_TYPE_ECHO_REQUEST = 8,
 	MSG_TYPE_ECHO_REPLY = 9,
+	MSG_TYPE_NODE_LIST = 10,
+	MSG_TYPE_NODE_LIST_REPLY = 11,
+	MSG_TYPE_VOTE_INFO = 12,
+	MSG_TYPE_CREDIT = 13,
+	MSG_TYPE_HEARTBEAT = 14,
+	MSG_TYPE_HEARTBEAT_REPLY = 15,
 };
 
 struct msg_decoded {
@@ -52,6 +59,43 @@ struct msg_decoded {
 	enum tlv_decision_algorithm_type decision_algorithm;		// Valid only if decision_algorithm_set != 0
 	uint8_t heartbeat_interval_set;
 	uint32_t heartbeat_interval;					// Valid only if heartbeat_interval_set != 0
+	size_t no_node_list;
+	uint32_t *node_list;		// Valid only if != NULL
+	uint8_t vote_set;
+	enum tlv_vote vote;		// Valid only if vote_set != 0
+	uint8_t node_list_epoch_set;
+	uint32_t node_list_epoch;	// Valid only if node_list_epoch_set != 0
+	uint8_t node_list_base_epoch_set;
+	uint32_t node_list_base_epoch;	// Valid only if node_list_base_epoch_set != 0
+	size_t no_node_list_added;
+	uint32_t *node_list_added;	// Valid only if != NULL
+	size_t no_node_list_removed;
+	uint32_t *node_list_removed;	// Valid only if != NULL
+	uint8_t credit_window_set;
+	uint32_t credit_window;		// Valid only if credit_window_set != 0
+	uint8_t credit_set;
+	uint32_t credit;		// Valid only if credit_set != 0
+	uint8_t heartbeat_timestamp_set;
+	uint32_t heartbeat_timestamp;	// Valid only if heartbeat_timestamp_set != 0
+	uint8_t tlv_encoding_set;
+	enum tlv_encoding tlv_encoding;	// Valid only if tlv_encoding_set != 0
+	uint8_t request_window_set;
+	uint32_t request_window;	// Valid only if request_window_set != 0
+	struct arena *arena;		// Strings and arrays are allocated from arena if set
+};
+
+/*
+ * Called by incremental decoder for every complete option. Non zero return value stops
+ * decoding and it's returned by msg_decoder_feed.
+ */
+typedef int (*msg_decoder_option_cb)(struct tlv_iterator *tlv_iter, void *user_data);
+
+struct msg_decoder {
+	struct dynar msg;	// Header and body of fixed layout (heartbeat) message
+	struct dynar option;	// Currently received option
+	size_t option_len;	// Length of whole option. 0 if option header is not complete yet
+	size_t received_bytes;	// Bytes of current message (including header) fed to decoder
+	size_t max_msg_size;	// Including header
 };
 
 extern size_t		msg_create_preinit(struct dynar *msg, const char *cluster_name,
@@ -65,29 +109,62 @@ extern size_t		msg_create_starttls(struct dynar *msg, int add_msg_seq_number,
 
 extern size_t		msg_create_init(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
     const enum msg_type *supported_msgs, size_t no_supported_msgs,
-    const enum tlv_opt_type *supported_opts, size_t no_supported_opts, uint32_t node_id);
+    const enum tlv_opt_type *supported_opts, size_t no_supported_opts, uint32_t node_id,
+    uint32_t credit_window,
+    int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
+    int add_heartbeat_interval, uint32_t heartbeat_interval, const char *cluster_name,
+    enum tlv_encoding tlv_encoding);
 
-extern size_t		msg_create_server_error(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
-    enum tlv_reply_error_code reply_error_code);
+extern size_t		msg_create_server_error(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number, enum tlv_reply_error_code reply_error_code);
 
 extern size_t		msg_create_init_reply(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number,
     const enum msg_type *supported_msgs, size_t no_supported_msgs,
     const enum tlv_opt_type *supported_opts, size_t no_supported_opts,
     size_t server_maximum_request_size, size_t server_maximum_reply_size,
-    const enum tlv_decision_algorithm_type *supported_decision_algorithms, size_t no_supported_decision_algorithms);
+    const enum tlv_decision_algorithm_type *supported_decision_algorithms, size_t no_supported_decision_algorithms,
+    uint32_t request_window,
+    int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
+    int add_heartbeat_interval, uint32_t heartbeat_interval, enum tlv_encoding tlv_encoding);
 
-extern size_t		msg_create_set_option(struct dynar *msg,
+extern size_t		msg_create_set_option(struct dynar *msg, enum tlv_encoding encoding,
     int add_msg_seq_number, uint32_t msg_seq_number,
     int add_decision_algorithm, enum tlv_decision_algorithm_type decision_algorithm,
     int add_heartbeat_interval, uint32_t heartbeat_interval);
 
-extern size_t		msg_create_set_option_reply(struct dynar *msg,
+extern size_t		msg_create_set_option_reply(struct dynar *msg, enum tlv_encoding encoding,
     int add_msg_seq_number, uint32_t msg_seq_number,
     enum tlv_decision_algorithm_type decision_algorithm, uint32_t heartbeat_interval);
 
-extern size_t		msg_create_echo_request(struct dynar *msg, int add_msg_seq_number, uint32_t msg_seq_number);
+extern size_t		msg_create_echo_request(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number);
+
+extern size_t		msg_create_echo_reply(struct dynar *msg, const struct rope *echo_request_msg);
+
+extern size_t		msg_create_node_list(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number, int add_epoch, uint32_t epoch,
+    const uint32_t *node_list, size_t no_nodes);
 
-extern size_t		msg_create_echo_reply(struct dynar *msg, const struct dynar *echo_request_msg);
+extern size_t		msg_create_node_list_delta(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number, uint32_t epoch, uint32_t base_epoch,
+    const uint32_t *added_nodes, size_t no_added_nodes, const uint32_t *removed_nodes, size_t no_removed_nodes);
+
+extern size_t		msg_create_node_list_reply(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number, int add_epoch, uint32_t epoch,
+    enum tlv_vote vote);
+
+extern size_t		msg_create_credit(struct dynar *msg, enum tlv_encoding encoding, uint32_t credit);
+
+extern size_t		msg_create_heartbeat(struct dynar *msg, uint32_t msg_seq_number,
+    uint32_t timestamp);
+
+extern size_t		msg_create_heartbeat_reply(struct dynar *msg, const struct rope *heartbeat_msg);
+
+extern int		msg_decode_heartbeat(const struct dynar *msg, uint32_t *msg_seq_number,
+    uint32_t *timestamp);
+
+extern size_t		msg_create_vote_info(struct dynar *msg, enum tlv_encoding encoding,
+    int add_msg_seq_number, uint32_t msg_seq_number, enum tlv_vote vote);
 
 extern size_t		msg_get_header_length(void);
 
@@ -95,14 +172,44 @@ extern uint32_t		msg_get_len(const struct dynar *msg);
 
 extern enum msg_type	msg_get_type(const struct dynar *msg);
 
+extern enum tlv_encoding	msg_get_tlv_encoding(const struct dynar *msg);
+
 extern int		msg_is_valid_msg_type(const struct dynar *msg);
 
+extern uint32_t		msg_rope_get_len(const struct rope *msg);
+
+extern enum msg_type	msg_rope_get_type(const struct rope *msg);
+
+extern int		msg_rope_is_valid_msg_type(const struct rope *msg);
+
 extern void		msg_decoded_init(struct msg_decoded *decoded_msg);
 
 extern void		msg_decoded_destroy(struct msg_decoded *decoded_msg);
 
+extern void		msg_decoded_set_arena(struct msg_decoded *decoded_msg, struct arena *arena);
+
 extern int		msg_decode(const struct dynar *msg, struct msg_decoded *decoded_msg);
 
+extern int		msg_decode_option(struct tlv_iterator *tlv_iter, struct msg_decoded *decoded_msg);
+
+extern void		msg_decoder_init(struct msg_decoder *decoder, size_t max_msg_size);
+
+extern void		msg_decoder_destroy(struct msg_decoder *decoder);
+
+extern void		msg_decoder_reset(struct msg_decoder *decoder);
+
+extern void		msg_decoder_set_max_msg_size(struct msg_decoder *decoder, size_t max_msg_size);
+
+extern size_t		msg_decoder_get_remaining(const struct msg_decoder *decoder);
+
+extern int		msg_decoder_feed(struct msg_decoder *decoder, const char *data, size_t data_len,
+    msg_decoder_option_cb option_cb, void *user_data);
+
+extern int		msg_decoder_finish(const struct msg_decoder *decoder, struct msg_decoded *decoded_msg);
+
+extern int		msg_decode_rope(const struct rope *msg, struct msg_decoder *decoder,
+    struct msg_decoded *decoded_msg);
+
 extern void		msg_get_supported_messages(enum msg_type **supported_messages,
     size_t *no_supported_messages);
 
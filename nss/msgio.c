@@ -175,3 +175,133 @@ msgio_read(PRFileDesc *socket, struct dynar *msg, size_t *already_received_bytes
 
 	return (ret);
 }
+
+/*
+ * Same as msgio_read but message is received directly to free space of rope, so it's never
+ * reallocated. Return values are same as for msgio_read.
+ */
+int
+msgio_read_rope(PRFileDesc *socket, struct rope *msg, size_t *already_received_bytes, int *skipping_msg)
+{
+	char local_read_buffer[MSGIO_LOCAL_BUF_SIZE];
+	char *read_buffer;
+	size_t read_buffer_len;
+	PRInt32 readed;
+	PRInt32 to_read;
+	int ret;
+
+	ret = 0;
+
+	if (*already_received_bytes < msg_get_header_length()) {
+		to_read = msg_get_header_length() - *already_received_bytes;
+	} else {
+		to_read = (msg_get_header_length() + msg_rope_get_len(msg)) - *already_received_bytes;
+	}
+
+	read_buffer = local_read_buffer;
+	read_buffer_len = MSGIO_LOCAL_BUF_SIZE;
+
+	if (!*skipping_msg && rope_reserve(msg, &read_buffer, &read_buffer_len) == -1) {
+		*skipping_msg = 1;
+		ret = -4;
+
+		read_buffer = local_read_buffer;
+		read_buffer_len = MSGIO_LOCAL_BUF_SIZE;
+	}
+
+	if (*skipping_msg && *already_received_bytes < msg_get_header_length()) {
+		/*
+		 * Fatal error. We were unable to store even message header
+		 */
+		return (-3);
+	}
+
+	if (to_read > read_buffer_len) {
+		to_read = read_buffer_len;
+	}
+
+	readed = PR_Recv(socket, read_buffer, to_read, 0, PR_INTERVAL_NO_TIMEOUT);
+	if (readed > 0) {
+		*already_received_bytes += readed;
+
+		if (!*skipping_msg) {
+			rope_commit(msg, readed);
+		}
+
+		if (!*skipping_msg && *already_received_bytes == msg_get_header_length()) {
+			/*
+			 * Full header received. Check type, maximum size, ...
+			 */
+			if (!msg_rope_is_valid_msg_type(msg)) {
+				*skipping_msg = 1;
+				ret = -5;
+			} else if (msg_get_header_length() + msg_rope_get_len(msg) > rope_max_size(msg)) {
+				*skipping_msg = 1;
+				ret = -6;
+			}
+		}
+
+		if (*already_received_bytes >= msg_get_header_length() &&
+		    *already_received_bytes == (msg_get_header_length() + msg_rope_get_len(msg))) {
+			/*
+			 * Full message skipped or received
+			 */
+			ret = 1;
+		}
+	}
+
+	if (readed == 0) {
+		return (-1);
+	}
+
+	if (readed < 0 && PR_GetError() != PR_WOULD_BLOCK_ERROR) {
+		return (-2);
+	}
+
+	return (ret);
+}
+
+/*
+ * Read next part of message (never past its end) and feed it to incremental decoder.
+ *  1 Full message received
+ *  0 Partial read
+ * -1 End of connection
+ * -2 Unhandled error
+ * -3 Decoder error. Value returned by msg_decoder_feed is stored in decode_res
+ */
+int
+msgio_read_decoder(PRFileDesc *socket, struct msg_decoder *decoder, msg_decoder_option_cb option_cb,
+    void *user_data, int *decode_res)
+{
+	char local_read_buffer[MSGIO_LOCAL_BUF_SIZE];
+	PRInt32 readed;
+	PRInt32 to_read;
+	int res;
+
+	to_read = MSGIO_LOCAL_BUF_SIZE;
+	if (msg_decoder_get_remaining(decoder) < MSGIO_LOCAL_BUF_SIZE) {
+		to_read = msg_decoder_get_remaining(decoder);
+	}
+
+	readed = PR_Recv(socket, local_read_buffer, to_read, 0, PR_INTERVAL_NO_TIMEOUT);
+	if (readed > 0) {
+		res = msg_decoder_feed(decoder, local_read_buffer, readed, option_cb, user_data);
+		if (res < 0) {
+			*decode_res = res;
+
+			return (-3);
+		}
+
+		return (res);
+	}
+
+	if (readed == 0) {
+		return (-1);
+	}
+
+	if (readed < 0 && PR_GetError() != PR_WOULD_BLOCK_ERROR) {
+		return (-2);
+	}
+
+	return (0);
+}
@@ -4,6 +4,8 @@
 #include <nspr.h>
 
 #include "dynar.h"
+#include "msg.h"
+#include "rope.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,6 +20,12 @@ extern int	msgio_write(PRFileDesc *socket, const struct dynar *msg, size_t *alre
 
 extern int	msgio_read(PRFileDesc *socket, struct dynar *msg, size_t *already_received_bytes, int *skipping_msg);
 
+extern int	msgio_read_rope(PRFileDesc *socket, struct rope *msg, size_t *already_received_bytes,
+    int *skipping_msg);
+
+extern int	msgio_read_decoder(PRFileDesc *socket, struct msg_decoder *decoder,
+    msg_decoder_option_cb option_cb, void *user_data, int *decode_res);
+
 #ifdef __cplusplus
 }
 #endif
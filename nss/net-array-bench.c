@@ -0,0 +1,239 @@
+/*
+ * Measure throughput of u16/u32 array conversion to/from network order.
+ *
+ * Usage: net-array-bench [-i iterations]
+ *
+ * Vectorized net_array functions are compared with naive per-item htons/htonl loop working
+ * on malloced temporary buffer (as used by tlv code before).
+ */
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "net-array.h"
+
+#define BENCH_DEFAULT_ITERATIONS	1000
+#define BENCH_MIN_ITEMS			8
+#define BENCH_MAX_ITEMS			65536
+
+static volatile uint32_t bench_sink;
+
+static double
+bench_time_diff(const struct timespec *start, const struct timespec *end)
+{
+
+	return ((end->tv_sec - start->tv_sec) * 1000000.0 + (end->tv_nsec - start->tv_nsec) / 1000.0);
+}
+
+static void
+naive_u16_to_net(void *dst, const uint16_t *src, size_t no_items)
+{
+	uint16_t *tmp;
+	size_t i;
+
+	tmp = malloc(sizeof(uint16_t) * no_items);
+	if (tmp == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	for (i = 0; i < no_items; i++) {
+		tmp[i] = htons(src[i]);
+	}
+
+	memcpy(dst, tmp, sizeof(uint16_t) * no_items);
+	free(tmp);
+}
+
+static void
+naive_u16_from_net(uint16_t *dst, const void *src, size_t no_items)
+{
+	size_t i;
+
+	memcpy(dst, src, sizeof(uint16_t) * no_items);
+
+	for (i = 0; i < no_items; i++) {
+		dst[i] = ntohs(dst[i]);
+	}
+}
+
+static void
+naive_u32_to_net(void *dst, const uint32_t *src, size_t no_items)
+{
+	uint32_t *tmp;
+	size_t i;
+
+	tmp = malloc(sizeof(uint32_t) * no_items);
+	if (tmp == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	for (i = 0; i < no_items; i++) {
+		tmp[i] = htonl(src[i]);
+	}
+
+	memcpy(dst, tmp, sizeof(uint32_t) * no_items);
+	free(tmp);
+}
+
+static void
+naive_u32_from_net(uint32_t *dst, const void *src, size_t no_items)
+{
+	size_t i;
+
+	memcpy(dst, src, sizeof(uint32_t) * no_items);
+
+	for (i = 0; i < no_items; i++) {
+		dst[i] = ntohl(dst[i]);
+	}
+}
+
+static void
+bench_check(const uint16_t *u16a, const uint32_t *u32a, char *net_buf, uint16_t *u16_res,
+    uint32_t *u32_res, size_t no_items)
+{
+	size_t i;
+	uint16_t nu16;
+	uint32_t nu32;
+
+	/*
+	 * Odd offset makes network buffer unaligned
+	 */
+	net_array_u16_to_net(net_buf + 1, u16a, no_items);
+	for (i = 0; i < no_items; i++) {
+		memcpy(&nu16, net_buf + 1 + i * sizeof(nu16), sizeof(nu16));
+		if (ntohs(nu16) != u16a[i]) {
+			errx(1, "u16 to net mismatch for %zu items at %zu", no_items, i);
+		}
+	}
+
+	net_array_u16_from_net(u16_res, net_buf + 1, no_items);
+	if (memcmp(u16_res, u16a, sizeof(uint16_t) * no_items) != 0) {
+		errx(1, "u16 from net mismatch for %zu items", no_items);
+	}
+
+	net_array_u32_to_net(net_buf + 1, u32a, no_items);
+	for (i = 0; i < no_items; i++) {
+		memcpy(&nu32, net_buf + 1 + i * sizeof(nu32), sizeof(nu32));
+		if (ntohl(nu32) != u32a[i]) {
+			errx(1, "u32 to net mismatch for %zu items at %zu", no_items, i);
+		}
+	}
+
+	net_array_u32_from_net(u32_res, net_buf + 1, no_items);
+	if (memcmp(u32_res, u32a, sizeof(uint32_t) * no_items) != 0) {
+		errx(1, "u32 from net mismatch for %zu items", no_items);
+	}
+}
+
+static void
+bench_run(const uint16_t *u16a, const uint32_t *u32a, char *net_buf, uint16_t *u16_res,
+    uint32_t *u32_res, size_t no_items, size_t iterations)
+{
+	struct timespec start, end;
+	double t[8];
+	size_t i;
+	int j;
+
+	for (j = 0; j < 8; j++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (i = 0; i < iterations; i++) {
+			switch (j) {
+			case 0: naive_u16_to_net(net_buf, u16a, no_items); break;
+			case 1: net_array_u16_to_net(net_buf, u16a, no_items); break;
+			case 2: naive_u16_from_net(u16_res, net_buf, no_items); break;
+			case 3: net_array_u16_from_net(u16_res, net_buf, no_items); break;
+			case 4: naive_u32_to_net(net_buf, u32a, no_items); break;
+			case 5: net_array_u32_to_net(net_buf, u32a, no_items); break;
+			case 6: naive_u32_from_net(u32_res, net_buf, no_items); break;
+			case 7: net_array_u32_from_net(u32_res, net_buf, no_items); break;
+			}
+
+			bench_sink += (uint8_t)net_buf[0] + u16_res[0] + u32_res[0];
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		t[j] = bench_time_diff(&start, &end) * 1000.0 / iterations;
+	}
+
+	printf("%8zu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", no_items,
+	    t[0], t[1], t[2], t[3], t[4], t[5], t[6], t[7]);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint16_t *u16a, *u16_res;
+	uint32_t *u32a, *u32_res;
+	char *net_buf;
+	size_t iterations;
+	size_t no_items;
+	size_t i;
+	char *ep;
+	int ch;
+
+	iterations = BENCH_DEFAULT_ITERATIONS;
+
+	while ((ch = getopt(argc, argv, "i:")) != -1) {
+		switch (ch) {
+		case 'i':
+			iterations = strtoul(optarg, &ep, 10);
+			if (*ep != '\0' || iterations == 0) {
+				errx(1, "Invalid number of iterations");
+			}
+			break;
+		default:
+			errx(1, "Usage: %s [-i iterations]", argv[0]);
+			break;
+		}
+	}
+
+	u16a = malloc(sizeof(uint16_t) * BENCH_MAX_ITEMS);
+	u16_res = malloc(sizeof(uint16_t) * BENCH_MAX_ITEMS);
+	u32a = malloc(sizeof(uint32_t) * BENCH_MAX_ITEMS);
+	u32_res = malloc(sizeof(uint32_t) * BENCH_MAX_ITEMS);
+	net_buf = malloc(sizeof(uint32_t) * BENCH_MAX_ITEMS + 1);
+	if (u16a == NULL || u16_res == NULL || u32a == NULL || u32_res == NULL || net_buf == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	srandom(time(NULL));
+	for (i = 0; i < BENCH_MAX_ITEMS; i++) {
+		u16a[i] = (uint16_t)random();
+		u32a[i] = (uint32_t)random() ^ ((uint32_t)random() << 16);
+	}
+
+	/*
+	 * Check also lengths which are not multiple of vector size
+	 */
+	for (no_items = 0; no_items <= 100; no_items++) {
+		bench_check(u16a, u32a, net_buf, u16_res, u32_res, no_items);
+	}
+	for (no_items = BENCH_MIN_ITEMS; no_items <= BENCH_MAX_ITEMS; no_items *= 2) {
+		bench_check(u16a, u32a, net_buf, u16_res, u32_res, no_items);
+	}
+
+	printf("Nanoseconds per call\n");
+	printf("%8s %12s %12s %12s %12s %12s %12s %12s %12s\n", "items",
+	    "u16to naive", "u16to vec", "u16from nai", "u16from vec",
+	    "u32to naive", "u32to vec", "u32from nai", "u32from vec");
+
+	for (no_items = BENCH_MIN_ITEMS; no_items <= BENCH_MAX_ITEMS; no_items *= 2) {
+		bench_run(u16a, u32a, net_buf, u16_res, u32_res, no_items, iterations);
+	}
+
+	free(u16a);
+	free(u16_res);
+	free(u32a);
+	free(u32_res);
+	free(net_buf);
+
+	return (0);
+}
@@ -0,0 +1,199 @@
+#include <sys/types.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "net-array.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define NET_ARRAY_SSE2
+#define NET_ARRAY_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NET_ARRAY_BIG_ENDIAN
+#endif
+
+#ifdef NET_ARRAY_AVX2
+/*
+ * -1 = not checked yet
+ */
+static int net_array_avx2_supported = -1;
+
+static int
+net_array_has_avx2(void)
+{
+
+	if (net_array_avx2_supported == -1) {
+		__builtin_cpu_init();
+		net_array_avx2_supported = (__builtin_cpu_supports("avx2") ? 1 : 0);
+	}
+
+	return (net_array_avx2_supported);
+}
+
+/*
+ * Returns number of swapped items. Rest is left for caller.
+ */
+__attribute__((target("avx2")))
+static size_t
+net_array_bswap16_avx2(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	__m256i mask;
+	__m256i v;
+	size_t i;
+
+	mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+	    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	for (i = 0; i + 16 <= no_items; i += 16) {
+		v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(uint16_t)));
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(uint16_t)), _mm256_shuffle_epi8(v, mask));
+	}
+
+	return (i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+net_array_bswap32_avx2(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	__m256i mask;
+	__m256i v;
+	size_t i;
+
+	mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	for (i = 0; i + 8 <= no_items; i += 8) {
+		v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(uint32_t)));
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(uint32_t)), _mm256_shuffle_epi8(v, mask));
+	}
+
+	return (i);
+}
+#endif
+
+#ifdef NET_ARRAY_SSE2
+static size_t
+net_array_bswap16_sse2(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	__m128i v;
+	size_t i;
+
+	for (i = 0; i + 8 <= no_items; i += 8) {
+		v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(uint16_t)));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(uint16_t)), v);
+	}
+
+	return (i);
+}
+
+static size_t
+net_array_bswap32_sse2(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	__m128i v;
+	size_t i;
+
+	for (i = 0; i + 4 <= no_items; i += 4) {
+		v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(uint32_t)));
+		/*
+		 * Swap bytes of 16-bit words and then words of 32-bit items
+		 */
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(uint32_t)), v);
+	}
+
+	return (i);
+}
+#endif
+
+static void
+net_array_bswap16(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	uint16_t u16;
+	size_t i;
+
+#ifdef NET_ARRAY_BIG_ENDIAN
+	memcpy(dst, src, no_items * sizeof(uint16_t));
+	return ;
+#endif
+
+	i = 0;
+
+#ifdef NET_ARRAY_AVX2
+	if (net_array_has_avx2()) {
+		i = net_array_bswap16_avx2(dst, src, no_items);
+	}
+#endif
+#ifdef NET_ARRAY_SSE2
+	i += net_array_bswap16_sse2(dst + i * sizeof(uint16_t), src + i * sizeof(uint16_t), no_items - i);
+#endif
+
+	for (; i < no_items; i++) {
+		memcpy(&u16, src + i * sizeof(u16), sizeof(u16));
+		u16 = (uint16_t)((u16 << 8) | (u16 >> 8));
+		memcpy(dst + i * sizeof(u16), &u16, sizeof(u16));
+	}
+}
+
+static void
+net_array_bswap32(unsigned char *dst, const unsigned char *src, size_t no_items)
+{
+	uint32_t u32;
+	size_t i;
+
+#ifdef NET_ARRAY_BIG_ENDIAN
+	memcpy(dst, src, no_items * sizeof(uint32_t));
+	return ;
+#endif
+
+	i = 0;
+
+#ifdef NET_ARRAY_AVX2
+	if (net_array_has_avx2()) {
+		i = net_array_bswap32_avx2(dst, src, no_items);
+	}
+#endif
+#ifdef NET_ARRAY_SSE2
+	i += net_array_bswap32_sse2(dst + i * sizeof(uint32_t), src + i * sizeof(uint32_t), no_items - i);
+#endif
+
+	for (; i < no_items; i++) {
+		memcpy(&u32, src + i * sizeof(u32), sizeof(u32));
+		u32 = (u32 << 24) | ((u32 & 0xff00) << 8) | ((u32 >> 8) & 0xff00) | (u32 >> 24);
+		memcpy(dst + i * sizeof(u32), &u32, sizeof(u32));
+	}
+}
+
+void
+net_array_u16_to_net(void *dst, const uint16_t *src, size_t no_items)
+{
+
+	net_array_bswap16(dst, (const unsigned char *)src, no_items);
+}
+
+void
+net_array_u16_from_net(uint16_t *dst, const void *src, size_t no_items)
+{
+
+	net_array_bswap16((unsigned char *)dst, src, no_items);
+}
+
+void
+net_array_u32_to_net(void *dst, const uint32_t *src, size_t no_items)
+{
+
+	net_array_bswap32(dst, (const unsigned char *)src, no_items);
+}
+
+void
+net_array_u32_from_net(uint32_t *dst, const void *src, size_t no_items)
+{
+
+	net_array_bswap32((unsigned char *)dst, src, no_items);
+}
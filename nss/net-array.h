@@ -0,0 +1,27 @@
+#ifndef _NET_ARRAY_H_
+#define _NET_ARRAY_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bulk conversion of u16/u32 arrays between host and network order. Network side buffer
+ * doesn't have to be aligned. SSE2/AVX2 is used on x86 when available.
+ */
+extern void	net_array_u16_to_net(void *dst, const uint16_t *src, size_t no_items);
+
+extern void	net_array_u16_from_net(uint16_t *dst, const void *src, size_t no_items);
+
+extern void	net_array_u32_to_net(void *dst, const uint32_t *src, size_t no_items);
+
+extern void	net_array_u32_from_net(uint32_t *dst, const void *src, size_t no_items);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NET_ARRAY_H_ */
@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "node-list.h"
+
+#define TEST_MAX_NODES		64
+#define TEST_NO_RANDOM_CYCLES	1000
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+static void
+check_list(const struct node_list *list, const uint32_t *expected, size_t no_expected)
+{
+
+	assert(list->size == no_expected);
+	assert(no_expected == 0 || memcmp(list->node_ids, expected, sizeof(*expected) * no_expected) == 0);
+}
+
+static void
+fill_random(uint32_t *node_ids, size_t *no_node_ids)
+{
+	size_t zi;
+
+	*no_node_ids = random() % TEST_MAX_NODES;
+
+	/*
+	 * Small range, so lists overlap and contain duplicates
+	 */
+	for (zi = 0; zi < *no_node_ids; zi++) {
+		node_ids[zi] = random() % (TEST_MAX_NODES / 2);
+	}
+}
+
+int
+main(void)
+{
+	const uint32_t base[] = {5, 1, 4, 2, 3};
+	const uint32_t added[] = {6, 3};
+	const uint32_t removed[] = {3, 1};
+	const uint32_t res1[] = {2, 3, 4, 5, 6};
+	const uint32_t added_dup[] = {7, 7, 2};
+	const uint32_t removed_missing[] = {100, 2, 2};
+	const uint32_t res2[] = {2, 3, 4, 5, 6, 7};
+	const uint32_t same[] = {4, 4};
+	const uint32_t res3[] = {3, 6};
+	const uint32_t removed_all[] = {2, 3, 4, 5, 6, 7, 8};
+	const uint32_t big[] = {10, 11, 12, 13, 14, 15, 16, 17};
+	uint32_t old_ids[TEST_MAX_NODES];
+	uint32_t new_ids[TEST_MAX_NODES];
+	size_t no_old_ids, no_new_ids;
+	struct node_list list, list2;
+	struct node_list diff_added, diff_removed;
+	size_t zi;
+
+	node_list_init(&list, TEST_MAX_NODES);
+
+	assert(node_list_set(&list, base, ARRAY_SIZE(base)) == 0);
+
+	/*
+	 * Node 3 is both removed and added, so it stays in list
+	 */
+	assert(node_list_apply_delta(&list, added, ARRAY_SIZE(added), removed, ARRAY_SIZE(removed)) == 0);
+	check_list(&list, res1, ARRAY_SIZE(res1));
+
+	/*
+	 * Duplicates in delta, removing missing node, re-adding existing node
+	 */
+	assert(node_list_apply_delta(&list, added_dup, ARRAY_SIZE(added_dup), removed_missing,
+	    ARRAY_SIZE(removed_missing)) == 0);
+	check_list(&list, res2, ARRAY_SIZE(res2));
+
+	assert(node_list_apply_delta(&list, same, ARRAY_SIZE(same), same, ARRAY_SIZE(same)) == 0);
+	check_list(&list, res2, ARRAY_SIZE(res2));
+
+	/*
+	 * Empty deltas
+	 */
+	assert(node_list_apply_delta(&list, NULL, 0, NULL, 0) == 0);
+	check_list(&list, res2, ARRAY_SIZE(res2));
+
+	assert(node_list_apply_delta(&list, NULL, 0, removed_all, ARRAY_SIZE(removed_all)) == 0);
+	check_list(&list, NULL, 0);
+
+	assert(node_list_apply_delta(&list, added, ARRAY_SIZE(added), NULL, 0) == 0);
+	check_list(&list, res3, ARRAY_SIZE(res3));
+
+	node_list_destroy(&list);
+
+	/*
+	 * Result bigger than maximum size
+	 */
+	node_list_init(&list, 4);
+	assert(node_list_apply_delta(&list, big, ARRAY_SIZE(big), NULL, 0) == -1);
+	node_list_destroy(&list);
+
+	/*
+	 * Delta computed by node_list_diff transforms old list to new list
+	 */
+	srandom(1);
+
+	node_list_init(&list, TEST_MAX_NODES);
+	node_list_init(&list2, TEST_MAX_NODES);
+	node_list_init(&diff_added, TEST_MAX_NODES);
+	node_list_init(&diff_removed, TEST_MAX_NODES);
+
+	for (zi = 0; zi < TEST_NO_RANDOM_CYCLES; zi++) {
+		fill_random(old_ids, &no_old_ids);
+		fill_random(new_ids, &no_new_ids);
+
+		assert(node_list_set(&list, old_ids, no_old_ids) == 0);
+		assert(node_list_set(&list2, new_ids, no_new_ids) == 0);
+		assert(node_list_diff(&list, &list2, &diff_added, &diff_removed) == 0);
+
+		assert(node_list_apply_delta(&list, diff_added.node_ids, diff_added.size,
+		    diff_removed.node_ids, diff_removed.size) == 0);
+		check_list(&list, list2.node_ids, list2.size);
+	}
+
+	node_list_destroy(&list);
+	node_list_destroy(&list2);
+	node_list_destroy(&diff_added);
+	node_list_destroy(&diff_removed);
+
+	printf("node-list-ut: all tests passed\n");
+
+	return (0);
+}
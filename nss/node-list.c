@@ -0,0 +1,258 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "node-list.h"
+
+static int
+node_list_node_id_cmp(const void *a, const void *b)
+{
+	uint32_t ia, ib;
+
+	ia = *(const uint32_t *)a;
+	ib = *(const uint32_t *)b;
+
+	return (ia < ib ? -1 : (ia > ib ? 1 : 0));
+}
+
+/*
+ * Remove duplicates from sorted array. Returns new number of items.
+ */
+static size_t
+node_list_uniq(uint32_t *node_ids, size_t no_node_ids)
+{
+	size_t zi, zj;
+
+	if (no_node_ids == 0) {
+		return (0);
+	}
+
+	for (zi = 1, zj = 1; zi < no_node_ids; zi++) {
+		if (node_ids[zi] != node_ids[zj - 1]) {
+			node_ids[zj++] = node_ids[zi];
+		}
+	}
+
+	return (zj);
+}
+
+/*
+ * Copy node_ids into newly allocated sorted array without duplicates
+ */
+static uint32_t *
+node_list_sorted_copy(const uint32_t *node_ids, size_t no_node_ids, size_t *no_items)
+{
+	uint32_t *res;
+
+	res = malloc(sizeof(*res) * (no_node_ids > 0 ? no_node_ids : 1));
+	if (res == NULL) {
+		return (NULL);
+	}
+
+	if (no_node_ids > 0) {
+		/*
+		 * node_ids may be NULL for empty delta
+		 */
+		memcpy(res, node_ids, sizeof(*res) * no_node_ids);
+		qsort(res, no_node_ids, sizeof(*res), node_list_node_id_cmp);
+	}
+	*no_items = node_list_uniq(res, no_node_ids);
+
+	return (res);
+}
+
+static int
+node_list_reserve(struct node_list *list, size_t size)
+{
+	uint32_t *new_node_ids;
+	size_t new_allocated;
+
+	if (size <= list->allocated) {
+		return (0);
+	}
+
+	new_allocated = (list->allocated > 0 ? list->allocated * 2 : 8);
+	if (new_allocated < size) {
+		new_allocated = size;
+	}
+
+	new_node_ids = realloc(list->node_ids, sizeof(*new_node_ids) * new_allocated);
+	if (new_node_ids == NULL) {
+		return (-1);
+	}
+
+	list->node_ids = new_node_ids;
+	list->allocated = new_allocated;
+
+	return (0);
+}
+
+void
+node_list_init(struct node_list *list, size_t maximum_size)
+{
+
+	memset(list, 0, sizeof(*list));
+	list->maximum_size = maximum_size;
+}
+
+void
+node_list_destroy(struct node_list *list)
+{
+
+	free(list->node_ids);
+	node_list_init(list, list->maximum_size);
+}
+
+void
+node_list_clean(struct node_list *list)
+{
+
+	list->size = 0;
+}
+
+/*
+ * Replace content of list by node_ids (in any order, may contain duplicates).
+ * Returns 0 on success, -1 if list would be too big or on allocation failure.
+ */
+int
+node_list_set(struct node_list *list, const uint32_t *node_ids, size_t no_node_ids)
+{
+
+	if (no_node_ids > list->maximum_size || node_list_reserve(list, no_node_ids) != 0) {
+		return (-1);
+	}
+
+	memcpy(list->node_ids, node_ids, sizeof(*node_ids) * no_node_ids);
+	qsort(list->node_ids, no_node_ids, sizeof(*node_ids), node_list_node_id_cmp);
+	list->size = node_list_uniq(list->node_ids, no_node_ids);
+
+	return (0);
+}
+
+int
+node_list_copy(struct node_list *dst, const struct node_list *src)
+{
+
+	if (node_list_reserve(dst, src->size) != 0) {
+		return (-1);
+	}
+
+	memcpy(dst->node_ids, src->node_ids, sizeof(*src->node_ids) * src->size);
+	dst->size = src->size;
+
+	return (0);
+}
+
+/*
+ * Remove removed node ids from list and add added node ids in place. Node ids which are
+ * both removed and added stay in list. Cost is linear in list size plus sorting of delta.
+ * Returns 0 on success, -1 if resulting list is too big or on allocation failure. Content
+ * of list is undefined after failure.
+ */
+int
+node_list_apply_delta(struct node_list *list, const uint32_t *added, size_t no_added,
+    const uint32_t *removed, size_t no_removed)
+{
+	uint32_t *sorted;
+	size_t no_sorted;
+	size_t zi, zj, zk;
+
+	/*
+	 * Filter out removed node ids
+	 */
+	sorted = node_list_sorted_copy(removed, no_removed, &no_sorted);
+	if (sorted == NULL) {
+		return (-1);
+	}
+
+	for (zi = 0, zj = 0, zk = 0; zi < list->size; zi++) {
+		while (zk < no_sorted && sorted[zk] < list->node_ids[zi]) {
+			zk++;
+		}
+
+		if (zk < no_sorted && sorted[zk] == list->node_ids[zi]) {
+			continue ;
+		}
+
+		list->node_ids[zj++] = list->node_ids[zi];
+	}
+	list->size = zj;
+
+	free(sorted);
+
+	/*
+	 * Merge added node ids from the end, so no temporary array is needed, then drop
+	 * duplicates
+	 */
+	sorted = node_list_sorted_copy(added, no_added, &no_sorted);
+	if (sorted == NULL) {
+		return (-1);
+	}
+
+	if (node_list_reserve(list, list->size + no_sorted) != 0) {
+		free(sorted);
+
+		return (-1);
+	}
+
+	zi = list->size;
+	zj = no_sorted;
+	zk = list->size + no_sorted;
+
+	while (zj > 0) {
+		if (zi > 0 && list->node_ids[zi - 1] > sorted[zj - 1]) {
+			list->node_ids[--zk] = list->node_ids[--zi];
+		} else {
+			list->node_ids[--zk] = sorted[--zj];
+		}
+	}
+
+	list->size = node_list_uniq(list->node_ids, list->size + no_sorted);
+
+	free(sorted);
+
+	if (list->size > list->maximum_size) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Compute node ids which are in new_list but not in old_list (added) and node ids which
+ * are in old_list but not in new_list (removed).
+ */
+int
+node_list_diff(const struct node_list *old_list, const struct node_list *new_list,
+    struct node_list *added, struct node_list *removed)
+{
+	size_t zi, zj;
+
+	node_list_clean(added);
+	node_list_clean(removed);
+
+	zi = zj = 0;
+
+	while (zi < old_list->size || zj < new_list->size) {
+		if (zj >= new_list->size ||
+		    (zi < old_list->size && old_list->node_ids[zi] < new_list->node_ids[zj])) {
+			if (node_list_reserve(removed, removed->size + 1) != 0) {
+				return (-1);
+			}
+
+			removed->node_ids[removed->size++] = old_list->node_ids[zi++];
+		} else if (zi >= old_list->size || new_list->node_ids[zj] < old_list->node_ids[zi]) {
+			if (node_list_reserve(added, added->size + 1) != 0) {
+				return (-1);
+			}
+
+			added->node_ids[added->size++] = new_list->node_ids[zj++];
+		} else {
+			zi++;
+			zj++;
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,41 @@
+#ifndef _NODE_LIST_H_
+#define _NODE_LIST_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Set of node ids kept as sorted array without duplicates
+ */
+struct node_list {
+	uint32_t *node_ids;
+	size_t size;
+	size_t allocated;
+	size_t maximum_size;
+};
+
+extern void	node_list_init(struct node_list *list, size_t maximum_size);
+
+extern void	node_list_destroy(struct node_list *list);
+
+extern void	node_list_clean(struct node_list *list);
+
+extern int	node_list_set(struct node_list *list, const uint32_t *node_ids, size_t no_node_ids);
+
+extern int	node_list_copy(struct node_list *dst, const struct node_list *src);
+
+extern int	node_list_apply_delta(struct node_list *list, const uint32_t *added, size_t no_added,
+    const uint32_t *removed, size_t no_removed);
+
+extern int	node_list_diff(const struct node_list *old_list, const struct node_list *new_list,
+    struct node_list *added, struct node_list *removed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NODE_LIST_H_ */
@@ -1,4 +1,12 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <errno.h>
+
 #include <prnetdb.h>
+#include <private/pprio.h>
 
 #include "nss-sock.h"
 
@@ -34,6 +42,24 @@ nss_sock_set_nonblocking(PRFileDesc *sock)
 	return (0);
 }
 
+/*
+ * Set NSS socket blocking
+ */
+int
+nss_sock_set_blocking(PRFileDesc *sock)
+{
+	PRSocketOptionData sock_opt;
+
+	memset(&sock_opt, 0, sizeof(sock_opt));
+	sock_opt.option = PR_SockOpt_Nonblocking;
+	sock_opt.value.non_blocking = PR_FALSE;
+	if (PR_SetSocketOption(sock, &sock_opt) != PR_SUCCESS) {
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Create TCP socket with af family. If reuse_addr is set, socket option
  * for reuse address is set.
@@ -61,139 +87,516 @@ nss_sock_create_socket(PRIntn af, int reuse_addr)
 }
 
 /*
- * Create listen socket and bind it to address. hostname can be NULL and then
- * any address is used. Address family (af) can be ether PR_AF_INET6 or
- * PR_AF_INET.
+ * Set TCP_DEFER_ACCEPT on listening socket, so accept is woken up only when
+ * client sent some data (or timeout in seconds expired). On platforms without
+ * TCP_DEFER_ACCEPT this is noop.
  */
-PRFileDesc *
-nss_sock_create_listen_socket(const char *hostname, uint16_t port, PRIntn af)
+static int
+nss_sock_set_defer_accept(PRFileDesc *socket, PRUint32 timeout)
+{
+#ifdef TCP_DEFER_ACCEPT
+	int val;
+
+	val = timeout;
+
+	if (setsockopt(PR_FileDesc2NativeHandle(socket), IPPROTO_TCP, TCP_DEFER_ACCEPT,
+	    &val, sizeof(val)) != 0) {
+		PR_SetError(PR_UNKNOWN_ERROR, errno);
+
+		return (-1);
+	}
+#endif
+
+	return (0);
+}
+
+/*
+ * Resolve hostname to at most *no_addrs addresses (on input size of addrs array, on output number
+ * of stored addresses). Blocks until resolver returns.
+ */
+int
+nss_sock_resolve(const char *hostname, uint16_t port, PRIntn af, PRNetAddr *addrs, size_t *no_addrs)
 {
-	PRNetAddr addr;
-	PRFileDesc *socket;
 	PRAddrInfo *addr_info;
-	PRIntn tmp_af;
 	void *addr_iter;
+	size_t max_addrs;
 
-	socket = NULL;
+	max_addrs = *no_addrs;
+	*no_addrs = 0;
 
-	if (hostname == NULL) {
-		memset(&addr, 0, sizeof(addr));
+	addr_info = PR_GetAddrInfoByName(hostname, af, PR_AI_ADDRCONFIG);
+	if (addr_info == NULL) {
+		return (-1);
+	}
 
-		if (PR_InitializeNetAddr(PR_IpAddrAny, port, &addr) != PR_SUCCESS) {
-			return (NULL);
+	addr_iter = NULL;
+
+	while (*no_addrs < max_addrs &&
+	    (addr_iter = PR_EnumerateAddrInfo(addr_iter, addr_info, port, &addrs[*no_addrs])) != NULL) {
+		(*no_addrs)++;
+	}
+
+	PR_FreeAddrInfo(addr_info);
+
+	return (0);
+}
+
+/*
+ * Create listen socket and bind it to first of addresses (with af family) where bind succeeds.
+ */
+PRFileDesc *
+nss_sock_create_listen_socket_addrs(const PRNetAddr *addrs, size_t no_addrs, PRIntn af,
+    PRUint32 defer_accept_timeout)
+{
+	PRFileDesc *socket;
+	size_t zi;
+	int bind_tried;
+
+	socket = NULL;
+	bind_tried = 0;
+
+	for (zi = 0; zi < no_addrs && socket == NULL; zi++) {
+		if (addrs[zi].raw.family != af) {
+			continue ;
 		}
-		addr.raw.family = af;
+
+		bind_tried = 1;
 
 		socket = nss_sock_create_socket(af, 1);
 		if (socket == NULL) {
-			return (NULL);
+			continue ;
 		}
 
-		if (PR_Bind(socket, &addr) != PR_SUCCESS) {
+		if (PR_Bind(socket, &addrs[zi]) != PR_SUCCESS) {
 			PR_Close(socket);
+			socket = NULL;
+		}
+	}
 
+	if (socket == NULL) {
+		if (!bind_tried) {
+			/*
+			 * No address with required family
+			 */
+			PR_SetError(PR_ADDRESS_NOT_AVAILABLE_ERROR, 0);
+		}
+
+		return (NULL);
+	}
+
+	if (defer_accept_timeout > 0 && nss_sock_set_defer_accept(socket, defer_accept_timeout) != 0) {
+		PR_Close(socket);
+
+		return (NULL);
+	}
+
+	return (socket);
+}
+
+/*
+ * Create listen socket and bind it to address. hostname can be NULL and then
+ * any address is used. Address family (af) can be ether PR_AF_INET6 or
+ * PR_AF_INET. If defer_accept_timeout is not 0, accept is deferred
+ * (TCP_DEFER_ACCEPT) until data arrives or timeout (in seconds) expires.
+ */
+PRFileDesc *
+nss_sock_create_listen_socket(const char *hostname, uint16_t port, PRIntn af, PRUint32 defer_accept_timeout)
+{
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+
+	no_addrs = 1;
+
+	if (hostname == NULL) {
+		memset(&addrs[0], 0, sizeof(addrs[0]));
+
+		if (PR_InitializeNetAddr(PR_IpAddrAny, port, &addrs[0]) != PR_SUCCESS) {
 			return (NULL);
 		}
+		addrs[0].raw.family = af;
 	} else {
-		tmp_af = PR_AF_UNSPEC;
-		if (af == PR_AF_INET)
-			tmp_af = PR_AF_INET;
+		no_addrs = NSS_SOCK_CONNECT_MAX_ADDRS;
 
-		addr_info = PR_GetAddrInfoByName(hostname, tmp_af, PR_AI_ADDRCONFIG);
-		if (addr_info == NULL) {
+		if (nss_sock_resolve(hostname, port, (af == PR_AF_INET ? PR_AF_INET : PR_AF_UNSPEC),
+		    addrs, &no_addrs) != 0) {
 			return (NULL);
 		}
+	}
 
-		addr_iter = NULL;
+	return (nss_sock_create_listen_socket_addrs(addrs, no_addrs, af, defer_accept_timeout));
+}
 
-		while ((addr_iter = PR_EnumerateAddrInfo(addr_iter, addr_info, port, &addr)) != NULL) {
-			if (addr.raw.family == af) {
-				socket = nss_sock_create_socket(af, 1);
-				if (socket == NULL) {
-					continue ;
-				}
+/*
+ * Return family of address used for interleaving. Unknown families are sorted together with IPv4.
+ */
+static PRUint16
+nss_sock_addr_family(const PRNetAddr *addr)
+{
 
-				if (PR_Bind(socket, &addr) != PR_SUCCESS) {
-					PR_Close(socket);
-					socket = NULL;
+	return (addr->raw.family == PR_AF_INET6 ? PR_AF_INET6 : PR_AF_INET);
+}
 
-					continue ;
-				}
+/*
+ * Reorder addresses so families alternate (first family is kept from resolver result, as
+ * recommended by RFC 6724 sorting). Relative order within one family is kept.
+ */
+static void
+nss_sock_interleave_addrs(PRNetAddr *addrs, size_t no_addrs)
+{
+	PRNetAddr sorted[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t first_family_pos, second_family_pos;
+	size_t zi;
+	PRUint16 first_family;
+
+	if (no_addrs == 0) {
+		return ;
+	}
+
+	first_family = nss_sock_addr_family(&addrs[0]);
+	first_family_pos = 0;
+	second_family_pos = 0;
+
+	for (zi = 0; zi < no_addrs; zi++) {
+		while (first_family_pos < no_addrs &&
+		    nss_sock_addr_family(&addrs[first_family_pos]) != first_family) {
+			first_family_pos++;
+		}
+
+		while (second_family_pos < no_addrs &&
+		    nss_sock_addr_family(&addrs[second_family_pos]) == first_family) {
+			second_family_pos++;
+		}
+
+		if ((zi % 2 == 0 && first_family_pos < no_addrs) || second_family_pos >= no_addrs) {
+			memcpy(&sorted[zi], &addrs[first_family_pos++], sizeof(sorted[zi]));
+		} else {
+			memcpy(&sorted[zi], &addrs[second_family_pos++], sizeof(sorted[zi]));
+		}
+	}
+
+	memcpy(addrs, sorted, sizeof(*addrs) * no_addrs);
+}
+
+/*
+ * Prepare non-blocking connect to one of addresses in addrs array. Connection attempts are
+ * raced (happy eyeballs, RFC 8305). Attempt to next address is started after
+ * NSS_SOCK_CONNECT_ATTEMPT_DELAY ms or immediately if all running attempts failed. Every
+ * attempt is aborted after attempt_timeout, so whole connect takes at most
+ * (no_addrs - 1) * NSS_SOCK_CONNECT_ATTEMPT_DELAY + attempt_timeout. No attempt is started
+ * until first call of nss_sock_connector_process.
+ */
+void
+nss_sock_connector_init(struct nss_sock_connector *connector, const PRNetAddr *addrs, size_t no_addrs,
+    PRIntervalTime attempt_timeout)
+{
+
+	memset(connector, 0, sizeof(*connector));
+
+	if (no_addrs > NSS_SOCK_CONNECT_MAX_ADDRS) {
+		no_addrs = NSS_SOCK_CONNECT_MAX_ADDRS;
+	}
+
+	memcpy(connector->addrs, addrs, sizeof(*addrs) * no_addrs);
+	nss_sock_interleave_addrs(connector->addrs, no_addrs);
+	connector->no_addrs = no_addrs;
+	connector->attempt_timeout = attempt_timeout;
+	connector->next_attempt_time = PR_IntervalNow();
+	connector->last_error = PR_ADDRESS_NOT_AVAILABLE_ERROR;
+}
+
+/*
+ * Close all running attempts
+ */
+void
+nss_sock_connector_destroy(struct nss_sock_connector *connector)
+{
+	size_t zi;
+
+	for (zi = 0; zi < connector->next_attempt; zi++) {
+		if (connector->attempts[zi] != NULL) {
+			PR_Close(connector->attempts[zi]);
+			connector->attempts[zi] = NULL;
+		}
+	}
+}
 
-				/*
-				 * Socket is sucesfully bound
-				 */
+static void
+nss_sock_connector_attempt_failed(struct nss_sock_connector *connector, size_t attempt,
+    PRErrorCode error, PRInt32 os_error)
+{
+
+	connector->last_error = error;
+	connector->last_os_error = os_error;
+
+	if (connector->attempts[attempt] != NULL) {
+		PR_Close(connector->attempts[attempt]);
+		connector->attempts[attempt] = NULL;
+	}
+}
+
+static size_t
+nss_sock_connector_no_running(const struct nss_sock_connector *connector)
+{
+	size_t zi;
+	size_t res;
+
+	res = 0;
+
+	for (zi = 0; zi < connector->next_attempt; zi++) {
+		if (connector->attempts[zi] != NULL) {
+			res++;
+		}
+	}
+
+	return (res);
+}
+
+/*
+ * Start attempt to next address. Returns 1 if connection was established immediately,
+ * 0 if attempt is in progress or -1 if attempt failed.
+ */
+static int
+nss_sock_connector_start_attempt(struct nss_sock_connector *connector, PRIntervalTime now,
+    PRFileDesc **socket)
+{
+	PRFileDesc *sock;
+	size_t zi;
+
+	zi = connector->next_attempt++;
+	connector->next_attempt_time = now + PR_MillisecondsToInterval(NSS_SOCK_CONNECT_ATTEMPT_DELAY);
+
+	sock = nss_sock_create_socket(connector->addrs[zi].raw.family, 0);
+	if (sock == NULL) {
+		nss_sock_connector_attempt_failed(connector, zi, PR_GetError(), PR_GetOSError());
+
+		return (-1);
+	}
+
+	connector->attempts[zi] = sock;
+	connector->attempt_start_time[zi] = now;
+
+	if (nss_sock_set_nonblocking(sock) != 0) {
+		nss_sock_connector_attempt_failed(connector, zi, PR_GetError(), PR_GetOSError());
+
+		return (-1);
+	}
+
+	if (PR_Connect(sock, &connector->addrs[zi], PR_INTERVAL_NO_WAIT) == PR_SUCCESS) {
+		connector->attempts[zi] = NULL;
+		*socket = sock;
+
+		return (1);
+	}
+
+	if (PR_GetError() != PR_IN_PROGRESS_ERROR) {
+		nss_sock_connector_attempt_failed(connector, zi, PR_GetError(), PR_GetOSError());
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Fill pfds (array of at least NSS_SOCK_CONNECT_MAX_ADDRS items) with running attempts.
+ * Returns number of used items.
+ */
+size_t
+nss_sock_connector_get_pfds(const struct nss_sock_connector *connector, PRPollDesc *pfds)
+{
+	size_t no_pfds;
+	size_t zi;
+
+	no_pfds = 0;
+
+	for (zi = 0; zi < connector->next_attempt; zi++) {
+		if (connector->attempts[zi] != NULL) {
+			pfds[no_pfds].fd = connector->attempts[zi];
+			pfds[no_pfds].in_flags = PR_POLL_WRITE | PR_POLL_EXCEPT;
+			pfds[no_pfds].out_flags = 0;
+			no_pfds++;
+		}
+	}
+
+	return (no_pfds);
+}
+
+static void
+nss_sock_connector_min_timeout(PRIntervalTime deadline, PRIntervalTime now, PRIntervalTime *timeout)
+{
+	PRIntervalTime remaining;
+
+	remaining = ((PRInt32)(deadline - now) > 0 ? (PRIntervalTime)(deadline - now) : PR_INTERVAL_NO_WAIT);
+
+	if (remaining < *timeout) {
+		*timeout = remaining;
+	}
+}
+
+/*
+ * Return time until nss_sock_connector_process has to be called even if none of pfds has
+ * event (next attempt has to be started or running attempt times out)
+ */
+PRIntervalTime
+nss_sock_connector_time_to_next_event(const struct nss_sock_connector *connector)
+{
+	PRIntervalTime now, res;
+	size_t zi;
+
+	now = PR_IntervalNow();
+	res = PR_INTERVAL_NO_TIMEOUT;
+
+	if (connector->next_attempt < connector->no_addrs) {
+		nss_sock_connector_min_timeout(connector->next_attempt_time, now, &res);
+	}
+
+	for (zi = 0; zi < connector->next_attempt; zi++) {
+		if (connector->attempts[zi] != NULL) {
+			nss_sock_connector_min_timeout(connector->attempt_start_time[zi] +
+			    connector->attempt_timeout, now, &res);
+		}
+	}
+
+	return (res);
+}
+
+/*
+ * Process result of polling pfds returned by nss_sock_connector_get_pfds. pfds must be passed
+ * only when PR_Poll returned events (out_flags are not reset on timeout), otherwise pfds can
+ * be NULL and no_pfds 0. Abort timed out attempts and start new attempts. Returns 1 and sets
+ * socket (non-blocking) when connection is established, 0 if connect is still in progress
+ * or -1 (with NSPR error set) if all attempts failed. Connector must not be used after
+ * non-zero return except for nss_sock_connector_init.
+ */
+int
+nss_sock_connector_process(struct nss_sock_connector *connector, const PRPollDesc *pfds, size_t no_pfds,
+    PRFileDesc **socket)
+{
+	PRIntervalTime now;
+	size_t zi, zj;
+
+	*socket = NULL;
+
+	for (zi = 0; zi < no_pfds; zi++) {
+		if (pfds[zi].out_flags == 0) {
+			continue ;
+		}
+
+		for (zj = 0; zj < connector->next_attempt; zj++) {
+			if (connector->attempts[zj] != NULL && connector->attempts[zj] == pfds[zi].fd) {
 				break;
 			}
 		}
 
-		PR_FreeAddrInfo(addr_info);
+		if (zj == connector->next_attempt) {
+			continue ;
+		}
 
-		if (socket == NULL) {
-			/*
-			 * No address succeeded
-			 */
-			PR_SetError(PR_ADDRESS_NOT_AVAILABLE_ERROR, 0);
+		if (PR_GetConnectStatus(&pfds[zi]) == PR_SUCCESS) {
+			*socket = connector->attempts[zj];
+			connector->attempts[zj] = NULL;
+			nss_sock_connector_destroy(connector);
 
-			return (NULL);
+			return (1);
+		}
+
+		if (PR_GetError() != PR_IN_PROGRESS_ERROR) {
+			nss_sock_connector_attempt_failed(connector, zj, PR_GetError(), PR_GetOSError());
 		}
 	}
 
-	return (socket);
+	now = PR_IntervalNow();
+
+	for (zi = 0; zi < connector->next_attempt; zi++) {
+		if (connector->attempts[zi] != NULL &&
+		    (PRIntervalTime)(now - connector->attempt_start_time[zi]) >= connector->attempt_timeout) {
+			nss_sock_connector_attempt_failed(connector, zi, PR_IO_TIMEOUT_ERROR, 0);
+		}
+	}
+
+	while (connector->next_attempt < connector->no_addrs &&
+	    (nss_sock_connector_no_running(connector) == 0 ||
+	    (PRInt32)(now - connector->next_attempt_time) >= 0)) {
+		if (nss_sock_connector_start_attempt(connector, now, socket) == 1) {
+			nss_sock_connector_destroy(connector);
+
+			return (1);
+		}
+	}
+
+	if (nss_sock_connector_no_running(connector) == 0) {
+		PR_SetError(connector->last_error, connector->last_os_error);
+
+		return (-1);
+	}
+
+	return (0);
 }
 
 /*
- * Create listen socket and bind it to address. hostname can be NULL and then
- * any address is used. Address family (af) can be ether PR_AF_UNSPEC or
- * PR_AF_INET.
+ * Blocking version of nss_sock_connector. Timeout is timeout of one attempt. Returned socket
+ * is in blocking mode.
  */
 PRFileDesc *
-nss_sock_create_client_socket(const char *hostname, uint16_t port, PRIntn af, PRIntervalTime timeout)
+nss_sock_create_client_socket_addrs(const PRNetAddr *addrs, size_t no_addrs, PRIntervalTime timeout)
 {
-	PRNetAddr addr;
+	struct nss_sock_connector connector;
+	PRPollDesc pfds[NSS_SOCK_CONNECT_MAX_ADDRS];
 	PRFileDesc *socket;
-	PRAddrInfo *addr_info;
-	void *addr_iter;
-	PRStatus res;
-	int connect_failed;
+	PRInt32 poll_res;
+	size_t no_pfds;
+	int res;
 
-	socket = NULL;
-	connect_failed = 0;
+	nss_sock_connector_init(&connector, addrs, no_addrs, timeout);
+	no_pfds = 0;
 
-	addr_info = PR_GetAddrInfoByName(hostname, af, PR_AI_ADDRCONFIG);
-	if (addr_info == NULL) {
-		return (NULL);
-	}
+	while ((res = nss_sock_connector_process(&connector, pfds, no_pfds, &socket)) == 0) {
+		no_pfds = nss_sock_connector_get_pfds(&connector, pfds);
 
-	addr_iter = NULL;
+		poll_res = PR_Poll(pfds, no_pfds, nss_sock_connector_time_to_next_event(&connector));
+		if (poll_res < 0) {
+			nss_sock_connector_destroy(&connector);
 
-	while ((addr_iter = PR_EnumerateAddrInfo(addr_iter, addr_info, port, &addr)) != NULL) {
-		socket = nss_sock_create_socket(addr.raw.family, 0);
-		if (socket == NULL) {
-			continue ;
+			return (NULL);
 		}
 
-		if ((res = PR_Connect(socket, &addr, timeout)) != PR_SUCCESS) {
-			PR_Close(socket);
-			socket = NULL;
-			connect_failed = 1;
+		if (poll_res == 0) {
+			no_pfds = 0;
 		}
+	}
 
-		/*
-		 * Connection attempt finished
-		 */
-		break;
+	if (res == -1) {
+		return (NULL);
 	}
 
-	PR_FreeAddrInfo(addr_info);
+	if (nss_sock_set_blocking(socket) != 0) {
+		PR_Close(socket);
 
-	if (socket == NULL && !connect_failed) {
-		PR_SetError(PR_ADDRESS_NOT_AVAILABLE_ERROR, 0);
+		return (NULL);
 	}
 
 	return (socket);
 }
 
+/*
+ * Create client socket connected to hostname. Address family (af) can be ether PR_AF_UNSPEC or
+ * PR_AF_INET. All resolved addresses are tried in parallel (see nss_sock_create_client_socket_addrs).
+ */
+PRFileDesc *
+nss_sock_create_client_socket(const char *hostname, uint16_t port, PRIntn af, PRIntervalTime timeout)
+{
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+
+	no_addrs = NSS_SOCK_CONNECT_MAX_ADDRS;
+
+	if (nss_sock_resolve(hostname, port, af, addrs, &no_addrs) != 0) {
+		return (NULL);
+	}
+
+	return (nss_sock_create_client_socket_addrs(addrs, no_addrs, timeout));
+}
+
 /*
  * Start client side SSL connection. This can block.
  *
@@ -8,10 +8,52 @@
 extern "C" {
 #endif
 
+/*
+ * Maximum number of addresses tried by client connect
+ */
+#define NSS_SOCK_CONNECT_MAX_ADDRS		16
+
+/*
+ * Delay (in ms) between starting of two parallel connection attempts
+ */
+#define NSS_SOCK_CONNECT_ATTEMPT_DELAY		250
+
+/*
+ * State of non-blocking connect racing all addresses of server
+ */
+struct nss_sock_connector {
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	PRFileDesc *attempts[NSS_SOCK_CONNECT_MAX_ADDRS];	// NULL if not running
+	PRIntervalTime attempt_start_time[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+	size_t next_attempt;		// Index of address tried next
+	PRIntervalTime next_attempt_time;
+	PRIntervalTime attempt_timeout;
+	PRErrorCode last_error;
+	PRInt32 last_os_error;
+};
+
 extern int		nss_sock_init_nss(char *config_dir);
-extern PRFileDesc	*nss_sock_create_listen_socket(const char *hostname, uint16_t port, PRIntn af);
+extern int		nss_sock_resolve(const char *hostname, uint16_t port, PRIntn af,
+    PRNetAddr *addrs, size_t *no_addrs);
+extern PRFileDesc	*nss_sock_create_listen_socket(const char *hostname, uint16_t port, PRIntn af,
+    PRUint32 defer_accept_timeout);
+extern PRFileDesc	*nss_sock_create_listen_socket_addrs(const PRNetAddr *addrs, size_t no_addrs,
+    PRIntn af, PRUint32 defer_accept_timeout);
 extern int		nss_sock_set_nonblocking(PRFileDesc *sock);
+extern int		nss_sock_set_blocking(PRFileDesc *sock);
 extern PRFileDesc 	*nss_sock_create_client_socket(const char *hostname, uint16_t port, PRIntn af, PRIntervalTime timeout);
+extern PRFileDesc	*nss_sock_create_client_socket_addrs(const PRNetAddr *addrs, size_t no_addrs,
+    PRIntervalTime timeout);
+
+extern void		nss_sock_connector_init(struct nss_sock_connector *connector,
+    const PRNetAddr *addrs, size_t no_addrs, PRIntervalTime attempt_timeout);
+extern void		nss_sock_connector_destroy(struct nss_sock_connector *connector);
+extern size_t		nss_sock_connector_get_pfds(const struct nss_sock_connector *connector,
+    PRPollDesc *pfds);
+extern PRIntervalTime	nss_sock_connector_time_to_next_event(const struct nss_sock_connector *connector);
+extern int		nss_sock_connector_process(struct nss_sock_connector *connector,
+    const PRPollDesc *pfds, size_t no_pfds, PRFileDesc **socket);
 
 extern PRFileDesc	*nss_sock_start_ssl_as_client(PRFileDesc *input_sock, const char *ssl_url,
     SSLBadCertHandler bad_cert_hook, SSLGetClientAuthData client_auth_hook, void *client_auth_hook_arg,
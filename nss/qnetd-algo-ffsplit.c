@@ -0,0 +1,131 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-ffsplit.h"
+#include "qnetd-algo-partitions.h"
+#include "qnetd-log.h"
+
+/*
+ * Fifty-fifty split algorithm.
+ *
+ * Every client reports its membership (list of node ids it can see). Clients reporting same
+ * membership form partition. Partition with most connected clients wins. Tie is broken by
+ * bigger membership and then by lowest node id, so exactly one half of evenly split
+ * cluster gets ACK. Other clients get NACK, clients which didn't report membership yet get
+ * ASK_LATER.
+ */
+
+static int
+qnetd_algo_ffsplit_partition_is_better(const struct qnetd_algo_partition *a,
+    const struct qnetd_algo_partition *b)
+{
+
+	if (b == NULL) {
+		return (1);
+	}
+
+	if (a->no_clients != b->no_clients) {
+		return (a->no_clients > b->no_clients);
+	}
+
+	return (qnetd_algo_partition_cmp_membership(a, b) > 0);
+}
+
+static int
+qnetd_algo_ffsplit_cluster_init(struct qnetd_cluster *cluster)
+{
+	struct qnetd_algo_partition_list *partitions;
+
+	partitions = malloc(sizeof(*partitions));
+	if (partitions == NULL) {
+		return (-1);
+	}
+
+	qnetd_algo_partition_list_init(partitions, qnetd_algo_ffsplit_partition_is_better);
+
+	cluster->algorithm_data = partitions;
+
+	return (0);
+}
+
+static void
+qnetd_algo_ffsplit_cluster_destroy(struct qnetd_cluster *cluster)
+{
+
+	/*
+	 * All clients are already detached so there are no partitions
+	 */
+	free(cluster->algorithm_data);
+}
+
+static int
+qnetd_algo_ffsplit_client_init(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+	struct qnetd_algo_partition_client *pclient;
+
+	pclient = malloc(sizeof(*pclient));
+	if (pclient == NULL) {
+		return (-1);
+	}
+
+	qnetd_algo_partition_client_init(pclient, client);
+	client->algorithm_data = pclient;
+
+	qnetd_algorithm_set_vote(client, TLV_VOTE_ASK_LATER);
+
+	return (0);
+}
+
+static int
+qnetd_algo_ffsplit_membership_changed(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    const uint32_t *node_ids, size_t no_node_ids)
+{
+	struct qnetd_algo_partition_list *partitions;
+
+	partitions = cluster->algorithm_data;
+
+	if (qnetd_algo_partition_list_set_membership(partitions, client->algorithm_data,
+	    node_ids, no_node_ids) != 0) {
+		return (-1);
+	}
+
+	qnetd_log(LOG_DEBUG, "algo-ffsplit: Cluster %s node %"PRIu32" reported membership of %zu nodes. "
+	    "Cluster has %zu partitions", cluster->cluster_name, client->node_id, no_node_ids,
+	    partitions->no_partitions);
+
+	return (0);
+}
+
+static void
+qnetd_algo_ffsplit_client_disconnect(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    int server_going_down)
+{
+
+	qnetd_algo_partition_list_del_client(cluster->algorithm_data, client->algorithm_data,
+	    !server_going_down);
+
+	free(client->algorithm_data);
+	client->algorithm_data = NULL;
+}
+
+static struct qnetd_algorithm qnetd_algo_ffsplit = {
+	.type			= TLV_DECISION_ALGORITHM_TYPE_FFSPLIT,
+	.name			= "ffsplit",
+	.cluster_init		= qnetd_algo_ffsplit_cluster_init,
+	.cluster_destroy	= qnetd_algo_ffsplit_cluster_destroy,
+	.client_init		= qnetd_algo_ffsplit_client_init,
+	.membership_changed	= qnetd_algo_ffsplit_membership_changed,
+	.heartbeat		= NULL,
+	.heartbeat_timeout	= NULL,
+	.client_disconnect	= qnetd_algo_ffsplit_client_disconnect,
+};
+
+int
+qnetd_algo_ffsplit_register(void)
+{
+
+	return (qnetd_algorithm_register(&qnetd_algo_ffsplit));
+}
@@ -0,0 +1,188 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-lms.h"
+#include "qnetd-algo-partitions.h"
+#include "qnetd-log.h"
+
+/*
+ * Last man standing algorithm.
+ *
+ * Like ffsplit, clients are grouped into partitions by reported membership, but only live
+ * clients (connected and sending heartbeats in time) are counted. Partition with most live
+ * clients gets ACK, so cluster can shrink node by node down to one survivor which is still
+ * heartbeating. Partition without live clients never wins.
+ *
+ * All counters are updated in constant time on connect, disconnect, heartbeat and
+ * heartbeat timeout.
+ */
+
+struct qnetd_algo_lms_cluster {
+	struct qnetd_algo_partition_list partitions;
+	size_t no_live_clients;
+};
+
+static int
+qnetd_algo_lms_partition_is_better(const struct qnetd_algo_partition *a,
+    const struct qnetd_algo_partition *b)
+{
+
+	if (a->no_live_clients == 0) {
+		return (0);
+	}
+
+	if (b == NULL) {
+		return (1);
+	}
+
+	if (a->no_live_clients != b->no_live_clients) {
+		return (a->no_live_clients > b->no_live_clients);
+	}
+
+	return (qnetd_algo_partition_cmp_membership(a, b) > 0);
+}
+
+static int
+qnetd_algo_lms_cluster_init(struct qnetd_cluster *cluster)
+{
+	struct qnetd_algo_lms_cluster *lcluster;
+
+	lcluster = malloc(sizeof(*lcluster));
+	if (lcluster == NULL) {
+		return (-1);
+	}
+
+	memset(lcluster, 0, sizeof(*lcluster));
+	qnetd_algo_partition_list_init(&lcluster->partitions, qnetd_algo_lms_partition_is_better);
+
+	cluster->algorithm_data = lcluster;
+
+	return (0);
+}
+
+static void
+qnetd_algo_lms_cluster_destroy(struct qnetd_cluster *cluster)
+{
+
+	free(cluster->algorithm_data);
+}
+
+static int
+qnetd_algo_lms_client_init(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+	struct qnetd_algo_lms_cluster *lcluster;
+	struct qnetd_algo_partition_client *pclient;
+
+	lcluster = cluster->algorithm_data;
+
+	pclient = malloc(sizeof(*pclient));
+	if (pclient == NULL) {
+		return (-1);
+	}
+
+	qnetd_algo_partition_client_init(pclient, client);
+	client->algorithm_data = pclient;
+	lcluster->no_live_clients++;
+
+	qnetd_algorithm_set_vote(client, TLV_VOTE_ASK_LATER);
+
+	return (0);
+}
+
+static int
+qnetd_algo_lms_membership_changed(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    const uint32_t *node_ids, size_t no_node_ids)
+{
+	struct qnetd_algo_lms_cluster *lcluster;
+
+	lcluster = cluster->algorithm_data;
+
+	return (qnetd_algo_partition_list_set_membership(&lcluster->partitions, client->algorithm_data,
+	    node_ids, no_node_ids));
+}
+
+static void
+qnetd_algo_lms_set_live(struct qnetd_cluster *cluster, struct qnetd_client *client, int live)
+{
+	struct qnetd_algo_lms_cluster *lcluster;
+	struct qnetd_algo_partition_client *pclient;
+
+	lcluster = cluster->algorithm_data;
+	pclient = client->algorithm_data;
+
+	if (pclient->live == live) {
+		return ;
+	}
+
+	if (live) {
+		lcluster->no_live_clients++;
+	} else {
+		lcluster->no_live_clients--;
+	}
+
+	qnetd_algo_partition_list_set_live(&lcluster->partitions, pclient, live);
+
+	qnetd_log(LOG_DEBUG, "algo-lms: Cluster %s node %"PRIu32" is %s. Cluster has %zu live nodes",
+	    cluster->cluster_name, client->node_id, (live ? "alive again" : "not responding"),
+	    lcluster->no_live_clients);
+}
+
+static int
+qnetd_algo_lms_heartbeat(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	qnetd_algo_lms_set_live(cluster, client, 1);
+
+	return (0);
+}
+
+static int
+qnetd_algo_lms_heartbeat_timeout(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	qnetd_algo_lms_set_live(cluster, client, 0);
+
+	return (0);
+}
+
+static void
+qnetd_algo_lms_client_disconnect(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    int server_going_down)
+{
+	struct qnetd_algo_lms_cluster *lcluster;
+	struct qnetd_algo_partition_client *pclient;
+
+	lcluster = cluster->algorithm_data;
+	pclient = client->algorithm_data;
+
+	if (pclient->live) {
+		lcluster->no_live_clients--;
+	}
+
+	qnetd_algo_partition_list_del_client(&lcluster->partitions, pclient, !server_going_down);
+
+	free(pclient);
+	client->algorithm_data = NULL;
+}
+
+static struct qnetd_algorithm qnetd_algo_lms = {
+	.type			= TLV_DECISION_ALGORITHM_TYPE_LMS,
+	.name			= "lms",
+	.cluster_init		= qnetd_algo_lms_cluster_init,
+	.cluster_destroy	= qnetd_algo_lms_cluster_destroy,
+	.client_init		= qnetd_algo_lms_client_init,
+	.membership_changed	= qnetd_algo_lms_membership_changed,
+	.heartbeat		= qnetd_algo_lms_heartbeat,
+	.heartbeat_timeout	= qnetd_algo_lms_heartbeat_timeout,
+	.client_disconnect	= qnetd_algo_lms_client_disconnect,
+};
+
+int
+qnetd_algo_lms_register(void)
+{
+
+	return (qnetd_algorithm_register(&qnetd_algo_lms));
+}
@@ -0,0 +1,14 @@
+#ifndef _QNETD_ALGO_LMS_H_
+#define _QNETD_ALGO_LMS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int	qnetd_algo_lms_register(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_ALGO_LMS_H_ */
@@ -0,0 +1,361 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-partitions.h"
+
+/*
+ * Winner is updated incrementally. Only partition touched by event is compared with current
+ * winner. Full scan of (usually very few) partitions is needed only when winner gets worse.
+ */
+
+static int
+qnetd_algo_partition_node_id_cmp(const void *a, const void *b)
+{
+	uint32_t ia, ib;
+
+	ia = *(const uint32_t *)a;
+	ib = *(const uint32_t *)b;
+
+	return (ia < ib ? -1 : (ia > ib ? 1 : 0));
+}
+
+/*
+ * Sort node_ids in place and remove duplicates. Returns new number of items.
+ */
+static size_t
+qnetd_algo_partition_normalize_node_ids(uint32_t *node_ids, size_t no_node_ids)
+{
+	size_t zi, zj;
+
+	if (no_node_ids == 0) {
+		return (0);
+	}
+
+	qsort(node_ids, no_node_ids, sizeof(*node_ids), qnetd_algo_partition_node_id_cmp);
+
+	for (zi = 1, zj = 1; zi < no_node_ids; zi++) {
+		if (node_ids[zi] != node_ids[zj - 1]) {
+			node_ids[zj++] = node_ids[zi];
+		}
+	}
+
+	return (zj);
+}
+
+static uint32_t
+qnetd_algo_partition_hash_node_ids(const uint32_t *node_ids, size_t no_node_ids)
+{
+	uint32_t hash;
+	size_t zi;
+
+	/*
+	 * FNV-1a over node ids
+	 */
+	hash = 2166136261U;
+
+	for (zi = 0; zi < no_node_ids; zi++) {
+		hash ^= node_ids[zi];
+		hash *= 16777619U;
+	}
+
+	return (hash);
+}
+
+static int
+qnetd_algo_partition_has_membership(const struct qnetd_algo_partition *partition,
+    const uint32_t *node_ids, size_t no_node_ids, uint32_t hash)
+{
+
+	return (partition->hash == hash && partition->no_node_ids == no_node_ids &&
+	    memcmp(partition->node_ids, node_ids, sizeof(*node_ids) * no_node_ids) == 0);
+}
+
+static struct qnetd_algo_partition *
+qnetd_algo_partition_list_find(struct qnetd_algo_partition_list *list, const uint32_t *node_ids,
+    size_t no_node_ids, uint32_t hash)
+{
+	struct qnetd_algo_partition *partition;
+
+	TAILQ_FOREACH(partition, &list->partitions, entries) {
+		if (qnetd_algo_partition_has_membership(partition, node_ids, no_node_ids, hash)) {
+			return (partition);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Create new partition. Partition takes ownership of node_ids.
+ */
+static struct qnetd_algo_partition *
+qnetd_algo_partition_list_create(struct qnetd_algo_partition_list *list, uint32_t *node_ids,
+    size_t no_node_ids, uint32_t hash)
+{
+	struct qnetd_algo_partition *partition;
+
+	partition = malloc(sizeof(*partition));
+	if (partition == NULL) {
+		return (NULL);
+	}
+
+	memset(partition, 0, sizeof(*partition));
+	partition->node_ids = node_ids;
+	partition->no_node_ids = no_node_ids;
+	partition->hash = hash;
+	TAILQ_INIT(&partition->clients);
+
+	TAILQ_INSERT_TAIL(&list->partitions, partition, entries);
+	list->no_partitions++;
+
+	return (partition);
+}
+
+static void
+qnetd_algo_partition_set_vote(struct qnetd_algo_partition *partition, enum tlv_vote vote)
+{
+	struct qnetd_algo_partition_client *pclient;
+
+	TAILQ_FOREACH(pclient, &partition->clients, entries) {
+		qnetd_algorithm_set_vote(pclient->client, vote);
+	}
+}
+
+/*
+ * Update winner partition after event. If winner_weakened is set, all partitions are
+ * compared, otherwise only strengthened partition (can be NULL) is compared with current
+ * winner. Votes are changed only for clients of old and new winner partition.
+ */
+static void
+qnetd_algo_partition_list_update_winner(struct qnetd_algo_partition_list *list, int winner_weakened,
+    struct qnetd_algo_partition *strengthened)
+{
+	struct qnetd_algo_partition *old_winner;
+	struct qnetd_algo_partition *new_winner;
+	struct qnetd_algo_partition *partition;
+
+	old_winner = list->winner;
+	new_winner = old_winner;
+
+	if (winner_weakened || old_winner == NULL) {
+		new_winner = NULL;
+
+		TAILQ_FOREACH(partition, &list->partitions, entries) {
+			if (list->is_better(partition, new_winner)) {
+				new_winner = partition;
+			}
+		}
+	} else if (strengthened != NULL && strengthened != old_winner &&
+	    list->is_better(strengthened, old_winner)) {
+		new_winner = strengthened;
+	}
+
+	if (new_winner == old_winner) {
+		return ;
+	}
+
+	if (old_winner != NULL) {
+		qnetd_algo_partition_set_vote(old_winner, TLV_VOTE_NACK);
+	}
+
+	if (new_winner != NULL) {
+		qnetd_algo_partition_set_vote(new_winner, TLV_VOTE_ACK);
+	}
+
+	list->winner = new_winner;
+}
+
+/*
+ * Remove client from its partition (if any). Empty partition is freed. Returns nonzero if
+ * winner partition lost client.
+ */
+static int
+qnetd_algo_partition_list_remove_client(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient)
+{
+	struct qnetd_algo_partition *partition;
+	int winner_weakened;
+
+	partition = pclient->partition;
+	if (partition == NULL) {
+		return (0);
+	}
+
+	winner_weakened = (partition == list->winner);
+
+	TAILQ_REMOVE(&partition->clients, pclient, entries);
+	partition->no_clients--;
+	if (pclient->live) {
+		partition->no_live_clients--;
+	}
+	pclient->partition = NULL;
+
+	if (partition->no_clients == 0) {
+		if (list->winner == partition) {
+			list->winner = NULL;
+		}
+
+		TAILQ_REMOVE(&list->partitions, partition, entries);
+		list->no_partitions--;
+		free(partition->node_ids);
+		free(partition);
+	}
+
+	return (winner_weakened);
+}
+
+void
+qnetd_algo_partition_list_init(struct qnetd_algo_partition_list *list,
+    qnetd_algo_partition_is_better_fn is_better)
+{
+
+	memset(list, 0, sizeof(*list));
+	TAILQ_INIT(&list->partitions);
+	list->is_better = is_better;
+}
+
+/*
+ * Client is live (connected and heartbeating) by default
+ */
+void
+qnetd_algo_partition_client_init(struct qnetd_algo_partition_client *pclient, struct qnetd_client *client)
+{
+
+	memset(pclient, 0, sizeof(*pclient));
+	pclient->client = client;
+	pclient->live = 1;
+}
+
+/*
+ * Move client to partition with given membership and set vote of client.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int
+qnetd_algo_partition_list_set_membership(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, const uint32_t *node_ids, size_t no_node_ids)
+{
+	struct qnetd_algo_partition *partition;
+	uint32_t *sorted_node_ids;
+	uint32_t hash;
+	int winner_weakened;
+
+	sorted_node_ids = malloc(sizeof(*sorted_node_ids) * (no_node_ids > 0 ? no_node_ids : 1));
+	if (sorted_node_ids == NULL) {
+		return (-1);
+	}
+
+	memcpy(sorted_node_ids, node_ids, sizeof(*node_ids) * no_node_ids);
+	no_node_ids = qnetd_algo_partition_normalize_node_ids(sorted_node_ids, no_node_ids);
+	hash = qnetd_algo_partition_hash_node_ids(sorted_node_ids, no_node_ids);
+
+	if (pclient->partition != NULL &&
+	    qnetd_algo_partition_has_membership(pclient->partition, sorted_node_ids, no_node_ids, hash)) {
+		/*
+		 * Membership didn't change
+		 */
+		free(sorted_node_ids);
+
+		return (0);
+	}
+
+	partition = qnetd_algo_partition_list_find(list, sorted_node_ids, no_node_ids, hash);
+	if (partition == NULL) {
+		partition = qnetd_algo_partition_list_create(list, sorted_node_ids, no_node_ids, hash);
+		if (partition == NULL) {
+			free(sorted_node_ids);
+
+			return (-1);
+		}
+	} else {
+		free(sorted_node_ids);
+	}
+
+	winner_weakened = qnetd_algo_partition_list_remove_client(list, pclient);
+
+	TAILQ_INSERT_TAIL(&partition->clients, pclient, entries);
+	partition->no_clients++;
+	if (pclient->live) {
+		partition->no_live_clients++;
+	}
+	pclient->partition = partition;
+
+	qnetd_algo_partition_list_update_winner(list, winner_weakened, partition);
+
+	qnetd_algorithm_set_vote(pclient->client, (list->winner == partition ? TLV_VOTE_ACK : TLV_VOTE_NACK));
+
+	return (0);
+}
+
+/*
+ * Change live flag of client. Counters are updated in constant time.
+ */
+void
+qnetd_algo_partition_list_set_live(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, int live)
+{
+	struct qnetd_algo_partition *partition;
+
+	if (pclient->live == live) {
+		return ;
+	}
+
+	pclient->live = live;
+
+	partition = pclient->partition;
+	if (partition == NULL) {
+		return ;
+	}
+
+	if (live) {
+		partition->no_live_clients++;
+		qnetd_algo_partition_list_update_winner(list, 0, partition);
+	} else {
+		partition->no_live_clients--;
+		qnetd_algo_partition_list_update_winner(list, (partition == list->winner), NULL);
+	}
+}
+
+/*
+ * Remove client from partition list. If update_winner is not set (server is going down),
+ * votes are not recomputed.
+ */
+void
+qnetd_algo_partition_list_del_client(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, int update_winner)
+{
+	int winner_weakened;
+
+	winner_weakened = qnetd_algo_partition_list_remove_client(list, pclient);
+
+	if (update_winner) {
+		qnetd_algo_partition_list_update_winner(list, winner_weakened, NULL);
+	}
+}
+
+/*
+ * Compare partitions by membership. Partition with bigger membership is better, if
+ * memberships have same size, sorted node ids are compared one by one and partition with
+ * lower node id at first differing position is better. Returns positive number if a is
+ * better, negative if b is better and 0 only if memberships are identical.
+ */
+int
+qnetd_algo_partition_cmp_membership(const struct qnetd_algo_partition *a,
+    const struct qnetd_algo_partition *b)
+{
+	size_t zi;
+
+	if (a->no_node_ids != b->no_node_ids) {
+		return (a->no_node_ids > b->no_node_ids ? 1 : -1);
+	}
+
+	for (zi = 0; zi < a->no_node_ids; zi++) {
+		if (a->node_ids[zi] != b->node_ids[zi]) {
+			return (a->node_ids[zi] < b->node_ids[zi] ? 1 : -1);
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,74 @@
+#ifndef _QNETD_ALGO_PARTITIONS_H_
+#define _QNETD_ALGO_PARTITIONS_H_
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <inttypes.h>
+
+#include "qnetd-client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Partitions of cluster used by membership based decision algorithms. Clients reporting same
+ * membership form one partition. Exactly one partition (winner) gets ACK vote, clients of
+ * other partitions get NACK.
+ */
+struct qnetd_algo_partition_client;
+
+struct qnetd_algo_partition {
+	uint32_t *node_ids;		// Sorted membership without duplicates
+	size_t no_node_ids;
+	uint32_t hash;
+	size_t no_clients;		// Clients reporting this membership
+	size_t no_live_clients;		// Clients with live flag set
+	TAILQ_HEAD(, qnetd_algo_partition_client) clients;
+	TAILQ_ENTRY(qnetd_algo_partition) entries;
+};
+
+struct qnetd_algo_partition_client {
+	struct qnetd_client *client;
+	struct qnetd_algo_partition *partition;	// NULL until membership is reported
+	int live;
+	TAILQ_ENTRY(qnetd_algo_partition_client) entries;
+};
+
+/*
+ * Returns nonzero if partition a is better than b. b can be NULL, in which case function
+ * returns nonzero if a can become winner at all.
+ */
+typedef int (*qnetd_algo_partition_is_better_fn)(const struct qnetd_algo_partition *a,
+    const struct qnetd_algo_partition *b);
+
+struct qnetd_algo_partition_list {
+	TAILQ_HEAD(, qnetd_algo_partition) partitions;
+	size_t no_partitions;
+	struct qnetd_algo_partition *winner;
+	qnetd_algo_partition_is_better_fn is_better;
+};
+
+extern void	qnetd_algo_partition_list_init(struct qnetd_algo_partition_list *list,
+    qnetd_algo_partition_is_better_fn is_better);
+
+extern void	qnetd_algo_partition_client_init(struct qnetd_algo_partition_client *pclient,
+    struct qnetd_client *client);
+
+extern int	qnetd_algo_partition_list_set_membership(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, const uint32_t *node_ids, size_t no_node_ids);
+
+extern void	qnetd_algo_partition_list_set_live(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, int live);
+
+extern void	qnetd_algo_partition_list_del_client(struct qnetd_algo_partition_list *list,
+    struct qnetd_algo_partition_client *pclient, int update_winner);
+
+extern int	qnetd_algo_partition_cmp_membership(const struct qnetd_algo_partition *a,
+    const struct qnetd_algo_partition *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_ALGO_PARTITIONS_H_ */
@@ -0,0 +1,59 @@
+#include <sys/types.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-test.h"
+#include "qnetd-log.h"
+
+/*
+ * Test algorithm. Every client which is attached and heartbeating gets ACK vote. It keeps
+ * no per cluster state and is mainly useful for testing qnetd itself.
+ */
+static int
+qnetd_algo_test_client_init(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	qnetd_algorithm_set_vote(client, TLV_VOTE_ACK);
+
+	return (0);
+}
+
+static int
+qnetd_algo_test_membership_changed(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    const uint32_t *node_ids, size_t no_node_ids)
+{
+
+	qnetd_log(LOG_DEBUG, "algo-test: Cluster %s node %"PRIu32" reported membership of %zu nodes",
+	    cluster->cluster_name, client->node_id, no_node_ids);
+
+	qnetd_algorithm_set_vote(client, TLV_VOTE_ACK);
+
+	return (0);
+}
+
+static int
+qnetd_algo_test_heartbeat(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	qnetd_algorithm_set_vote(client, TLV_VOTE_ACK);
+
+	return (0);
+}
+
+static struct qnetd_algorithm qnetd_algo_test = {
+	.type			= TLV_DECISION_ALGORITHM_TYPE_TEST,
+	.name			= "test",
+	.cluster_init		= NULL,
+	.cluster_destroy	= NULL,
+	.client_init		= qnetd_algo_test_client_init,
+	.membership_changed	= qnetd_algo_test_membership_changed,
+	.heartbeat		= qnetd_algo_test_heartbeat,
+	.heartbeat_timeout	= NULL,
+	.client_disconnect	= NULL,
+};
+
+int
+qnetd_algo_test_register(void)
+{
+
+	return (qnetd_algorithm_register(&qnetd_algo_test));
+}
@@ -0,0 +1,488 @@
+/*
+ * Measure latency of decision algorithm events with many connected clusters.
+ *
+ * Usage: qnetd-algorithm-bench [-a test|ffsplit|lms] [-c clusters] [-n nodes_per_cluster] [-e events]
+ *
+ * test algorithm measures client init, heartbeat and reconnect latency.
+ * ffsplit algorithm measures resolution of 50/50 split for clusters of 2 to 32 nodes
+ * (or only given number of nodes).
+ * lms algorithm measures heartbeat timeout and heartbeat latency while nodes of every cluster
+ * stop responding one by one down to last man standing.
+ */
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-algo-test.h"
+#include "qnetd-algo-ffsplit.h"
+#include "qnetd-algo-lms.h"
+#include "qnetd-cluster-list.h"
+#include "qnetd-log.h"
+
+#define BENCH_DEFAULT_CLUSTERS		10000
+#define BENCH_DEFAULT_NODES		4
+#define BENCH_DEFAULT_EVENTS		1000000
+#define BENCH_FFSPLIT_MAX_NODES		32
+
+struct bench_stats {
+	const char *name;
+	size_t count;
+	double total;
+	double max;
+};
+
+struct bench_clients {
+	struct qnetd_cluster_list clusters;
+	struct qnetd_client *clients;
+	size_t no_clusters;
+	size_t no_nodes;
+	size_t no_clients;
+};
+
+static double
+bench_time_diff(const struct timespec *start, const struct timespec *end)
+{
+
+	return ((end->tv_sec - start->tv_sec) * 1000000.0 + (end->tv_nsec - start->tv_nsec) / 1000.0);
+}
+
+static void
+bench_stats_init(struct bench_stats *stats, const char *name)
+{
+
+	memset(stats, 0, sizeof(*stats));
+	stats->name = name;
+}
+
+static void
+bench_stats_add(struct bench_stats *stats, const struct timespec *start, const struct timespec *end)
+{
+	double diff;
+
+	diff = bench_time_diff(start, end);
+
+	stats->count++;
+	stats->total += diff;
+	if (diff > stats->max) {
+		stats->max = diff;
+	}
+}
+
+static void
+bench_stats_print(const struct bench_stats *stats)
+{
+
+	printf("%-18s %10zu events, avg %8.3f us, max %10.3f us\n", stats->name, stats->count,
+	    (stats->count > 0 ? stats->total / stats->count : 0.0), stats->max);
+}
+
+/*
+ * Create clusters with connected and initialized clients attached to algorithm
+ */
+static void
+bench_clients_create(struct bench_clients *bc, size_t no_clusters, size_t no_nodes,
+    enum tlv_decision_algorithm_type algorithm, struct bench_stats *init_stats)
+{
+	struct timespec start, end;
+	struct qnetd_client *client;
+	struct qnetd_client *replaced_client;
+	char cluster_name[32];
+	size_t zi;
+
+	bc->no_clusters = no_clusters;
+	bc->no_nodes = no_nodes;
+	bc->no_clients = no_clusters * no_nodes;
+
+	if (qnetd_cluster_list_init(&bc->clusters) != 0) {
+		errx(1, "Can't init cluster list");
+	}
+
+	bc->clients = calloc(bc->no_clients, sizeof(*bc->clients));
+	if (bc->clients == NULL) {
+		errx(1, "Can't alloc clients");
+	}
+
+	for (zi = 0; zi < bc->no_clients; zi++) {
+		client = &bc->clients[zi];
+
+		snprintf(cluster_name, sizeof(cluster_name), "cluster%zu", zi / no_nodes);
+		if (qnetd_cluster_list_add_client(&bc->clusters, client, cluster_name,
+		    strlen(cluster_name)) == NULL) {
+			errx(1, "Can't add client to cluster");
+		}
+
+		if (qnetd_cluster_set_node_id(client->cluster, client, zi % no_nodes + 1,
+		    &replaced_client) != 0) {
+			errx(1, "Can't set node id");
+		}
+		qnetd_cluster_client_init_received(client->cluster, client);
+		client->init_received = 1;
+		client->decision_algorithm = algorithm;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (qnetd_algorithm_client_init(client) != 0) {
+			errx(1, "Can't init client in algorithm");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		bench_stats_add(init_stats, &start, &end);
+	}
+}
+
+static void
+bench_clients_destroy(struct bench_clients *bc)
+{
+	size_t zi;
+
+	for (zi = 0; zi < bc->no_clients; zi++) {
+		qnetd_algorithm_client_disconnect(&bc->clients[zi], 1);
+		qnetd_cluster_list_del_client(&bc->clusters, &bc->clients[zi]);
+	}
+
+	qnetd_cluster_list_free(&bc->clusters);
+	free(bc->clients);
+}
+
+static void
+bench_test(size_t no_clusters, size_t no_nodes, size_t no_events)
+{
+	struct bench_clients bc;
+	struct bench_stats init_stats, hb_stats, reconnect_stats;
+	struct timespec start, end;
+	struct qnetd_client *client;
+	size_t zi;
+
+	bench_stats_init(&init_stats, "client init");
+	bench_stats_init(&hb_stats, "heartbeat");
+	bench_stats_init(&reconnect_stats, "reconnect");
+
+	bench_clients_create(&bc, no_clusters, no_nodes, TLV_DECISION_ALGORITHM_TYPE_TEST, &init_stats);
+
+	for (zi = 0; zi < no_events; zi++) {
+		client = &bc.clients[(size_t)random() % bc.no_clients];
+
+		if (zi % 16 == 0) {
+			/*
+			 * Node disconnects and connects again
+			 */
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			qnetd_algorithm_client_disconnect(client, 0);
+			if (qnetd_algorithm_client_init(client) != 0) {
+				errx(1, "Can't init client in algorithm");
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			bench_stats_add(&reconnect_stats, &start, &end);
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (qnetd_algorithm_heartbeat(client) != 0) {
+				errx(1, "Heartbeat failed");
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			bench_stats_add(&hb_stats, &start, &end);
+		}
+	}
+
+	printf("test: %zu clusters, %zu nodes per cluster\n", no_clusters, no_nodes);
+	bench_stats_print(&init_stats);
+	bench_stats_print(&hb_stats);
+	bench_stats_print(&reconnect_stats);
+
+	bench_clients_destroy(&bc);
+}
+
+/*
+ * All nodes first report full membership, then cluster splits into two halves and every
+ * node reports its half. Split is resolved when last node of cluster reports. Nodes report
+ * in random order.
+ */
+static void
+bench_ffsplit(size_t no_clusters, size_t no_nodes)
+{
+	struct bench_clients bc;
+	struct bench_stats init_stats, report_stats, split_stats;
+	struct timespec start, end;
+	struct qnetd_client *client;
+	uint32_t node_list[BENCH_FFSPLIT_MAX_NODES];
+	size_t order[BENCH_FFSPLIT_MAX_NODES];
+	size_t zi, zj, pos, tmp, half;
+	size_t winner_start, winner_end;
+	size_t no_acks;
+	double split_time;
+
+	bench_stats_init(&init_stats, "client init");
+	bench_stats_init(&report_stats, "membership report");
+	bench_stats_init(&split_stats, "split resolution");
+
+	bench_clients_create(&bc, no_clusters, no_nodes, TLV_DECISION_ALGORITHM_TYPE_FFSPLIT, &init_stats);
+
+	for (zi = 0; zi < no_nodes; zi++) {
+		node_list[zi] = zi + 1;
+	}
+
+	half = no_nodes / 2;
+
+	/*
+	 * Bigger partition wins. For even number of nodes, halves are equal and half with lowest
+	 * node id wins.
+	 */
+	if (half >= no_nodes - half) {
+		winner_start = 0;
+		winner_end = half;
+	} else {
+		winner_start = half;
+		winner_end = no_nodes;
+	}
+
+	for (zi = 0; zi < bc.no_clients; zi++) {
+		if (qnetd_algorithm_membership_changed(&bc.clients[zi], node_list, no_nodes) != 0) {
+			errx(1, "Membership change failed");
+		}
+	}
+
+	for (zi = 0; zi < no_clusters; zi++) {
+		for (zj = 0; zj < no_nodes; zj++) {
+			order[zj] = zj;
+		}
+
+		for (zj = no_nodes - 1; zj > 0; zj--) {
+			pos = (size_t)random() % (zj + 1);
+			tmp = order[pos];
+			order[pos] = order[zj];
+			order[zj] = tmp;
+		}
+
+		split_time = 0.0;
+
+		for (zj = 0; zj < no_nodes; zj++) {
+			client = &bc.clients[zi * no_nodes + order[zj]];
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (order[zj] < half) {
+				if (qnetd_algorithm_membership_changed(client, node_list, half) != 0) {
+					errx(1, "Membership change failed");
+				}
+			} else {
+				if (qnetd_algorithm_membership_changed(client, node_list + half,
+				    no_nodes - half) != 0) {
+					errx(1, "Membership change failed");
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			bench_stats_add(&report_stats, &start, &end);
+			split_time += bench_time_diff(&start, &end);
+		}
+
+		split_stats.count++;
+		split_stats.total += split_time;
+		if (split_time > split_stats.max) {
+			split_stats.max = split_time;
+		}
+
+		/*
+		 * Check result. Only nodes of winning partition get ACK.
+		 */
+		no_acks = 0;
+		for (zj = 0; zj < no_nodes; zj++) {
+			client = &bc.clients[zi * no_nodes + zj];
+
+			if (client->vote == TLV_VOTE_ACK) {
+				no_acks++;
+
+				if (zj < winner_start || zj >= winner_end) {
+					errx(1, "Wrong partition won");
+				}
+			}
+		}
+
+		if (no_acks != winner_end - winner_start) {
+			errx(1, "Split not resolved (%zu ACKs, expected %zu)", no_acks,
+			    winner_end - winner_start);
+		}
+	}
+
+	printf("ffsplit: %zu clusters, %zu nodes per cluster\n", no_clusters, no_nodes);
+	bench_stats_print(&init_stats);
+	bench_stats_print(&report_stats);
+	bench_stats_print(&split_stats);
+
+	bench_clients_destroy(&bc);
+}
+
+/*
+ * All nodes report full membership, then nodes (in random order) stop heartbeating until only
+ * one node is left. Last node must get ACK. Then all nodes are alive again.
+ */
+static void
+bench_lms(size_t no_clusters, size_t no_nodes)
+{
+	struct bench_clients bc;
+	struct bench_stats init_stats, timeout_stats, heartbeat_stats;
+	struct timespec start, end;
+	struct qnetd_client *client;
+	uint32_t node_list[BENCH_FFSPLIT_MAX_NODES];
+	size_t order[BENCH_FFSPLIT_MAX_NODES];
+	size_t zi, zj, pos, tmp;
+
+	bench_stats_init(&init_stats, "client init");
+	bench_stats_init(&timeout_stats, "heartbeat timeout");
+	bench_stats_init(&heartbeat_stats, "heartbeat");
+
+	bench_clients_create(&bc, no_clusters, no_nodes, TLV_DECISION_ALGORITHM_TYPE_LMS, &init_stats);
+
+	for (zi = 0; zi < no_nodes; zi++) {
+		node_list[zi] = zi + 1;
+	}
+
+	for (zi = 0; zi < bc.no_clients; zi++) {
+		if (qnetd_algorithm_membership_changed(&bc.clients[zi], node_list, no_nodes) != 0) {
+			errx(1, "Membership change failed");
+		}
+	}
+
+	for (zi = 0; zi < no_clusters; zi++) {
+		for (zj = 0; zj < no_nodes; zj++) {
+			order[zj] = zj;
+		}
+
+		for (zj = no_nodes - 1; zj > 0; zj--) {
+			pos = (size_t)random() % (zj + 1);
+			tmp = order[pos];
+			order[pos] = order[zj];
+			order[zj] = tmp;
+		}
+
+		for (zj = 0; zj < no_nodes - 1; zj++) {
+			client = &bc.clients[zi * no_nodes + order[zj]];
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (qnetd_algorithm_heartbeat_timeout(client) != 0) {
+				errx(1, "Heartbeat timeout failed");
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			bench_stats_add(&timeout_stats, &start, &end);
+		}
+
+		client = &bc.clients[zi * no_nodes + order[no_nodes - 1]];
+		if (client->vote != TLV_VOTE_ACK) {
+			errx(1, "Last man standing didn't get ACK");
+		}
+
+		for (zj = 0; zj < no_nodes; zj++) {
+			client = &bc.clients[zi * no_nodes + zj];
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (qnetd_algorithm_heartbeat(client) != 0) {
+				errx(1, "Heartbeat failed");
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			bench_stats_add(&heartbeat_stats, &start, &end);
+		}
+
+		for (zj = 0; zj < no_nodes; zj++) {
+			if (bc.clients[zi * no_nodes + zj].vote != TLV_VOTE_ACK) {
+				errx(1, "Revived node didn't get ACK");
+			}
+		}
+	}
+
+	printf("lms: %zu clusters, %zu nodes per cluster\n", no_clusters, no_nodes);
+	bench_stats_print(&init_stats);
+	bench_stats_print(&timeout_stats);
+	bench_stats_print(&heartbeat_stats);
+
+	bench_clients_destroy(&bc);
+}
+
+static void
+usage(void)
+{
+
+	printf("usage: qnetd-algorithm-bench [-a test|ffsplit|lms] [-c clusters] [-n nodes] [-e events]\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	enum tlv_decision_algorithm_type algorithm;
+	size_t no_clusters, no_nodes, no_events;
+	size_t no_nodes_min, no_nodes_max;
+	int ch;
+
+	algorithm = TLV_DECISION_ALGORITHM_TYPE_TEST;
+	no_clusters = BENCH_DEFAULT_CLUSTERS;
+	no_nodes = 0;
+	no_events = BENCH_DEFAULT_EVENTS;
+
+	while ((ch = getopt(argc, argv, "a:c:e:hn:")) != -1) {
+		switch (ch) {
+		case 'a':
+			if (strcmp(optarg, "test") == 0) {
+				algorithm = TLV_DECISION_ALGORITHM_TYPE_TEST;
+			} else if (strcmp(optarg, "ffsplit") == 0) {
+				algorithm = TLV_DECISION_ALGORITHM_TYPE_FFSPLIT;
+			} else if (strcmp(optarg, "lms") == 0) {
+				algorithm = TLV_DECISION_ALGORITHM_TYPE_LMS;
+			} else {
+				errx(1, "Unknown algorithm %s", optarg);
+			}
+			break;
+		case 'c':
+			no_clusters = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			no_events = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			no_nodes = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+		case '?':
+			usage();
+			exit(1);
+			break;
+		}
+	}
+
+	if (no_clusters == 0) {
+		errx(1, "Number of clusters must be positive");
+	}
+
+	qnetd_log_init(0);
+
+	if (qnetd_algo_test_register() != 0 || qnetd_algo_ffsplit_register() != 0 ||
+	    qnetd_algo_lms_register() != 0) {
+		errx(1, "Can't register decision algorithms");
+	}
+
+	srandom(1);
+
+	if (algorithm == TLV_DECISION_ALGORITHM_TYPE_TEST) {
+		bench_test(no_clusters, (no_nodes > 0 ? no_nodes : BENCH_DEFAULT_NODES), no_events);
+	} else {
+		if (no_nodes > BENCH_FFSPLIT_MAX_NODES || no_nodes == 1) {
+			errx(1, "Number of nodes must be between 2 and %u", BENCH_FFSPLIT_MAX_NODES);
+		}
+
+		if (no_nodes > 0) {
+			no_nodes_min = no_nodes_max = no_nodes;
+		} else {
+			no_nodes_min = 2;
+			no_nodes_max = BENCH_FFSPLIT_MAX_NODES;
+		}
+
+		for (no_nodes = no_nodes_min; no_nodes <= no_nodes_max; no_nodes *= 2) {
+			if (algorithm == TLV_DECISION_ALGORITHM_TYPE_FFSPLIT) {
+				bench_ffsplit(no_clusters, no_nodes);
+			} else {
+				bench_lms(no_clusters, no_nodes);
+			}
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,282 @@
+#include <sys/types.h>
+
+#include "qnetd-algorithm.h"
+#include "qnetd-log.h"
+
+static const struct qnetd_algorithm *qnetd_algorithms[QNETD_ALGORITHM_MAX_ALGORITHMS];
+
+/*
+ * Register decision algorithm. Returns 0 on success, -1 if algorithm type is out of range
+ * or already registered.
+ */
+int
+qnetd_algorithm_register(const struct qnetd_algorithm *algorithm)
+{
+
+	if ((size_t)algorithm->type >= QNETD_ALGORITHM_MAX_ALGORITHMS ||
+	    qnetd_algorithms[algorithm->type] != NULL) {
+		return (-1);
+	}
+
+	qnetd_algorithms[algorithm->type] = algorithm;
+
+	return (0);
+}
+
+const struct qnetd_algorithm *
+qnetd_algorithm_find(enum tlv_decision_algorithm_type type)
+{
+
+	if ((size_t)type >= QNETD_ALGORITHM_MAX_ALGORITHMS) {
+		return (NULL);
+	}
+
+	return (qnetd_algorithms[type]);
+}
+
+/*
+ * Fill algorithms array (with at least QNETD_ALGORITHM_MAX_ALGORITHMS items) with types of
+ * registered algorithms
+ */
+void
+qnetd_algorithm_get_supported(enum tlv_decision_algorithm_type *algorithms, size_t *no_algorithms)
+{
+	size_t zi;
+
+	*no_algorithms = 0;
+
+	for (zi = 0; zi < QNETD_ALGORITHM_MAX_ALGORITHMS; zi++) {
+		if (qnetd_algorithms[zi] != NULL) {
+			algorithms[(*no_algorithms)++] = qnetd_algorithms[zi]->type;
+		}
+	}
+}
+
+/*
+ * Undo counters of attached client without calling algorithm client_disconnect callback.
+ * Algorithm cluster data is destroyed together with last client.
+ */
+static void
+qnetd_algorithm_client_detach(struct qnetd_client *client)
+{
+	struct qnetd_cluster *cluster;
+
+	cluster = client->cluster;
+
+	client->algorithm_attached = 0;
+	client->vote = TLV_VOTE_UNDEFINED;
+	client->reported_vote = TLV_VOTE_UNDEFINED;
+	client->vote_info_pending = 0;
+	client->algorithm_data = NULL;
+	cluster->no_algorithm_clients--;
+
+	if (cluster->no_algorithm_clients == 0) {
+		if (cluster->algorithm->cluster_destroy != NULL) {
+			cluster->algorithm->cluster_destroy(cluster);
+		}
+
+		cluster->algorithm = NULL;
+		cluster->algorithm_data = NULL;
+	}
+}
+
+/*
+ * Attach detached client to algorithm. Cluster data are initialized for first client of
+ * cluster. Returns 0 on success and -3 if algorithm failed.
+ */
+static int
+qnetd_algorithm_client_attach(struct qnetd_client *client, const struct qnetd_algorithm *algorithm)
+{
+	struct qnetd_cluster *cluster;
+
+	cluster = client->cluster;
+
+	if (cluster->no_algorithm_clients == 0) {
+		cluster->algorithm = algorithm;
+		cluster->algorithm_data = NULL;
+
+		if (algorithm->cluster_init != NULL && algorithm->cluster_init(cluster) != 0) {
+			cluster->algorithm = NULL;
+
+			return (-3);
+		}
+	}
+
+	cluster->no_algorithm_clients++;
+	client->algorithm_attached = 1;
+	client->vote = TLV_VOTE_UNDEFINED;
+
+	if (algorithm->client_init(cluster, client) != 0) {
+		/*
+		 * Algorithm has no data for client, so client_disconnect callback must not be called
+		 */
+		qnetd_algorithm_client_detach(client);
+
+		return (-3);
+	}
+
+	return (0);
+}
+
+/*
+ * Attach client to decision algorithm selected by client->decision_algorithm. If client is
+ * already attached to other algorithm (and it is the only client of the cluster), it's
+ * detached first and attached back to previous algorithm if new algorithm fails.
+ *
+ * Returns 0 on success, -1 if algorithm is not supported, -2 if cluster already uses
+ * different algorithm, -3 if algorithm failed and -4 if algorithm failed and client
+ * couldn't be attached back to previous algorithm (client is then not attached to any
+ * algorithm).
+ */
+int
+qnetd_algorithm_client_init(struct qnetd_client *client)
+{
+	const struct qnetd_algorithm *algorithm;
+	const struct qnetd_algorithm *old_algorithm;
+	struct qnetd_cluster *cluster;
+
+	cluster = client->cluster;
+
+	algorithm = qnetd_algorithm_find(client->decision_algorithm);
+	if (algorithm == NULL) {
+		return (-1);
+	}
+
+	if (client->algorithm_attached && cluster->algorithm == algorithm) {
+		return (0);
+	}
+
+	if (cluster->no_algorithm_clients > (client->algorithm_attached ? 1 : 0) &&
+	    cluster->algorithm != algorithm) {
+		return (-2);
+	}
+
+	old_algorithm = (client->algorithm_attached ? cluster->algorithm : NULL);
+
+	qnetd_algorithm_client_disconnect(client, 0);
+
+	if (qnetd_algorithm_client_attach(client, algorithm) != 0) {
+		if (old_algorithm != NULL && qnetd_algorithm_client_attach(client, old_algorithm) != 0) {
+			return (-4);
+		}
+
+		return (-3);
+	}
+
+	return (0);
+}
+
+int
+qnetd_algorithm_membership_changed(struct qnetd_client *client, const uint32_t *node_ids,
+    size_t no_node_ids)
+{
+	struct qnetd_cluster *cluster;
+
+	if (!client->algorithm_attached) {
+		return (0);
+	}
+
+	cluster = client->cluster;
+
+	if (cluster->algorithm->membership_changed == NULL) {
+		return (0);
+	}
+
+	return (cluster->algorithm->membership_changed(cluster, client, node_ids, no_node_ids));
+}
+
+int
+qnetd_algorithm_heartbeat(struct qnetd_client *client)
+{
+	struct qnetd_cluster *cluster;
+
+	if (!client->algorithm_attached) {
+		return (0);
+	}
+
+	cluster = client->cluster;
+
+	if (cluster->algorithm->heartbeat == NULL) {
+		return (0);
+	}
+
+	return (cluster->algorithm->heartbeat(cluster, client));
+}
+
+int
+qnetd_algorithm_heartbeat_timeout(struct qnetd_client *client)
+{
+	struct qnetd_cluster *cluster;
+
+	if (!client->algorithm_attached) {
+		return (0);
+	}
+
+	cluster = client->cluster;
+
+	if (cluster->algorithm->heartbeat_timeout == NULL) {
+		return (0);
+	}
+
+	return (cluster->algorithm->heartbeat_timeout(cluster, client));
+}
+
+/*
+ * Detach client from algorithm. Safe to call for client which is not attached.
+ */
+void
+qnetd_algorithm_client_disconnect(struct qnetd_client *client, int server_going_down)
+{
+	struct qnetd_cluster *cluster;
+
+	if (!client->algorithm_attached) {
+		return ;
+	}
+
+	cluster = client->cluster;
+
+	if (cluster->algorithm->client_disconnect != NULL) {
+		cluster->algorithm->client_disconnect(cluster, client, server_going_down);
+	}
+
+	qnetd_algorithm_client_detach(client);
+}
+
+/*
+ * Set vote of client. Used by algorithms. If vote differs from vote last reported to client,
+ * client->vote_info_pending is set so caller knows client should be informed. Vote which
+ * flapped back to reported value is not sent again.
+ */
+void
+qnetd_algorithm_set_vote(struct qnetd_client *client, enum tlv_vote vote)
+{
+
+	if (client->vote == vote) {
+		return ;
+	}
+
+	qnetd_log(LOG_DEBUG, "Cluster %s node %"PRIu32" vote changed from %s to %s",
+	    client->cluster_name, client->node_id, qnetd_algorithm_vote_to_str(client->vote),
+	    qnetd_algorithm_vote_to_str(vote));
+
+	client->vote = vote;
+	client->vote_info_pending = (vote != client->reported_vote);
+}
+
+const char *
+qnetd_algorithm_vote_to_str(enum tlv_vote vote)
+{
+
+	switch (vote) {
+	case TLV_VOTE_UNDEFINED:
+		return ("undefined");
+	case TLV_VOTE_ACK:
+		return ("ACK");
+	case TLV_VOTE_NACK:
+		return ("NACK");
+	case TLV_VOTE_ASK_LATER:
+		return ("ask later");
+	}
+
+	return ("unknown");
+}
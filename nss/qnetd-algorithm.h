@@ -0,0 +1,91 @@
+#ifndef _QNETD_ALGORITHM_H_
+#define _QNETD_ALGORITHM_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "tlv.h"
+#include "qnetd-client.h"
+#include "qnetd-cluster.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QNETD_ALGORITHM_MAX_ALGORITHMS		16
+
+/*
+ * Decision algorithm. All callbacks are called only for cluster of given client, so
+ * algorithm is expected to update its per cluster state (cluster->algorithm_data)
+ * incrementally and set votes (qnetd_algorithm_set_vote) only of affected clients.
+ *
+ * Callbacks returning int return 0 on success and -1 on (fatal) error. Error in
+ * client callback means client is disconnected.
+ */
+struct qnetd_algorithm {
+	enum tlv_decision_algorithm_type type;
+	const char *name;
+
+	/*
+	 * Called when first client attaches to algorithm in given cluster
+	 */
+	int (*cluster_init)(struct qnetd_cluster *cluster);
+
+	/*
+	 * Called after last client detached from algorithm in given cluster
+	 */
+	void (*cluster_destroy)(struct qnetd_cluster *cluster);
+
+	int (*client_init)(struct qnetd_cluster *cluster, struct qnetd_client *client);
+
+	/*
+	 * Client reported (new) membership
+	 */
+	int (*membership_changed)(struct qnetd_cluster *cluster, struct qnetd_client *client,
+	    const uint32_t *node_ids, size_t no_node_ids);
+
+	int (*heartbeat)(struct qnetd_cluster *cluster, struct qnetd_client *client);
+
+	/*
+	 * Client didn't send heartbeat in time. Client is still connected and next heartbeat
+	 * is delivered by heartbeat callback.
+	 */
+	int (*heartbeat_timeout)(struct qnetd_cluster *cluster, struct qnetd_client *client);
+
+	/*
+	 * Client is going to be removed from cluster. server_going_down is set when
+	 * qnetd is shutting down.
+	 */
+	void (*client_disconnect)(struct qnetd_cluster *cluster, struct qnetd_client *client,
+	    int server_going_down);
+};
+
+extern int				 qnetd_algorithm_register(const struct qnetd_algorithm *algorithm);
+
+extern const struct qnetd_algorithm	*qnetd_algorithm_find(enum tlv_decision_algorithm_type type);
+
+extern void				 qnetd_algorithm_get_supported(
+    enum tlv_decision_algorithm_type *algorithms, size_t *no_algorithms);
+
+extern int				 qnetd_algorithm_client_init(struct qnetd_client *client);
+
+extern int				 qnetd_algorithm_membership_changed(struct qnetd_client *client,
+    const uint32_t *node_ids, size_t no_node_ids);
+
+extern int				 qnetd_algorithm_heartbeat(struct qnetd_client *client);
+
+extern int				 qnetd_algorithm_heartbeat_timeout(struct qnetd_client *client);
+
+extern void				 qnetd_algorithm_client_disconnect(struct qnetd_client *client,
+    int server_going_down);
+
+extern void				 qnetd_algorithm_set_vote(struct qnetd_client *client,
+    enum tlv_vote vote);
+
+extern const char			*qnetd_algorithm_vote_to_str(enum tlv_vote vote);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_ALGORITHM_H_ */
@@ -0,0 +1,117 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-client-slots.h"
+#include "qnetd-client.h"
+
+void
+qnetd_client_slots_init(struct qnetd_client_slots *slots)
+{
+
+	memset(slots, 0, sizeof(*slots));
+}
+
+void
+qnetd_client_slots_destroy(struct qnetd_client_slots *slots)
+{
+
+	free(slots->array);
+	qnetd_client_slots_init(slots);
+}
+
+unsigned int
+qnetd_client_slots_size(const struct qnetd_client_slots *slots)
+{
+
+	return (slots->items);
+}
+
+/*
+ * Add client to the end of array and store its slot number. Returns 0 on success or -1 on
+ * alloc failure.
+ */
+int
+qnetd_client_slots_add(struct qnetd_client_slots *slots, struct qnetd_client *client, PRFileDesc *socket,
+    unsigned int *slot)
+{
+	struct qnetd_client_hot *new_array;
+	struct qnetd_client_hot *hot;
+	unsigned int new_size;
+
+	if (slots->items >= slots->allocated) {
+		new_size = (slots->allocated * 2) + 1;
+
+		new_array = realloc(slots->array, sizeof(*new_array) * new_size);
+		if (new_array == NULL) {
+			return (-1);
+		}
+
+		slots->array = new_array;
+		slots->allocated = new_size;
+	}
+
+	*slot = slots->items;
+	hot = &slots->array[slots->items++];
+
+	memset(hot, 0, sizeof(*hot));
+	hot->socket = socket;
+	hot->client = client;
+
+	return (0);
+}
+
+/*
+ * Release slot. It's reused after compaction.
+ */
+void
+qnetd_client_slots_del(struct qnetd_client_slots *slots, unsigned int slot)
+{
+
+	memset(&slots->array[slot], 0, sizeof(slots->array[slot]));
+	slots->released_items++;
+}
+
+struct qnetd_client_hot *
+qnetd_client_slots_get(const struct qnetd_client_slots *slots, unsigned int slot)
+{
+
+	if (slot >= slots->items) {
+		return (NULL);
+	}
+
+	return (&slots->array[slot]);
+}
+
+/*
+ * Remove released slots. Order of clients is kept and slot number of moved clients is
+ * updated. Must not be called while slot numbers are used (during poll iteration).
+ */
+void
+qnetd_client_slots_compact(struct qnetd_client_slots *slots)
+{
+	unsigned int src;
+	unsigned int dst;
+
+	if (slots->released_items == 0) {
+		return ;
+	}
+
+	dst = 0;
+	for (src = 0; src < slots->items; src++) {
+		if (slots->array[src].client == NULL) {
+			continue ;
+		}
+
+		if (src != dst) {
+			slots->array[dst] = slots->array[src];
+			slots->array[dst].client->slot = dst;
+		}
+
+		dst++;
+	}
+
+	slots->items = dst;
+	slots->released_items = 0;
+}
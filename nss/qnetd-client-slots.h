@@ -0,0 +1,61 @@
+#ifndef _QNETD_CLIENT_SLOTS_H_
+#define _QNETD_CLIENT_SLOTS_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <nspr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct qnetd_client;
+
+/*
+ * Per event state of client. Hot parts of all clients are stored in dense array indexed by
+ * slot, so poll loop scans them without touching (much bigger) struct qnetd_client.
+ */
+struct qnetd_client_hot {
+	PRFileDesc *socket;
+	struct qnetd_client *client;	// Cold part. NULL if slot was released
+	size_t msg_already_received_bytes;
+	size_t msg_already_sent_bytes;
+	int sending_msg;		// Have message to sent
+	int send_queue_pending;		// Send queue of client is not empty
+	int skipping_msg;		// When incorrect message was received skip it
+	int schedule_disconnect;	// Disconnect at the end of current poll iteration
+};
+
+/*
+ * Released slots stay in array (so slot numbers don't change during poll iteration) until
+ * qnetd_client_slots_compact is called.
+ */
+struct qnetd_client_slots {
+	struct qnetd_client_hot *array;
+	unsigned int allocated;
+	unsigned int items;		// Including released slots
+	unsigned int released_items;
+};
+
+extern void			 qnetd_client_slots_init(struct qnetd_client_slots *slots);
+
+extern void			 qnetd_client_slots_destroy(struct qnetd_client_slots *slots);
+
+extern unsigned int		 qnetd_client_slots_size(const struct qnetd_client_slots *slots);
+
+extern int			 qnetd_client_slots_add(struct qnetd_client_slots *slots,
+    struct qnetd_client *client, PRFileDesc *socket, unsigned int *slot);
+
+extern void			 qnetd_client_slots_del(struct qnetd_client_slots *slots, unsigned int slot);
+
+extern struct qnetd_client_hot	*qnetd_client_slots_get(const struct qnetd_client_slots *slots,
+    unsigned int slot);
+
+extern void			 qnetd_client_slots_compact(struct qnetd_client_slots *slots);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_CLIENT_SLOTS_H_ */
@@ -4,22 +4,50 @@
 
 #include "qnetd-client.h"
 
-void
-qnetd_client_init(struct qnetd_client *client, PRFileDesc *socket, PRNetAddr *addr,
-    size_t max_receive_size, size_t max_send_size)
+/*
+ * Returns 0 on success or -1 if hot part of client can't be allocated
+ */
+int
+qnetd_client_init(struct qnetd_client *client, struct qnetd_client_slots *slots,
+    PRFileDesc *socket, PRNetAddr *addr, struct rope_chunk_pool *receive_chunk_pool,
+    size_t max_receive_size, size_t max_send_size, size_t max_send_queue_size)
 {
 
 	memset(client, 0, sizeof(*client));
-	client->socket = socket;
+
+	if (qnetd_client_slots_add(slots, client, socket, &client->slot) != 0) {
+		return (-1);
+	}
+
+	client->slots = slots;
 	memcpy(&client->addr, addr, sizeof(*addr));
-	dynar_init(&client->receive_buffer, max_receive_size);
+	rope_init(&client->receive_buffer, receive_chunk_pool, max_receive_size);
+	msg_decoder_init(&client->msg_decoder, max_receive_size);
 	dynar_init(&client->send_buffer, max_send_size);
+	send_queue_init(&client->send_queue, max_send_queue_size);
+	/*
+	 * Node list applied from deltas can't be bigger than node list sent at once
+	 */
+	node_list_init(&client->node_list, max_receive_size / sizeof(uint32_t));
+
+	return (0);
 }
 
 void
 qnetd_client_destroy(struct qnetd_client *client)
 {
 
-	dynar_destroy(&client->receive_buffer);
+	rope_destroy(&client->receive_buffer);
+	msg_decoder_destroy(&client->msg_decoder);
 	dynar_destroy(&client->send_buffer);
+	send_queue_destroy(&client->send_queue);
+	node_list_destroy(&client->node_list);
+	qnetd_client_slots_del(client->slots, client->slot);
+}
+
+struct qnetd_client_hot *
+qnetd_client_hot(const struct qnetd_client *client)
+{
+
+	return (qnetd_client_slots_get(client->slots, client->slot));
 }
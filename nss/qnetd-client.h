@@ -8,40 +8,69 @@
 
 #include <nspr.h>
 #include "dynar.h"
+#include "rope.h"
+#include "msg.h"
+#include "send-queue.h"
+#include "node-list.h"
 #include "tlv.h"
+#include "timer-list.h"
+#include "qnetd-client-slots.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct qnetd_cluster;
+
+/*
+ * Cold part of client. Per event state (socket, send/receive progress, ...) is in
+ * struct qnetd_client_hot, use qnetd_client_hot to get it.
+ */
 struct qnetd_client {
-	PRFileDesc *socket;
+	struct qnetd_client_slots *slots;
+	unsigned int slot;
 	PRNetAddr addr;
-	struct dynar receive_buffer;
+	struct rope receive_buffer;	// Chunks are taken from pool shared by all clients
+	struct msg_decoder msg_decoder;	// Used by msg_decode_rope for received messages
 	struct dynar send_buffer;
-	size_t msg_already_received_bytes;
-	size_t msg_already_sent_bytes;
-	int sending_msg;	// Have message to sent
-	int skipping_msg;	// When incorrect message was received skip it
+	struct send_queue send_queue;	// Shared messages (vote info) waiting for send
+	size_t send_queue_before_msg;	// Number of queued messages to send before send_buffer
+	uint32_t credit_window;		// Unsolicited msgs client accepts. 0 = no flow control
+	uint32_t send_credit;		// Unsolicited msgs which can be sent now
+	enum tlv_encoding tlv_encoding;	// Encoding of messages sent after init reply
 	int tls_started;	// Set after TLS started
 	int tls_peer_certificate_verified;	// Certificate is verified only once
 	int preinit_received;
 	int init_received;
-	char *cluster_name;
+	const char *cluster_name;	// Interned name owned by cluster. Valid only if cluster != NULL
 	size_t cluster_name_len;
+	struct qnetd_cluster *cluster;	// Set after preinit is received
 	uint8_t node_id_set;
 	uint32_t node_id;
 	enum tlv_decision_algorithm_type decision_algorithm;
+	int algorithm_attached;		// Client takes part in decision algorithm of its cluster
+	enum tlv_vote vote;		// Vote computed by decision algorithm
+	int vote_info_pending;		// Vote differs from reported_vote
+	enum tlv_vote reported_vote;	// Last vote sent (or queued) to client
+	void *algorithm_data;		// Per client state owned by decision algorithm
+	struct node_list node_list;	// Last membership reported by client
+	int node_list_epoch_set;	// Client uses node list deltas
+	uint32_t node_list_epoch;	// Valid only if node_list_epoch_set != 0
 	uint32_t heartbeat_interval;
+	struct timer_list_entry *heartbeat_timeout_timer;	// Set if heartbeat_interval != 0
 	enum tlv_reply_error_code skipping_msg_reason;
 	TAILQ_ENTRY(qnetd_client) entries;
+	TAILQ_ENTRY(qnetd_client) cluster_entries;
 };
 
-extern void		qnetd_client_init(struct qnetd_client *client, PRFileDesc *socket, PRNetAddr *addr,
-    size_t max_receive_size, size_t max_send_size);
+extern int		qnetd_client_init(struct qnetd_client *client, struct qnetd_client_slots *slots,
+    PRFileDesc *socket, PRNetAddr *addr, struct rope_chunk_pool *receive_chunk_pool,
+    size_t max_receive_size, size_t max_send_size, size_t max_send_queue_size);
 
 extern void		qnetd_client_destroy(struct qnetd_client *client);
 
+extern struct qnetd_client_hot	*qnetd_client_hot(const struct qnetd_client *client);
+
 #ifdef __cplusplus
 }
 #endif
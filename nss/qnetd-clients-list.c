@@ -15,8 +15,9 @@ qnetd_clients_list_init(struct qnetd_clients_list *clients_list)
 }
 
 struct qnetd_client *
-qnetd_clients_list_add(struct qnetd_clients_list *clients_list, PRFileDesc *socket, PRNetAddr *addr,
-	size_t max_receive_size, size_t max_send_size)
+qnetd_clients_list_add(struct qnetd_clients_list *clients_list, struct qnetd_client_slots *slots,
+	PRFileDesc *socket, PRNetAddr *addr, struct rope_chunk_pool *receive_chunk_pool,
+	size_t max_receive_size, size_t max_send_size, size_t max_send_queue_size)
 {
 	struct qnetd_client *client;
 
@@ -25,7 +26,12 @@ qnetd_clients_list_add(struct qnetd_clients_list *clients_list, PRFileDesc *sock
 		return (NULL);
 	}
 
-	qnetd_client_init(client, socket, addr, max_receive_size, max_send_size);
+	if (qnetd_client_init(client, slots, socket, addr, receive_chunk_pool, max_receive_size,
+	    max_send_size, max_send_queue_size) != 0) {
+		free(client);
+
+		return (NULL);
+	}
 
 	TAILQ_INSERT_TAIL(clients_list, client, entries);
 
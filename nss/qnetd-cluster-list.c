@@ -0,0 +1,199 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-cluster-list.h"
+
+#define QNETD_CLUSTER_LIST_INITIAL_BUCKETS	64
+
+/*
+ * FNV-1a hash
+ */
+static uint32_t
+qnetd_cluster_list_hash(const char *cluster_name, size_t cluster_name_len)
+{
+	uint32_t hash;
+	size_t zi;
+
+	hash = 2166136261U;
+
+	for (zi = 0; zi < cluster_name_len; zi++) {
+		hash ^= (unsigned char)cluster_name[zi];
+		hash *= 16777619U;
+	}
+
+	return (hash);
+}
+
+int
+qnetd_cluster_list_init(struct qnetd_cluster_list *list)
+{
+
+	memset(list, 0, sizeof(*list));
+
+	list->buckets = calloc(QNETD_CLUSTER_LIST_INITIAL_BUCKETS, sizeof(*list->buckets));
+	if (list->buckets == NULL) {
+		return (-1);
+	}
+
+	list->no_buckets = QNETD_CLUSTER_LIST_INITIAL_BUCKETS;
+
+	return (0);
+}
+
+void
+qnetd_cluster_list_free(struct qnetd_cluster_list *list)
+{
+	struct qnetd_cluster *cluster;
+	struct qnetd_cluster *cluster_next;
+	size_t zi;
+
+	for (zi = 0; zi < list->no_buckets; zi++) {
+		cluster = list->buckets[zi];
+
+		while (cluster != NULL) {
+			cluster_next = cluster->next;
+
+			qnetd_cluster_destroy(cluster);
+			free(cluster);
+
+			cluster = cluster_next;
+		}
+	}
+
+	free(list->buckets);
+	memset(list, 0, sizeof(*list));
+}
+
+static struct qnetd_cluster *
+qnetd_cluster_list_find_with_hash(const struct qnetd_cluster_list *list, const char *cluster_name,
+    size_t cluster_name_len, uint32_t hash)
+{
+	struct qnetd_cluster *cluster;
+
+	for (cluster = list->buckets[hash % list->no_buckets]; cluster != NULL; cluster = cluster->next) {
+		if (cluster->cluster_name_hash == hash && cluster->cluster_name_len == cluster_name_len &&
+		    memcmp(cluster->cluster_name, cluster_name, cluster_name_len) == 0) {
+			return (cluster);
+		}
+	}
+
+	return (NULL);
+}
+
+struct qnetd_cluster *
+qnetd_cluster_list_find(const struct qnetd_cluster_list *list, const char *cluster_name,
+    size_t cluster_name_len)
+{
+
+	return (qnetd_cluster_list_find_with_hash(list, cluster_name, cluster_name_len,
+	    qnetd_cluster_list_hash(cluster_name, cluster_name_len)));
+}
+
+/*
+ * Double number of buckets. Failure is not fatal (hash table just gets slower).
+ */
+static void
+qnetd_cluster_list_grow(struct qnetd_cluster_list *list)
+{
+	struct qnetd_cluster **new_buckets;
+	struct qnetd_cluster *cluster;
+	struct qnetd_cluster *cluster_next;
+	size_t new_no_buckets;
+	size_t zi;
+
+	new_no_buckets = list->no_buckets * 2;
+
+	new_buckets = calloc(new_no_buckets, sizeof(*new_buckets));
+	if (new_buckets == NULL) {
+		return ;
+	}
+
+	for (zi = 0; zi < list->no_buckets; zi++) {
+		cluster = list->buckets[zi];
+
+		while (cluster != NULL) {
+			cluster_next = cluster->next;
+
+			cluster->next = new_buckets[cluster->cluster_name_hash % new_no_buckets];
+			new_buckets[cluster->cluster_name_hash % new_no_buckets] = cluster;
+
+			cluster = cluster_next;
+		}
+	}
+
+	free(list->buckets);
+	list->buckets = new_buckets;
+	list->no_buckets = new_no_buckets;
+}
+
+/*
+ * Add client to cluster with given name. Cluster is created if it doesn't exist yet.
+ */
+struct qnetd_cluster *
+qnetd_cluster_list_add_client(struct qnetd_cluster_list *list, struct qnetd_client *client,
+    const char *cluster_name, size_t cluster_name_len)
+{
+	struct qnetd_cluster *cluster;
+	uint32_t hash;
+
+	hash = qnetd_cluster_list_hash(cluster_name, cluster_name_len);
+
+	cluster = qnetd_cluster_list_find_with_hash(list, cluster_name, cluster_name_len, hash);
+	if (cluster == NULL) {
+		cluster = malloc(sizeof(*cluster));
+		if (cluster == NULL) {
+			return (NULL);
+		}
+
+		if (qnetd_cluster_init(cluster, cluster_name, cluster_name_len, hash) != 0) {
+			free(cluster);
+
+			return (NULL);
+		}
+
+		if (list->no_clusters >= list->no_buckets * 2) {
+			qnetd_cluster_list_grow(list);
+		}
+
+		cluster->next = list->buckets[hash % list->no_buckets];
+		list->buckets[hash % list->no_buckets] = cluster;
+		list->no_clusters++;
+	}
+
+	qnetd_cluster_add_client(cluster, client);
+
+	return (cluster);
+}
+
+/*
+ * Remove client from its cluster. Cluster without clients is freed.
+ */
+void
+qnetd_cluster_list_del_client(struct qnetd_cluster_list *list, struct qnetd_client *client)
+{
+	struct qnetd_cluster *cluster;
+	struct qnetd_cluster **cluster_iter;
+
+	cluster = client->cluster;
+
+	qnetd_cluster_del_client(cluster, client);
+
+	if (cluster->no_clients > 0) {
+		return ;
+	}
+
+	for (cluster_iter = &list->buckets[cluster->cluster_name_hash % list->no_buckets];
+	    *cluster_iter != NULL; cluster_iter = &(*cluster_iter)->next) {
+		if (*cluster_iter == cluster) {
+			*cluster_iter = cluster->next;
+			break;
+		}
+	}
+
+	list->no_clusters--;
+
+	qnetd_cluster_destroy(cluster);
+	free(cluster);
+}
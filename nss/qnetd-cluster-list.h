@@ -0,0 +1,40 @@
+#ifndef _QNETD_CLUSTER_LIST_H_
+#define _QNETD_CLUSTER_LIST_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "qnetd-cluster.h"
+#include "qnetd-client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash table of clusters keyed by cluster name
+ */
+struct qnetd_cluster_list {
+	struct qnetd_cluster **buckets;
+	size_t no_buckets;
+	size_t no_clusters;
+};
+
+extern int			 qnetd_cluster_list_init(struct qnetd_cluster_list *list);
+
+extern void			 qnetd_cluster_list_free(struct qnetd_cluster_list *list);
+
+extern struct qnetd_cluster	*qnetd_cluster_list_find(const struct qnetd_cluster_list *list,
+    const char *cluster_name, size_t cluster_name_len);
+
+extern struct qnetd_cluster	*qnetd_cluster_list_add_client(struct qnetd_cluster_list *list,
+    struct qnetd_client *client, const char *cluster_name, size_t cluster_name_len);
+
+extern void			 qnetd_cluster_list_del_client(struct qnetd_cluster_list *list,
+    struct qnetd_client *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_CLUSTER_LIST_H_ */
@@ -0,0 +1,248 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qnetd-cluster.h"
+
+#define QNETD_CLUSTER_NODE_ID_MAP_INITIAL_SIZE	16
+
+int
+qnetd_cluster_init(struct qnetd_cluster *cluster, const char *cluster_name, size_t cluster_name_len,
+    uint32_t cluster_name_hash)
+{
+
+	memset(cluster, 0, sizeof(*cluster));
+
+	cluster->cluster_name = malloc(cluster_name_len + 1);
+	if (cluster->cluster_name == NULL) {
+		return (-1);
+	}
+
+	memcpy(cluster->cluster_name, cluster_name, cluster_name_len);
+	cluster->cluster_name[cluster_name_len] = '\0';
+	cluster->cluster_name_len = cluster_name_len;
+	cluster->cluster_name_hash = cluster_name_hash;
+
+	TAILQ_INIT(&cluster->clients);
+
+	return (0);
+}
+
+void
+qnetd_cluster_destroy(struct qnetd_cluster *cluster)
+{
+
+	free(cluster->cluster_name);
+	cluster->cluster_name = NULL;
+
+	free(cluster->node_id_map);
+	cluster->node_id_map = NULL;
+	cluster->node_id_map_size = 0;
+	cluster->no_node_ids = 0;
+}
+
+static size_t
+qnetd_cluster_node_id_map_pos(const struct qnetd_cluster *cluster, uint32_t node_id)
+{
+
+	/*
+	 * Knuth multiplicative hash
+	 */
+	return ((size_t)(node_id * 2654435761U) & (cluster->node_id_map_size - 1));
+}
+
+/*
+ * Return position of node_id in map or position of empty slot where node_id should be stored.
+ * Map must not be full.
+ */
+static size_t
+qnetd_cluster_node_id_map_lookup(const struct qnetd_cluster *cluster, uint32_t node_id)
+{
+	size_t pos;
+
+	pos = qnetd_cluster_node_id_map_pos(cluster, node_id);
+
+	while (cluster->node_id_map[pos] != NULL && cluster->node_id_map[pos]->node_id != node_id) {
+		pos = (pos + 1) & (cluster->node_id_map_size - 1);
+	}
+
+	return (pos);
+}
+
+static int
+qnetd_cluster_node_id_map_resize(struct qnetd_cluster *cluster, size_t new_size)
+{
+	struct qnetd_client **old_map;
+	size_t old_size;
+	size_t zi;
+
+	old_map = cluster->node_id_map;
+	old_size = cluster->node_id_map_size;
+
+	cluster->node_id_map = calloc(new_size, sizeof(*cluster->node_id_map));
+	if (cluster->node_id_map == NULL) {
+		cluster->node_id_map = old_map;
+
+		return (-1);
+	}
+
+	cluster->node_id_map_size = new_size;
+
+	for (zi = 0; zi < old_size; zi++) {
+		if (old_map[zi] != NULL) {
+			cluster->node_id_map[qnetd_cluster_node_id_map_lookup(cluster, old_map[zi]->node_id)] =
+			    old_map[zi];
+		}
+	}
+
+	free(old_map);
+
+	return (0);
+}
+
+/*
+ * Remove item on given position (backward shift deletion, so no tombstones are needed)
+ */
+static void
+qnetd_cluster_node_id_map_del_pos(struct qnetd_cluster *cluster, size_t pos)
+{
+	size_t mask;
+	size_t next;
+	size_t home;
+
+	mask = cluster->node_id_map_size - 1;
+	cluster->node_id_map[pos] = NULL;
+	cluster->no_node_ids--;
+
+	for (next = (pos + 1) & mask; cluster->node_id_map[next] != NULL; next = (next + 1) & mask) {
+		home = qnetd_cluster_node_id_map_pos(cluster, cluster->node_id_map[next]->node_id);
+
+		/*
+		 * Move item if its home position is not in (pos, next] cyclic interval
+		 */
+		if (((next - home) & mask) >= ((next - pos) & mask)) {
+			cluster->node_id_map[pos] = cluster->node_id_map[next];
+			cluster->node_id_map[next] = NULL;
+			pos = next;
+		}
+	}
+}
+
+/*
+ * Remove client from node id map (if it is there)
+ */
+static void
+qnetd_cluster_node_id_map_del(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+	size_t pos;
+
+	if (!client->node_id_set || cluster->node_id_map == NULL) {
+		return ;
+	}
+
+	pos = qnetd_cluster_node_id_map_lookup(cluster, client->node_id);
+
+	if (cluster->node_id_map[pos] == client) {
+		qnetd_cluster_node_id_map_del_pos(cluster, pos);
+	}
+}
+
+struct qnetd_client *
+qnetd_cluster_find_node_id(const struct qnetd_cluster *cluster, uint32_t node_id)
+{
+
+	if (cluster->node_id_map == NULL) {
+		return (NULL);
+	}
+
+	return (cluster->node_id_map[qnetd_cluster_node_id_map_lookup(cluster, node_id)]);
+}
+
+/*
+ * Set node id of client and store client in node id map. If other client of cluster already
+ * claims node_id, it is replaced in the map and returned in replaced_client (otherwise
+ * replaced_client is set to NULL). Caller is responsible for disconnecting replaced client.
+ */
+int
+qnetd_cluster_set_node_id(struct qnetd_cluster *cluster, struct qnetd_client *client, uint32_t node_id,
+    struct qnetd_client **replaced_client)
+{
+	size_t pos;
+
+	*replaced_client = NULL;
+
+	qnetd_cluster_node_id_map_del(cluster, client);
+	client->node_id_set = 0;
+
+	if (cluster->node_id_map == NULL || (cluster->no_node_ids + 1) * 2 > cluster->node_id_map_size) {
+		if (qnetd_cluster_node_id_map_resize(cluster, (cluster->node_id_map == NULL ?
+		    QNETD_CLUSTER_NODE_ID_MAP_INITIAL_SIZE : cluster->node_id_map_size * 2)) != 0) {
+			return (-1);
+		}
+	}
+
+	client->node_id = node_id;
+	client->node_id_set = 1;
+
+	pos = qnetd_cluster_node_id_map_lookup(cluster, node_id);
+
+	if (cluster->node_id_map[pos] != NULL) {
+		*replaced_client = cluster->node_id_map[pos];
+	} else {
+		cluster->no_node_ids++;
+	}
+
+	cluster->node_id_map[pos] = client;
+
+	return (0);
+}
+
+/*
+ * Add client to cluster. Cluster name of client is set to (interned) name of cluster.
+ */
+void
+qnetd_cluster_add_client(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	TAILQ_INSERT_TAIL(&cluster->clients, client, cluster_entries);
+	cluster->no_clients++;
+
+	if (client->init_received) {
+		cluster->no_init_clients++;
+	}
+
+	client->cluster = cluster;
+	client->cluster_name = cluster->cluster_name;
+	client->cluster_name_len = cluster->cluster_name_len;
+}
+
+void
+qnetd_cluster_del_client(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	qnetd_cluster_node_id_map_del(cluster, client);
+
+	TAILQ_REMOVE(&cluster->clients, client, cluster_entries);
+	cluster->no_clients--;
+
+	if (client->init_received) {
+		cluster->no_init_clients--;
+	}
+
+	client->cluster = NULL;
+	client->cluster_name = NULL;
+	client->cluster_name_len = 0;
+}
+
+/*
+ * Must be called before client->init_received is set
+ */
+void
+qnetd_cluster_client_init_received(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	if (!client->init_received) {
+		cluster->no_init_clients++;
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef _QNETD_CLUSTER_H_
+#define _QNETD_CLUSTER_H_
+
+#include <sys/types.h>
+
+#include <sys/queue.h>
+#include <inttypes.h>
+
+#include "qnetd-client.h"
+#include "timer-list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct qnetd_algorithm;
+
+struct qnetd_cluster {
+	char *cluster_name;
+	size_t cluster_name_len;
+	uint32_t cluster_name_hash;
+	TAILQ_HEAD(, qnetd_client) clients;
+	size_t no_clients;		// Number of clients in clients list
+	size_t no_init_clients;		// Number of clients which already sent init msg
+	struct qnetd_client **node_id_map;	// Open addressing hash table node_id -> client
+	size_t node_id_map_size;	// Always power of 2
+	size_t no_node_ids;		// Number of items in node_id_map
+	const struct qnetd_algorithm *algorithm;	// Set while some client is attached to algorithm
+	void *algorithm_data;		// Per cluster state owned by algorithm
+	size_t no_algorithm_clients;	// Number of clients attached to algorithm
+	struct timer_list_entry *vote_info_timer;	// Set while vote info debounce window is open
+	int vote_info_deferred;		// Vote info send postponed to end of window
+	PRIntervalTime vote_info_deferred_since;
+	struct qnetd_cluster *next;	// Next cluster in hash table bucket
+};
+
+extern int		qnetd_cluster_init(struct qnetd_cluster *cluster, const char *cluster_name,
+    size_t cluster_name_len, uint32_t cluster_name_hash);
+
+extern void		qnetd_cluster_destroy(struct qnetd_cluster *cluster);
+
+extern void		qnetd_cluster_add_client(struct qnetd_cluster *cluster, struct qnetd_client *client);
+
+extern void		qnetd_cluster_del_client(struct qnetd_cluster *cluster, struct qnetd_client *client);
+
+extern void		qnetd_cluster_client_init_received(struct qnetd_cluster *cluster,
+    struct qnetd_client *client);
+
+extern struct qnetd_client	*qnetd_cluster_find_node_id(const struct qnetd_cluster *cluster,
+    uint32_t node_id);
+
+extern int		qnetd_cluster_set_node_id(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    uint32_t node_id, struct qnetd_client **replaced_client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_CLUSTER_H_ */
@@ -90,36 +90,54 @@ qnetd_poll_array_get(const struct qnetd_poll_array *poll_array, unsigned int pos
 	return (&poll_array->array[pos]);
 }
 
+/*
+ * Poll array item i + no_extra_fds belongs to client slot i. Only hot parts of clients are
+ * touched. Released slots get NULL fd (ignored by PR_Poll), but slots should be compacted
+ * before.
+ */
 PRPollDesc *
-qnetd_poll_array_create_from_clients_list(struct qnetd_poll_array *poll_array,
-    const struct qnetd_clients_list *clients_list,
-    PRFileDesc *extra_fd, PRInt16 extra_fd_in_flags)
+qnetd_poll_array_create_from_client_slots(struct qnetd_poll_array *poll_array,
+    const struct qnetd_client_slots *slots,
+    PRFileDesc * const *extra_fds, unsigned int no_extra_fds, PRInt16 extra_fd_in_flags)
 {
-	struct qnetd_client *client;
+	const struct qnetd_client_hot *hot;
 	PRPollDesc *poll_desc;
+	unsigned int i;
 
 	qnetd_poll_array_clean(poll_array);
 
-	if (extra_fd != NULL) {
+	/*
+	 * Extra fds (listening sockets) are placed before clients
+	 */
+	for (i = 0; i < no_extra_fds; i++) {
 		poll_desc = qnetd_poll_array_add(poll_array);
 		if (poll_desc == NULL) {
 			return (NULL);
 		}
 
-		poll_desc->fd = extra_fd;
+		poll_desc->fd = extra_fds[i];
 		poll_desc->in_flags = extra_fd_in_flags;
 		poll_desc->out_flags = 0;
 	}
 
-	TAILQ_FOREACH(client, clients_list, entries) {
+	for (i = 0; i < qnetd_client_slots_size(slots); i++) {
+		hot = qnetd_client_slots_get(slots, i);
+
 		poll_desc = qnetd_poll_array_add(poll_array);
 		if (poll_desc == NULL) {
 			return (NULL);
 		}
-		poll_desc->fd = client->socket;
-		poll_desc->in_flags = PR_POLL_READ;
-		if (client->sending_msg) {
-			poll_desc->in_flags |= PR_POLL_WRITE;
+		poll_desc->fd = hot->socket;
+		/*
+		 * Client has only one send buffer, so next message is not read until
+		 * previous reply is sent. Queued shared messages don't block reading.
+		 */
+		if (hot->sending_msg) {
+			poll_desc->in_flags = PR_POLL_WRITE;
+		} else if (hot->send_queue_pending) {
+			poll_desc->in_flags = PR_POLL_READ | PR_POLL_WRITE;
+		} else {
+			poll_desc->in_flags = PR_POLL_READ;
 		}
 		poll_desc->out_flags = 0;
 	}
@@ -6,8 +6,7 @@
 
 #include <nspr.h>
 
-#include "qnetd-client.h"
-#include "qnetd-clients-list.h"
+#include "qnetd-client-slots.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,7 +18,6 @@ struct qnetd_poll_array {
 	unsigned int items;
 };
 
-
 extern void		 qnetd_poll_array_init(struct qnetd_poll_array *poll_array);
 
 extern void		 qnetd_poll_array_destroy(struct qnetd_poll_array *poll_array);
@@ -32,8 +30,9 @@ extern PRPollDesc	*qnetd_poll_array_add(struct qnetd_poll_array *poll_array);
 
 extern PRPollDesc 	*qnetd_poll_array_get(const struct qnetd_poll_array *poll_array, unsigned int pos);
 
-extern PRPollDesc	*qnetd_poll_array_create_from_clients_list(struct qnetd_poll_array *poll_array,
-    const struct qnetd_clients_list *clients_list, PRFileDesc *extra_fd, PRInt16 extra_fd_in_flags);
+extern PRPollDesc	*qnetd_poll_array_create_from_client_slots(struct qnetd_poll_array *poll_array,
+    const struct qnetd_client_slots *slots, PRFileDesc * const *extra_fds,
+    unsigned int no_extra_fds, PRInt16 extra_fd_in_flags);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,497 @@
+/*
+ * Measure cost of one qnetd poll iteration (poll array build and event dispatch) with many
+ * connected clients and few events.
+ *
+ * Usage: qnetd-poll-bench [-n clients] [-e events_per_poll] [-i iterations] [-l list|slots]
+ *
+ * List layout walks clients list and reads per event state from (heap scattered) struct
+ * qnetd_client, as qnetd did before per event state was moved to client slots. Slots layout
+ * scans qnetd_client_slots and touches struct qnetd_client only for clients with event.
+ * PR_Poll itself is not called, out_flags are set for random clients instead.
+ *
+ * Cache misses are read from hardware performance counter if available. Where it isn't (n/a
+ * is printed), run layouts separately under "perf stat -e cache-misses" with -l.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "qnetd-client.h"
+#include "qnetd-client-slots.h"
+#include "qnetd-poll-array.h"
+
+#define BENCH_DEFAULT_CLIENTS		50000
+#define BENCH_DEFAULT_EVENTS		50
+#define BENCH_DEFAULT_ITERATIONS	1000
+#define BENCH_NO_LISTEN_SOCKETS		2
+
+/*
+ * Client with per event state stored inline, followed by rest of client
+ */
+struct bench_list_client {
+	PRFileDesc *socket;
+	int sending_msg;
+	int send_queue_pending;
+	int schedule_disconnect;
+	uint64_t events;
+	TAILQ_ENTRY(bench_list_client) entries;
+	char cold[sizeof(struct qnetd_client)];
+};
+
+TAILQ_HEAD(bench_list, bench_list_client);
+
+static volatile uint64_t bench_sink;
+
+static double
+bench_time_diff(const struct timespec *start, const struct timespec *end)
+{
+
+	return ((end->tv_sec - start->tv_sec) * 1000000000.0 + (end->tv_nsec - start->tv_nsec));
+}
+
+static int
+bench_cache_misses_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+	return (-1);
+#endif
+}
+
+static void
+bench_cache_misses_start(int fd)
+{
+
+#ifdef __linux__
+	if (fd != -1) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+/*
+ * Returns number of cache misses since bench_cache_misses_start or -1 if counter is not
+ * available
+ */
+static int64_t
+bench_cache_misses_stop(int fd)
+{
+	uint64_t count;
+
+	if (fd == -1) {
+		return (-1);
+	}
+
+#ifdef __linux__
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+	if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+		return (-1);
+	}
+
+	return ((int64_t)count);
+}
+
+/*
+ * Random permutation of 0 .. n - 1
+ */
+static unsigned int *
+bench_permutation(unsigned int n)
+{
+	unsigned int *perm;
+	unsigned int i, j, tmp;
+
+	perm = malloc(sizeof(*perm) * n);
+	if (perm == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	for (i = 0; i < n; i++) {
+		perm[i] = i;
+	}
+
+	for (i = n - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		tmp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = tmp;
+	}
+
+	return (perm);
+}
+
+/*
+ * Allocate n blocks of given size interleaved with other allocations and return them in
+ * random order, as left by long running daemon with reconnecting clients
+ */
+static void **
+bench_scattered_alloc(unsigned int n, size_t size)
+{
+	void **blocks;
+	void **spacers;
+	void *tmp;
+	unsigned int i, j;
+
+	blocks = malloc(sizeof(*blocks) * n);
+	spacers = malloc(sizeof(*spacers) * n);
+	if (blocks == NULL || spacers == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	for (i = 0; i < n; i++) {
+		blocks[i] = malloc(size);
+		spacers[i] = malloc(64 + random() % 4096);
+		if (blocks[i] == NULL || spacers[i] == NULL) {
+			errx(1, "Can't alloc memory");
+		}
+		memset(blocks[i], 0, size);
+	}
+
+	for (i = 0; i < n; i++) {
+		free(spacers[i]);
+	}
+	free(spacers);
+
+	for (i = n - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		tmp = blocks[i];
+		blocks[i] = blocks[j];
+		blocks[j] = tmp;
+	}
+
+	return (blocks);
+}
+
+/*
+ * Process event of client. Only cold part of client is touched.
+ */
+static void
+bench_client_event(char *cold, PRInt16 out_flags)
+{
+
+	bench_sink += cold[0] + cold[sizeof(struct qnetd_client) / 2] + out_flags;
+}
+
+static PRPollDesc *
+bench_list_create_poll_array(struct qnetd_poll_array *poll_array, const struct bench_list *list,
+    PRFileDesc * const *extra_fds, unsigned int no_extra_fds)
+{
+	struct bench_list_client *client;
+	PRPollDesc *poll_desc;
+	unsigned int i;
+
+	qnetd_poll_array_clean(poll_array);
+
+	for (i = 0; i < no_extra_fds; i++) {
+		poll_desc = qnetd_poll_array_add(poll_array);
+		if (poll_desc == NULL) {
+			return (NULL);
+		}
+
+		poll_desc->fd = extra_fds[i];
+		poll_desc->in_flags = PR_POLL_READ;
+		poll_desc->out_flags = 0;
+	}
+
+	TAILQ_FOREACH(client, list, entries) {
+		poll_desc = qnetd_poll_array_add(poll_array);
+		if (poll_desc == NULL) {
+			return (NULL);
+		}
+		poll_desc->fd = client->socket;
+		if (client->sending_msg) {
+			poll_desc->in_flags = PR_POLL_WRITE;
+		} else if (client->send_queue_pending) {
+			poll_desc->in_flags = PR_POLL_READ | PR_POLL_WRITE;
+		} else {
+			poll_desc->in_flags = PR_POLL_READ;
+		}
+		poll_desc->out_flags = 0;
+	}
+
+	return (poll_array->array);
+}
+
+static void
+bench_set_events(PRPollDesc *pfds, const unsigned int *events, unsigned int no_events)
+{
+	unsigned int i;
+
+	for (i = 0; i < no_events; i++) {
+		pfds[BENCH_NO_LISTEN_SOCKETS + events[i]].out_flags = PR_POLL_READ;
+	}
+}
+
+static void
+bench_list_poll(struct qnetd_poll_array *poll_array, const struct bench_list *list,
+    PRFileDesc * const *listen_sockets, const unsigned int *events, unsigned int no_events)
+{
+	struct bench_list_client *client;
+	struct bench_list_client *client_next;
+	PRPollDesc *pfds;
+	unsigned int i;
+
+	pfds = bench_list_create_poll_array(poll_array, list, listen_sockets, BENCH_NO_LISTEN_SOCKETS);
+	if (pfds == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	bench_set_events(pfds, events, no_events);
+
+	client = NULL;
+	client_next = NULL;
+
+	for (i = 0; i < qnetd_poll_array_size(poll_array); i++) {
+		if (i >= BENCH_NO_LISTEN_SOCKETS) {
+			if (i == BENCH_NO_LISTEN_SOCKETS) {
+				client = TAILQ_FIRST(list);
+			} else {
+				client = client_next;
+			}
+			client_next = TAILQ_NEXT(client, entries);
+
+			if (client->schedule_disconnect) {
+				continue ;
+			}
+
+			if (pfds[i].out_flags != 0) {
+				client->events++;
+				bench_client_event(client->cold, pfds[i].out_flags);
+			}
+		}
+	}
+}
+
+static void
+bench_slots_poll(struct qnetd_poll_array *poll_array, const struct qnetd_client_slots *slots,
+    PRFileDesc * const *listen_sockets, const unsigned int *events, unsigned int no_events)
+{
+	struct qnetd_client_hot *hot;
+	PRPollDesc *pfds;
+	unsigned int i;
+
+	pfds = qnetd_poll_array_create_from_client_slots(poll_array, slots, listen_sockets,
+	    BENCH_NO_LISTEN_SOCKETS, PR_POLL_READ);
+	if (pfds == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+
+	bench_set_events(pfds, events, no_events);
+
+	for (i = 0; i < qnetd_poll_array_size(poll_array); i++) {
+		if (i >= BENCH_NO_LISTEN_SOCKETS) {
+			hot = qnetd_client_slots_get(slots, i - BENCH_NO_LISTEN_SOCKETS);
+			if (hot->client == NULL || hot->schedule_disconnect) {
+				continue ;
+			}
+
+			if (pfds[i].out_flags != 0) {
+				bench_client_event((char *)hot->client, pfds[i].out_flags);
+			}
+		}
+	}
+}
+
+static void
+bench_print_result(const char *name, double ns, int64_t misses, unsigned int iterations,
+    unsigned int no_events)
+{
+	char misses_str[32];
+
+	if (misses >= 0) {
+		snprintf(misses_str, sizeof(misses_str), "%.1f",
+		    (double)misses / ((double)iterations * no_events));
+	} else {
+		snprintf(misses_str, sizeof(misses_str), "n/a");
+	}
+
+	printf("%-16s %14.0f %14.1f %18s\n", name, ns / iterations, ns / ((double)iterations * no_events),
+	    misses_str);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench_list list;
+	struct bench_list_client **list_clients;
+	struct qnetd_client_slots slots;
+	struct qnetd_client **clients;
+	struct qnetd_poll_array poll_array;
+	PRFileDesc *listen_sockets[BENCH_NO_LISTEN_SOCKETS];
+	struct timespec start, end;
+	unsigned int *perm;
+	unsigned int *events;
+	unsigned int no_clients, no_events, iterations;
+	unsigned int i, j;
+	int64_t misses;
+	double ns;
+	char *ep;
+	int perf_fd;
+	int only_layout;
+	int layout;
+	int ch;
+
+	no_clients = BENCH_DEFAULT_CLIENTS;
+	no_events = BENCH_DEFAULT_EVENTS;
+	iterations = BENCH_DEFAULT_ITERATIONS;
+	only_layout = -1;
+
+	while ((ch = getopt(argc, argv, "n:e:i:l:")) != -1) {
+		switch (ch) {
+		case 'n':
+			no_clients = strtoul(optarg, &ep, 10);
+			if (*ep != '\0' || no_clients == 0) {
+				errx(1, "Invalid number of clients");
+			}
+			break;
+		case 'e':
+			no_events = strtoul(optarg, &ep, 10);
+			if (*ep != '\0' || no_events == 0) {
+				errx(1, "Invalid number of events");
+			}
+			break;
+		case 'i':
+			iterations = strtoul(optarg, &ep, 10);
+			if (*ep != '\0' || iterations == 0) {
+				errx(1, "Invalid number of iterations");
+			}
+			break;
+		case 'l':
+			if (strcmp(optarg, "list") == 0) {
+				only_layout = 0;
+			} else if (strcmp(optarg, "slots") == 0) {
+				only_layout = 1;
+			} else {
+				errx(1, "Invalid layout");
+			}
+			break;
+		default:
+			errx(1, "Usage: %s [-n clients] [-e events_per_poll] [-i iterations] "
+			    "[-l list|slots]", argv[0]);
+			break;
+		}
+	}
+
+	if (no_events > no_clients) {
+		errx(1, "Number of events can't be bigger than number of clients");
+	}
+
+	srandom(time(NULL));
+
+	/*
+	 * Sockets are never dereferenced
+	 */
+	for (i = 0; i < BENCH_NO_LISTEN_SOCKETS; i++) {
+		listen_sockets[i] = (PRFileDesc *)(uintptr_t)(i + 1);
+	}
+
+	TAILQ_INIT(&list);
+	list_clients = (struct bench_list_client **)bench_scattered_alloc(no_clients,
+	    sizeof(struct bench_list_client));
+	for (i = 0; i < no_clients; i++) {
+		list_clients[i]->socket = (PRFileDesc *)(uintptr_t)(i + BENCH_NO_LISTEN_SOCKETS + 1);
+		TAILQ_INSERT_TAIL(&list, list_clients[i], entries);
+	}
+
+	qnetd_client_slots_init(&slots);
+	clients = (struct qnetd_client **)bench_scattered_alloc(no_clients, sizeof(struct qnetd_client));
+	for (i = 0; i < no_clients; i++) {
+		clients[i]->slots = &slots;
+		if (qnetd_client_slots_add(&slots, clients[i],
+		    (PRFileDesc *)(uintptr_t)(i + BENCH_NO_LISTEN_SOCKETS + 1), &clients[i]->slot) != 0) {
+			errx(1, "Can't alloc memory");
+		}
+	}
+
+	qnetd_poll_array_init(&poll_array);
+
+	/*
+	 * Events of every iteration are at different random clients
+	 */
+	events = malloc(sizeof(*events) * no_events * iterations);
+	if (events == NULL) {
+		errx(1, "Can't alloc memory");
+	}
+	for (i = 0; i < iterations; i++) {
+		perm = bench_permutation(no_clients);
+		memcpy(&events[i * no_events], perm, sizeof(*events) * no_events);
+		free(perm);
+	}
+
+	perf_fd = bench_cache_misses_open();
+
+	printf("%u clients, %u events per poll, %u iterations\n", no_clients, no_events, iterations);
+	printf("%-16s %14s %14s %18s\n", "layout", "ns/poll", "ns/event", "cache misses/event");
+
+	for (layout = 0; layout < 2; layout++) {
+		if (only_layout != -1 && layout != only_layout) {
+			continue ;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bench_cache_misses_start(perf_fd);
+
+		for (j = 0; j < iterations; j++) {
+			switch (layout) {
+			case 0:
+				bench_list_poll(&poll_array, &list, listen_sockets,
+				    &events[j * no_events], no_events);
+				break;
+			case 1:
+				bench_slots_poll(&poll_array, &slots, listen_sockets,
+				    &events[j * no_events], no_events);
+				break;
+			}
+		}
+
+		misses = bench_cache_misses_stop(perf_fd);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ns = bench_time_diff(&start, &end);
+
+		switch (layout) {
+		case 0: bench_print_result("list", ns, misses, iterations, no_events); break;
+		case 1: bench_print_result("slots", ns, misses, iterations, no_events); break;
+		}
+	}
+
+	if (perf_fd != -1) {
+		close(perf_fd);
+	}
+
+	for (i = 0; i < no_clients; i++) {
+		free(list_clients[i]);
+		free(clients[i]);
+	}
+	free(list_clients);
+	free(clients);
+	free(events);
+	qnetd_client_slots_destroy(&slots);
+	qnetd_poll_array_destroy(&poll_array);
+
+	return (0);
+}
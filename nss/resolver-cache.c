@@ -0,0 +1,245 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <prthread.h>
+#include <prlock.h>
+
+#include "resolver-cache.h"
+
+int
+resolver_cache_init(struct resolver_cache *cache, PRUint32 ttl)
+{
+
+	memset(cache, 0, sizeof(*cache));
+
+	cache->lock = PR_NewLock();
+	if (cache->lock == NULL) {
+		return (-1);
+	}
+
+	cache->ttl = ttl;
+	TAILQ_INIT(&cache->entries);
+
+	return (0);
+}
+
+void
+resolver_cache_destroy(struct resolver_cache *cache)
+{
+	struct resolver_cache_entry *entry;
+	struct resolver_cache_entry *entry_next;
+
+	entry = TAILQ_FIRST(&cache->entries);
+
+	while (entry != NULL) {
+		entry_next = TAILQ_NEXT(entry, entries);
+
+		if (entry->refresh_thread != NULL) {
+			PR_JoinThread(entry->refresh_thread);
+		}
+
+		free(entry->hostname);
+		free(entry);
+
+		entry = entry_next;
+	}
+
+	TAILQ_INIT(&cache->entries);
+
+	PR_DestroyLock(cache->lock);
+	cache->lock = NULL;
+}
+
+/*
+ * Must be called with cache lock held
+ */
+static struct resolver_cache_entry *
+resolver_cache_find(struct resolver_cache *cache, const char *hostname, uint16_t port, PRIntn af)
+{
+	struct resolver_cache_entry *entry;
+
+	TAILQ_FOREACH(entry, &cache->entries, entries) {
+		if (entry->port == port && entry->af == af && strcmp(entry->hostname, hostname) == 0) {
+			return (entry);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Must be called with cache lock held
+ */
+static struct resolver_cache_entry *
+resolver_cache_add(struct resolver_cache *cache, const char *hostname, uint16_t port, PRIntn af)
+{
+	struct resolver_cache_entry *entry;
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL) {
+		return (NULL);
+	}
+
+	memset(entry, 0, sizeof(*entry));
+
+	entry->hostname = strdup(hostname);
+	if (entry->hostname == NULL) {
+		free(entry);
+
+		return (NULL);
+	}
+
+	entry->cache = cache;
+	entry->port = port;
+	entry->af = af;
+
+	TAILQ_INSERT_TAIL(&cache->entries, entry, entries);
+
+	return (entry);
+}
+
+/*
+ * Store result of resolve. On failure previously resolved addresses are kept. Must be called
+ * with cache lock held.
+ */
+static void
+resolver_cache_entry_store(struct resolver_cache_entry *entry, int resolve_res, const PRNetAddr *addrs,
+    size_t no_addrs, PRErrorCode error)
+{
+
+	if (resolve_res == 0 && no_addrs > 0) {
+		memcpy(entry->addrs, addrs, sizeof(*addrs) * no_addrs);
+		entry->no_addrs = no_addrs;
+		entry->resolved = 1;
+		entry->resolve_time = PR_IntervalNow();
+		entry->last_error = 0;
+	} else {
+		entry->last_error = (resolve_res == 0 ? PR_ADDRESS_NOT_AVAILABLE_ERROR : error);
+	}
+}
+
+static void
+resolver_cache_refresh_thread(void *arg)
+{
+	struct resolver_cache_entry *entry;
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+	int res;
+
+	entry = (struct resolver_cache_entry *)arg;
+
+	/*
+	 * hostname, port and af are never changed after entry is created so it's safe
+	 * to access them without lock
+	 */
+	no_addrs = NSS_SOCK_CONNECT_MAX_ADDRS;
+	res = nss_sock_resolve(entry->hostname, entry->port, entry->af, addrs, &no_addrs);
+
+	PR_Lock(entry->cache->lock);
+	resolver_cache_entry_store(entry, res, addrs, no_addrs, PR_GetError());
+	entry->refresh_in_progress = 0;
+	PR_Unlock(entry->cache->lock);
+}
+
+/*
+ * Start background refresh of entry. Must be called with cache lock held.
+ */
+static int
+resolver_cache_entry_start_refresh(struct resolver_cache_entry *entry)
+{
+
+	if (entry->refresh_in_progress) {
+		return (0);
+	}
+
+	if (entry->refresh_thread != NULL) {
+		/*
+		 * Previous refresh thread already finished (refresh_in_progress is unset) so
+		 * join returns without waiting
+		 */
+		PR_JoinThread(entry->refresh_thread);
+		entry->refresh_thread = NULL;
+	}
+
+	entry->refresh_thread = PR_CreateThread(PR_USER_THREAD, resolver_cache_refresh_thread, entry,
+	    PR_PRIORITY_NORMAL, PR_GLOBAL_THREAD, PR_JOINABLE_THREAD, 0);
+	if (entry->refresh_thread == NULL) {
+		return (-1);
+	}
+
+	entry->refresh_in_progress = 1;
+
+	return (0);
+}
+
+/*
+ * Get addresses of hostname. addrs must have space for NSS_SOCK_CONNECT_MAX_ADDRS items.
+ *
+ * Cached addresses are returned immediately. If they are older than cache ttl, refresh is started
+ * in background. If hostname was not resolved yet, blocking resolve is done when blocking is set.
+ * Otherwise resolve is started in background and -1 is returned with PR_WOULD_BLOCK_ERROR (or
+ * error of last failed resolve).
+ */
+int
+resolver_cache_get(struct resolver_cache *cache, const char *hostname, uint16_t port, PRIntn af,
+    int blocking, PRNetAddr *addrs, size_t *no_addrs)
+{
+	struct resolver_cache_entry *entry;
+	PRErrorCode error;
+	int res;
+
+	PR_Lock(cache->lock);
+
+	entry = resolver_cache_find(cache, hostname, port, af);
+	if (entry == NULL) {
+		entry = resolver_cache_add(cache, hostname, port, af);
+	}
+
+	if (entry == NULL) {
+		PR_Unlock(cache->lock);
+		PR_SetError(PR_OUT_OF_MEMORY_ERROR, 0);
+
+		return (-1);
+	}
+
+	if (!entry->resolved && blocking) {
+		PR_Unlock(cache->lock);
+
+		*no_addrs = NSS_SOCK_CONNECT_MAX_ADDRS;
+		res = nss_sock_resolve(hostname, port, af, addrs, no_addrs);
+		error = PR_GetError();
+
+		PR_Lock(cache->lock);
+		resolver_cache_entry_store(entry, res, addrs, *no_addrs, error);
+	}
+
+	if (!entry->resolved) {
+		error = entry->last_error;
+
+		if (resolver_cache_entry_start_refresh(entry) != 0) {
+			error = PR_GetError();
+		}
+
+		PR_Unlock(cache->lock);
+		PR_SetError((error != 0 ? error : PR_WOULD_BLOCK_ERROR), 0);
+
+		return (-1);
+	}
+
+	memcpy(addrs, entry->addrs, sizeof(*addrs) * entry->no_addrs);
+	*no_addrs = entry->no_addrs;
+
+	if (PR_IntervalToMilliseconds(PR_IntervalNow() - entry->resolve_time) >= cache->ttl) {
+		/*
+		 * Stale addresses are used but refresh is started. Error is not fatal, because
+		 * refresh is retried on next call.
+		 */
+		(void)resolver_cache_entry_start_refresh(entry);
+	}
+
+	PR_Unlock(cache->lock);
+
+	return (0);
+}
@@ -0,0 +1,50 @@
+#ifndef _RESOLVER_CACHE_H_
+#define _RESOLVER_CACHE_H_
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <inttypes.h>
+
+#include <nspr.h>
+
+#include "nss-sock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolver_cache;
+
+struct resolver_cache_entry {
+	struct resolver_cache *cache;
+	char *hostname;
+	uint16_t port;
+	PRIntn af;
+	PRNetAddr addrs[NSS_SOCK_CONNECT_MAX_ADDRS];
+	size_t no_addrs;
+	int resolved;			// addrs are valid
+	PRIntervalTime resolve_time;	// Valid only if resolved != 0
+	PRErrorCode last_error;		// Error of last failed resolve
+	PRThread *refresh_thread;	// Set when background refresh thread was started
+	int refresh_in_progress;
+	TAILQ_ENTRY(resolver_cache_entry) entries;
+};
+
+struct resolver_cache {
+	PRLock *lock;
+	PRUint32 ttl;
+	TAILQ_HEAD(, resolver_cache_entry) entries;
+};
+
+extern int		resolver_cache_init(struct resolver_cache *cache, PRUint32 ttl);
+
+extern void		resolver_cache_destroy(struct resolver_cache *cache);
+
+extern int		resolver_cache_get(struct resolver_cache *cache, const char *hostname,
+    uint16_t port, PRIntn af, int blocking, PRNetAddr *addrs, size_t *no_addrs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLVER_CACHE_H_ */
@@ -0,0 +1,306 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rope.h"
+
+void
+rope_chunk_pool_init(struct rope_chunk_pool *pool, size_t chunk_size, size_t max_free_chunks)
+{
+
+	memset(pool, 0, sizeof(*pool));
+	pool->chunk_size = chunk_size;
+	pool->max_free_chunks = max_free_chunks;
+}
+
+void
+rope_chunk_pool_destroy(struct rope_chunk_pool *pool)
+{
+	struct rope_chunk *chunk;
+	struct rope_chunk *chunk_next;
+
+	chunk = pool->free_chunks;
+	while (chunk != NULL) {
+		chunk_next = chunk->next;
+		free(chunk);
+		chunk = chunk_next;
+	}
+
+	pool->free_chunks = NULL;
+	pool->no_free_chunks = 0;
+}
+
+static struct rope_chunk *
+rope_chunk_pool_get(struct rope_chunk_pool *pool)
+{
+	struct rope_chunk *chunk;
+
+	if (pool->free_chunks != NULL) {
+		chunk = pool->free_chunks;
+		pool->free_chunks = chunk->next;
+		pool->no_free_chunks--;
+	} else {
+		chunk = malloc(sizeof(*chunk) + pool->chunk_size);
+		if (chunk == NULL) {
+			return (NULL);
+		}
+	}
+
+	chunk->next = NULL;
+	chunk->used = 0;
+
+	return (chunk);
+}
+
+static void
+rope_chunk_pool_put(struct rope_chunk_pool *pool, struct rope_chunk *chunk)
+{
+
+	if (pool->no_free_chunks >= pool->max_free_chunks) {
+		free(chunk);
+
+		return ;
+	}
+
+	chunk->next = pool->free_chunks;
+	pool->free_chunks = chunk;
+	pool->no_free_chunks++;
+}
+
+void
+rope_init(struct rope *rope, struct rope_chunk_pool *pool, size_t maximum_size)
+{
+
+	memset(rope, 0, sizeof(*rope));
+	rope->pool = pool;
+	rope->maximum_size = maximum_size;
+}
+
+/*
+ * Return chunk and all chunks following it to pool
+ */
+static void
+rope_put_chunks(struct rope *rope, struct rope_chunk *chunk)
+{
+	struct rope_chunk *chunk_next;
+
+	while (chunk != NULL) {
+		chunk_next = chunk->next;
+		rope_chunk_pool_put(rope->pool, chunk);
+		chunk = chunk_next;
+	}
+}
+
+void
+rope_destroy(struct rope *rope)
+{
+
+	rope_put_chunks(rope, rope->first);
+	rope_init(rope, rope->pool, rope->maximum_size);
+}
+
+/*
+ * Remove all data. All chunks are returned to pool, so idle rope holds no memory.
+ */
+void
+rope_clean(struct rope *rope)
+{
+
+	rope_put_chunks(rope, rope->first);
+	rope->first = NULL;
+	rope->last = NULL;
+	rope->size = 0;
+}
+
+size_t
+rope_size(const struct rope *rope)
+{
+
+	return (rope->size);
+}
+
+size_t
+rope_max_size(const struct rope *rope)
+{
+
+	return (rope->maximum_size);
+}
+
+void
+rope_set_max_size(struct rope *rope, size_t maximum_size)
+{
+
+	rope->maximum_size = maximum_size;
+}
+
+/*
+ * Return free space at the end of rope (adding new chunk if last one is full) so caller can
+ * fill it directly and then call rope_commit. space_len is never bigger than space left
+ * before reaching maximum size. Returns 0 on success or -1 if rope is already at maximum
+ * size or on alloc failure.
+ */
+int
+rope_reserve(struct rope *rope, char **space, size_t *space_len)
+{
+	struct rope_chunk *chunk;
+
+	if (rope->size >= rope->maximum_size) {
+		return (-1);
+	}
+
+	if (rope->last == NULL || rope->last->used == rope->pool->chunk_size) {
+		chunk = rope_chunk_pool_get(rope->pool);
+		if (chunk == NULL) {
+			return (-1);
+		}
+
+		if (rope->last == NULL) {
+			rope->first = chunk;
+		} else {
+			rope->last->next = chunk;
+		}
+		rope->last = chunk;
+	}
+
+	*space = rope->last->data + rope->last->used;
+	*space_len = rope->pool->chunk_size - rope->last->used;
+	if (*space_len > rope->maximum_size - rope->size) {
+		*space_len = rope->maximum_size - rope->size;
+	}
+
+	return (0);
+}
+
+/*
+ * Mark size bytes of space returned by rope_reserve as used
+ */
+void
+rope_commit(struct rope *rope, size_t size)
+{
+
+	rope->last->used += size;
+	rope->size += size;
+}
+
+int
+rope_cat(struct rope *rope, const void *src, size_t size)
+{
+	const char *csrc;
+	char *space;
+	size_t space_len;
+
+	if (rope->size + size > rope->maximum_size) {
+		return (-1);
+	}
+
+	csrc = (const char *)src;
+
+	while (size > 0) {
+		if (rope_reserve(rope, &space, &space_len) == -1) {
+			return (-1);
+		}
+
+		if (space_len > size) {
+			space_len = size;
+		}
+
+		memcpy(space, csrc, space_len);
+		rope_commit(rope, space_len);
+
+		csrc += space_len;
+		size -= space_len;
+	}
+
+	return (0);
+}
+
+/*
+ * Copy size bytes starting at pos to dst. Returns 0 on success or -1 if rope is shorter.
+ */
+int
+rope_copy_out(const struct rope *rope, size_t pos, void *dst, size_t size)
+{
+	struct rope_cursor cursor;
+	const char *data;
+	char *cdst;
+	size_t data_len;
+
+	if (pos + size > rope->size) {
+		return (-1);
+	}
+
+	cdst = (char *)dst;
+
+	rope_cursor_init(rope, pos, &cursor);
+
+	while (size > 0) {
+		data = rope_cursor_get_data(&cursor, &data_len);
+		if (data_len > size) {
+			data_len = size;
+		}
+
+		memcpy(cdst, data, data_len);
+		rope_cursor_skip(&cursor, data_len);
+
+		cdst += data_len;
+		size -= data_len;
+	}
+
+	return (0);
+}
+
+void
+rope_cursor_init(const struct rope *rope, size_t pos, struct rope_cursor *cursor)
+{
+
+	cursor->chunk = rope->first;
+	cursor->chunk_pos = 0;
+
+	rope_cursor_skip(cursor, pos);
+}
+
+/*
+ * Return contiguous data from cursor to end of its chunk. data_len is 0 (and NULL is
+ * returned) at the end of rope.
+ */
+const char *
+rope_cursor_get_data(const struct rope_cursor *cursor, size_t *data_len)
+{
+
+	if (cursor->chunk == NULL) {
+		*data_len = 0;
+
+		return (NULL);
+	}
+
+	*data_len = cursor->chunk->used - cursor->chunk_pos;
+	if (*data_len == 0) {
+		return (NULL);
+	}
+
+	return (cursor->chunk->data + cursor->chunk_pos);
+}
+
+/*
+ * Move cursor by size bytes. Moving past end of rope leaves cursor at the end.
+ */
+void
+rope_cursor_skip(struct rope_cursor *cursor, size_t size)
+{
+	size_t chunk_rest;
+
+	while (cursor->chunk != NULL) {
+		chunk_rest = cursor->chunk->used - cursor->chunk_pos;
+
+		if (size < chunk_rest || (size == chunk_rest && cursor->chunk->next == NULL)) {
+			cursor->chunk_pos += size;
+
+			return ;
+		}
+
+		size -= chunk_rest;
+		cursor->chunk = cursor->chunk->next;
+		cursor->chunk_pos = 0;
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef _ROPE_H_
+#define _ROPE_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Segmented buffer. Data are stored in chain of fixed size chunks, so appending never
+ * reallocates or copies already stored data. Chunks are taken from (and returned to)
+ * shared pool.
+ */
+struct rope_chunk {
+	struct rope_chunk *next;
+	size_t used;
+	char data[];
+};
+
+struct rope_chunk_pool {
+	struct rope_chunk *free_chunks;
+	size_t chunk_size;
+	size_t no_free_chunks;
+	size_t max_free_chunks;		// Chunks over this limit are freed instead of cached
+};
+
+struct rope {
+	struct rope_chunk_pool *pool;
+	struct rope_chunk *first;
+	struct rope_chunk *last;
+	size_t size;
+	size_t maximum_size;
+};
+
+/*
+ * Position in rope. All chunks except last one are full.
+ */
+struct rope_cursor {
+	const struct rope_chunk *chunk;
+	size_t chunk_pos;
+};
+
+extern void		 rope_chunk_pool_init(struct rope_chunk_pool *pool, size_t chunk_size,
+    size_t max_free_chunks);
+
+extern void		 rope_chunk_pool_destroy(struct rope_chunk_pool *pool);
+
+extern void		 rope_init(struct rope *rope, struct rope_chunk_pool *pool, size_t maximum_size);
+
+extern void		 rope_destroy(struct rope *rope);
+
+extern void		 rope_clean(struct rope *rope);
+
+extern size_t		 rope_size(const struct rope *rope);
+
+extern size_t		 rope_max_size(const struct rope *rope);
+
+extern void		 rope_set_max_size(struct rope *rope, size_t maximum_size);
+
+extern int		 rope_cat(struct rope *rope, const void *src, size_t size);
+
+extern int		 rope_reserve(struct rope *rope, char **space, size_t *space_len);
+
+extern void		 rope_commit(struct rope *rope, size_t size);
+
+extern int		 rope_copy_out(const struct rope *rope, size_t pos, void *dst, size_t size);
+
+extern void		 rope_cursor_init(const struct rope *rope, size_t pos, struct rope_cursor *cursor);
+
+extern const char	*rope_cursor_get_data(const struct rope_cursor *cursor, size_t *data_len);
+
+extern void		 rope_cursor_skip(struct rope_cursor *cursor, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ROPE_H_ */
@@ -0,0 +1,149 @@
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "send-queue.h"
+
+/*
+ * Create new message with reference count 1
+ */
+struct send_queue_msg *
+send_queue_msg_create(size_t maximum_size)
+{
+	struct send_queue_msg *msg;
+
+	msg = malloc(sizeof(*msg));
+	if (msg == NULL) {
+		return (NULL);
+	}
+
+	dynar_init(&msg->buffer, maximum_size);
+	msg->refcount = 1;
+
+	return (msg);
+}
+
+void
+send_queue_msg_ref(struct send_queue_msg *msg)
+{
+
+	msg->refcount++;
+}
+
+void
+send_queue_msg_unref(struct send_queue_msg *msg)
+{
+
+	assert(msg->refcount > 0);
+
+	if (--msg->refcount == 0) {
+		dynar_destroy(&msg->buffer);
+		free(msg);
+	}
+}
+
+void
+send_queue_init(struct send_queue *queue, size_t max_entries)
+{
+
+	memset(queue, 0, sizeof(*queue));
+
+	TAILQ_INIT(&queue->list);
+	TAILQ_INIT(&queue->free_list);
+	queue->max_entries = max_entries;
+}
+
+void
+send_queue_destroy(struct send_queue *queue)
+{
+	struct send_queue_entry *entry;
+	struct send_queue_entry *entry_next;
+
+	while (!send_queue_is_empty(queue)) {
+		send_queue_del_first(queue);
+	}
+
+	entry = TAILQ_FIRST(&queue->free_list);
+	while (entry != NULL) {
+		entry_next = TAILQ_NEXT(entry, entries);
+
+		free(entry);
+
+		entry = entry_next;
+	}
+
+	send_queue_init(queue, queue->max_entries);
+}
+
+/*
+ * Add reference of msg to the end of the queue. Returns 0 on success, -1 if queue is full
+ * and -2 on allocation failure.
+ */
+int
+send_queue_add(struct send_queue *queue, struct send_queue_msg *msg)
+{
+	struct send_queue_entry *entry;
+
+	if (queue->no_entries >= queue->max_entries) {
+		return (-1);
+	}
+
+	if (!TAILQ_EMPTY(&queue->free_list)) {
+		entry = TAILQ_FIRST(&queue->free_list);
+		TAILQ_REMOVE(&queue->free_list, entry, entries);
+	} else {
+		entry = malloc(sizeof(*entry));
+		if (entry == NULL) {
+			return (-2);
+		}
+	}
+
+	send_queue_msg_ref(msg);
+	entry->msg = msg;
+
+	TAILQ_INSERT_TAIL(&queue->list, entry, entries);
+	queue->no_entries++;
+
+	return (0);
+}
+
+struct send_queue_msg *
+send_queue_first(const struct send_queue *queue)
+{
+
+	if (TAILQ_EMPTY(&queue->list)) {
+		return (NULL);
+	}
+
+	return (TAILQ_FIRST(&queue->list)->msg);
+}
+
+/*
+ * Remove first message (usually after it was sent) and drop its reference
+ */
+void
+send_queue_del_first(struct send_queue *queue)
+{
+	struct send_queue_entry *entry;
+
+	entry = TAILQ_FIRST(&queue->list);
+	assert(entry != NULL);
+
+	TAILQ_REMOVE(&queue->list, entry, entries);
+	queue->no_entries--;
+	queue->msg_already_sent_bytes = 0;
+
+	send_queue_msg_unref(entry->msg);
+	entry->msg = NULL;
+
+	TAILQ_INSERT_HEAD(&queue->free_list, entry, entries);
+}
+
+int
+send_queue_is_empty(const struct send_queue *queue)
+{
+
+	return (TAILQ_EMPTY(&queue->list));
+}
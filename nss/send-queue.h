@@ -0,0 +1,57 @@
+#ifndef _SEND_QUEUE_H_
+#define _SEND_QUEUE_H_
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include "dynar.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Immutable reference counted message. Same message can be queued to many send queues and
+ * it is freed when last reference is dropped.
+ */
+struct send_queue_msg {
+	struct dynar buffer;
+	unsigned int refcount;
+};
+
+struct send_queue_entry {
+	struct send_queue_msg *msg;
+	TAILQ_ENTRY(send_queue_entry) entries;
+};
+
+struct send_queue {
+	TAILQ_HEAD(, send_queue_entry) list;
+	TAILQ_HEAD(, send_queue_entry) free_list;
+	size_t no_entries;
+	size_t max_entries;
+	size_t msg_already_sent_bytes;	// Of first message in queue
+};
+
+extern struct send_queue_msg	*send_queue_msg_create(size_t maximum_size);
+
+extern void			 send_queue_msg_ref(struct send_queue_msg *msg);
+
+extern void			 send_queue_msg_unref(struct send_queue_msg *msg);
+
+extern void			 send_queue_init(struct send_queue *queue, size_t max_entries);
+
+extern void			 send_queue_destroy(struct send_queue *queue);
+
+extern int			 send_queue_add(struct send_queue *queue, struct send_queue_msg *msg);
+
+extern struct send_queue_msg	*send_queue_first(const struct send_queue *queue);
+
+extern void			 send_queue_del_first(struct send_queue *queue);
+
+extern int			 send_queue_is_empty(const struct send_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SEND_QUEUE_H_ */
@@ -234,7 +234,7 @@ int main(void)
 		err_nss();
 	}
 
-	server.socket = nss_sock_create_listen_socket(NULL, 4433, PR_AF_INET6);
+	server.socket = nss_sock_create_listen_socket(NULL, 4433, PR_AF_INET6, 0);
 	if (server.socket == NULL) {
 		err_nss();
 	}
@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tlv.h"
+
+/*
+ * Decode value of single compact option (type TLV_OPT_NODE_ID) as u32
+ */
+static int
+decode_compact_u32(const unsigned char *value, size_t value_len, uint32_t *res)
+{
+	unsigned char opt[16];
+	struct tlv_iterator tlv_iter;
+
+	assert(value_len + 2 <= sizeof(opt));
+
+	opt[0] = TLV_OPT_NODE_ID;
+	opt[1] = value_len;
+	memcpy(opt + 2, value, value_len);
+
+	tlv_iter_init_data((const char *)opt, value_len + 2, 0, TLV_ENCODING_COMPACT, &tlv_iter);
+	assert(tlv_iter_next(&tlv_iter) == 1);
+	assert(tlv_iter_get_type(&tlv_iter) == TLV_OPT_NODE_ID);
+
+	return (tlv_iter_decode_u32(&tlv_iter, res));
+}
+
+static int
+get_len_from_header(const unsigned char *data, size_t data_len, enum tlv_encoding encoding,
+    size_t *tlv_len)
+{
+
+	return (tlv_get_len_from_header((const char *)data, data_len, encoding, tlv_len));
+}
+
+/*
+ * Return result of tlv_iter_next for option with index opt_index (first is 0)
+ */
+static int
+iter_next_compact(const unsigned char *data, size_t data_len, size_t opt_index)
+{
+	struct tlv_iterator tlv_iter;
+	size_t zi;
+
+	tlv_iter_init_data((const char *)data, data_len, 0, TLV_ENCODING_COMPACT, &tlv_iter);
+
+	for (zi = 0; zi < opt_index; zi++) {
+		assert(tlv_iter_next(&tlv_iter) == 1);
+	}
+
+	return (tlv_iter_next(&tlv_iter));
+}
+
+int
+main(void)
+{
+	const unsigned char v_small[] = {0x05};
+	const unsigned char v_two_bytes[] = {0x82, 0x01};
+	const unsigned char v_max[] = {0xff, 0xff, 0xff, 0xff, 0x0f};
+	const unsigned char v_overflow[] = {0xff, 0xff, 0xff, 0xff, 0x1f};
+	const unsigned char v_overflow_cont[] = {0x80, 0x80, 0x80, 0x80, 0x80};
+	const unsigned char v_too_long[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+	const unsigned char v_truncated1[] = {0x80};
+	const unsigned char v_truncated4[] = {0xff, 0xff, 0xff, 0xff};
+	const unsigned char v_trailing[] = {0x05, 0x00};
+	const unsigned char h_type_truncated[] = {0x80, 0x80, 0x80, 0x80};
+	const unsigned char h_type_overflow[] = {0xff, 0xff, 0xff, 0xff, 0x1f, 0x00};
+	const unsigned char h_type_cont[] = {0x80, 0x80, 0x80, 0x80, 0x80};
+	const unsigned char h_len_truncated[] = {0x13, 0x82};
+	const unsigned char h_len_overflow[] = {0x13, 0xff, 0xff, 0xff, 0xff, 0x1f};
+	const unsigned char h_complete[] = {0x13, 0x82, 0x01};
+	const unsigned char h_type_too_big[] = {0x80, 0x80, 0x04, 0x00};
+	const unsigned char h_len_too_big[] = {0x13, 0x80, 0x80, 0x04};
+	const unsigned char h_standard[] = {0x00, 0x13, 0x00, 0x04};
+	const unsigned char o_past_end[] = {0x13, 0x05, 0x01};
+	const unsigned char o_header_at_end[] = {0x13, 0x01, 0x01, 0x14};
+	size_t tlv_len;
+	uint32_t u32;
+
+	/*
+	 * Varint values
+	 */
+	assert(decode_compact_u32(v_small, sizeof(v_small), &u32) == 0 && u32 == 5);
+	assert(decode_compact_u32(v_two_bytes, sizeof(v_two_bytes), &u32) == 0 && u32 == 130);
+	assert(decode_compact_u32(v_max, sizeof(v_max), &u32) == 0 && u32 == UINT32_MAX);
+
+	/*
+	 * 5th byte can carry only 4 bits and must not have continuation bit
+	 */
+	assert(decode_compact_u32(v_overflow, sizeof(v_overflow), &u32) == -1);
+	assert(decode_compact_u32(v_overflow_cont, sizeof(v_overflow_cont), &u32) == -1);
+	assert(decode_compact_u32(v_too_long, sizeof(v_too_long), &u32) == -1);
+
+	/*
+	 * Truncated varint and varint not filling whole value
+	 */
+	assert(decode_compact_u32(v_truncated1, sizeof(v_truncated1), &u32) == -1);
+	assert(decode_compact_u32(v_truncated4, sizeof(v_truncated4), &u32) == -1);
+	assert(decode_compact_u32(v_trailing, sizeof(v_trailing), &u32) == -1);
+
+	/*
+	 * Compact header. Truncated varint needs more data until all 5 bytes are available.
+	 */
+	assert(get_len_from_header(h_type_truncated, 0, TLV_ENCODING_COMPACT, &tlv_len) == 0);
+	assert(get_len_from_header(h_type_truncated, 1, TLV_ENCODING_COMPACT, &tlv_len) == 0);
+	assert(get_len_from_header(h_type_truncated, sizeof(h_type_truncated), TLV_ENCODING_COMPACT,
+	    &tlv_len) == 0);
+	assert(get_len_from_header(h_type_overflow, sizeof(h_type_overflow), TLV_ENCODING_COMPACT,
+	    &tlv_len) == -1);
+	assert(get_len_from_header(h_type_cont, sizeof(h_type_cont), TLV_ENCODING_COMPACT,
+	    &tlv_len) == -1);
+	assert(get_len_from_header(h_complete, 1, TLV_ENCODING_COMPACT, &tlv_len) == 0);
+	assert(get_len_from_header(h_len_truncated, sizeof(h_len_truncated), TLV_ENCODING_COMPACT,
+	    &tlv_len) == 0);
+	assert(get_len_from_header(h_len_overflow, sizeof(h_len_overflow), TLV_ENCODING_COMPACT,
+	    &tlv_len) == -1);
+
+	tlv_len = 0;
+	assert(get_len_from_header(h_complete, sizeof(h_complete), TLV_ENCODING_COMPACT,
+	    &tlv_len) == 1);
+	assert(tlv_len == sizeof(h_complete) + 130);
+
+	/*
+	 * Valid varints which don't fit into 16-bit type or length
+	 */
+	assert(get_len_from_header(h_type_too_big, sizeof(h_type_too_big), TLV_ENCODING_COMPACT,
+	    &tlv_len) == -1);
+	assert(get_len_from_header(h_len_too_big, sizeof(h_len_too_big), TLV_ENCODING_COMPACT,
+	    &tlv_len) == -1);
+
+	/*
+	 * Standard header
+	 */
+	assert(get_len_from_header(h_standard, sizeof(h_standard) - 1, TLV_ENCODING_STANDARD,
+	    &tlv_len) == 0);
+	assert(get_len_from_header(h_standard, sizeof(h_standard), TLV_ENCODING_STANDARD,
+	    &tlv_len) == 1);
+	assert(tlv_len == sizeof(h_standard) + 4);
+
+	/*
+	 * Iterator rejects option running past end of message and truncated header
+	 */
+	assert(iter_next_compact(o_past_end, sizeof(o_past_end), 0) == -1);
+	assert(iter_next_compact(o_header_at_end, 0, 0) == 0);
+	assert(iter_next_compact(o_header_at_end, 3, 1) == 0);
+	assert(iter_next_compact(o_header_at_end, sizeof(o_header_at_end), 1) == -1);
+
+	printf("tlv-ut: all tests passed\n");
+
+	return (0);
+}
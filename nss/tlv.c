@@ -6,11 +6,12 @@
 #include <string.h>
 
 #include "tlv.h"
+#include "net-array.h"
 
 #define TLV_TYPE_LENGTH		2
 #define TLV_LENGTH_LENGTH	2
 
-#define TLV_STATIC_SUPPORTED_OPTIONS_SIZE      13
+#define TLV_STATIC_SUPPORTED_OPTIONS_SIZE      23
 
 enum tlv_opt_type tlv_static_supported_options[TLV_STATIC_SUPPORTED_OPTIONS_SIZE] = {
     TLV_OPT_MSG_SEQ_NUMBER,
@@ -26,119 +27,294 @@ enum tlv_opt_type tlv_static_supported_options[TLV_STATIC_SUPPORTED_OPTIONS_SIZE
     TLV_OPT_SUPPORTED_DECISION_ALGORITHMS,
     TLV_OPT_DECISION_ALGORITHM,
     TLV_OPT_HEARTBEAT_INTERVAL,
+    TLV_OPT_NODE_LIST,
+    TLV_OPT_VOTE,
+    TLV_OPT_NODE_LIST_EPOCH,
+    TLV_OPT_NODE_LIST_BASE_EPOCH,
+    TLV_OPT_NODE_LIST_ADDED,
+    TLV_OPT_NODE_LIST_REMOVED,
+    TLV_OPT_CREDIT_WINDOW,
+    TLV_OPT_CREDIT,
+    TLV_OPT_TLV_ENCODING,
+    TLV_OPT_REQUEST_WINDOW,
 };
 
+/*
+ * Unsigned LEB128 varint used by compact encoding. Returns number of bytes stored in buf.
+ */
+size_t
+tlv_varint_encode(uint32_t value, unsigned char *buf)
+{
+	size_t len;
+
+	len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	buf[len++] = value;
+
+	return (len);
+}
+
+/*
+ * Decode varint stored in first buf_len bytes of buf. Returns 0 on success and number of
+ * used bytes in used, or -1 if varint is truncated or doesn't fit into uint32_t.
+ */
 int
-tlv_add(struct dynar *msg, enum tlv_opt_type opt_type, uint16_t opt_len, const void *value)
+tlv_varint_decode(const unsigned char *buf, size_t buf_len, uint32_t *value, size_t *used)
+{
+	uint32_t res;
+	size_t i;
+
+	res = 0;
+
+	for (i = 0; i < buf_len && i < TLV_VARINT_MAX_LENGTH; i++) {
+		if (i == TLV_VARINT_MAX_LENGTH - 1 && (buf[i] & 0xf0) != 0) {
+			return (-1);
+		}
+
+		res |= (uint32_t)(buf[i] & 0x7f) << (7 * i);
+
+		if ((buf[i] & 0x80) == 0) {
+			*value = res;
+			*used = i + 1;
+
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+/*
+ * Add tlv header and reserve opt_len bytes for value. Value is filled by caller directly in
+ * msg (using value pointer).
+ */
+static int
+tlv_add_reserve(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, uint16_t opt_len,
+    char **value)
 {
+	unsigned char header[TLV_VARINT_MAX_LENGTH * 2];
+	size_t header_len;
 	uint16_t nlen;
 	uint16_t nopt_type;
 
-	if (dynar_size(msg) + sizeof(nopt_type) + sizeof(nlen) + opt_len > dynar_max_size(msg)) {
+	if (encoding == TLV_ENCODING_COMPACT) {
+		header_len = tlv_varint_encode((uint16_t)opt_type, header);
+		header_len += tlv_varint_encode(opt_len, header + header_len);
+	} else {
+		nopt_type = htons((uint16_t)opt_type);
+		nlen = htons(opt_len);
+
+		memcpy(header, &nopt_type, sizeof(nopt_type));
+		memcpy(header + TLV_TYPE_LENGTH, &nlen, sizeof(nlen));
+		header_len = TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH;
+	}
+
+	if (dynar_size(msg) + header_len + opt_len > dynar_max_size(msg)) {
 		return (-1);
 	}
 
-	nopt_type = htons((uint16_t)opt_type);
-	nlen = htons(opt_len);
+	if (dynar_cat(msg, header, header_len) == -1 || dynar_grow(msg, opt_len, value) == -1) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+tlv_add(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, uint16_t opt_len,
+    const void *value)
+{
+	char *opt_value;
 
-	dynar_cat(msg, &nopt_type, sizeof(nopt_type));
-	dynar_cat(msg, &nlen, sizeof(nlen));
-	dynar_cat(msg, value, opt_len);
+	if (tlv_add_reserve(msg, encoding, opt_type, opt_len, &opt_value) == -1) {
+		return (-1);
+	}
+
+	memcpy(opt_value, value, opt_len);
 
 	return (0);
 }
 
 int
-tlv_add_u32(struct dynar *msg, enum tlv_opt_type opt_type, uint32_t u32)
+tlv_add_u32(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, uint32_t u32)
 {
+	unsigned char varint[TLV_VARINT_MAX_LENGTH];
 	uint32_t nu32;
 
+	if (encoding == TLV_ENCODING_COMPACT) {
+		return (tlv_add(msg, encoding, opt_type, tlv_varint_encode(u32, varint), varint));
+	}
+
 	nu32 = htonl(u32);
 
-	return (tlv_add(msg, opt_type, sizeof(nu32), &nu32));
+	return (tlv_add(msg, encoding, opt_type, sizeof(nu32), &nu32));
 }
 
+/*
+ * u8 is stored as single byte in both encodings
+ */
 int
-tlv_add_u8(struct dynar *msg, enum tlv_opt_type opt_type, uint8_t u8)
+tlv_add_u8(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, uint8_t u8)
 {
 
-	return (tlv_add(msg, opt_type, sizeof(u8), &u8));
+	return (tlv_add(msg, encoding, opt_type, sizeof(u8), &u8));
 }
 
 int
-tlv_add_u16(struct dynar *msg, enum tlv_opt_type opt_type, uint16_t u16)
+tlv_add_u16(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, uint16_t u16)
 {
+	unsigned char varint[TLV_VARINT_MAX_LENGTH];
 	uint16_t nu16;
 
+	if (encoding == TLV_ENCODING_COMPACT) {
+		return (tlv_add(msg, encoding, opt_type, tlv_varint_encode(u16, varint), varint));
+	}
+
 	nu16 = htons(u16);
 
-	return (tlv_add(msg, opt_type, sizeof(nu16), &nu16));
+	return (tlv_add(msg, encoding, opt_type, sizeof(nu16), &nu16));
 }
 
 int
-tlv_add_string(struct dynar *msg, enum tlv_opt_type opt_type, const char *str)
+tlv_add_string(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type, const char *str)
 {
 
-	return (tlv_add(msg, opt_type, strlen(str), str));
+	return (tlv_add(msg, encoding, opt_type, strlen(str), str));
 }
 
 int
-tlv_add_msg_seq_number(struct dynar *msg, uint32_t msg_seq_number)
+tlv_add_msg_seq_number(struct dynar *msg, enum tlv_encoding encoding, uint32_t msg_seq_number)
 {
 
-	return (tlv_add_u32(msg, TLV_OPT_MSG_SEQ_NUMBER, msg_seq_number));
+	return (tlv_add_u32(msg, encoding, TLV_OPT_MSG_SEQ_NUMBER, msg_seq_number));
 }
 
 int
-tlv_add_cluster_name(struct dynar *msg, const char *cluster_name)
+tlv_add_cluster_name(struct dynar *msg, enum tlv_encoding encoding, const char *cluster_name)
 {
 
-	return (tlv_add_string(msg, TLV_OPT_CLUSTER_NAME, cluster_name));
+	return (tlv_add_string(msg, encoding, TLV_OPT_CLUSTER_NAME, cluster_name));
 }
 
 int
-tlv_add_tls_supported(struct dynar *msg, enum tlv_tls_supported tls_supported)
+tlv_add_tls_supported(struct dynar *msg, enum tlv_encoding encoding, enum tlv_tls_supported tls_supported)
 {
 
-	return (tlv_add_u8(msg, TLV_OPT_TLS_SUPPORTED, tls_supported));
+	return (tlv_add_u8(msg, encoding, TLV_OPT_TLS_SUPPORTED, tls_supported));
 }
 
 int
-tlv_add_tls_client_cert_required(struct dynar *msg, int tls_client_cert_required)
+tlv_add_tls_client_cert_required(struct dynar *msg, enum tlv_encoding encoding, int tls_client_cert_required)
 {
 
-	return (tlv_add_u8(msg, TLV_OPT_TLS_CLIENT_CERT_REQUIRED, tls_client_cert_required));
+	return (tlv_add_u8(msg, encoding, TLV_OPT_TLS_CLIENT_CERT_REQUIRED, tls_client_cert_required));
 }
 
-int
-tlv_add_u16_array(struct dynar *msg, enum tlv_opt_type opt_type, const uint16_t *array, size_t array_size)
+/*
+ * Compact encoding stores array as sequence of varints
+ */
+static int
+tlv_add_varint_array(struct dynar *msg, enum tlv_opt_type opt_type, const uint32_t *array,
+    size_t array_size)
 {
+	unsigned char *buf;
+	size_t buf_len;
 	size_t i;
-	uint16_t *nu16a;
-	uint16_t opt_len;
 	int res;
 
-	nu16a = malloc(sizeof(uint16_t) * array_size);
-	if (nu16a == NULL) {
+	buf = malloc(TLV_VARINT_MAX_LENGTH * array_size);
+	if (buf == NULL) {
 		return (-1);
 	}
 
+	buf_len = 0;
 	for (i = 0; i < array_size; i++) {
-		nu16a[i] = htons(array[i]);
+		buf_len += tlv_varint_encode(array[i], buf + buf_len);
 	}
 
-	opt_len = sizeof(uint16_t) * array_size;
+	if (buf_len > UINT16_MAX) {
+		free(buf);
 
-	res = tlv_add(msg, opt_type, opt_len, nu16a);
+		return (-1);
+	}
+
+	res = tlv_add(msg, TLV_ENCODING_COMPACT, opt_type, buf_len, buf);
 
-	free(nu16a);
+	free(buf);
 
 	return (res);
 }
 
 int
-tlv_add_supported_options(struct dynar *msg, const enum tlv_opt_type *supported_options,
-    size_t no_supported_options)
+tlv_add_u16_array(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type,
+    const uint16_t *array, size_t array_size)
+{
+	size_t i;
+	uint32_t *u32a;
+	char *opt_value;
+	int res;
+
+	if (encoding == TLV_ENCODING_COMPACT) {
+		u32a = malloc(sizeof(uint32_t) * array_size);
+		if (u32a == NULL) {
+			return (-1);
+		}
+
+		for (i = 0; i < array_size; i++) {
+			u32a[i] = array[i];
+		}
+
+		res = tlv_add_varint_array(msg, opt_type, u32a, array_size);
+
+		free(u32a);
+
+		return (res);
+	}
+
+	if (sizeof(uint16_t) * array_size > UINT16_MAX) {
+		return (-1);
+	}
+
+	if (tlv_add_reserve(msg, encoding, opt_type, sizeof(uint16_t) * array_size, &opt_value) == -1) {
+		return (-1);
+	}
+
+	net_array_u16_to_net(opt_value, array, array_size);
+
+	return (0);
+}
+
+int
+tlv_add_u32_array(struct dynar *msg, enum tlv_encoding encoding, enum tlv_opt_type opt_type,
+    const uint32_t *array, size_t array_size)
+{
+	char *opt_value;
+
+	if (encoding == TLV_ENCODING_COMPACT) {
+		return (tlv_add_varint_array(msg, opt_type, array, array_size));
+	}
+
+	if (sizeof(uint32_t) * array_size > UINT16_MAX) {
+		return (-1);
+	}
+
+	if (tlv_add_reserve(msg, encoding, opt_type, sizeof(uint32_t) * array_size, &opt_value) == -1) {
+		return (-1);
+	}
+
+	net_array_u32_to_net(opt_value, array, array_size);
+
+	return (0);
+}
+
+int
+tlv_add_supported_options(struct dynar *msg, enum tlv_encoding encoding,
+    const enum tlv_opt_type *supported_options, size_t no_supported_options)
 {
 	uint16_t *u16a;
 	size_t i;
@@ -153,7 +329,7 @@ tlv_add_supported_options(struct dynar *msg, const enum tlv_opt_type *supported_
 		u16a[i] = (uint16_t)supported_options[i];
 	}
 
-	res = (tlv_add_u16_array(msg, TLV_OPT_SUPPORTED_OPTIONS, u16a, no_supported_options));
+	res = (tlv_add_u16_array(msg, encoding, TLV_OPT_SUPPORTED_OPTIONS, u16a, no_supported_options));
 
 	free(u16a);
 
@@ -161,8 +337,8 @@ tlv_add_supported_options(struct dynar *msg, const enum tlv_opt_type *supported_
 }
 
 int
-tlv_add_supported_decision_algorithms(struct dynar *msg, const enum tlv_decision_algorithm_type *supported_algorithms,
-    size_t no_supported_algorithms)
+tlv_add_supported_decision_algorithms(struct dynar *msg, enum tlv_encoding encoding,
+    const enum tlv_decision_algorithm_type *supported_algorithms, size_t no_supported_algorithms)
 {
 	uint16_t *u16a;
 	size_t i;
@@ -177,7 +353,8 @@ tlv_add_supported_decision_algorithms(struct dynar *msg, const enum tlv_decision
 		u16a[i] = (uint16_t)supported_algorithms[i];
 	}
 
-	res = (tlv_add_u16_array(msg, TLV_OPT_SUPPORTED_DECISION_ALGORITHMS, u16a, no_supported_algorithms));
+	res = (tlv_add_u16_array(msg, encoding, TLV_OPT_SUPPORTED_DECISION_ALGORITHMS, u16a,
+	    no_supported_algorithms));
 
 	free(u16a);
 
@@ -185,119 +362,404 @@ tlv_add_supported_decision_algorithms(struct dynar *msg, const enum tlv_decision
 }
 
 int
-tlv_add_reply_error_code(struct dynar *msg, enum tlv_reply_error_code error_code)
+tlv_add_reply_error_code(struct dynar *msg, enum tlv_encoding encoding, enum tlv_reply_error_code error_code)
+{
+
+	return (tlv_add_u16(msg, encoding, TLV_OPT_REPLY_ERROR_CODE, (uint16_t)error_code));
+}
+
+int
+tlv_add_server_maximum_request_size(struct dynar *msg, enum tlv_encoding encoding,
+    size_t server_maximum_request_size)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_SERVER_MAXIMUM_REQUEST_SIZE, server_maximum_request_size));
+}
+
+int
+tlv_add_server_maximum_reply_size(struct dynar *msg, enum tlv_encoding encoding,
+    size_t server_maximum_reply_size)
 {
 
-	return (tlv_add_u16(msg, TLV_OPT_REPLY_ERROR_CODE, (uint16_t)error_code));
+	return (tlv_add_u32(msg, encoding, TLV_OPT_SERVER_MAXIMUM_REPLY_SIZE, server_maximum_reply_size));
 }
 
 int
-tlv_add_server_maximum_request_size(struct dynar *msg, size_t server_maximum_request_size)
+tlv_add_node_id(struct dynar *msg, enum tlv_encoding encoding, uint32_t node_id)
 {
 
-	return (tlv_add_u32(msg, TLV_OPT_SERVER_MAXIMUM_REQUEST_SIZE, server_maximum_request_size));
+	return (tlv_add_u32(msg, encoding, TLV_OPT_NODE_ID, node_id));
 }
 
 int
-tlv_add_server_maximum_reply_size(struct dynar *msg, size_t server_maximum_reply_size)
+tlv_add_decision_algorithm(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_decision_algorithm_type decision_algorithm)
 {
 
-	return (tlv_add_u32(msg, TLV_OPT_SERVER_MAXIMUM_REPLY_SIZE, server_maximum_reply_size));
+	return (tlv_add_u16(msg, encoding, TLV_OPT_DECISION_ALGORITHM, (uint16_t)decision_algorithm));
 }
 
 int
-tlv_add_node_id(struct dynar *msg, uint32_t node_id)
+tlv_add_heartbeat_interval(struct dynar *msg, enum tlv_encoding encoding, uint32_t heartbeat_interval)
 {
 
-	return (tlv_add_u32(msg, TLV_OPT_NODE_ID, node_id));
+	return (tlv_add_u32(msg, encoding, TLV_OPT_HEARTBEAT_INTERVAL, heartbeat_interval));
 }
 
 int
-tlv_add_decision_algorithm(struct dynar *msg, enum tlv_decision_algorithm_type decision_algorithm)
+tlv_add_node_list(struct dynar *msg, enum tlv_encoding encoding, const uint32_t *node_list, size_t no_nodes)
 {
 
-	return (tlv_add_u16(msg, TLV_OPT_DECISION_ALGORITHM, (uint16_t)decision_algorithm));
+	return (tlv_add_u32_array(msg, encoding, TLV_OPT_NODE_LIST, node_list, no_nodes));
 }
 
 int
-tlv_add_heartbeat_interval(struct dynar *msg, uint32_t heartbeat_interval)
+tlv_add_vote(struct dynar *msg, enum tlv_encoding encoding, enum tlv_vote vote)
 {
 
-	return (tlv_add_u32(msg, TLV_OPT_HEARTBEAT_INTERVAL, heartbeat_interval));
+	return (tlv_add_u8(msg, encoding, TLV_OPT_VOTE, (uint8_t)vote));
 }
 
+int
+tlv_add_node_list_epoch(struct dynar *msg, enum tlv_encoding encoding, uint32_t epoch)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_NODE_LIST_EPOCH, epoch));
+}
+
+int
+tlv_add_node_list_base_epoch(struct dynar *msg, enum tlv_encoding encoding, uint32_t base_epoch)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_NODE_LIST_BASE_EPOCH, base_epoch));
+}
+
+int
+tlv_add_node_list_added(struct dynar *msg, enum tlv_encoding encoding, const uint32_t *node_list,
+    size_t no_nodes)
+{
+
+	return (tlv_add_u32_array(msg, encoding, TLV_OPT_NODE_LIST_ADDED, node_list, no_nodes));
+}
+
+int
+tlv_add_node_list_removed(struct dynar *msg, enum tlv_encoding encoding, const uint32_t *node_list,
+    size_t no_nodes)
+{
+
+	return (tlv_add_u32_array(msg, encoding, TLV_OPT_NODE_LIST_REMOVED, node_list, no_nodes));
+}
+
+int
+tlv_add_credit_window(struct dynar *msg, enum tlv_encoding encoding, uint32_t credit_window)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_CREDIT_WINDOW, credit_window));
+}
+
+int
+tlv_add_credit(struct dynar *msg, enum tlv_encoding encoding, uint32_t credit)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_CREDIT, credit));
+}
+
+int
+tlv_add_tlv_encoding(struct dynar *msg, enum tlv_encoding encoding, enum tlv_encoding tlv_encoding)
+{
+
+	return (tlv_add_u8(msg, encoding, TLV_OPT_TLV_ENCODING, (uint8_t)tlv_encoding));
+}
+
+int
+tlv_add_request_window(struct dynar *msg, enum tlv_encoding encoding, uint32_t request_window)
+{
+
+	return (tlv_add_u32(msg, encoding, TLV_OPT_REQUEST_WINDOW, request_window));
+}
+
+void
+tlv_iter_init(const struct dynar *msg, size_t msg_header_len, enum tlv_encoding encoding,
+    struct tlv_iterator *tlv_iter)
+{
+
+	tlv_iter_init_data(dynar_data(msg), dynar_size(msg), msg_header_len, encoding, tlv_iter);
+}
+
+/*
+ * Iterate tlvs stored in plain buffer (part of message which is not stored in dynar)
+ */
 void
-tlv_iter_init(const struct dynar *msg, size_t msg_header_len, struct tlv_iterator *tlv_iter)
+tlv_iter_init_data(const char *data, size_t data_len, size_t msg_header_len, enum tlv_encoding encoding,
+    struct tlv_iterator *tlv_iter)
 {
 
-	tlv_iter->msg = msg;
+	tlv_iter->data = data;
+	tlv_iter->data_len = data_len;
 	tlv_iter->current_pos = 0;
 	tlv_iter->msg_header_len = msg_header_len;
+	tlv_iter->encoding = encoding;
+	tlv_iter->current_type = 0;
+	tlv_iter->current_len = 0;
+	tlv_iter->current_data_pos = msg_header_len;
+	tlv_iter->arena = NULL;
+}
+
+/*
+ * Allocate decoded values (strings and arrays) from arena. They must not be freed by caller
+ * then. NULL means heap (malloc).
+ */
+void
+tlv_iter_set_arena(struct tlv_iterator *tlv_iter, struct arena *arena)
+{
+
+	tlv_iter->arena = arena;
 }
 
 enum tlv_opt_type
 tlv_iter_get_type(const struct tlv_iterator *tlv_iter)
 {
-	uint16_t ntype;
-	uint16_t type;
-
-	memcpy(&ntype, dynar_data(tlv_iter->msg) + tlv_iter->current_pos, sizeof(ntype));
-	type = ntohs(ntype);
 
-	return (type);
+	return (tlv_iter->current_type);
 }
 
 uint16_t
 tlv_iter_get_len(const struct tlv_iterator *tlv_iter)
 {
-	uint16_t nlen;
-	uint16_t len;
-
-	memcpy(&nlen, dynar_data(tlv_iter->msg) + tlv_iter->current_pos + TLV_TYPE_LENGTH, sizeof(nlen));
-	len = ntohs(nlen);
 
-	return (len);
+	return (tlv_iter->current_len);
 }
 
 const char *
 tlv_iter_get_data(const struct tlv_iterator *tlv_iter)
 {
 
-	return (dynar_data(tlv_iter->msg) + tlv_iter->current_pos + TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH);
+	return (tlv_iter->data + tlv_iter->current_data_pos);
 }
 
-int
-tlv_iter_next(struct tlv_iterator *tlv_iter)
+/*
+ * Parse tlv header stored in first data_len bytes of data.
+ *  1 - Header is complete, type, len and header_len are set
+ *  0 - Header is not complete, more data is needed
+ * -1 - Header is invalid
+ */
+static int
+tlv_parse_header(const unsigned char *data, size_t data_len, enum tlv_encoding encoding,
+    uint32_t *type, uint32_t *len, size_t *header_len)
 {
-	uint16_t len;
+	size_t used;
+	uint16_t nu16;
+
+	if (encoding == TLV_ENCODING_COMPACT) {
+		/*
+		 * Varint can be invalid only when all TLV_VARINT_MAX_LENGTH bytes are available
+		 */
+		if (tlv_varint_decode(data, data_len, type, &used) != 0) {
+			return (data_len < TLV_VARINT_MAX_LENGTH ? 0 : -1);
+		}
+		*header_len = used;
+
+		if (tlv_varint_decode(data + *header_len, data_len - *header_len, len, &used) != 0) {
+			return (data_len - *header_len < TLV_VARINT_MAX_LENGTH ? 0 : -1);
+		}
+		*header_len += used;
+
+		if (*type > UINT16_MAX || *len > UINT16_MAX) {
+			return (-1);
+		}
+	} else {
+		if (data_len < TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH) {
+			return (0);
+		}
+
+		memcpy(&nu16, data, sizeof(nu16));
+		*type = ntohs(nu16);
+		memcpy(&nu16, data + TLV_TYPE_LENGTH, sizeof(nu16));
+		*len = ntohs(nu16);
+		*header_len = TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH;
+	}
+
+	return (1);
+}
 
-	if (tlv_iter->current_pos == 0) {
-		tlv_iter->current_pos = tlv_iter->msg_header_len;
+/*
+ * Get length of whole tlv (header and value) from first data_len bytes of tlv. Used by
+ * incremental decoders which receive tlv in parts.
+ *  1 - tlv_len is set
+ *  0 - Header is not complete, more data is needed
+ * -1 - Header is invalid
+ */
+int
+tlv_get_len_from_header(const char *data, size_t data_len, enum tlv_encoding encoding, size_t *tlv_len)
+{
+	uint32_t type;
+	uint32_t len;
+	size_t header_len;
+	int res;
 
-		goto check_tlv_validity;
+	res = tlv_parse_header((const unsigned char *)data, data_len, encoding, &type, &len, &header_len);
+	if (res == 1) {
+		*tlv_len = header_len + len;
 	}
 
-	len = tlv_iter_get_len(tlv_iter);
+	return (res);
+}
+
+/*
+ * Maximum length of tlv (header and value) in any encoding
+ */
+size_t
+tlv_get_max_len(void)
+{
+
+	return (TLV_VARINT_MAX_LENGTH * 2 + UINT16_MAX);
+}
+
+/*
+ * Parse header of next tlv. Type and length are cached in iterator, so getters don't have
+ * to decode them again.
+ *  1 - Next tlv is valid
+ *  0 - No more tlvs
+ * -1 - tlv is invalid (larger than whole message or malformed header)
+ */
+int
+tlv_iter_next(struct tlv_iterator *tlv_iter)
+{
+	const unsigned char *data;
+	size_t msg_size;
+	size_t pos;
+	size_t header_len;
+	uint32_t type;
+	uint32_t len;
+
+	data = (const unsigned char *)tlv_iter->data;
+	msg_size = tlv_iter->data_len;
 
-	if (tlv_iter->current_pos + TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH + len >= dynar_size(tlv_iter->msg)) {
+	/*
+	 * current_data_pos is initialized to msg_header_len, so this works also for first tlv
+	 * (and for iterator without header)
+	 */
+	pos = tlv_iter->current_data_pos + tlv_iter->current_len;
+
+	if (pos >= msg_size) {
 		return (0);
 	}
 
-	tlv_iter->current_pos += TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH + len;
+	tlv_iter->current_pos = pos;
+
+	if (tlv_parse_header(data + pos, msg_size - pos, tlv_iter->encoding, &type, &len,
+	    &header_len) != 1) {
+		return (-1);
+	}
+	pos += header_len;
 
-check_tlv_validity:
 	/*
 	 * Check if tlv is valid = is not larger than whole message
 	 */
-	len = tlv_iter_get_len(tlv_iter);
-
-	if (tlv_iter->current_pos + TLV_TYPE_LENGTH + TLV_LENGTH_LENGTH + len > dynar_size(tlv_iter->msg)) {
+	if (pos + len > msg_size) {
 		return (-1);
 	}
 
+	tlv_iter->current_type = (enum tlv_opt_type)type;
+	tlv_iter->current_len = len;
+	tlv_iter->current_data_pos = pos;
+
 	return (1);
 }
 
+/*
+ * Decode varint which must fill whole value of current tlv
+ */
+static int
+tlv_iter_decode_varint(struct tlv_iterator *tlv_iter, uint32_t max_value, uint32_t *res)
+{
+	uint32_t value;
+	size_t used;
+
+	if (tlv_varint_decode((const unsigned char *)tlv_iter_get_data(tlv_iter), tlv_iter_get_len(tlv_iter),
+	    &value, &used) != 0 || used != tlv_iter_get_len(tlv_iter) || value > max_value) {
+		return (-1);
+	}
+
+	*res = value;
+
+	return (0);
+}
+
+/*
+ * Memory for decoded values is taken from arena of iterator (if set) or from heap
+ */
+static void *
+tlv_iter_alloc(const struct tlv_iterator *tlv_iter, size_t size)
+{
+
+	if (tlv_iter->arena != NULL) {
+		return (arena_alloc(tlv_iter->arena, size));
+	}
+
+	return (malloc(size));
+}
+
+static void
+tlv_iter_free(const struct tlv_iterator *tlv_iter, void *ptr)
+{
+
+	if (tlv_iter->arena == NULL) {
+		free(ptr);
+	}
+}
+
+/*
+ * Decode compact array (sequence of varints). Every varint ends with byte with cleared
+ * high bit, so number of items is known before allocation.
+ */
+static int
+tlv_iter_decode_varint_array(struct tlv_iterator *tlv_iter, uint32_t max_value, uint32_t **u32a,
+    size_t *no_items)
+{
+	const unsigned char *opt_data;
+	uint16_t opt_len;
+	uint32_t *u32a_res;
+	size_t pos;
+	size_t used;
+	size_t i;
+
+	opt_len = tlv_iter_get_len(tlv_iter);
+	opt_data = (const unsigned char *)tlv_iter_get_data(tlv_iter);
+
+	if (opt_len > 0 && (opt_data[opt_len - 1] & 0x80) != 0) {
+		return (-1);
+	}
+
+	*no_items = 0;
+	for (pos = 0; pos < opt_len; pos++) {
+		if ((opt_data[pos] & 0x80) == 0) {
+			(*no_items)++;
+		}
+	}
+
+	u32a_res = tlv_iter_alloc(tlv_iter, sizeof(uint32_t) * *no_items);
+	if (u32a_res == NULL) {
+		return (-2);
+	}
+
+	pos = 0;
+	for (i = 0; i < *no_items; i++) {
+		if (tlv_varint_decode(opt_data + pos, opt_len - pos, &u32a_res[i], &used) != 0 ||
+		    u32a_res[i] > max_value) {
+			tlv_iter_free(tlv_iter, u32a_res);
+
+			return (-1);
+		}
+
+		pos += used;
+	}
+
+	*u32a = u32a_res;
+
+	return (0);
+}
+
 int
 tlv_iter_decode_u32(struct tlv_iterator *tlv_iter, uint32_t *res)
 {
@@ -305,6 +767,10 @@ tlv_iter_decode_u32(struct tlv_iterator *tlv_iter, uint32_t *res)
 	uint16_t opt_len;
 	uint32_t nu32;
 
+	if (tlv_iter->encoding == TLV_ENCODING_COMPACT) {
+		return (tlv_iter_decode_varint(tlv_iter, UINT32_MAX, res));
+	}
+
 	opt_len = tlv_iter_get_len(tlv_iter);
 	opt_data = tlv_iter_get_data(tlv_iter);
 
@@ -353,7 +819,7 @@ tlv_iter_decode_str(struct tlv_iterator *tlv_iter, char **str, size_t *str_len)
 	opt_len = tlv_iter_get_len(tlv_iter);
 	opt_data = tlv_iter_get_data(tlv_iter);
 
-	tmp_str = malloc(opt_len + 1);
+	tmp_str = tlv_iter_alloc(tlv_iter, opt_len + 1);
 	if (tmp_str == NULL) {
 		return (-1);
 	}
@@ -372,7 +838,31 @@ tlv_iter_decode_u16_array(struct tlv_iterator *tlv_iter, uint16_t **u16a, size_t
 {
 	uint16_t opt_len;
 	uint16_t *u16a_res;
+	uint32_t *u32a;
 	size_t i;
+	int res;
+
+	if (tlv_iter->encoding == TLV_ENCODING_COMPACT) {
+		if ((res = tlv_iter_decode_varint_array(tlv_iter, UINT16_MAX, &u32a, no_items)) != 0) {
+			return (res);
+		}
+
+		u16a_res = tlv_iter_alloc(tlv_iter, sizeof(uint16_t) * *no_items);
+		if (u16a_res == NULL) {
+			tlv_iter_free(tlv_iter, u32a);
+			return (-2);
+		}
+
+		for (i = 0; i < *no_items; i++) {
+			u16a_res[i] = u32a[i];
+		}
+
+		tlv_iter_free(tlv_iter, u32a);
+
+		*u16a = u16a_res;
+
+		return (0);
+	}
 
 	opt_len = tlv_iter_get_len(tlv_iter);
 
@@ -382,18 +872,44 @@ tlv_iter_decode_u16_array(struct tlv_iterator *tlv_iter, uint16_t **u16a, size_t
 
 	*no_items = opt_len / sizeof(uint16_t);
 
-	u16a_res = malloc(sizeof(uint16_t) * *no_items);
+	u16a_res = tlv_iter_alloc(tlv_iter, sizeof(uint16_t) * *no_items);
 	if (u16a_res == NULL) {
 		return (-2);
 	}
 
-	memcpy(u16a_res, tlv_iter_get_data(tlv_iter), opt_len);
+	net_array_u16_from_net(u16a_res, tlv_iter_get_data(tlv_iter), *no_items);
 
-	for (i = 0; i < *no_items; i++) {
-		u16a_res[i] = ntohs(u16a_res[i]);
+	*u16a = u16a_res;
+
+	return (0);
+}
+
+int
+tlv_iter_decode_u32_array(struct tlv_iterator *tlv_iter, uint32_t **u32a, size_t *no_items)
+{
+	uint16_t opt_len;
+	uint32_t *u32a_res;
+
+	if (tlv_iter->encoding == TLV_ENCODING_COMPACT) {
+		return (tlv_iter_decode_varint_array(tlv_iter, UINT32_MAX, u32a, no_items));
 	}
 
-	*u16a = u16a_res;
+	opt_len = tlv_iter_get_len(tlv_iter);
+
+	if (opt_len % sizeof(uint32_t) != 0) {
+		return (-1);
+	}
+
+	*no_items = opt_len / sizeof(uint32_t);
+
+	u32a_res = tlv_iter_alloc(tlv_iter, sizeof(uint32_t) * *no_items);
+	if (u32a_res == NULL) {
+		return (-2);
+	}
+
+	net_array_u32_from_net(u32a_res, tlv_iter_get_data(tlv_iter), *no_items);
+
+	*u32a = u32a_res;
 
 	return (0);
 }
@@ -412,9 +928,9 @@ tlv_iter_decode_supported_options(struct tlv_iterator *tlv_iter, enum tlv_opt_ty
 		return (res);
 	}
 
-	tlv_opt_array = malloc(sizeof(enum tlv_opt_type) * *no_supported_options);
+	tlv_opt_array = tlv_iter_alloc(tlv_iter, sizeof(enum tlv_opt_type) * *no_supported_options);
 	if (tlv_opt_array == NULL) {
-		free(u16a);
+		tlv_iter_free(tlv_iter, u16a);
 		return (-2);
 	}
 
@@ -422,7 +938,7 @@ tlv_iter_decode_supported_options(struct tlv_iterator *tlv_iter, enum tlv_opt_ty
 		tlv_opt_array[i] = (enum tlv_opt_type)u16a[i];
 	}
 
-	free(u16a);
+	tlv_iter_free(tlv_iter, u16a);
 
 	*supported_options = tlv_opt_array;
 
@@ -443,11 +959,11 @@ tlv_iter_decode_supported_decision_algorithms(struct tlv_iterator *tlv_iter,
 		return (res);
 	}
 
-	tlv_decision_algorithm_type_array = malloc(
+	tlv_decision_algorithm_type_array = tlv_iter_alloc(tlv_iter,
 	    sizeof(enum tlv_decision_algorithm_type) * *no_supported_decision_algorithms);
 
 	if (tlv_decision_algorithm_type_array == NULL) {
-		free(u16a);
+		tlv_iter_free(tlv_iter, u16a);
 		return (-2);
 	}
 
@@ -455,7 +971,7 @@ tlv_iter_decode_supported_decision_algorithms(struct tlv_iterator *tlv_iter,
 		tlv_decision_algorithm_type_array[i] = (enum tlv_decision_algorithm_type)u16a[i];
 	}
 
-	free(u16a);
+	tlv_iter_free(tlv_iter, u16a);
 
 	*supported_decision_algorithms = tlv_decision_algorithm_type_array;
 
@@ -468,6 +984,17 @@ tlv_iter_decode_u16(struct tlv_iterator *tlv_iter, uint16_t *u16)
 	const char *opt_data;
 	uint16_t opt_len;
 	uint16_t nu16;
+	uint32_t u32;
+
+	if (tlv_iter->encoding == TLV_ENCODING_COMPACT) {
+		if (tlv_iter_decode_varint(tlv_iter, UINT16_MAX, &u32) != 0) {
+			return (-1);
+		}
+
+		*u16 = u32;
+
+		return (0);
+	}
 
 	opt_len = tlv_iter_get_len(tlv_iter);
 	opt_data = tlv_iter_get_data(tlv_iter);
@@ -523,6 +1050,46 @@ tlv_iter_decode_decision_algorithm(struct tlv_iterator *tlv_iter, enum tlv_decis
 	return (0);
 }
 
+int
+tlv_iter_decode_vote(struct tlv_iterator *tlv_iter, enum tlv_vote *vote)
+{
+	uint8_t u8;
+
+	if (tlv_iter_decode_u8(tlv_iter, &u8) != 0) {
+		return (-1);
+	}
+
+	*vote = u8;
+
+	if (*vote != TLV_VOTE_UNDEFINED &&
+	    *vote != TLV_VOTE_ACK &&
+	    *vote != TLV_VOTE_NACK &&
+	    *vote != TLV_VOTE_ASK_LATER) {
+		return (-4);
+	}
+
+	return (0);
+}
+
+int
+tlv_iter_decode_tlv_encoding(struct tlv_iterator *tlv_iter, enum tlv_encoding *tlv_encoding)
+{
+	uint8_t u8;
+
+	if (tlv_iter_decode_u8(tlv_iter, &u8) != 0) {
+		return (-1);
+	}
+
+	*tlv_encoding = u8;
+
+	if (*tlv_encoding != TLV_ENCODING_STANDARD &&
+	    *tlv_encoding != TLV_ENCODING_COMPACT) {
+		return (-4);
+	}
+
+	return (0);
+}
+
 void
 tlv_get_supported_options(enum tlv_opt_type **supported_options, size_t *no_supported_options)
 {
@@ -5,11 +5,17 @@
 #include <inttypes.h>
 
 #include "dynar.h"
+#include "arena.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * Maximum length of varint encoded uint32_t
+ */
+#define TLV_VARINT_MAX_LENGTH	5
+
 enum tlv_opt_type {
 	TLV_OPT_MSG_SEQ_NUMBER = 0,
 	TLV_OPT_CLUSTER_NAME = 1,
@@ -24,6 +30,16 @@ enum tlv_opt_type {
 	TLV_OPT_SUPPORTED_DECISION_ALGORITHMS = 10,
 	TLV_OPT_DECISION_ALGORITHM = 11,
 	TLV_OPT_HEARTBEAT_INTERVAL = 12,
+	TLV_OPT_NODE_LIST = 13,
+	TLV_OPT_VOTE = 14,
+	TLV_OPT_NODE_LIST_EPOCH = 15,
+	TLV_OPT_NODE_LIST_BASE_EPOCH = 16,
+	TLV_OPT_NODE_LIST_ADDED = 17,
+	TLV_OPT_NODE_LIST_REMOVED = 18,
+	TLV_OPT_CREDIT_WINDOW = 19,
+	TLV_OPT_CREDIT = 20,
+	TLV_OPT_TLV_ENCODING = 21,
+	TLV_OPT_REQUEST_WINDOW = 22,
 };
 
 enum tlv_tls_supported {
@@ -47,63 +63,148 @@ enum tlv_reply_error_code {
 	TLV_REPLY_ERROR_CODE_INIT_REQUIRED = 11,
 	TLV_REPLY_ERROR_CODE_UNSUPPORTED_DECISION_ALGORITHM = 12,
 	TLV_REPLY_ERROR_CODE_INVALID_HEARTBEAT_INTERVAL = 13,
+	TLV_REPLY_ERROR_CODE_DECISION_ALGORITHM_DIFFERS = 14,
 };
 
 enum tlv_decision_algorithm_type {
 	TLV_DECISION_ALGORITHM_TYPE_TEST = 0,
+	TLV_DECISION_ALGORITHM_TYPE_FFSPLIT = 1,
+	TLV_DECISION_ALGORITHM_TYPE_LMS = 2,
+};
+
+enum tlv_vote {
+	TLV_VOTE_UNDEFINED = 0,
+	TLV_VOTE_ACK = 1,
+	TLV_VOTE_NACK = 2,
+	TLV_VOTE_ASK_LATER = 3,
+};
+
+/*
+ * Standard encoding uses 2 bytes for type and length and fixed size integers in network
+ * order. Compact encoding (negotiated in init) uses varints for type, length and u16/u32
+ * values (u8 stays single byte, strings are unchanged).
+ */
+enum tlv_encoding {
+	TLV_ENCODING_STANDARD = 0,
+	TLV_ENCODING_COMPACT = 1,
 };
 
 struct tlv_iterator {
-	const struct dynar *msg;
+	const char *data;
+	size_t data_len;
 	size_t current_pos;
 	size_t msg_header_len;
+	enum tlv_encoding encoding;
+	enum tlv_opt_type current_type;	// Valid after tlv_iter_next returned 1
+	uint16_t current_len;		// Valid after tlv_iter_next returned 1
+	size_t current_data_pos;	// Valid after tlv_iter_next returned 1
+	struct arena *arena;		// Decoded values are allocated from arena if set
 };
 
-extern int			 tlv_add(struct dynar *msg, enum tlv_opt_type opt_type, uint16_t opt_len,
-    const void *value);
+extern size_t			 tlv_varint_encode(uint32_t value, unsigned char *buf);
+
+extern int			 tlv_varint_decode(const unsigned char *buf, size_t buf_len,
+    uint32_t *value, size_t *used);
+
+extern int			 tlv_add(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, uint16_t opt_len, const void *value);
 
-extern int			 tlv_add_u32(struct dynar *msg, enum tlv_opt_type opt_type, uint32_t u32);
+extern int			 tlv_add_u32(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, uint32_t u32);
 
-extern int			 tlv_add_u8(struct dynar *msg, enum tlv_opt_type opt_type, uint8_t u8);
+extern int			 tlv_add_u8(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, uint8_t u8);
 
-extern int			 tlv_add_u16(struct dynar *msg, enum tlv_opt_type opt_type, uint16_t u16);
+extern int			 tlv_add_u16(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, uint16_t u16);
 
-extern int			 tlv_add_string(struct dynar *msg, enum tlv_opt_type opt_type, const char *str);
+extern int			 tlv_add_string(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, const char *str);
 
-extern int			 tlv_add_u16_array(struct dynar *msg, enum tlv_opt_type opt_type,
-    const uint16_t *array, size_t array_size);
+extern int			 tlv_add_u16_array(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, const uint16_t *array, size_t array_size);
 
-extern int			 tlv_add_supported_options(struct dynar *msg,
+extern int			 tlv_add_u32_array(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_opt_type opt_type, const uint32_t *array, size_t array_size);
+
+extern int			 tlv_add_supported_options(struct dynar *msg, enum tlv_encoding encoding,
     const enum tlv_opt_type *supported_options, size_t no_supported_options);
 
-extern int			 tlv_add_msg_seq_number(struct dynar *msg, uint32_t msg_seq_number);
+extern int			 tlv_add_msg_seq_number(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t msg_seq_number);
 
-extern int			 tlv_add_cluster_name(struct dynar *msg, const char *cluster_name);
+extern int			 tlv_add_cluster_name(struct dynar *msg, enum tlv_encoding encoding,
+    const char *cluster_name);
 
-extern int			 tlv_add_tls_supported(struct dynar *msg, enum tlv_tls_supported tls_supported);
+extern int			 tlv_add_tls_supported(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_tls_supported tls_supported);
 
-extern int			 tlv_add_tls_client_cert_required(struct dynar *msg, int tls_client_cert_required);
+extern int			 tlv_add_tls_client_cert_required(struct dynar *msg, enum tlv_encoding encoding,
+    int tls_client_cert_required);
 
-extern int			 tlv_add_reply_error_code(struct dynar *msg, enum tlv_reply_error_code error_code);
+extern int			 tlv_add_reply_error_code(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_reply_error_code error_code);
 
-extern int			 tlv_add_node_id(struct dynar *msg, uint32_t node_id);
+extern int			 tlv_add_node_id(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t node_id);
 
-extern int			 tlv_add_server_maximum_request_size(struct dynar *msg,
+extern int			 tlv_add_server_maximum_request_size(struct dynar *msg, enum tlv_encoding encoding,
     size_t server_maximum_request_size);
 
-extern int			 tlv_add_server_maximum_reply_size(struct dynar *msg,
+extern int			 tlv_add_server_maximum_reply_size(struct dynar *msg, enum tlv_encoding encoding,
     size_t server_maximum_reply_size);
 
-extern int			 tlv_add_supported_decision_algorithms(struct dynar *msg,
+extern int			 tlv_add_supported_decision_algorithms(struct dynar *msg, enum tlv_encoding encoding,
     const enum tlv_decision_algorithm_type *supported_algorithms, size_t no_supported_algorithms);
 
-extern int			 tlv_add_decision_algorithm(struct dynar *msg,
+extern int			 tlv_add_decision_algorithm(struct dynar *msg, enum tlv_encoding encoding,
     enum tlv_decision_algorithm_type decision_algorithm);
 
-extern int			 tlv_add_heartbeat_interval(struct dynar *msg, uint32_t heartbeat_interval);
+extern int			 tlv_add_heartbeat_interval(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t heartbeat_interval);
+
+extern int			 tlv_add_node_list(struct dynar *msg, enum tlv_encoding encoding,
+    const uint32_t *node_list, size_t no_nodes);
+
+extern int			 tlv_add_vote(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_vote vote);
+
+extern int			 tlv_add_node_list_epoch(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t epoch);
+
+extern int			 tlv_add_node_list_base_epoch(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t base_epoch);
+
+extern int			 tlv_add_node_list_added(struct dynar *msg, enum tlv_encoding encoding,
+    const uint32_t *node_list, size_t no_nodes);
+
+extern int			 tlv_add_node_list_removed(struct dynar *msg, enum tlv_encoding encoding,
+    const uint32_t *node_list, size_t no_nodes);
+
+extern int			 tlv_add_credit_window(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t credit_window);
+
+extern int			 tlv_add_credit(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t credit);
+
+extern int			 tlv_add_tlv_encoding(struct dynar *msg, enum tlv_encoding encoding,
+    enum tlv_encoding tlv_encoding);
+
+extern int			 tlv_add_request_window(struct dynar *msg, enum tlv_encoding encoding,
+    uint32_t request_window);
+
+extern int			 tlv_get_len_from_header(const char *data, size_t data_len,
+    enum tlv_encoding encoding, size_t *tlv_len);
+
+extern size_t			 tlv_get_max_len(void);
 
 extern void			 tlv_iter_init(const struct dynar *msg, size_t msg_header_len,
-    struct tlv_iterator *tlv_iter);
+    enum tlv_encoding encoding, struct tlv_iterator *tlv_iter);
+
+extern void			 tlv_iter_init_data(const char *data, size_t data_len,
+    size_t msg_header_len, enum tlv_encoding encoding, struct tlv_iterator *tlv_iter);
+
+extern void			 tlv_iter_set_arena(struct tlv_iterator *tlv_iter, struct arena *arena);
 
 extern enum tlv_opt_type	 tlv_iter_get_type(const struct tlv_iterator *tlv_iter);
 
@@ -128,6 +229,9 @@ extern int			 tlv_iter_decode_client_cert_required(struct tlv_iterator *tlv_iter
 extern int			 tlv_iter_decode_u16_array(struct tlv_iterator *tlv_iter,
     uint16_t **u16a, size_t *no_items);
 
+extern int			 tlv_iter_decode_u32_array(struct tlv_iterator *tlv_iter,
+    uint32_t **u32a, size_t *no_items);
+
 extern int			 tlv_iter_decode_supported_options(struct tlv_iterator *tlv_iter,
     enum tlv_opt_type **supported_options, size_t *no_supported_options);
 
@@ -142,6 +246,11 @@ extern int			 tlv_iter_decode_reply_error_code(struct tlv_iterator *tlv_iter,
 extern int			 tlv_iter_decode_decision_algorithm(struct tlv_iterator *tlv_iter,
     enum tlv_decision_algorithm_type *decision_algorithm);
 
+extern int			 tlv_iter_decode_vote(struct tlv_iterator *tlv_iter, enum tlv_vote *vote);
+
+extern int			 tlv_iter_decode_tlv_encoding(struct tlv_iterator *tlv_iter,
+    enum tlv_encoding *tlv_encoding);
+
 extern void			 tlv_get_supported_options(enum tlv_opt_type **supported_options,
     size_t *no_supported_options);
 